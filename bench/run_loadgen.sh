@@ -0,0 +1,46 @@
+#!/bin/bash
+# Build the module in every expire mode and run the load generator scenarios
+# against a fresh redis-server for each one.
+#
+# run_loadgen.sh /path/to/redis-server [scenario.conf ...]
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 /path/to/redis-server [scenario.conf ...]" >&2
+    exit 1
+fi
+
+REDIS_SERVER=$1
+shift
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SCENARIOS=("$@")
+if [ ${#SCENARIOS[@]} -eq 0 ]; then
+    SCENARIOS=("$ROOT"/bench/scenarios/*.conf)
+fi
+PORT=${PORT:-21111}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+HEADER=""
+for MODE in SCAN SORT SLAB; do
+    BUILD=$WORKDIR/build_$MODE
+    OPTS="-DLIBRARY_OUTPUT_PATH=$BUILD/lib"
+    [ $MODE != SCAN ] && OPTS="$OPTS -D${MODE}_MODE=yes"
+    cmake -S "$ROOT" -B "$BUILD" $OPTS > /dev/null
+    cmake --build "$BUILD" -j"$(nproc)" > /dev/null
+    cp "$BUILD/lib/tairhash_module.so" "$WORKDIR/tairhash_$MODE.so"
+
+    "$REDIS_SERVER" --port $PORT --save "" --appendonly no --daemonize no \
+        --loadmodule "$WORKDIR/tairhash_$MODE.so" > "$WORKDIR/redis_$MODE.log" 2>&1 &
+    PID=$!
+    for i in $(seq 50); do
+        "$BUILD/bench/tairhash_loadgen" -p $PORT --ping && break || sleep 0.1
+    done
+
+    "$BUILD/bench/tairhash_loadgen" -p $PORT $HEADER "${SCENARIOS[@]}" || true
+    HEADER="--no-header"
+
+    kill $PID
+    wait $PID 2>/dev/null || true
+done
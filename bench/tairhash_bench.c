@@ -0,0 +1,369 @@
+/*
+ * Copyright 2021 Alibaba Tair Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Microbenchmarks of the kernels behind tairhash: the field dict, the
+ * skiplist index used by SCAN_MODE and SORT_MODE, and the slab index used by
+ * SLAB_MODE.
+ *
+ * tairhash_bench [--fields n[,n...]] [--ttl all|uniform|sequential|same] [--seed n]
+ *
+ * Results are printed as CSV, one line per kernel/op/fields/ttl:
+ *
+ * kernel,op,fields,ttl,ops,nsec,ops_per_sec
+ *
+ * The split and merge lines of the slab kernel report the number of slab
+ * splits (merges) done by the insert (delete) phase and its duration. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dict.h"
+#include "redismodule_mock.h"
+#include "skiplist.h"
+#include "slabapi.h"
+#include "tairhash_skiplist.h"
+
+#define BENCH_NOW_MS 1000000000000LL
+#define BENCH_MAX_FIELD_COUNTS 16
+
+typedef enum { TTL_UNIFORM, TTL_SEQUENTIAL, TTL_SAME, TTL_NUM } ttlDistribution;
+static const char *ttl_names[TTL_NUM] = {"uniform", "sequential", "same"};
+
+static int ontime_indices[SLABMAXN], timeout_indices[SLABMAXN];
+
+static uint64_t nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *kernel, const char *op, long fields, const char *ttl, uint64_t ops, uint64_t nsec) {
+    double ops_per_sec = nsec ? (double)ops * 1e9 / nsec : 0;
+    printf("%s,%s,%ld,%s,%llu,%llu,%.0f\n", kernel, op, fields, ttl, (unsigned long long)ops, (unsigned long long)nsec, ops_per_sec);
+}
+
+static long long genExpire(ttlDistribution ttl, long i) {
+    switch (ttl) {
+        case TTL_UNIFORM:
+            return BENCH_NOW_MS + 1 + rand() % 3600000;
+        case TTL_SEQUENTIAL:
+            return BENCH_NOW_MS + 1 + i;
+        case TTL_SAME:
+        default:
+            return BENCH_NOW_MS + 1000;
+    }
+}
+
+/* A reference for the kernel, the caller keeps its own. */
+static RedisModuleString *retainString(RedisModuleString *str) {
+    RedisModule_RetainString(NULL, str);
+    return str;
+}
+
+/* The expire scan runs with the clock moved to the median expire time, so
+ * about half of the fields are expired. */
+static int compareLongLong(const void *a, const void *b) {
+    long long la = *(const long long *)a, lb = *(const long long *)b;
+    return la < lb ? -1 : (la > lb);
+}
+
+static long long medianExpire(const long long *expires, long count) {
+    long long *sorted = malloc(sizeof(long long) * count);
+    memcpy(sorted, expires, sizeof(long long) * count);
+    qsort(sorted, count, sizeof(long long), compareLongLong);
+    long long median = sorted[count / 2];
+    free(sorted);
+    return median;
+}
+
+/* ========================== dict ========================== */
+
+static uint64_t benchDictHash(const void *key) {
+    size_t len;
+    const char *buf = RedisModule_StringPtrLen(key, &len);
+    return m_dictGenHashFunction(buf, (int)len);
+}
+
+static int benchDictKeyCompare(void *privdata, const void *key1, const void *key2) {
+    size_t l1, l2;
+    DICT_NOTUSED(privdata);
+
+    const char *buf1 = RedisModule_StringPtrLen(key1, &l1);
+    const char *buf2 = RedisModule_StringPtrLen(key2, &l2);
+    if (l1 != l2) return 0;
+    return memcmp(buf1, buf2, l1) == 0;
+}
+
+static void benchDictKeyDestructor(void *privdata, void *key) {
+    DICT_NOTUSED(privdata);
+    RedisModule_FreeString(NULL, key);
+}
+
+static m_dictType benchDictType = {
+    benchDictHash,          /* hash function */
+    NULL,                   /* key dup */
+    NULL,                   /* val dup */
+    benchDictKeyCompare,    /* key compare */
+    benchDictKeyDestructor, /* key destructor */
+    NULL                    /* val destructor */
+};
+
+static void benchDict(RedisModuleString **fields, long count) {
+    dict *d = m_dictCreate(&benchDictType, NULL);
+    uint64_t start;
+
+    start = nowNsec();
+    for (long i = 0; i < count; i++) {
+        int ret = m_dictAdd(d, retainString(fields[i]), (void *)i);
+        assert(ret == DICT_OK);
+    }
+    report("dict", "insert", count, "-", count, nowNsec() - start);
+
+    while (dictIsRehashing(d)) {
+        m_dictRehashMilliseconds(d, 100);
+    }
+
+    start = nowNsec();
+    for (long i = 0; i < count; i++) {
+        m_dictEntry *de = m_dictFind(d, fields[rand() % count]);
+        assert(de != NULL);
+    }
+    report("dict", "lookup", count, "-", count, nowNsec() - start);
+
+    start = nowNsec();
+    for (long i = 0; i < count; i++) {
+        int ret = m_dictDelete(d, fields[i]);
+        assert(ret == DICT_OK);
+    }
+    report("dict", "delete", count, "-", count, nowNsec() - start);
+
+    m_dictRelease(d);
+}
+
+/* ========================== skiplist ========================== */
+
+static void benchSkiplist(RedisModuleString **fields, long long *expires, long count, ttlDistribution ttl) {
+    const char *ttl_name = ttl_names[ttl];
+    m_zskiplist *zsl = m_zslCreate();
+    uint64_t start, ops;
+
+    for (long i = 0; i < count; i++) {
+        expires[i] = genExpire(ttl, i);
+    }
+
+    start = nowNsec();
+    for (long i = 0; i < count; i++) {
+        m_zslInsert(zsl, expires[i], retainString(fields[i]));
+    }
+    report("skiplist", "insert", count, ttl_name, count, nowNsec() - start);
+
+    start = nowNsec();
+    for (long i = 0; i < count; i++) {
+        long long new_expire = genExpire(ttl, count + i);
+        m_zslUpdateScore(zsl, expires[i], fields[i], new_expire);
+        expires[i] = new_expire;
+    }
+    report("skiplist", "update", count, ttl_name, count, nowNsec() - start);
+
+    /* The same walk as the active expire of SCAN_MODE and SORT_MODE. */
+    long long now = medianExpire(expires, count);
+    start = nowNsec();
+    ops = 0;
+    m_zskiplistNode *ln = zsl->header->level[0].forward;
+    while (ln && ln->score <= now) {
+        ops++;
+        ln = ln->level[0].forward;
+    }
+    if (ops) {
+        m_zslDeleteRangeByRank(zsl, 1, ops);
+    }
+    report("skiplist", "expire_scan", count, ttl_name, ops, nowNsec() - start);
+
+    start = nowNsec();
+    ops = 0;
+    for (long i = 0; i < count; i++) {
+        if (expires[i] > now) {
+            int ret = m_zslDelete(zsl, expires[i], fields[i], NULL);
+            assert(ret == 1);
+            ops++;
+        }
+    }
+    report("skiplist", "delete", count, ttl_name, ops, nowNsec() - start);
+
+    assert(zsl->length == 0);
+    m_zslFree(zsl);
+}
+
+/* ========================== slab ========================== */
+
+static void benchSlab(RedisModuleString **fields, long long *expires, long count, ttlDistribution ttl) {
+    const char *ttl_name = ttl_names[ttl];
+    tairhash_zskiplist *zsl = slab_create();
+    unsigned long long splits, merges;
+    uint64_t start, elapsed, ops;
+
+    for (long i = 0; i < count; i++) {
+        expires[i] = genExpire(ttl, i);
+    }
+
+    splits = slab_getStatSplits();
+    start = nowNsec();
+    for (long i = 0; i < count; i++) {
+        slab_expireInsert(zsl, retainString(fields[i]), expires[i]);
+    }
+    elapsed = nowNsec() - start;
+    report("slab", "insert", count, ttl_name, count, elapsed);
+    report("slab", "split", count, ttl_name, slab_getStatSplits() - splits, elapsed);
+
+    start = nowNsec();
+    for (long i = 0; i < count; i++) {
+        long long new_expire = genExpire(ttl, count + i);
+        slab_expireUpdate(zsl, fields[i], expires[i], retainString(fields[i]), new_expire);
+        expires[i] = new_expire;
+    }
+    report("slab", "update", count, ttl_name, count, nowNsec() - start);
+
+    /* The same walk as the active expire of SLAB_MODE, fully expired slabs
+     * are dropped by rank and the first partially expired one is compacted.
+     * Both calls release the keys they drop. */
+    long long now = medianExpire(expires, count);
+    mockSetTime(now);
+    start = nowNsec();
+    ops = 0;
+    unsigned int delete_rank = 0;
+    int ontime_num = 0;
+    tairhash_zskiplistNode *ln = zsl->header->level[0].forward;
+    while (ln) {
+        int timeout_num = slab_getSlabTimeoutExpireIndex(ln, ontime_indices, timeout_indices, now);
+        if (timeout_num <= 0) {
+            break;
+        }
+        ontime_num = ln->slab->num_keys - timeout_num;
+        ops += timeout_num;
+        if (ontime_num) {
+            break;
+        }
+        delete_rank++;
+        ln = ln->level[0].forward;
+    }
+    if (delete_rank) {
+        slab_deleteTairhashRangeByRank(zsl, 1, delete_rank);
+    }
+    if (ontime_num) {
+        slab_deleteSlabExpire(zsl, zsl->header->level[0].forward, ontime_indices, ontime_num);
+    }
+    report("slab", "expire_scan", count, ttl_name, ops, nowNsec() - start);
+    mockSetTime(BENCH_NOW_MS);
+
+    merges = slab_getStatMerges();
+    start = nowNsec();
+    ops = 0;
+    for (long i = 0; i < count; i++) {
+        if (expires[i] > now) {
+            slab_expireDelete(zsl, fields[i], expires[i]);
+            ops++;
+        }
+    }
+    elapsed = nowNsec() - start;
+    report("slab", "delete", count, ttl_name, ops, elapsed);
+    report("slab", "merge", count, ttl_name, slab_getStatMerges() - merges, elapsed);
+
+    slab_free(zsl);
+}
+
+/* ========================== main ========================== */
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--fields n[,n...]] [--ttl all|uniform|sequential|same] [--seed n]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    long field_counts[BENCH_MAX_FIELD_COUNTS] = {1000, 10000, 100000};
+    int num_field_counts = 3;
+    int ttl_first = 0, ttl_last = TTL_NUM - 1;
+    unsigned int seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        int more = i + 1 < argc;
+        if (!strcmp(argv[i], "--fields") && more) {
+            char *p = argv[++i];
+            num_field_counts = 0;
+            while (*p && num_field_counts < BENCH_MAX_FIELD_COUNTS) {
+                long n = strtol(p, &p, 10);
+                if (n <= 0) usage(argv[0]);
+                field_counts[num_field_counts++] = n;
+                if (*p == ',') p++;
+            }
+        } else if (!strcmp(argv[i], "--ttl") && more) {
+            i++;
+            if (strcmp(argv[i], "all")) {
+                int t;
+                for (t = 0; t < TTL_NUM && strcmp(argv[i], ttl_names[t]); t++)
+                    ;
+                if (t == TTL_NUM) usage(argv[0]);
+                ttl_first = ttl_last = t;
+            }
+        } else if (!strcmp(argv[i], "--seed") && more) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    mockInit();
+    mockSetTime(BENCH_NOW_MS);
+#ifdef __AVX2__
+    slab_initShuffleMask();
+#endif
+    srand(seed);
+
+    printf("kernel,op,fields,ttl,ops,nsec,ops_per_sec\n");
+    for (int c = 0; c < num_field_counts; c++) {
+        long count = field_counts[c];
+        RedisModuleString **fields = malloc(sizeof(RedisModuleString *) * count);
+        long long *expires = malloc(sizeof(long long) * count);
+        for (long i = 0; i < count; i++) {
+            char buf[32];
+            int len = snprintf(buf, sizeof(buf), "field:%ld", i);
+            fields[i] = RedisModule_CreateString(NULL, buf, len);
+        }
+
+        benchDict(fields, count);
+        for (int t = ttl_first; t <= ttl_last; t++) {
+            benchSkiplist(fields, expires, count, t);
+            benchSlab(fields, expires, count, t);
+        }
+
+        for (long i = 0; i < count; i++) {
+            RedisModule_FreeString(NULL, fields[i]);
+        }
+        free(fields);
+        free(expires);
+    }
+
+    /* Every kernel must have released its references to the fields. */
+    mockStats stats;
+    mockGetStats(&stats);
+    if (stats.live_strings != 0) {
+        fprintf(stderr, "leaked %lld strings\n", stats.live_strings);
+        return 1;
+    }
+    return 0;
+}
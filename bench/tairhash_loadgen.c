@@ -0,0 +1,696 @@
+/*
+ * Copyright 2021 Alibaba Tair Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* End to end load generator for the EXH* commands.
+ *
+ * tairhash_loadgen [-h host] [-p port] [--no-header] scenario.conf [scenario.conf ...]
+ * tairhash_loadgen [-h host] [-p port] --ping
+ *
+ * Every scenario drives a redis-server with the module loaded from a number
+ * of closed loop clients, then optionally waits until all the fields written
+ * with a TTL have been reclaimed. One CSV line is printed per scenario:
+ *
+ * scenario,mode,clients,ops,errors,seconds,ops_per_sec,p50_usec,p99_usec,p999_usec,max_usec,used_memory,rss_bytes,reclaim_lag_msec
+ *
+ * reclaim_lag_msec is the time between the expire time of the last field
+ * and the moment no written key is left, -1 if the scenario does not wait
+ * for reclaim or it timed out. The scenario file format is documented in
+ * bench/scenarios/README.md. */
+
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "histogram.h"
+
+#define LOADGEN_MAX_ARGS 16
+#define LOADGEN_MAX_CLIENTS 256
+#define LOADGEN_IOBUF (16 * 1024)
+
+/* ========================== scenario ========================== */
+
+typedef enum { TTL_NONE, TTL_SAME, TTL_UNIFORM, TTL_EXPONENTIAL } ttlDistribution;
+typedef enum { FIELD_RANDOM, FIELD_SEQUENTIAL } fieldPattern;
+
+typedef struct scenario {
+    char name[128];
+    long keys;
+    long fields;
+    fieldPattern field_pattern;
+    long value_size;
+    long clients;
+    long requests;
+    double duration;
+    double write_ratio;
+    ttlDistribution ttl_dist;
+    long ttl_min;
+    long ttl_max;
+    int versioned;
+    int flushdb;
+    int wait_reclaim;
+    double reclaim_timeout;
+} scenario;
+
+static void scenarioInit(scenario *s) {
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "default");
+    s->keys = 100;
+    s->fields = 1000;
+    s->field_pattern = FIELD_RANDOM;
+    s->value_size = 32;
+    s->clients = 16;
+    s->requests = 100000;
+    s->write_ratio = 1.0;
+    s->ttl_dist = TTL_NONE;
+    s->ttl_min = 1000;
+    s->ttl_max = 1000;
+    s->reclaim_timeout = 60;
+}
+
+static char *trim(char *s) {
+    char *end;
+    while (*s == ' ' || *s == '\t') s++;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) end--;
+    *end = '\0';
+    return s;
+}
+
+static int parseYesNo(const char *v) {
+    return !strcasecmp(v, "yes") || !strcmp(v, "1");
+}
+
+/* Parse a "name = value" per line file, '#' starts a comment. */
+static int scenarioLoad(scenario *s, const char *path) {
+    char line[512];
+    int lineno = 0;
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    scenarioInit(s);
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = strchr(line, '#'), *name, *value, *eq;
+        lineno++;
+        if (p) *p = '\0';
+        name = trim(line);
+        if (*name == '\0') continue;
+        if ((eq = strchr(name, '=')) == NULL) goto err;
+        *eq = '\0';
+        name = trim(name);
+        value = trim(eq + 1);
+
+        if (!strcmp(name, "name")) {
+            snprintf(s->name, sizeof(s->name), "%s", value);
+        } else if (!strcmp(name, "keys")) {
+            s->keys = atol(value);
+        } else if (!strcmp(name, "fields")) {
+            s->fields = atol(value);
+        } else if (!strcmp(name, "field_pattern")) {
+            if (!strcmp(value, "random")) s->field_pattern = FIELD_RANDOM;
+            else if (!strcmp(value, "sequential")) s->field_pattern = FIELD_SEQUENTIAL;
+            else goto err;
+        } else if (!strcmp(name, "value_size")) {
+            s->value_size = atol(value);
+        } else if (!strcmp(name, "clients")) {
+            s->clients = atol(value);
+        } else if (!strcmp(name, "requests")) {
+            s->requests = atol(value);
+        } else if (!strcmp(name, "duration")) {
+            s->duration = atof(value);
+        } else if (!strcmp(name, "write_ratio")) {
+            s->write_ratio = atof(value);
+        } else if (!strcmp(name, "ttl")) {
+            if (!strcmp(value, "none")) s->ttl_dist = TTL_NONE;
+            else if (!strcmp(value, "same")) s->ttl_dist = TTL_SAME;
+            else if (!strcmp(value, "uniform")) s->ttl_dist = TTL_UNIFORM;
+            else if (!strcmp(value, "exponential")) s->ttl_dist = TTL_EXPONENTIAL;
+            else goto err;
+        } else if (!strcmp(name, "ttl_min")) {
+            s->ttl_min = atol(value);
+        } else if (!strcmp(name, "ttl_max")) {
+            s->ttl_max = atol(value);
+        } else if (!strcmp(name, "versioned")) {
+            s->versioned = parseYesNo(value);
+        } else if (!strcmp(name, "flushdb")) {
+            s->flushdb = parseYesNo(value);
+        } else if (!strcmp(name, "wait_reclaim")) {
+            s->wait_reclaim = parseYesNo(value);
+        } else if (!strcmp(name, "reclaim_timeout")) {
+            s->reclaim_timeout = atof(value);
+        } else {
+            goto err;
+        }
+    }
+    fclose(fp);
+
+    if (s->keys <= 0 || s->fields <= 0 || s->value_size < 0 || s->clients <= 0 || s->clients > LOADGEN_MAX_CLIENTS ||
+        (s->requests <= 0 && s->duration <= 0) || s->write_ratio < 0 || s->write_ratio > 1 || s->ttl_min <= 0 ||
+        s->ttl_max < s->ttl_min) {
+        fprintf(stderr, "%s: invalid scenario parameters\n", path);
+        return -1;
+    }
+    return 0;
+
+err:
+    fprintf(stderr, "%s:%d: invalid line\n", path, lineno);
+    fclose(fp);
+    return -1;
+}
+
+/* ========================== RESP client ========================== */
+
+typedef struct reply {
+    char type; /* '+', '-', ':', '$', '*' */
+    long long integer;
+    char *str; /* status, error and bulk strings, NULL for nil */
+    size_t len;
+    size_t elements;
+    struct reply **element;
+} reply;
+
+typedef struct client {
+    int fd;
+    char rbuf[LOADGEN_IOBUF];
+    size_t rpos, rlen;
+} client;
+
+static void freeReply(reply *r) {
+    if (r == NULL) return;
+    for (size_t i = 0; i < r->elements; i++) {
+        freeReply(r->element[i]);
+    }
+    free(r->element);
+    free(r->str);
+    free(r);
+}
+
+static client *clientConnect(const char *host, int port) {
+    struct addrinfo hints, *res, *ai;
+    char portstr[16];
+    int fd = -1, yes = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    if (getaddrinfo(host, portstr, &hints, &res) != 0) {
+        return NULL;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd == -1) {
+        return NULL;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    client *c = calloc(1, sizeof(*c));
+    c->fd = fd;
+    return c;
+}
+
+static void clientClose(client *c) {
+    close(c->fd);
+    free(c);
+}
+
+static int writeAll(int fd, const char *buf, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int sendCommand(client *c, int argc, const char **argv, const size_t *argvlen) {
+    char buf[LOADGEN_IOBUF];
+    size_t len = snprintf(buf, sizeof(buf), "*%d\r\n", argc);
+
+    for (int i = 0; i < argc; i++) {
+        if (len + argvlen[i] + 32 > sizeof(buf)) {
+            if (writeAll(c->fd, buf, len) == -1) return -1;
+            len = 0;
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "$%zu\r\n", argvlen[i]);
+        if (argvlen[i] + 2 > sizeof(buf) - len) {
+            if (writeAll(c->fd, buf, len) == -1 || writeAll(c->fd, argv[i], argvlen[i]) == -1) return -1;
+            len = 0;
+        } else {
+            memcpy(buf + len, argv[i], argvlen[i]);
+            len += argvlen[i];
+        }
+        memcpy(buf + len, "\r\n", 2);
+        len += 2;
+    }
+    return writeAll(c->fd, buf, len);
+}
+
+static int fillBuffer(client *c) {
+    if (c->rpos == c->rlen) {
+        c->rpos = c->rlen = 0;
+    }
+    if (c->rlen == sizeof(c->rbuf)) {
+        memmove(c->rbuf, c->rbuf + c->rpos, c->rlen - c->rpos);
+        c->rlen -= c->rpos;
+        c->rpos = 0;
+    }
+    ssize_t n;
+    do {
+        n = read(c->fd, c->rbuf + c->rlen, sizeof(c->rbuf) - c->rlen);
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) return -1;
+    c->rlen += n;
+    return 0;
+}
+
+static int readBytes(client *c, char *dst, size_t len) {
+    while (len) {
+        if (c->rpos == c->rlen && fillBuffer(c) == -1) return -1;
+        size_t n = c->rlen - c->rpos < len ? c->rlen - c->rpos : len;
+        memcpy(dst, c->rbuf + c->rpos, n);
+        c->rpos += n;
+        dst += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Read a CRLF terminated line, the CRLF is stripped. */
+static int readLine(client *c, char *dst, size_t size) {
+    size_t len = 0;
+    char ch;
+    while (1) {
+        if (readBytes(c, &ch, 1) == -1) return -1;
+        if (ch == '\r') {
+            if (readBytes(c, &ch, 1) == -1) return -1;
+            break;
+        }
+        if (len + 1 < size) dst[len++] = ch;
+    }
+    dst[len] = '\0';
+    return (int)len;
+}
+
+static reply *readReply(client *c) {
+    char line[512];
+    if (readLine(c, line, sizeof(line)) < 1) return NULL;
+
+    reply *r = calloc(1, sizeof(*r));
+    r->type = line[0];
+    switch (r->type) {
+        case '+':
+        case '-':
+            r->len = strlen(line + 1);
+            r->str = strdup(line + 1);
+            break;
+        case ':':
+            r->integer = strtoll(line + 1, NULL, 10);
+            break;
+        case '$': {
+            long long len = strtoll(line + 1, NULL, 10);
+            char crlf[2];
+            if (len < 0) break;
+            r->len = len;
+            r->str = malloc(len + 1);
+            if (readBytes(c, r->str, len) == -1 || readBytes(c, crlf, 2) == -1) goto err;
+            r->str[len] = '\0';
+            break;
+        }
+        case '*': {
+            long long n = strtoll(line + 1, NULL, 10);
+            if (n < 0) break;
+            r->element = calloc(n ? n : 1, sizeof(reply *));
+            for (long long i = 0; i < n; i++) {
+                if ((r->element[i] = readReply(c)) == NULL) goto err;
+                r->elements++;
+            }
+            break;
+        }
+        default:
+            goto err;
+    }
+    return r;
+
+err:
+    freeReply(r);
+    return NULL;
+}
+
+/* Send a command built from a printf-like list of space separated words and
+ * wait for the reply. */
+static reply *command(client *c, const char *fmt, ...) {
+    char buf[1024], *argv[LOADGEN_MAX_ARGS], *saveptr = NULL, *tok;
+    size_t argvlen[LOADGEN_MAX_ARGS];
+    int argc = 0;
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    for (tok = strtok_r(buf, " ", &saveptr); tok && argc < LOADGEN_MAX_ARGS; tok = strtok_r(NULL, " ", &saveptr)) {
+        argv[argc] = tok;
+        argvlen[argc++] = strlen(tok);
+    }
+    if (sendCommand(c, argc, (const char **)argv, argvlen) == -1) return NULL;
+    return readReply(c);
+}
+
+/* Return the value of a "name:value" line of an INFO reply. */
+static long long infoField(client *c, const char *section, const char *name) {
+    long long value = -1;
+    size_t namelen = strlen(name);
+    reply *r = command(c, "INFO %s", section);
+
+    if (r && r->type == '$' && r->str) {
+        for (char *p = r->str; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL) {
+            if (!strncmp(p, name, namelen) && p[namelen] == ':') {
+                value = strtoll(p + namelen + 1, NULL, 10);
+                break;
+            }
+        }
+    }
+    freeReply(r);
+    return value;
+}
+
+/* The expire engine the module was built with, from EXHDEBUG INDEXSTATS. */
+static void engineMode(client *c, char *mode, size_t size) {
+    reply *r = command(c, "EXHDEBUG INDEXSTATS");
+
+    snprintf(mode, size, "unknown");
+    if (r && r->type == '*') {
+        for (size_t i = 0; i + 1 < r->elements; i += 2) {
+            if (r->element[i]->str && !strcmp(r->element[i]->str, "mode") && r->element[i + 1]->str) {
+                snprintf(mode, size, "%s", r->element[i + 1]->str);
+            }
+        }
+    }
+    freeReply(r);
+}
+
+/* ========================== load ========================== */
+
+typedef struct worker {
+    pthread_t thread;
+    const scenario *s;
+    client *c;
+    uint64_t seed;
+    uint64_t ops;
+    uint64_t errors;
+    long long max_expire_ms;
+    m_histogram latency;
+} worker;
+
+static const char *g_host = "127.0.0.1";
+static int g_port = 6379;
+static long g_requests_left;
+static long g_sequential_field;
+static long long g_version;
+static double g_deadline;
+
+static double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long long wallMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static double randUnit(uint64_t *state) {
+    return (xorshift64(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static long genTtl(const scenario *s, uint64_t *state) {
+    switch (s->ttl_dist) {
+        case TTL_SAME:
+            return s->ttl_min;
+        case TTL_UNIFORM:
+            return s->ttl_min + (long)(xorshift64(state) % (uint64_t)(s->ttl_max - s->ttl_min + 1));
+        case TTL_EXPONENTIAL: {
+            long ttl = (long)(-log(1.0 - randUnit(state)) * s->ttl_min);
+            return ttl < 1 ? 1 : (ttl > s->ttl_max ? s->ttl_max : ttl);
+        }
+        case TTL_NONE:
+        default:
+            return 0;
+    }
+}
+
+static void *workerMain(void *arg) {
+    worker *w = arg;
+    const scenario *s = w->s;
+    char key[64], field[64], ttl[32], ver[32];
+    char *value = malloc(s->value_size + 1);
+    const char *argv[LOADGEN_MAX_ARGS];
+    size_t argvlen[LOADGEN_MAX_ARGS];
+
+    memset(value, 'x', s->value_size);
+    value[s->value_size] = '\0';
+    while (1) {
+        if (s->duration > 0 ? nowSec() >= g_deadline : __atomic_sub_fetch(&g_requests_left, 1, __ATOMIC_RELAXED) < 0) {
+            break;
+        }
+
+        long field_id;
+        if (s->field_pattern == FIELD_SEQUENTIAL) {
+            field_id = __atomic_fetch_add(&g_sequential_field, 1, __ATOMIC_RELAXED);
+        } else {
+            field_id = (long)(xorshift64(&w->seed) % (uint64_t)s->fields);
+        }
+        int argc = 0, write = randUnit(&w->seed) < s->write_ratio;
+        snprintf(key, sizeof(key), "tairhash:load:%ld", (long)(xorshift64(&w->seed) % (uint64_t)s->keys));
+        snprintf(field, sizeof(field), "field:%ld", field_id);
+
+        if (write) {
+            argv[argc++] = "EXHSET";
+            argv[argc++] = key;
+            argv[argc++] = field;
+            argv[argc++] = value;
+            long ttl_ms = genTtl(s, &w->seed);
+            if (ttl_ms) {
+                long long expire = wallMs() + ttl_ms;
+                if (expire > w->max_expire_ms) w->max_expire_ms = expire;
+                snprintf(ttl, sizeof(ttl), "%ld", ttl_ms);
+                argv[argc++] = "PX";
+                argv[argc++] = ttl;
+            }
+            if (s->versioned) {
+                snprintf(ver, sizeof(ver), "%lld", __atomic_add_fetch(&g_version, 1, __ATOMIC_RELAXED));
+                argv[argc++] = "ABS";
+                argv[argc++] = ver;
+            }
+        } else {
+            argv[argc++] = "EXHGET";
+            argv[argc++] = key;
+            argv[argc++] = field;
+        }
+        for (int i = 0; i < argc; i++) {
+            argvlen[i] = argv[i] == value ? (size_t)s->value_size : strlen(argv[i]);
+        }
+
+        double start = nowSec();
+        if (sendCommand(w->c, argc, argv, argvlen) == -1) {
+            w->errors++;
+            break;
+        }
+        reply *r = readReply(w->c);
+        m_histogramRecord(&w->latency, (uint64_t)((nowSec() - start) * 1e6));
+        if (r == NULL) {
+            w->errors++;
+            break;
+        }
+        if (r->type == '-') w->errors++;
+        freeReply(r);
+        w->ops++;
+    }
+    free(value);
+    return NULL;
+}
+
+/* Wait until none of the written keys exists, return the delay since the
+ * last field expired, or -1 on timeout. */
+static long long waitReclaim(client *c, const scenario *s, long long max_expire_ms) {
+    double deadline = nowSec() + s->reclaim_timeout;
+
+    while (nowSec() < deadline) {
+        long long remaining = 0;
+        for (long i = 0; i < s->keys; i++) {
+            reply *r = command(c, "EXISTS tairhash:load:%ld", i);
+            if (r && r->type == ':') remaining += r->integer;
+            freeReply(r);
+            if (remaining) break;
+        }
+        if (remaining == 0) {
+            long long lag = wallMs() - max_expire_ms;
+            return lag < 0 ? 0 : lag;
+        }
+        usleep(10000);
+    }
+    return -1;
+}
+
+static int runScenario(const scenario *s) {
+    worker workers[LOADGEN_MAX_CLIENTS];
+    m_histogram latency;
+    uint64_t ops = 0, errors = 0;
+    long long max_expire_ms = 0, reclaim_lag = -1;
+    char mode[32];
+
+    client *ctl = clientConnect(g_host, g_port);
+    if (ctl == NULL) {
+        fprintf(stderr, "%s: cannot connect to %s:%d\n", s->name, g_host, g_port);
+        return -1;
+    }
+    engineMode(ctl, mode, sizeof(mode));
+    if (s->flushdb) {
+        freeReply(command(ctl, "FLUSHDB"));
+    }
+
+    g_requests_left = s->requests;
+    g_sequential_field = 0;
+    g_version = 0;
+    for (long i = 0; i < s->clients; i++) {
+        worker *w = &workers[i];
+        memset(w, 0, sizeof(*w));
+        w->s = s;
+        w->seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+        m_histogramReset(&w->latency);
+        if ((w->c = clientConnect(g_host, g_port)) == NULL) {
+            fprintf(stderr, "%s: cannot connect to %s:%d\n", s->name, g_host, g_port);
+            return -1;
+        }
+    }
+
+    double start = nowSec();
+    g_deadline = start + s->duration;
+    for (long i = 0; i < s->clients; i++) {
+        pthread_create(&workers[i].thread, NULL, workerMain, &workers[i]);
+    }
+    m_histogramReset(&latency);
+    for (long i = 0; i < s->clients; i++) {
+        pthread_join(workers[i].thread, NULL);
+        m_histogramMerge(&latency, &workers[i].latency);
+        ops += workers[i].ops;
+        errors += workers[i].errors;
+        if (workers[i].max_expire_ms > max_expire_ms) max_expire_ms = workers[i].max_expire_ms;
+        clientClose(workers[i].c);
+    }
+    double elapsed = nowSec() - start;
+
+    long long used_memory = infoField(ctl, "memory", "used_memory");
+    long long rss = infoField(ctl, "memory", "used_memory_rss");
+    if (s->wait_reclaim && s->ttl_dist != TTL_NONE) {
+        reclaim_lag = waitReclaim(ctl, s, max_expire_ms);
+    }
+    clientClose(ctl);
+
+    printf("%s,%s,%ld,%llu,%llu,%.3f,%.0f,%llu,%llu,%llu,%llu,%lld,%lld,%lld\n", s->name, mode, s->clients,
+           (unsigned long long)ops, (unsigned long long)errors, elapsed, elapsed > 0 ? ops / elapsed : 0,
+           (unsigned long long)m_histogramPercentile(&latency, 50), (unsigned long long)m_histogramPercentile(&latency, 99),
+           (unsigned long long)m_histogramPercentile(&latency, 99.9), (unsigned long long)latency.max, used_memory, rss,
+           reclaim_lag);
+    fflush(stdout);
+    return 0;
+}
+
+/* Exit with 0 if the server answers PING, used to wait for it to start. */
+static int ping(void) {
+    client *c = clientConnect(g_host, g_port);
+    if (c == NULL) return 1;
+
+    reply *r = command(c, "PING");
+    int ok = r && r->type == '+' && !strcmp(r->str, "PONG");
+    freeReply(r);
+    clientClose(c);
+    return !ok;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-h host] [-p port] [--no-header] scenario.conf [scenario.conf ...]\n", prog);
+    fprintf(stderr, "       %s [-h host] [-p port] --ping\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int header = 1, first_scenario = argc, failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int more = i + 1 < argc;
+        if (!strcmp(argv[i], "-h") && more) {
+            g_host = argv[++i];
+        } else if (!strcmp(argv[i], "-p") && more) {
+            g_port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-header")) {
+            header = 0;
+        } else if (!strcmp(argv[i], "--ping")) {
+            return ping();
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            first_scenario = i;
+            break;
+        }
+    }
+    if (first_scenario == argc) usage(argv[0]);
+
+    if (header) {
+        printf("scenario,mode,clients,ops,errors,seconds,ops_per_sec,p50_usec,p99_usec,p999_usec,max_usec,used_memory,rss_bytes,reclaim_lag_msec\n");
+    }
+    for (int i = first_scenario; i < argc; i++) {
+        scenario s;
+        if (scenarioLoad(&s, argv[i]) == -1 || runScenario(&s) == -1) {
+            failed = 1;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include "coldstore.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../src/redismodule.h"
+
+/* A record is the length of the data, 4 bytes, then the data. */
+#define COLDSTORE_HDR_LEN 4
+#define COLDSTORE_MAX_BYTES (1ULL << M_COLDSTORE_FILE_BITS)
+#define COLDSTORE_MIN_SIZE (1 << 20)
+#define COLDSTORE_PUNCHED UINT32_MAX
+
+#define coldStoreSlotOf(offset) ((int)((offset) >> M_COLDSTORE_FILE_BITS))
+#define coldStorePosOf(offset) ((offset) & (COLDSTORE_MAX_BYTES - 1))
+
+static coldFile *coldFileOpen(coldStore *cs) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/tairhash-cold.%ld.%llu", cs->dir, (long)getpid(), cs->file_seq++);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) return NULL;
+    unlink(path);
+
+    char *map = mmap(NULL, COLDSTORE_MAX_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    coldFile *f = RedisModule_Calloc(1, sizeof(*f));
+    f->fd = fd;
+    f->map = map;
+    f->pages = RedisModule_Calloc(COLDSTORE_MAX_BYTES / cs->page_size / M_COLDSTORE_CHUNK_PAGES + 1, sizeof(uint32_t *));
+    return f;
+}
+
+static void coldFileClose(coldStore *cs, coldFile *f) {
+    uint64_t chunks = COLDSTORE_MAX_BYTES / cs->page_size / M_COLDSTORE_CHUNK_PAGES + 1;
+    for (uint64_t j = 0; j < chunks; j++) {
+        if (f->pages[j]) RedisModule_Free(f->pages[j]);
+    }
+    RedisModule_Free(f->pages);
+    munmap(f->map, COLDSTORE_MAX_BYTES);
+    close(f->fd);
+    RedisModule_Free(f);
+}
+
+/* Make the file long enough for 'len' more bytes, and their pages counted. */
+static int coldFileGrow(coldStore *cs, coldFile *f, uint64_t len) {
+    uint64_t end = f->used + len;
+    if (end > f->size) {
+        uint64_t size = f->size * 2;
+        if (size < COLDSTORE_MIN_SIZE) size = COLDSTORE_MIN_SIZE;
+        if (size < end) size = end;
+        if (size > COLDSTORE_MAX_BYTES) size = COLDSTORE_MAX_BYTES;
+        /* Reserve the blocks rather than growing a sparse file, a store into
+         * the mapping of a hole the disk has no room for raises SIGBUS. If
+         * the doubled size does not fit, settle for what the record needs. */
+        if (posix_fallocate(f->fd, (off_t)f->size, (off_t)(size - f->size)) != 0) {
+            size = end;
+            if (posix_fallocate(f->fd, (off_t)f->size, (off_t)(size - f->size)) != 0) return -1;
+        }
+        f->size = size;
+    }
+    for (uint64_t j = f->used / cs->page_size / M_COLDSTORE_CHUNK_PAGES; j <= (end - 1) / cs->page_size / M_COLDSTORE_CHUNK_PAGES; j++) {
+        if (f->pages[j] == NULL) f->pages[j] = RedisModule_Calloc(M_COLDSTORE_CHUNK_PAGES, sizeof(uint32_t));
+    }
+    return 0;
+}
+
+static inline uint32_t *coldFilePage(coldStore *cs, coldFile *f, uint64_t page) {
+    return &f->pages[page / M_COLDSTORE_CHUNK_PAGES][page % M_COLDSTORE_CHUNK_PAGES];
+}
+
+/* Add or remove the bytes of [pos, pos + len) to the live bytes of their
+ * pages. */
+static void coldFileCount(coldStore *cs, coldFile *f, uint64_t pos, uint64_t len, int add) {
+    uint64_t end = pos + len;
+    while (pos < end) {
+        uint64_t page = pos / cs->page_size, next = (page + 1) * cs->page_size;
+        uint32_t bytes = (uint32_t)((next < end ? next : end) - pos);
+        uint32_t *count = coldFilePage(cs, f, page);
+        if (add) {
+            __atomic_add_fetch(count, bytes, __ATOMIC_RELAXED);
+        } else {
+            __atomic_sub_fetch(count, bytes, __ATOMIC_RELAXED);
+        }
+        pos += bytes;
+    }
+}
+
+coldStore *m_coldStoreCreate(const char *dir) {
+    coldStore *cs = RedisModule_Calloc(1, sizeof(*cs));
+    cs->dir = RedisModule_Strdup(dir);
+    cs->page_size = (unsigned int)sysconf(_SC_PAGESIZE);
+    cs->can_punch = 1;
+    if ((cs->files[0] = coldFileOpen(cs)) == NULL) {
+        m_coldStoreRelease(cs);
+        return NULL;
+    }
+    return cs;
+}
+
+void m_coldStoreRelease(coldStore *cs) {
+    for (int j = 0; j < M_COLDSTORE_FILES; j++) {
+        if (cs->files[j]) coldFileClose(cs, cs->files[j]);
+    }
+    RedisModule_Free(cs->dir);
+    RedisModule_Free(cs);
+}
+
+/* Move the appends to a new file in a free slot. */
+static int coldStoreRotate(coldStore *cs) {
+    for (int j = 0; j < M_COLDSTORE_FILES; j++) {
+        if (cs->files[j] == NULL) {
+            if ((cs->files[j] = coldFileOpen(cs)) == NULL) return -1;
+            cs->active = j;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Append a record. Returns 0 and its offset, or -1 if the store is full or
+ * the file could not grow. */
+int m_coldStorePut(coldStore *cs, const void *buf, size_t len, uint64_t *offset) {
+    uint64_t need = COLDSTORE_HDR_LEN + (uint64_t)len;
+    uint32_t len32 = (uint32_t)len;
+    coldFile *f = cs->files[cs->active];
+
+    if (len > UINT32_MAX) return -1;
+    if (f->used + need > COLDSTORE_MAX_BYTES) {
+        if (coldStoreRotate(cs) == -1) return -1;
+        f = cs->files[cs->active];
+    }
+    if (coldFileGrow(cs, f, need) == -1) return -1;
+
+    memcpy(f->map + f->used, &len32, sizeof(len32));
+    memcpy(f->map + f->used + COLDSTORE_HDR_LEN, buf, len);
+    coldFileCount(cs, f, f->used, need, 1);
+    __atomic_add_fetch(&f->live, need, __ATOMIC_RELAXED);
+    *offset = ((uint64_t)cs->active << M_COLDSTORE_FILE_BITS) | f->used;
+    f->used += need;
+    return 0;
+}
+
+/* The data of a record, faulted in from the disk if needed. */
+const char *m_coldStoreGet(coldStore *cs, uint64_t offset, size_t *len) {
+    const char *rec = cs->files[coldStoreSlotOf(offset)]->map + coldStorePosOf(offset);
+    uint32_t len32;
+
+    memcpy(&len32, rec, sizeof(len32));
+    *len = len32;
+    return rec + COLDSTORE_HDR_LEN;
+}
+
+void m_coldStoreFree(coldStore *cs, uint64_t offset) {
+    coldFile *f = cs->files[coldStoreSlotOf(offset)];
+    uint64_t pos = coldStorePosOf(offset);
+    uint32_t len32;
+
+    memcpy(&len32, f->map + pos, sizeof(len32));
+    coldFileCount(cs, f, pos, COLDSTORE_HDR_LEN + len32, 0);
+    __atomic_sub_fetch(&f->live, COLDSTORE_HDR_LEN + len32, __ATOMIC_RELAXED);
+}
+
+static int coldFilePunch(coldStore *cs, coldFile *f, uint64_t page, uint64_t pages) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (cs->can_punch && fallocate(f->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)(page * cs->page_size), (off_t)(pages * cs->page_size)) == 0) {
+        return 0;
+    }
+#endif
+    cs->can_punch = 0;
+    return -1;
+}
+
+/* Punch a hole over the pages without live bytes, among the next 'budget'
+ * ones of the file. The page holding the end of the file is left alone,
+ * appends still go there. */
+static uint64_t coldFileReclaim(coldStore *cs, coldFile *f, unsigned long *budget) {
+    uint64_t full = f->used / cs->page_size, page = f->reclaim_pos, reclaimed = 0;
+
+    while (page < full && *budget) {
+        uint64_t first = page;
+        while (page < full && *budget && __atomic_load_n(coldFilePage(cs, f, page), __ATOMIC_RELAXED) == 0) {
+            page++;
+            (*budget)--;
+        }
+        if (page > first && coldFilePunch(cs, f, first, page - first) == 0) {
+            for (uint64_t p = first; p < page; p++) *coldFilePage(cs, f, p) = COLDSTORE_PUNCHED;
+            reclaimed += (page - first) * cs->page_size;
+        }
+        /* A page with live bytes, or already punched. */
+        if (page < full && *budget) {
+            page++;
+            (*budget)--;
+        }
+    }
+    f->reclaim_pos = page < full ? page : 0;
+    f->punched += reclaimed;
+    return reclaimed;
+}
+
+/* Give the space of the freed records back to the file system, looking at
+ * up to 'max_pages' pages, and close the files left without records. Must
+ * not run while a fork child may still read the records. Returns the bytes
+ * reclaimed. */
+uint64_t m_coldStoreReclaim(coldStore *cs, unsigned long max_pages) {
+    uint64_t reclaimed = 0;
+
+    for (int n = 0; n < M_COLDSTORE_FILES && max_pages; n++) {
+        int slot = cs->reclaim_file;
+        coldFile *f = cs->files[slot];
+        if (f && slot != cs->active && __atomic_load_n(&f->live, __ATOMIC_RELAXED) == 0) {
+            reclaimed += f->used - f->punched;
+            coldFileClose(cs, f);
+            cs->files[slot] = NULL;
+        } else if (f && cs->can_punch) {
+            reclaimed += coldFileReclaim(cs, f, &max_pages);
+            /* Stay on the file until all of it was looked at. */
+            if (f->reclaim_pos) break;
+        }
+        cs->reclaim_file = (slot + 1) % M_COLDSTORE_FILES;
+    }
+    cs->stat_reclaimed += reclaimed;
+    return reclaimed;
+}
+
+/* Bytes the files take on disk, freed records not yet reclaimed included. */
+uint64_t m_coldStoreFileBytes(const coldStore *cs) {
+    uint64_t bytes = 0;
+    for (int j = 0; j < M_COLDSTORE_FILES; j++) {
+        if (cs->files[j]) bytes += cs->files[j]->used - cs->files[j]->punched;
+    }
+    return bytes;
+}
+
+uint64_t m_coldStoreLiveBytes(const coldStore *cs) {
+    uint64_t bytes = 0;
+    for (int j = 0; j < M_COLDSTORE_FILES; j++) {
+        if (cs->files[j]) bytes += __atomic_load_n(&cs->files[j]->live, __ATOMIC_RELAXED);
+    }
+    return bytes;
+}
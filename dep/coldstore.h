@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Append-only files of values on local disk, read through mmap. Records
+ * never move: the space of freed records goes back to the file system once
+ * every record sharing their pages is freed too, when m_coldStoreReclaim()
+ * punches a hole over those pages.
+ *
+ * m_coldStoreFree() may run in the lazyfree thread: it only updates atomic
+ * counters, and every file is mapped once for its largest size, so mappings
+ * never move. Everything else runs in the main thread. The files are
+ * unlinked as soon as they are created, nothing is left on disk by a crash.
+ *
+ * An offset is the slot of the file in the high bits and the position of
+ * the record in the file in the low ones. Appends go to a new file once the
+ * current one is full, a file is closed when its last record is freed. */
+#define M_COLDSTORE_FILES 16
+#define M_COLDSTORE_FILE_BITS 38 /* Largest file, 256 GB. */
+#define M_COLDSTORE_CHUNK_PAGES (1 << 16)
+
+typedef struct coldFile {
+    int fd;
+    char *map;            /* The largest size is mapped, the file is 'size' long. */
+    uint64_t size;
+    uint64_t used;        /* Bytes appended. */
+    uint64_t live;        /* Bytes of the records not freed yet. */
+    uint64_t punched;     /* Bytes given back to the file system. */
+    uint64_t reclaim_pos; /* Next page looked at by m_coldStoreReclaim(). */
+    uint32_t **pages;     /* Live bytes of every page, in chunks. */
+} coldFile;
+
+typedef struct coldStore {
+    char *dir;
+    coldFile *files[M_COLDSTORE_FILES];
+    int active;           /* Appends go to files[active]. */
+    int reclaim_file;     /* Next file looked at by m_coldStoreReclaim(). */
+    int can_punch;        /* Cleared if the file system can't punch holes. */
+    unsigned int page_size;
+    unsigned long long file_seq; /* Names the files. */
+    uint64_t stat_reclaimed;     /* Bytes given back to the file system. */
+} coldStore;
+
+coldStore *m_coldStoreCreate(const char *dir);
+void m_coldStoreRelease(coldStore *cs);
+int m_coldStorePut(coldStore *cs, const void *buf, size_t len, uint64_t *offset);
+const char *m_coldStoreGet(coldStore *cs, uint64_t offset, size_t *len);
+void m_coldStoreFree(coldStore *cs, uint64_t offset);
+uint64_t m_coldStoreReclaim(coldStore *cs, unsigned long max_pages);
+uint64_t m_coldStoreFileBytes(const coldStore *cs);
+uint64_t m_coldStoreLiveBytes(const coldStore *cs);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Number of hash slots of a redis cluster. */
+#define M_CLUSTER_SLOTS 16384
+
+uint16_t m_crc16(const char *buf, int len);
+unsigned int m_keyHashSlot(const char *key, int keylen);
@@ -65,6 +65,10 @@ extern void *REDISMODULE_API_FUNC(RedisModule_Calloc)(size_t nmemb, size_t size)
 static int dict_can_resize = 1;
 static unsigned int dict_force_resize_ratio = 5;
 
+/* Number of times a table expansion was postponed because resizing was
+ * disabled and the force ratio was not yet reached. */
+static unsigned long long dict_stat_deferred_resizes = 0;
+
 /* -------------------------- private prototypes ---------------------------- */
 
 static int _dictExpandIfNeeded(dict *ht);
@@ -118,6 +122,11 @@ dict *m_dictCreate(m_dictType *type,
     return d;
 }
 
+/* Initialize a dict embedded in another structure. */
+void m_dictInit(dict *d, m_dictType *type, void *privDataPtr) {
+    _dictInit(d, type, privDataPtr);
+}
+
 /* Initialize the hash table */
 int _dictInit(dict *d, m_dictType *type,
               void *privDataPtr) {
@@ -915,8 +924,11 @@ static int _dictExpandIfNeeded(dict *d) {
      * table (global setting) or we should avoid it but the ratio between
      * elements/buckets is over the "safe" threshold, we resize doubling
      * the number of buckets. */
-    if (d->ht[0].used >= d->ht[0].size && (dict_can_resize || d->ht[0].used / d->ht[0].size > dict_force_resize_ratio)) {
-        return m_dictExpand(d, d->ht[0].used * 2);
+    if (d->ht[0].used >= d->ht[0].size) {
+        if (dict_can_resize || d->ht[0].used / d->ht[0].size > dict_force_resize_ratio) {
+            return m_dictExpand(d, d->ht[0].used * 2);
+        }
+        dict_stat_deferred_resizes++;
     }
     return DICT_OK;
 }
@@ -979,6 +991,22 @@ void m_dictDisableResize(void) {
     dict_can_resize = 0;
 }
 
+int m_dictIsResizeEnabled(void) {
+    return dict_can_resize;
+}
+
+void m_dictSetForceResizeRatio(unsigned int ratio) {
+    dict_force_resize_ratio = ratio;
+}
+
+unsigned int m_dictGetForceResizeRatio(void) {
+    return dict_force_resize_ratio;
+}
+
+unsigned long long m_dictGetStatDeferredResizes(void) {
+    return dict_stat_deferred_resizes;
+}
+
 uint64_t m_dictGetHash(dict *d, const void *key) {
     return dictHashKey(d, key);
 }
@@ -156,6 +156,7 @@ typedef void(dictScanBucketFunction)(void *privdata, m_dictEntry **bucketref);
 
 /* API */
 dict *m_dictCreate(m_dictType *type, void *privDataPtr);
+void m_dictInit(dict *d, m_dictType *type, void *privDataPtr);
 int m_dictExpand(dict *d, unsigned long size);
 int m_dictAdd(dict *d, void *key, void *val);
 m_dictEntry *m_dictAddRaw(dict *d, void *key, m_dictEntry **existing);
@@ -180,6 +181,10 @@ uint64_t m_dictGenCaseHashFunction(const unsigned char *buf, int len);
 void m_dictEmpty(dict *d, void(callback)(void *));
 void m_dictEnableResize(void);
 void m_dictDisableResize(void);
+int m_dictIsResizeEnabled(void);
+void m_dictSetForceResizeRatio(unsigned int ratio);
+unsigned int m_dictGetForceResizeRatio(void);
+unsigned long long m_dictGetStatDeferredResizes(void);
 int m_dictRehash(dict *d, int n);
 int m_dictRehashMilliseconds(dict *d, int ms);
 void m_dictSetHashFunctionSeed(uint8_t *seed);
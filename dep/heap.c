@@ -0,0 +1,134 @@
+#include "heap.h"
+
+#include <assert.h>
+
+/* Initialize a heap embedded in another structure. */
+void m_heapInit(m_heap *heap) {
+    heap->items = NULL;
+    heap->length = 0;
+    heap->size = 0;
+}
+
+/* Create a new empty heap. */
+m_heap *m_heapCreate(void) {
+    m_heap *heap = RedisModule_Alloc(sizeof(*heap));
+    m_heapInit(heap);
+    return heap;
+}
+
+/* Empty the heap and release its items. The entries still in it are
+ * unlinked, their owners may be released later without touching the heap. */
+void m_heapClear(m_heap *heap) {
+    for (unsigned long j = 0; j < heap->length; j++) {
+        heap->items[j].entry->heap = NULL;
+    }
+    RedisModule_Free(heap->items);
+    m_heapInit(heap);
+}
+
+void m_heapFree(m_heap *heap) {
+    m_heapClear(heap);
+    RedisModule_Free(heap);
+}
+
+static inline void m_heapPlace(m_heap *heap, unsigned long slot, m_heapItem item) {
+    heap->items[slot] = item;
+    item.entry->slot = slot;
+}
+
+/* Move the item at 'slot' up while it is smaller than its parent. */
+static void m_heapSiftUp(m_heap *heap, unsigned long slot) {
+    m_heapItem item = heap->items[slot];
+    while (slot > 0) {
+        unsigned long parent = (slot - 1) / M_HEAP_ARITY;
+        if (heap->items[parent].score <= item.score) break;
+        m_heapPlace(heap, slot, heap->items[parent]);
+        slot = parent;
+    }
+    m_heapPlace(heap, slot, item);
+}
+
+/* Move the item at 'slot' down while one of its children is smaller. */
+static void m_heapSiftDown(m_heap *heap, unsigned long slot) {
+    m_heapItem item = heap->items[slot];
+    for (;;) {
+        unsigned long first = slot * M_HEAP_ARITY + 1, last, min;
+        if (first >= heap->length) break;
+        last = first + M_HEAP_ARITY < heap->length ? first + M_HEAP_ARITY : heap->length;
+        min = first;
+        for (unsigned long j = first + 1; j < last; j++) {
+            if (heap->items[j].score < heap->items[min].score) min = j;
+        }
+        if (heap->items[min].score >= item.score) break;
+        m_heapPlace(heap, slot, heap->items[min]);
+        slot = min;
+    }
+    m_heapPlace(heap, slot, item);
+}
+
+/* Insert an entry that is in no heap. */
+void m_heapInsert(m_heap *heap, m_heapEntry *entry, long long score) {
+    assert(entry->heap == NULL);
+    if (heap->length == heap->size) {
+        heap->size = heap->size ? heap->size * 2 : M_HEAP_INITSIZE;
+        heap->items = RedisModule_Realloc(heap->items, heap->size * sizeof(m_heapItem));
+    }
+    entry->heap = heap;
+    heap->items[heap->length].score = score;
+    heap->items[heap->length].entry = entry;
+    entry->slot = heap->length++;
+    m_heapSiftUp(heap, entry->slot);
+}
+
+/* Change the score of an entry and restore the heap order. */
+void m_heapUpdate(m_heapEntry *entry, long long score) {
+    m_heap *heap = entry->heap;
+    long long old = heap->items[entry->slot].score;
+    heap->items[entry->slot].score = score;
+    if (score < old) {
+        m_heapSiftUp(heap, entry->slot);
+    } else if (score > old) {
+        m_heapSiftDown(heap, entry->slot);
+    }
+}
+
+/* Remove an entry from its heap, the last item takes its slot. */
+void m_heapDelete(m_heapEntry *entry) {
+    m_heap *heap = entry->heap;
+    unsigned long slot = entry->slot;
+    entry->heap = NULL;
+    if (slot != --heap->length) {
+        long long old = heap->items[slot].score;
+        m_heapPlace(heap, slot, heap->items[heap->length]);
+        if (heap->items[slot].score < old) {
+            m_heapSiftUp(heap, slot);
+        } else {
+            m_heapSiftDown(heap, slot);
+        }
+    }
+
+    if (heap->size > M_HEAP_INITSIZE && heap->length < heap->size / 4) {
+        heap->size /= 2;
+        heap->items = RedisModule_Realloc(heap->items, heap->size * sizeof(m_heapItem));
+    }
+}
+
+/* The owner of the entry was moved in memory, point its slot at the new
+ * address. */
+void m_heapRelocate(m_heapEntry *entry) {
+    if (entry->heap) {
+        entry->heap->items[entry->slot].entry = entry;
+    }
+}
+
+/* The entries point at the heap itself, only the item array is relocated. */
+void m_heapDefrag(RedisModuleDefragCtx *ctx, m_heap *heap) {
+    m_heapItem *newitems;
+    if (heap->items && (newitems = RedisModule_DefragAlloc(ctx, heap->items)) != NULL) {
+        heap->items = newitems;
+    }
+}
+
+size_t m_heapMemUsage(const m_heap *heap) {
+    return sizeof(*heap) + heap->size * sizeof(m_heapItem);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../src/redismodule.h"
+
+#define M_HEAP_ARITY 4
+#define M_HEAP_INITSIZE 16
+
+/* Indexed 4-ary min heap. The owner of an item embeds an m_heapEntry, which
+ * remembers the heap and the slot the item is in, so repositioning or
+ * removing an item is a sift from its slot, without any search. */
+struct m_heap;
+
+typedef struct m_heapEntry {
+    struct m_heap *heap; /* NULL while the entry is in no heap. */
+    unsigned long slot;
+} m_heapEntry;
+
+typedef struct m_heapItem {
+    long long score;
+    m_heapEntry *entry;
+} m_heapItem;
+
+typedef struct m_heap {
+    m_heapItem *items;
+    unsigned long length;
+    unsigned long size;
+} m_heap;
+
+void m_heapInit(m_heap *heap);
+m_heap *m_heapCreate(void);
+void m_heapClear(m_heap *heap);
+void m_heapFree(m_heap *heap);
+void m_heapInsert(m_heap *heap, m_heapEntry *entry, long long score);
+void m_heapUpdate(m_heapEntry *entry, long long score);
+void m_heapDelete(m_heapEntry *entry);
+void m_heapRelocate(m_heapEntry *entry);
+void m_heapDefrag(RedisModuleDefragCtx *ctx, m_heap *heap);
+size_t m_heapMemUsage(const m_heap *heap);
+
+static inline m_heapEntry *m_heapFirst(const m_heap *heap) {
+    return heap->length ? heap->items[0].entry : NULL;
+}
+
+static inline long long m_heapScore(const m_heapEntry *entry) {
+    return entry->heap->items[entry->slot].score;
+}
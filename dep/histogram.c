@@ -0,0 +1,100 @@
+/*
+ * Copyright 2021 Alibaba Tair Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "histogram.h"
+
+#include <string.h>
+
+static inline unsigned int bucketIndex(uint64_t value) {
+    if (value < M_HISTOGRAM_SUB_COUNT) {
+        return (unsigned int)value;
+    }
+
+    unsigned int msb = 63 - __builtin_clzll(value);
+    if (msb >= M_HISTOGRAM_MAX_BITS) {
+        return M_HISTOGRAM_BUCKETS - 1;
+    }
+
+    unsigned int shift = msb - M_HISTOGRAM_SUB_BITS;
+    unsigned int sub = (unsigned int)(value >> shift) - M_HISTOGRAM_SUB_COUNT;
+    return M_HISTOGRAM_SUB_COUNT * (shift + 1) + sub;
+}
+
+/* The highest value that falls into the bucket. */
+static inline uint64_t bucketValue(unsigned int index) {
+    if (index < M_HISTOGRAM_SUB_COUNT) {
+        return index;
+    }
+
+    unsigned int shift = index / M_HISTOGRAM_SUB_COUNT - 1;
+    uint64_t sub = index % M_HISTOGRAM_SUB_COUNT;
+    return ((M_HISTOGRAM_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void m_histogramReset(m_histogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void m_histogramRecord(m_histogram *h, uint64_t value) {
+    h->buckets[bucketIndex(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void m_histogramMerge(m_histogram *dst, const m_histogram *src) {
+    for (int i = 0; i < M_HISTOGRAM_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/* Return the value below which 'percentile' (0-100) of the recorded values
+ * fall, reported as the highest value of the matching bucket but never more
+ * than the largest value recorded. */
+uint64_t m_histogramPercentile(const m_histogram *h, double percentile) {
+    if (h->count == 0) {
+        return 0;
+    }
+
+    if (percentile > 100) {
+        percentile = 100;
+    }
+
+    uint64_t target = (uint64_t)(percentile / 100 * h->count + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < M_HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= target) {
+            uint64_t value = bucketValue(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+uint64_t m_histogramMean(const m_histogram *h) {
+    return h->count ? h->sum / h->count : 0;
+}
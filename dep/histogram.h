@@ -0,0 +1,44 @@
+/*
+ * Copyright 2021 Alibaba Tair Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/* A fixed size log-linear histogram in the HdrHistogram style: values below
+ * 2^M_HISTOGRAM_SUB_BITS get one bucket each, every following power of two
+ * range is split into 2^M_HISTOGRAM_SUB_BITS linear sub buckets. With 4 sub
+ * bits the relative error of a reported percentile is below 6.25%. Values
+ * above 2^M_HISTOGRAM_MAX_BITS are clamped into the last bucket. */
+#define M_HISTOGRAM_SUB_BITS 4
+#define M_HISTOGRAM_SUB_COUNT (1 << M_HISTOGRAM_SUB_BITS)
+#define M_HISTOGRAM_MAX_BITS 40
+#define M_HISTOGRAM_BUCKETS (M_HISTOGRAM_SUB_COUNT * (M_HISTOGRAM_MAX_BITS - M_HISTOGRAM_SUB_BITS + 1))
+
+typedef struct m_histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[M_HISTOGRAM_BUCKETS];
+} m_histogram;
+
+void m_histogramReset(m_histogram *h);
+void m_histogramRecord(m_histogram *h, uint64_t value);
+void m_histogramMerge(m_histogram *dst, const m_histogram *src);
+uint64_t m_histogramPercentile(const m_histogram *h, double percentile);
+uint64_t m_histogramMean(const m_histogram *h);
+
+#endif
@@ -0,0 +1,113 @@
+#include "lzf.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZF_HLOG 13
+#define LZF_MAX_LIT (1 << 5)
+#define LZF_MAX_OFF (1 << 13)
+#define LZF_MAX_REF ((1 << 8) + (1 << 3))
+
+#define lzfHash(p) ((((uint32_t)(p)[0] << 16 | (uint32_t)(p)[1] << 8 | (p)[2]) * 2654435761u) >> (32 - LZF_HLOG))
+
+unsigned int m_lzfCompress(const void *in_data, unsigned int in_len, void *out_data, unsigned int out_len) {
+    /* Last position + 1 of every hashed 3 byte sequence, 0 if none. */
+    uint32_t htab[1 << LZF_HLOG];
+    const uint8_t *in = in_data, *ip = in, *in_end = in + in_len;
+    uint8_t *op = out_data, *out_end = op + out_len;
+    int lit = 0;
+
+    if (in_len == 0 || out_len < 2) return 0;
+    memset(htab, 0, sizeof(htab));
+    op++; /* Start a run, its control byte is written when it ends. */
+
+    while (ip + 2 < in_end) {
+        uint32_t h = lzfHash(ip);
+        const uint8_t *ref = htab[h] ? in + htab[h] - 1 : NULL;
+        htab[h] = (uint32_t)(ip - in) + 1;
+
+        unsigned long off = ref ? (unsigned long)(ip - ref - 1) : LZF_MAX_OFF;
+        if (off < LZF_MAX_OFF && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+            unsigned int len = 2, maxlen = (unsigned int)(in_end - ip) - len;
+            if (maxlen > LZF_MAX_REF) maxlen = LZF_MAX_REF;
+
+            /* The reference takes up to 3 bytes, the next run 1 more. */
+            if (op - !lit + 3 + 1 >= out_end) return 0;
+            op[-lit - 1] = lit - 1; /* End the run. */
+            op -= !lit;             /* Drop it if it is empty. */
+
+            do {
+                len++;
+            } while (len < maxlen && ref[len] == ip[len]);
+
+            ip += len;
+            len -= 2; /* Stored as the length minus 2. */
+            if (len < 7) {
+                *op++ = (uint8_t)((off >> 8) + (len << 5));
+            } else {
+                *op++ = (uint8_t)((off >> 8) + (7 << 5));
+                *op++ = (uint8_t)(len - 7);
+            }
+            *op++ = (uint8_t)off;
+            lit = 0;
+            op++;
+        } else {
+            if (op >= out_end) return 0;
+            lit++;
+            *op++ = *ip++;
+            if (lit == LZF_MAX_LIT) {
+                if (op >= out_end) return 0;
+                op[-lit - 1] = lit - 1;
+                lit = 0;
+                op++;
+            }
+        }
+    }
+
+    while (ip < in_end) {
+        if (op >= out_end) return 0;
+        lit++;
+        *op++ = *ip++;
+        if (lit == LZF_MAX_LIT) {
+            if (op >= out_end) return 0;
+            op[-lit - 1] = lit - 1;
+            lit = 0;
+            op++;
+        }
+    }
+
+    op[-lit - 1] = lit - 1;
+    op -= !lit;
+    return (unsigned int)(op - (uint8_t *)out_data);
+}
+
+unsigned int m_lzfDecompress(const void *in_data, unsigned int in_len, void *out_data, unsigned int out_len) {
+    const uint8_t *ip = in_data, *in_end = ip + in_len;
+    uint8_t *out = out_data, *op = out, *out_end = out + out_len;
+
+    while (ip < in_end) {
+        unsigned int ctrl = *ip++;
+
+        if (ctrl < LZF_MAX_LIT) {
+            ctrl++;
+            if ((unsigned long)(out_end - op) < ctrl || (unsigned long)(in_end - ip) < ctrl) return 0;
+            memcpy(op, ip, ctrl);
+            op += ctrl;
+            ip += ctrl;
+        } else {
+            unsigned int len = ctrl >> 5;
+            if (len == 7) {
+                if (ip >= in_end) return 0;
+                len += *ip++;
+            }
+            if (ip >= in_end) return 0;
+            unsigned long off = ((unsigned long)(ctrl & 0x1f) << 8) + *ip++ + 1;
+            len += 2;
+            if (off > (unsigned long)(op - out) || (unsigned long)(out_end - op) < len) return 0;
+            /* The reference may overlap the bytes being written. */
+            const uint8_t *ref = op - off;
+            while (len--) *op++ = *ref++;
+        }
+    }
+    return (unsigned int)(op - out);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+/* LZF compression, the format of liblzf: a control byte below 32 starts a
+ * run of that many plus one literal bytes, any other control byte is a back
+ * reference of up to 264 bytes within the last 8 KB of output. */
+
+/* Compress 'in_len' bytes into at most 'out_len' bytes. Returns the
+ * compressed length, or 0 if the output does not fit. */
+unsigned int m_lzfCompress(const void *in_data, unsigned int in_len, void *out_data, unsigned int out_len);
+
+/* Decompress into at most 'out_len' bytes. Returns the decompressed length,
+ * or 0 if the input is damaged or the output does not fit. */
+unsigned int m_lzfDecompress(const void *in_data, unsigned int in_len, void *out_data, unsigned int out_len);
@@ -0,0 +1,207 @@
+#include "segdict.h"
+
+#include "../src/redismodule.h"
+
+/* A dict splits once it holds this many entries. */
+static unsigned long segdict_split_size = M_SEGDICT_DEFAULT_SPLIT_SIZE;
+static unsigned long long segdict_stat_splits = 0;
+
+/* Segmented scan cursors carry this flag, the segment in the low bits and
+ * the cursor inside the segment above them. */
+#define SEGDICT_CURSOR_FLAG (1UL << 62)
+#define SEGDICT_CURSOR_INNER_MASK ((SEGDICT_CURSOR_FLAG - 1) >> M_SEGDICT_SEG_BITS)
+
+/* A segment shrinks when less than 1/SEGDICT_MIN_FILL of it is used. */
+#define SEGDICT_MIN_FILL 8
+
+#define segDictSegOf(hash) ((unsigned int)((hash) >> (64 - M_SEGDICT_SEG_BITS)))
+
+static inline dict *segDictSeg(segDict *sd, const void *key) {
+    return sd->segs[segDictSegOf(dictHashKey(&sd->d, key))];
+}
+
+/* Returns the seg-th dict holding entries, NULL past the last one. */
+static inline dict *segDictAt(segDict *sd, unsigned int seg) {
+    if (sd->segs == NULL) return seg == 0 ? &sd->d : NULL;
+    return seg < M_SEGDICT_SEGS ? sd->segs[seg] : NULL;
+}
+
+segDict *m_segDictCreate(m_dictType *type, void *privDataPtr) {
+    segDict *sd = RedisModule_Alloc(sizeof(*sd));
+    m_dictInit(&sd->d, type, privDataPtr);
+    sd->segs = NULL;
+    sd->used = 0;
+    return sd;
+}
+
+void m_segDictRelease(segDict *sd) {
+    if (sd->segs) {
+        for (int i = 0; i < M_SEGDICT_SEGS; i++) m_dictRelease(sd->segs[i]);
+        RedisModule_Free(sd->segs);
+    }
+    m_dictEmpty(&sd->d, NULL);
+    RedisModule_Free(sd);
+}
+
+/* Move every entry of the inline dict into segments sized for 'size'
+ * entries. The entries are relinked, not copied, and the inline dict is
+ * left empty, keeping only its type for hashing. */
+static void segDictSplit(segDict *sd, unsigned long size) {
+    dict *d = &sd->d;
+    unsigned long used = dictSize(d);
+
+    sd->segs = RedisModule_Alloc(sizeof(dict *) * M_SEGDICT_SEGS);
+    for (int i = 0; i < M_SEGDICT_SEGS; i++) {
+        sd->segs[i] = m_dictCreate(d->type, d->privdata);
+        m_dictExpand(sd->segs[i], size / M_SEGDICT_SEGS + 1);
+    }
+
+    for (int table = 0; table <= 1; table++) {
+        dictht *ht = &d->ht[table];
+        for (unsigned long i = 0; i < ht->size; i++) {
+            m_dictEntry *he = ht->table[i];
+            while (he) {
+                m_dictEntry *next = he->next;
+                uint64_t hash = dictHashKey(d, he->key);
+                dict *seg = sd->segs[segDictSegOf(hash)];
+                unsigned long idx = hash & seg->ht[0].sizemask;
+                he->next = seg->ht[0].table[idx];
+                seg->ht[0].table[idx] = he;
+                seg->ht[0].used++;
+                he = next;
+            }
+        }
+        RedisModule_Free(ht->table);
+    }
+    m_dictInit(d, d->type, d->privdata);
+    sd->used = used;
+    segdict_stat_splits++;
+}
+
+int m_segDictExpand(segDict *sd, unsigned long size) {
+    if (sd->segs == NULL) {
+        if (size < segdict_split_size || sd->d.iterators || !m_dictIsResizeEnabled())
+            return m_dictExpand(&sd->d, size);
+        segDictSplit(sd, size);
+        return DICT_OK;
+    }
+    for (int i = 0; i < M_SEGDICT_SEGS; i++) m_dictExpand(sd->segs[i], size / M_SEGDICT_SEGS + 1);
+    return DICT_OK;
+}
+
+int m_segDictAdd(segDict *sd, void *key, void *val) {
+    if (sd->segs == NULL) {
+        if (m_dictAdd(&sd->d, key, val) != DICT_OK) return DICT_ERR;
+        /* A fork child or a running iterator only delays the split. */
+        if (dictSize(&sd->d) >= segdict_split_size && sd->d.iterators == 0 && m_dictIsResizeEnabled())
+            segDictSplit(sd, dictSize(&sd->d));
+        return DICT_OK;
+    }
+    if (m_dictAdd(segDictSeg(sd, key), key, val) != DICT_OK) return DICT_ERR;
+    sd->used++;
+    return DICT_OK;
+}
+
+int m_segDictDelete(segDict *sd, const void *key) {
+    if (sd->segs == NULL) return m_dictDelete(&sd->d, key);
+
+    dict *seg = segDictSeg(sd, key);
+    if (m_dictDelete(seg, key) != DICT_OK) return DICT_ERR;
+    sd->used--;
+    /* Segments are small, shrinking one as soon as it gets sparse keeps
+     * the memory of a draining key in check at a negligible cost. */
+    if (seg->iterators == 0 && dictSlots(seg) > DICT_HT_INITIAL_SIZE && dictSize(seg) * SEGDICT_MIN_FILL < dictSlots(seg))
+        m_dictResize(seg);
+    return DICT_OK;
+}
+
+m_dictEntry *m_segDictFind(segDict *sd, const void *key) {
+    if (sd->segs == NULL) return m_dictFind(&sd->d, key);
+    return m_dictFind(segDictSeg(sd, key), key);
+}
+
+void *m_segDictFetchValue(segDict *sd, const void *key) {
+    m_dictEntry *he = m_segDictFind(sd, key);
+    return he ? dictGetVal(he) : NULL;
+}
+
+static m_segDictIterator *segDictGetIterator(segDict *sd, int safe) {
+    m_segDictIterator *iter = RedisModule_Alloc(sizeof(*iter));
+    iter->sd = sd;
+    iter->seg = 0;
+    iter->safe = safe;
+    iter->di = NULL;
+    return iter;
+}
+
+m_segDictIterator *m_segDictGetIterator(segDict *sd) {
+    return segDictGetIterator(sd, 0);
+}
+
+m_segDictIterator *m_segDictGetSafeIterator(segDict *sd) {
+    return segDictGetIterator(sd, 1);
+}
+
+m_dictEntry *m_segDictNext(m_segDictIterator *iter) {
+    while (1) {
+        if (iter->di == NULL) {
+            dict *d = segDictAt(iter->sd, iter->seg);
+            if (d == NULL) return NULL;
+            iter->di = iter->safe ? m_dictGetSafeIterator(d) : m_dictGetIterator(d);
+        }
+        m_dictEntry *de = m_dictNext(iter->di);
+        if (de) return de;
+        m_dictReleaseIterator(iter->di);
+        iter->di = NULL;
+        iter->seg++;
+    }
+}
+
+void m_segDictReleaseIterator(m_segDictIterator *iter) {
+    if (iter->di) m_dictReleaseIterator(iter->di);
+    RedisModule_Free(iter);
+}
+
+/* Same guarantees as m_dictScan. A cursor of the inline dict handed back
+ * after the split restarts the scan, which may report elements twice but
+ * never misses one. */
+unsigned long m_segDictScan(segDict *sd, unsigned long v, dictScanFunction *fn, dictScanBucketFunction *bucketfn, void *privdata) {
+    if (sd->segs == NULL) return m_dictScan(&sd->d, v, fn, bucketfn, privdata);
+
+    unsigned int seg = 0;
+    unsigned long inner = 0;
+    if (v & SEGDICT_CURSOR_FLAG) {
+        seg = v & (M_SEGDICT_SEGS - 1);
+        inner = (v >> M_SEGDICT_SEG_BITS) & SEGDICT_CURSOR_INNER_MASK;
+    }
+
+    while (seg < M_SEGDICT_SEGS && dictSize(sd->segs[seg]) == 0) {
+        seg++;
+        inner = 0;
+    }
+    if (seg == M_SEGDICT_SEGS) return 0;
+
+    inner = m_dictScan(sd->segs[seg], inner, fn, bucketfn, privdata);
+    if (inner == 0 && ++seg == M_SEGDICT_SEGS) return 0;
+    return SEGDICT_CURSOR_FLAG | (inner << M_SEGDICT_SEG_BITS) | seg;
+}
+
+/* Buckets allocated over all the tables. */
+unsigned long m_segDictSlots(const segDict *sd) {
+    if (sd->segs == NULL) return dictSlots(&sd->d);
+    unsigned long slots = 0;
+    for (int i = 0; i < M_SEGDICT_SEGS; i++) slots += dictSlots(sd->segs[i]);
+    return slots;
+}
+
+void m_segDictSetSplitSize(unsigned long size) {
+    segdict_split_size = size;
+}
+
+unsigned long m_segDictGetSplitSize(void) {
+    return segdict_split_size;
+}
+
+unsigned long long m_segDictGetStatSplits(void) {
+    return segdict_stat_splits;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "dict.h"
+
+/* A dict that splits in M_SEGDICT_SEGS dicts, selected by the high bits of
+ * the hash, once it holds more than the split size. Each segment grows,
+ * rehashes and shrinks on its own, so a very large dict never resizes, nor
+ * allocates, a single huge table. The entries are plain dict entries. */
+#define M_SEGDICT_SEG_BITS 8
+#define M_SEGDICT_SEGS (1 << M_SEGDICT_SEG_BITS)
+#define M_SEGDICT_DEFAULT_SPLIT_SIZE 65536
+
+typedef struct segDict {
+    dict d;               /* All the entries until the split, empty after it. */
+    dict **segs;          /* NULL until the split. */
+    unsigned long used;   /* Entries in the segments. */
+} segDict;
+
+typedef struct m_segDictIterator {
+    segDict *sd;
+    unsigned int seg;
+    int safe;
+    m_dictIterator *di;
+} m_segDictIterator;
+
+#define segDictSize(sd) ((sd)->segs ? (sd)->used : dictSize(&(sd)->d))
+#define segDictIsSegmented(sd) ((sd)->segs != NULL)
+
+segDict *m_segDictCreate(m_dictType *type, void *privDataPtr);
+void m_segDictRelease(segDict *sd);
+int m_segDictExpand(segDict *sd, unsigned long size);
+int m_segDictAdd(segDict *sd, void *key, void *val);
+int m_segDictDelete(segDict *sd, const void *key);
+m_dictEntry *m_segDictFind(segDict *sd, const void *key);
+void *m_segDictFetchValue(segDict *sd, const void *key);
+m_segDictIterator *m_segDictGetIterator(segDict *sd);
+m_segDictIterator *m_segDictGetSafeIterator(segDict *sd);
+m_dictEntry *m_segDictNext(m_segDictIterator *iter);
+void m_segDictReleaseIterator(m_segDictIterator *iter);
+unsigned long m_segDictScan(segDict *sd, unsigned long v, dictScanFunction *fn, dictScanBucketFunction *bucketfn, void *privdata);
+unsigned long m_segDictSlots(const segDict *sd);
+void m_segDictSetSplitSize(unsigned long size);
+unsigned long m_segDictGetSplitSize(void);
+unsigned long long m_segDictGetStatSplits(void);
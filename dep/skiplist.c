@@ -22,9 +22,11 @@ m_zskiplist *m_zslCreate(void) {
 
     zsl = RedisModule_Alloc(sizeof(*zsl));
     zsl->level = 1;
+    zsl->header_level = ZSKIPLIST_INITLEVEL;
     zsl->length = 0;
-    zsl->header = m_zslCreateNode(ZSKIPLIST_MAXLEVEL, 0, NULL);
-    for (j = 0; j < ZSKIPLIST_MAXLEVEL; j++) {
+    zsl->level_sum = 0;
+    zsl->header = m_zslCreateNode(zsl->header_level, 0, NULL);
+    for (j = 0; j < zsl->header_level; j++) {
         zsl->header->level[j].forward = NULL;
         zsl->header->level[j].span = 0;
     }
@@ -67,6 +69,23 @@ int m_zslRandomLevel(void) {
     return (level < ZSKIPLIST_MAXLEVEL) ? level : ZSKIPLIST_MAXLEVEL;
 }
 
+/* Make room for 'level' levels in the header. Most skiplists stay small, so
+ * the header starts with ZSKIPLIST_INITLEVEL levels and doubles when a node
+ * taller than that shows up. */
+static void m_zslGrowHeader(m_zskiplist *zsl, int level) {
+    int j, header_level = zsl->header_level;
+
+    if (level <= header_level) return;
+    while (header_level < level) header_level *= 2;
+    if (header_level > ZSKIPLIST_MAXLEVEL) header_level = ZSKIPLIST_MAXLEVEL;
+    zsl->header = RedisModule_Realloc(zsl->header, sizeof(*zsl->header) + header_level * sizeof(struct zskiplistLevel));
+    for (j = zsl->header_level; j < header_level; j++) {
+        zsl->header->level[j].forward = NULL;
+        zsl->header->level[j].span = 0;
+    }
+    zsl->header_level = header_level;
+}
+
 /* Insert a new node in the skiplist. Assumes the element does not already
  * exist (up to the caller to enforce that). The skiplist takes ownership
  * of the passed SDS string 'ele'. */
@@ -75,6 +94,10 @@ m_zskiplistNode *m_zslInsert(m_zskiplist *zsl, long long score, RedisModuleStrin
     unsigned int rank[ZSKIPLIST_MAXLEVEL];
     int i, level;
 
+    /* The header may move when it grows, pick the level before walking. */
+    level = m_zslRandomLevel();
+    m_zslGrowHeader(zsl, level);
+
     x = zsl->header;
     for (i = zsl->level - 1; i >= 0; i--) {
         /* store rank that is crossed to reach the insert position */
@@ -92,7 +115,6 @@ m_zskiplistNode *m_zslInsert(m_zskiplist *zsl, long long score, RedisModuleStrin
      * scores, reinserting the same element should never happen since the
      * caller of m_zslInsert() should test in the hash table if the element is
      * already inside or not. */
-    level = m_zslRandomLevel();
     if (level > zsl->level) {
         for (i = zsl->level; i < level; i++) {
             rank[i] = 0;
@@ -122,6 +144,7 @@ m_zskiplistNode *m_zslInsert(m_zskiplist *zsl, long long score, RedisModuleStrin
     else
         zsl->tail = x;
     zsl->length++;
+    zsl->level_sum += level;
     return x;
 }
 
@@ -132,6 +155,7 @@ void m_zslDeleteNode(m_zskiplist *zsl, m_zskiplistNode *x, m_zskiplistNode **upd
         if (update[i]->level[i].forward == x) {
             update[i]->level[i].span += x->level[i].span - 1;
             update[i]->level[i].forward = x->level[i].forward;
+            zsl->level_sum--;
         } else {
             update[i]->level[i].span -= 1;
         }
@@ -283,6 +307,38 @@ m_zskiplistNode *m_zslFirstInRange(m_zskiplist *zsl, m_zrangespec *range) {
     return x;
 }
 
+int m_zslLexValueGteMin(RedisModuleString *value, m_zlexrangespec *spec) {
+    if (spec->min == NULL) return 1;
+    int cmp = RedisModule_StringCompare(value, spec->min);
+    return spec->minex ? (cmp > 0) : (cmp >= 0);
+}
+
+int m_zslLexValueLteMax(RedisModuleString *value, m_zlexrangespec *spec) {
+    if (spec->max == NULL) return 1;
+    int cmp = RedisModule_StringCompare(value, spec->max);
+    return spec->maxex ? (cmp < 0) : (cmp <= 0);
+}
+
+/* Find the first node whose member is in the specified lex range, the
+ * scores of the skiplist must all be equal. Returns NULL when no element
+ * is contained in the range. */
+m_zskiplistNode *m_zslFirstInLexRange(m_zskiplist *zsl, m_zlexrangespec *range) {
+    m_zskiplistNode *x;
+    int i;
+
+    x = zsl->header;
+    for (i = zsl->level - 1; i >= 0; i--) {
+        /* Go forward while *OUT* of range. */
+        while (x->level[i].forward && !m_zslLexValueGteMin(x->level[i].forward->member, range))
+            x = x->level[i].forward;
+    }
+
+    x = x->level[0].forward;
+    if (x == NULL || !m_zslLexValueLteMax(x->member, range))
+        return NULL;
+    return x;
+}
+
 /* Find the last node that is contained in the specified range.
  * Returns NULL when no element is contained in the range. */
 m_zskiplistNode *m_zslLastInRange(m_zskiplist *zsl, m_zrangespec *range) {
@@ -385,4 +441,61 @@ m_zskiplistNode* m_zslGetElementByRank(m_zskiplist *zsl, unsigned long rank) {
         }
     }
     return NULL;
-}
\ No newline at end of file
+}
+/* Relocate the header and the nodes of the skiplist with the active defrag
+ * allocator. Members are left alone, they are shared with the owner of the
+ * skiplist. The walk resumes after the first 'rank' nodes, patching the
+ * forward pointers of the predecessors and the backward pointer of the
+ * successor of every node that moved. Returns the number of nodes visited so
+ * far when the defrag context asks us to stop, or 0 once the list is done. */
+unsigned long m_zslDefrag(RedisModuleDefragCtx *ctx, m_zskiplist *zsl, unsigned long rank) {
+    m_zskiplistNode *update[ZSKIPLIST_MAXLEVEL], *x, *newx;
+    unsigned long traversed = 0;
+    int i;
+
+    if (rank == 0 && (newx = RedisModule_DefragAlloc(ctx, zsl->header)) != NULL) {
+        zsl->header = newx;
+    }
+
+    x = zsl->header;
+    for (i = zsl->level - 1; i >= 0; i--) {
+        while (x->level[i].forward && (traversed + x->level[i].span) <= rank) {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    while (x) {
+        newx = RedisModule_DefragAlloc(ctx, x);
+        /* update[i] still points to x exactly for the levels x spans. */
+        for (i = 0; i < zsl->level && update[i]->level[i].forward == x; i++) {
+            if (newx) update[i]->level[i].forward = newx;
+            update[i] = newx ? newx : x;
+        }
+        if (newx) {
+            if (newx->level[0].forward) {
+                newx->level[0].forward->backward = newx;
+            } else {
+                zsl->tail = newx;
+            }
+            x = newx;
+        }
+
+        x = x->level[0].forward;
+        if (++traversed % 16 == 0 && x && RedisModule_DefragShouldStop(ctx)) {
+            return traversed;
+        }
+    }
+    return 0;
+}
+
+/* Bytes used by the skiplist itself, the members are not included. */
+size_t m_zslMemUsage(const m_zskiplist *zsl) {
+    size_t size = sizeof(*zsl);
+    size += sizeof(m_zskiplistNode) + zsl->header_level * sizeof(struct zskiplistLevel);
+    size += zsl->length * sizeof(m_zskiplistNode);
+    size += zsl->level_sum * sizeof(struct zskiplistLevel);
+    return size;
+}
@@ -4,12 +4,20 @@
 
 #define ZSKIPLIST_MAXLEVEL 64 /* Should be enough for 2^64 elements */
 #define ZSKIPLIST_P 0.25      /* Skiplist P = 1/4 */
+#define ZSKIPLIST_INITLEVEL 4 /* Header levels allocated up front, grown on demand */
 
 typedef struct {
     long long min, max;
     int minex, maxex; /* are min or max exclusive? */
 } m_zrangespec;
 
+/* Range over the members of a skiplist whose scores are all equal. A NULL
+ * min or max stands for the infinity on that side. */
+typedef struct {
+    RedisModuleString *min, *max;
+    int minex, maxex; /* are min or max exclusive? */
+} m_zlexrangespec;
+
 typedef struct m_zskiplistNode {
     RedisModuleString *member; 
     long long score;
@@ -24,6 +32,8 @@ typedef struct m_zskiplist {
     struct m_zskiplistNode *header, *tail;
     unsigned long length;
     int level;
+    int header_level; /* Levels allocated in the header, >= level. */
+    unsigned long level_sum; /* Levels of all the nodes, the header excluded. */
 } m_zskiplist;
 
 m_zskiplist *m_zslCreate(void);
@@ -34,7 +44,12 @@ m_zskiplistNode *m_zslFirstInRange(m_zskiplist *zsl, m_zrangespec *range);
 m_zskiplistNode *m_zslLastInRange(m_zskiplist *zsl, m_zrangespec *range);
 int m_zslValueGteMin(long long value, m_zrangespec *spec);
 int m_zslValueLteMax(long long value, m_zrangespec *spec);
+m_zskiplistNode *m_zslFirstInLexRange(m_zskiplist *zsl, m_zlexrangespec *range);
+int m_zslLexValueGteMin(RedisModuleString *value, m_zlexrangespec *spec);
+int m_zslLexValueLteMax(RedisModuleString *value, m_zlexrangespec *spec);
 void m_zslDeleteNode(m_zskiplist *zsl, m_zskiplistNode *x, m_zskiplistNode **update);
 m_zskiplistNode *m_zslUpdateScore(m_zskiplist *zsl, long long  curscore, RedisModuleString *member, long long newscore);
 m_zskiplistNode* m_zslGetElementByRank(m_zskiplist *zsl, unsigned long rank);
-unsigned long m_zslDeleteRangeByRank(m_zskiplist *zsl, unsigned int start, unsigned int end);
\ No newline at end of file
+unsigned long m_zslDeleteRangeByRank(m_zskiplist *zsl, unsigned int start, unsigned int end);
+unsigned long m_zslDefrag(RedisModuleDefragCtx *ctx, m_zskiplist *zsl, unsigned long rank);
+size_t m_zslMemUsage(const m_zskiplist *zsl);
\ No newline at end of file
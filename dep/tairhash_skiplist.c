@@ -18,9 +18,11 @@ tairhash_zskiplist *tairhash_zslCreate(void) {
 
     zsl = (tairhash_zskiplist *)RedisModule_Alloc(sizeof(*zsl));
     zsl->length = 0;
+    zsl->level_sum = 0;
     zsl->level = 1;
-    zsl->header = tairhash_zslCreateNode(TAIRHASH_ZSKIPLIST_MAXLEVEL, NULL, 0, NULL);
-    for (int j = 0; j < TAIRHASH_ZSKIPLIST_MAXLEVEL; j++) {
+    zsl->header_level = TAIRHASH_ZSKIPLIST_INITLEVEL;
+    zsl->header = tairhash_zslCreateNode(zsl->header_level, NULL, 0, NULL);
+    for (int j = 0; j < zsl->header_level; j++) {
         zsl->header->level[j].forward = NULL;
         zsl->header->level[j].span = 0;
     }
@@ -59,6 +61,21 @@ int tairhash_zslRandomLevel(void) {
     return (level < TAIRHASH_ZSKIPLIST_MAXLEVEL) ? level : TAIRHASH_ZSKIPLIST_MAXLEVEL;
 }
 
+/* Same as m_zslGrowHeader(). */
+static void tairhash_zslGrowHeader(tairhash_zskiplist *zsl, int level) {
+    int header_level = zsl->header_level;
+
+    if (level <= header_level) return;
+    while (header_level < level) header_level *= 2;
+    if (header_level > TAIRHASH_ZSKIPLIST_MAXLEVEL) header_level = TAIRHASH_ZSKIPLIST_MAXLEVEL;
+    zsl->header = RedisModule_Realloc(zsl->header, sizeof(*zsl->header) + header_level * sizeof(struct tairhash_zskiplistLevel));
+    for (int j = zsl->header_level; j < header_level; j++) {
+        zsl->header->level[j].forward = NULL;
+        zsl->header->level[j].span = 0;
+    }
+    zsl->header_level = header_level;
+}
+
 tairhash_zskiplistNode *tairhash_zslGetNode(tairhash_zskiplist *zsl, RedisModuleString *key_min, long long expire_min) {
     tairhash_zskiplistNode *x;
 
@@ -76,6 +93,10 @@ tairhash_zskiplistNode *tairhash_zslInsertNode(tairhash_zskiplist *zsl, Slab *sl
     uint32_t rank[TAIRHASH_ZSKIPLIST_MAXLEVEL];
     int i, level;
 
+    /* The header may move when it grows, pick the level before walking. */
+    level = tairhash_zslRandomLevel();
+    tairhash_zslGrowHeader(zsl, level);
+
     x = zsl->header;
     for (i = zsl->level - 1; i >= 0; i--) {
         rank[i] = i == (zsl->level - 1) ? 0 : rank[i + 1];
@@ -86,7 +107,6 @@ tairhash_zskiplistNode *tairhash_zslInsertNode(tairhash_zskiplist *zsl, Slab *sl
         update[i] = x;
     }
 
-    level = tairhash_zslRandomLevel();
     if (level > zsl->level) {
         for (i = zsl->level; i < level; i++) {
             rank[i] = 0;
@@ -116,6 +136,7 @@ tairhash_zskiplistNode *tairhash_zslInsertNode(tairhash_zskiplist *zsl, Slab *sl
     else
         zsl->tail = x;
     zsl->length++;
+    zsl->level_sum += level;
     return x;
 }
 
@@ -124,6 +145,7 @@ void tairhash_zslDeleteNode(tairhash_zskiplist *zsl, tairhash_zskiplistNode *x,
         if (update[i]->level[i].forward == x) {
             update[i]->level[i].span += x->level[i].span - 1;
             update[i]->level[i].forward = x->level[i].forward;
+            zsl->level_sum--;
         } else {
             update[i]->level[i].span -= 1;
         }
@@ -221,4 +243,61 @@ unsigned int tairhash_zslDeleteRangeByRank(tairhash_zskiplist *zsl, unsigned int
         x = next;
     }
     return removed;
-}
\ No newline at end of file
+}
+/* Same as m_zslDefrag(), the slabs hanging from the nodes are relocated
+ * together with the nodes. */
+unsigned long tairhash_zslDefrag(RedisModuleDefragCtx *ctx, tairhash_zskiplist *zsl, unsigned long rank) {
+    tairhash_zskiplistNode *update[TAIRHASH_ZSKIPLIST_MAXLEVEL], *x, *newx;
+    Slab *newslab;
+    unsigned long traversed = 0;
+    int i;
+
+    if (rank == 0 && (newx = RedisModule_DefragAlloc(ctx, zsl->header)) != NULL) {
+        zsl->header = newx;
+    }
+
+    x = zsl->header;
+    for (i = zsl->level - 1; i >= 0; i--) {
+        while (x->level[i].forward && (traversed + x->level[i].span) <= rank) {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    while (x) {
+        newx = RedisModule_DefragAlloc(ctx, x);
+        for (i = 0; i < zsl->level && update[i]->level[i].forward == x; i++) {
+            if (newx) update[i]->level[i].forward = newx;
+            update[i] = newx ? newx : x;
+        }
+        if (newx) {
+            if (newx->level[0].forward) {
+                newx->level[0].forward->backward = newx;
+            } else {
+                zsl->tail = newx;
+            }
+            x = newx;
+        }
+        if (x->slab && (newslab = RedisModule_DefragAlloc(ctx, x->slab)) != NULL) {
+            x->slab = newslab;
+        }
+
+        x = x->level[0].forward;
+        if (++traversed % 16 == 0 && x && RedisModule_DefragShouldStop(ctx)) {
+            return traversed;
+        }
+    }
+    return 0;
+}
+
+/* Bytes used by the skiplist and the slabs hanging from its nodes, the
+ * fields referenced by the slabs are not included. */
+size_t tairhash_zslMemUsage(const tairhash_zskiplist *zsl) {
+    size_t size = sizeof(*zsl);
+    size += sizeof(tairhash_zskiplistNode) + zsl->header_level * sizeof(struct tairhash_zskiplistLevel);
+    size += zsl->length * (sizeof(tairhash_zskiplistNode) + sizeof(Slab));
+    size += zsl->level_sum * sizeof(struct tairhash_zskiplistLevel);
+    return size;
+}
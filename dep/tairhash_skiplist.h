@@ -8,6 +8,7 @@
 
 #define TAIRHASH_ZSKIPLIST_MAXLEVEL 64 /* Should be enough for 2^64 elements */
 #define TAIRHASH_ZSKIPLIST_P 0.25      /* Skiplist P = 1/4 */
+#define TAIRHASH_ZSKIPLIST_INITLEVEL 4 /* Header levels allocated up front, grown on demand */
 typedef struct tairhash_zskiplistNode {
     Slab *slab;
     long long expire_min;
@@ -23,6 +24,8 @@ typedef struct tairhash_zskiplist {
     struct tairhash_zskiplistNode *header, *tail;
     unsigned long length;
     int level;
+    int header_level; /* Levels allocated in the header, >= level. */
+    unsigned long level_sum; /* Levels of all the nodes, the header excluded. */
 } tairhash_zskiplist;
 
 tairhash_zskiplist *tairhash_zslCreate(void);
@@ -32,4 +35,6 @@ tairhash_zskiplistNode *tairhash_zslUpdateNode(tairhash_zskiplist *zsl, RedisMod
 int tairhash_zslDelete(tairhash_zskiplist *zsl, RedisModuleString *key, long long expire);
 void tairhash_zslFree(tairhash_zskiplist *zsl);
 unsigned int tairhash_zslDeleteRangeByRank(tairhash_zskiplist *zsl, unsigned int start, unsigned int end);
+unsigned long tairhash_zslDefrag(RedisModuleDefragCtx *ctx, tairhash_zskiplist *zsl, unsigned long rank);
+size_t tairhash_zslMemUsage(const tairhash_zskiplist *zsl);
 #endif
\ No newline at end of file
@@ -19,12 +19,14 @@
 
 extern ExpireAlgorithm g_expire_algorithm;
 extern RedisModuleType *TairHashType;
+long long *g_scan_cursor; /* Allocated on load, g_db_num entries. */
 
 void insert(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *obj, RedisModuleString *field, long long expire) {
     REDISMODULE_NOT_USED(ctx);
     REDISMODULE_NOT_USED(dbid);
     REDISMODULE_NOT_USED(key);
     if (expire) {
+        createExpireIndexIfNeeded(obj);
         m_zslInsert(obj->expire_index, expire, takeAndRef(field));
     }
 }
@@ -44,6 +46,7 @@ void delete(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *
     REDISMODULE_NOT_USED(key);
     if (cur_expire != 0) {
         m_zslDelete(obj->expire_index, cur_expire, field, NULL);
+        releaseExpireIndexIfEmpty(obj);
     }
 }
 
@@ -59,13 +62,10 @@ void activeExpire(RedisModuleCtx *ctx, int dbid, uint64_t keys_per_loop) {
     long long when, now;
     unsigned long zsl_len;
 
-    long long start = RedisModule_Milliseconds();
-
     list *keys = m_listCreate();
     /* Each db has its own cursor, but this value may be wrong when swapdb appears (because we do not have a callback notification),
      * But this will not cause serious problems. */
-    static long long scan_cursor[DB_NUM] = {0};
-    RedisModuleCallReply *reply = RedisModule_Call(ctx, "SCAN", "lcl", scan_cursor[dbid], "COUNT", g_expire_algorithm.keys_per_active_loop);
+    RedisModuleCallReply *reply = RedisModule_Call(ctx, "SCAN", "lcl", g_scan_cursor[dbid], "COUNT", g_expire_algorithm.keys_per_active_loop);
     if (reply != NULL) {
         switch (RedisModule_CallReplyType(reply)) {
             case REDISMODULE_REPLY_ARRAY: {
@@ -73,7 +73,7 @@ void activeExpire(RedisModuleCtx *ctx, int dbid, uint64_t keys_per_loop) {
 
                 RedisModuleCallReply *cursor_reply = RedisModule_CallReplyArrayElement(reply, 0);
                 Module_Assert(RedisModule_CallReplyType(cursor_reply) == REDISMODULE_REPLY_STRING);
-                Module_Assert(RedisModule_StringToLongLong(RedisModule_CreateStringFromCallReply(cursor_reply), &scan_cursor[dbid]) == REDISMODULE_OK);
+                Module_Assert(RedisModule_StringToLongLong(RedisModule_CreateStringFromCallReply(cursor_reply), &g_scan_cursor[dbid]) == REDISMODULE_OK);
 
                 RedisModuleCallReply *keys_reply = RedisModule_CallReplyArrayElement(reply, 1);
                 Module_Assert(RedisModule_CallReplyType(keys_reply) == REDISMODULE_REPLY_ARRAY);
@@ -85,6 +85,7 @@ void activeExpire(RedisModuleCtx *ctx, int dbid, uint64_t keys_per_loop) {
                     Module_Assert(RedisModule_CallReplyType(key_reply) == REDISMODULE_REPLY_STRING);
                     key = RedisModule_CreateStringFromCallReply(key_reply);
                     real_key = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_OPEN_KEY_NOTOUCH);
+                    g_expire_algorithm.stat_active_keys_visited++;
                     /* Since RedisModule_KeyType does not deal with the stream type, it is possible to
                        return REDISMODULE_KEYTYPE_EMPTY here, so we must deal with it until after this
                        bugfix: https://github.com/redis/redis/commit/1833d008b3af8628835b5f082c5b4b1359557893 */
@@ -93,7 +94,7 @@ void activeExpire(RedisModuleCtx *ctx, int dbid, uint64_t keys_per_loop) {
                     }
                     if (RedisModule_ModuleTypeGetType(real_key) == TairHashType) {
                         tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
-                        if (tair_hash_obj->expire_index->length > 0) {
+                        if (expireIndexLength(tair_hash_obj) > 0) {
                             m_listAddNodeTail(keys, key);
                         }
                     }
@@ -129,13 +130,14 @@ void activeExpire(RedisModuleCtx *ctx, int dbid, uint64_t keys_per_loop) {
 
         tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
 
-        zsl_len = tair_hash_obj->expire_index->length;
+        zsl_len = expireIndexLength(tair_hash_obj);
         Module_Assert(zsl_len > 0);
 
         ln2 = tair_hash_obj->expire_index->header->level[0].forward;
         start_index = 0;
         while (ln2 && expire_keys_per_loop) {
             field = ln2->member;
+            g_expire_algorithm.stat_active_fields_examined++;
             if (fieldExpireIfNeeded(ctx, dbid, key, tair_hash_obj, field, 1)) {
                 g_expire_algorithm.stat_active_expired_field[dbid]++;
                 start_index++;
@@ -148,6 +150,7 @@ void activeExpire(RedisModuleCtx *ctx, int dbid, uint64_t keys_per_loop) {
 
         if (start_index) {
             m_zslDeleteRangeByRank(tair_hash_obj->expire_index, 1, start_index);
+            releaseExpireIndexIfEmpty(tair_hash_obj);
             delEmptyTairHashIfNeeded(ctx, real_key, key, tair_hash_obj);
         }
         m_listDelNode(keys, node);
@@ -155,70 +158,47 @@ void activeExpire(RedisModuleCtx *ctx, int dbid, uint64_t keys_per_loop) {
     m_listRelease(keys);
 }
 
-void passiveExpire(RedisModuleCtx *ctx, int dbid, RedisModuleString *key) {
-    tairHashObj *tair_hash_obj = NULL;
-    long long when, now;
-    int start_index = 0;
-    m_zskiplistNode *ln = NULL;
-
-    RedisModuleString *field;
-    RedisModuleKey *real_key;
-    unsigned long zsl_len;
-    /* 1. The current db does not have a key that needs to expire. */
-    list *keys = m_listCreate();
-
-    real_key = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
-    if (RedisModule_KeyType(real_key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(real_key) == TairHashType) {
-        tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
-        if (tair_hash_obj->expire_index->length > 0) {
-            m_listAddNodeTail(keys, key);
-        }
+/* The earliest expire of the key is the head of its index, nothing is due
+ * while it is in the future. */
+int passiveExpireDue(int dbid, RedisModuleKey *real_key) {
+    REDISMODULE_NOT_USED(dbid);
+    if (RedisModule_KeyType(real_key) == REDISMODULE_KEYTYPE_EMPTY || RedisModule_ModuleTypeGetType(real_key) != TairHashType) {
+        return 0;
+    }
+    tairHashObj *tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
+    if (tair_hash_obj->expire_index == NULL) {
+        return 0;
     }
-    RedisModule_CloseKey(real_key);
+    m_zskiplistNode *ln = tair_hash_obj->expire_index->header->level[0].forward;
+    return ln && ln->score <= expireClockNow();
+}
 
-    if (listLength(keys) == 0) {
-        m_listRelease(keys);
-        return;
+RedisModuleKey *passiveExpire(RedisModuleCtx *ctx, int dbid, RedisModuleKey *real_key, RedisModuleString *key) {
+    if (RedisModule_KeyType(real_key) == REDISMODULE_KEYTYPE_EMPTY || RedisModule_ModuleTypeGetType(real_key) != TairHashType) {
+        return real_key;
     }
 
-    /* 3. Delete expired field. */
+    tairHashObj *tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
     int keys_per_loop = g_expire_algorithm.keys_per_passive_loop;
-    m_listNode *node;
-    while ((node = listFirst(keys)) != NULL) {
-        key = listNodeValue(node);
-        real_key = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
-        int type = RedisModule_KeyType(real_key);
-
-        Module_Assert(type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(real_key) == TairHashType);
-        tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
-
-        zsl_len = tair_hash_obj->expire_index->length;
-        Module_Assert(zsl_len > 0);
-
-        start_index = 0;
-        ln = tair_hash_obj->expire_index->header->level[0].forward;
-        while (ln && keys_per_loop) {
-            field = ln->member;
-            if (fieldExpireIfNeeded(ctx, dbid, key, tair_hash_obj, field, 0)) {
-                g_expire_algorithm.stat_passive_expired_field[dbid]++;
-                start_index++;
-                keys_per_loop--;
-            } else {
-                break;
-            }
-            ln = ln->level[0].forward;
-        }
-
-        if (start_index) {
-            m_zslDeleteRangeByRank(tair_hash_obj->expire_index, 1, start_index);
-            if (!delEmptyTairHashIfNeeded(ctx, real_key, key, tair_hash_obj)) {
-                RedisModule_CloseKey(real_key);
-            }
+    int expired = 0;
+    m_zskiplistNode *ln;
+
+    /* Outside the timer an expired field is removed from the index right
+     * away, so we always look at the first node. */
+    while (keys_per_loop && tair_hash_obj->expire_index && (ln = tair_hash_obj->expire_index->header->level[0].forward)) {
+        if (!fieldExpireIfNeeded(ctx, dbid, key, tair_hash_obj, ln->member, 0)) {
+            break;
         }
-        m_listDelNode(keys, node);
+        g_expire_algorithm.stat_passive_expired_field[dbid]++;
+        expired++;
+        keys_per_loop--;
     }
 
-    m_listRelease(keys);
+    if (expired && delEmptyTairHashIfNeeded(ctx, real_key, key, tair_hash_obj)) {
+        /* The handle was closed along with the key. */
+        real_key = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_WRITE);
+    }
+    return real_key;
 }
 
 void deleteAndPropagate(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *obj, RedisModuleString *field, long long expire, int is_timer) {
@@ -229,7 +209,7 @@ void deleteAndPropagate(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, t
         */
         RedisModuleCtx *ctx2 = RedisModule_GetThreadSafeContext(NULL);
         RedisModule_SelectDb(ctx2, dbid);
-        notifyFieldSpaceEvent("expired", key, field, dbid);
+        notifyFieldSpaceEvent("expired", key, field, m_segDictFetchValue(obj->hash, field), dbid);
         RedisModuleCallReply *reply = RedisModule_Call(ctx2, "EXHDELREPL", "ss!", key, field);
         if (reply != NULL) {
             RedisModule_FreeCallReply(reply);
@@ -239,9 +219,10 @@ void deleteAndPropagate(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, t
         RedisModuleString *key_dup = RedisModule_CreateStringFromString(NULL, key);
         RedisModuleString *field_dup = RedisModule_CreateStringFromString(NULL, field);
         m_zslDelete(obj->expire_index, expire, field_dup, NULL);
-        m_dictDelete(obj->hash, field);
+        releaseExpireIndexIfEmpty(obj);
+        notifyFieldSpaceEvent("expired", key_dup, field_dup, m_segDictFetchValue(obj->hash, field_dup), dbid);
+        delTairHashField(obj, field_dup);
         RedisModule_Replicate(ctx, "EXHDEL", "ss", key_dup, field_dup);
-        notifyFieldSpaceEvent("expired", key_dup, field_dup, dbid);
         RedisModule_FreeString(NULL, key_dup);
         RedisModule_FreeString(NULL, field_dup);
     }
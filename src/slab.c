@@ -20,6 +20,9 @@
 
 #include "util.h"
 
+/* Number of slabs currently allocated. */
+static long long slab_stat_slabs = 0;
+
 /* create slab */
 Slab *slab_createNode(void) {
     Slab *slab = (Slab *)RedisModule_Alloc(sizeof(Slab));
@@ -28,6 +31,7 @@ Slab *slab_createNode(void) {
         slab->expires[i] = 0;
     }
     slab->num_keys = 0;
+    slab_stat_slabs++;
 
     return slab;
 }
@@ -100,6 +104,7 @@ void slab_delete(Slab *slab) {
         RedisModule_FreeString(NULL, slab->keys[i]);
     }
     RedisModule_Free(slab);
+    slab_stat_slabs--;
 }
 
 /* get the smallest element ssubscript */
@@ -131,4 +136,15 @@ inline void slab_swap(Slab *slab, int left, int right) {
     slab->expires[left] = slab->expires[right], slab->keys[left] = slab->keys[right];
     slab->expires[right] = temp_expire, slab->keys[right] = temp_key;
     return;
-}
\ No newline at end of file
+}
+
+/* free slab without its keys, which have been moved to another slab */
+void slab_release(Slab *slab) {
+    if (slab == NULL) return;
+    RedisModule_Free(slab);
+    slab_stat_slabs--;
+}
+
+long long slab_getStatSlabs(void) {
+    return slab_stat_slabs;
+}
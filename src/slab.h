@@ -40,4 +40,6 @@ void slab_delete(Slab *slab);
 int slab_minExpireTimeIndex(Slab *slab);
 int slab_getExpiredKeyIndices(Slab *slab, long long target_ttl, int *out_indices);
 void slab_swap(Slab *slab, int left, int right);
+void slab_release(Slab *slab);
+long long slab_getStatSlabs(void);
 #endif
\ No newline at end of file
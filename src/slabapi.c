@@ -27,6 +27,9 @@
 #include "tairhash_skiplist.h"
 
 #define RELAXATION 10
+
+static unsigned long long slab_stat_splits = 0;
+static unsigned long long slab_stat_merges = 0;
 #ifdef __AVX2__
 __m256i shuffle_timeout_mask_4x64[16], shuffle_ontime_mask_4x64[16];
 #endif
@@ -101,7 +104,8 @@ void slab_mergeIfNeed(tairhash_zskiplist *zsl, tairhash_zskiplistNode *tair_hash
             memcpy(&(cur_slab->expires[cur_slab->num_keys]), &(next_slab->expires[0]), next_slab->num_keys * sizeof(&(cur_slab->expires[0])));
             memcpy(&(cur_slab->keys[cur_slab->num_keys]), &(next_slab->keys[0]), next_slab->num_keys * sizeof(&(cur_slab->keys[0])));
             cur_slab->num_keys = merge_sum;
-            RedisModule_Free(next_slab);
+            slab_release(next_slab);
+            slab_stat_merges++;
             int delete_ans = tairhash_zslDelete(zsl, next_tair_hash_node->key_min, next_tair_hash_node->expire_min);
             assert(delete_ans == 1);
         }
@@ -115,7 +119,8 @@ void slab_mergeIfNeed(tairhash_zskiplist *zsl, tairhash_zskiplistNode *tair_hash
             memcpy(&(cur_slab->keys[cur_slab->num_keys]), &(pre_slab->keys[0]), pre_slab->num_keys * sizeof(cur_slab->keys[0]));
             cur_slab->num_keys = merge_sum;
             tair_hash_node->expire_min = pre_tair_hash_node->expire_min, tair_hash_node->key_min = pre_tair_hash_node->key_min;
-            RedisModule_Free(pre_slab);
+            slab_release(pre_slab);
+            slab_stat_merges++;
             int delete_ans = tairhash_zslDelete(zsl, pre_tair_hash_node->key_min, pre_tair_hash_node->expire_min);
             assert(delete_ans == 1);
         }
@@ -145,6 +150,7 @@ tairhash_zskiplistNode *slab_split(tairhash_zskiplist *zsl, tairhash_zskiplistNo
     memcpy(&(new_slab->expires[0]), &(slab->expires[split_subscript]), (SLABMAXN - split_subscript) * sizeof(&(slab->expires[0])));
     memcpy(&(new_slab->keys[0]), &(slab->keys[split_subscript]), (SLABMAXN - split_subscript) * sizeof(&(slab->keys[0])));
     slab->num_keys = split_subscript, new_slab->num_keys = SLABMAXN - split_subscript;
+    slab_stat_splits++;
 
     long long new_expire_min = new_slab->expires[0];
     RedisModuleString *new_key_min = new_slab->keys[0];
@@ -259,6 +265,16 @@ void slab_deleteSlabExpire(tairhash_zskiplist *zsl, tairhash_zskiplistNode *zsl_
         return;
     }
     int index = 0, min_index = 0, i;
+    /* The timed out keys are dropped from the slab, release their references. */
+    char effective[SLABMAXN] = {0};
+    for (i = 0; i < effective_num; i++) {
+        effective[effective_indexs[i]] = 1;
+    }
+    for (i = 0; i < slab->num_keys; i++) {
+        if (!effective[i]) {
+            RedisModule_FreeString(NULL, slab->keys[i]);
+        }
+    }
     for (i = 0; i < effective_num; i++) {
         index = effective_indexs[i];
         slab->expires[i] = slab->expires[index];
@@ -274,12 +290,34 @@ void slab_deleteSlabExpire(tairhash_zskiplist *zsl, tairhash_zskiplistNode *zsl_
 }
 
 unsigned int slab_deleteTairhashRangeByRank(tairhash_zskiplist *zsl, unsigned int start, unsigned int end) {
+    /* The skiplist only frees its nodes, the slabs hanging from them go first. */
+    tairhash_zskiplistNode *x = zsl->header->level[0].forward;
+    for (unsigned int rank = 1; x && rank <= end; rank++, x = x->level[0].forward) {
+        if (rank >= start) {
+            slab_delete(x->slab);
+            x->slab = NULL;
+        }
+    }
     return tairhash_zslDeleteRangeByRank(zsl, start, end);
 }
 
+unsigned long long slab_getStatSplits(void) {
+    return slab_stat_splits;
+}
+
+unsigned long long slab_getStatMerges(void) {
+    return slab_stat_merges;
+}
+
 #ifdef __AVX2__
-int slab_getSlabTimeoutExpireIndex(tairhash_zskiplistNode *node, int *ontime_indices, int *timeout_indices) {
-    long long now = RedisModule_Milliseconds();
+/* The offsets are computed in 64 bit lanes, the index arrays are int, so pack
+ * the low halves and store exactly four indices. */
+static inline void slab_storeIndices(int *indices, __m256i offsets) {
+    __m256i packed = _mm256_permutevar8x32_epi32(offsets, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+    _mm_storeu_si128((__m128i *)indices, _mm256_castsi256_si128(packed));
+}
+
+int slab_getSlabTimeoutExpireIndex(tairhash_zskiplistNode *node, int *ontime_indices, int *timeout_indices, long long now) {
     if (node == NULL || node->expire_min > now) return 0;
     Slab *slab = node->slab;
     if (slab == NULL || slab->num_keys == 0)
@@ -306,16 +344,16 @@ int slab_getSlabTimeoutExpireIndex(tairhash_zskiplistNode *node, int *ontime_ind
 
         __m256i v_a_offsets = _mm256_add_epi64(v_a_cur_i, shuffle_ontime_mask_4x64[v_a_gt_mask]);
         __m256i v_b_offsets = _mm256_add_epi64(v_b_cur_i, shuffle_ontime_mask_4x64[v_b_gt_mask]);
-        _mm256_storeu_si256((__m256i *)(ontime_indices + ontime_num), v_a_offsets);
+        slab_storeIndices(ontime_indices + ontime_num, v_a_offsets);
         ontime_num += _mm_popcnt_u64((unsigned)v_a_gt_mask);
-        _mm256_storeu_si256((__m256i *)(ontime_indices + ontime_num), v_b_offsets);
+        slab_storeIndices(ontime_indices + ontime_num, v_b_offsets);
         ontime_num += _mm_popcnt_u64((unsigned)v_b_gt_mask);
 
         v_a_offsets = _mm256_add_epi64(v_a_cur_i, shuffle_timeout_mask_4x64[v_a_gt_mask]);
         v_b_offsets = _mm256_add_epi64(v_b_cur_i, shuffle_timeout_mask_4x64[v_b_gt_mask]);
-        _mm256_storeu_si256((__m256i *)(timeout_indices + timeout_num), v_a_offsets);
+        slab_storeIndices(timeout_indices + timeout_num, v_a_offsets);
         timeout_num += width - _mm_popcnt_u64((unsigned)v_a_gt_mask);
-        _mm256_storeu_si256((__m256i *)(timeout_indices + timeout_num), v_b_offsets);
+        slab_storeIndices(timeout_indices + timeout_num, v_b_offsets);
         timeout_num += width - _mm_popcnt_u64((unsigned)v_b_gt_mask);
     }
     for (; i < size; ++i) {
@@ -372,8 +410,7 @@ void slab_initShuffleMask() {
 
 #else
 
-int slab_getSlabTimeoutExpireIndex(tairhash_zskiplistNode *node, int *ontime_indices, int *timeout_indices) {
-    long long now = RedisModule_Milliseconds();
+int slab_getSlabTimeoutExpireIndex(tairhash_zskiplistNode *node, int *ontime_indices, int *timeout_indices, long long now) {
     if (node == NULL || node->expire_min > now) return 0;
     Slab *slab = node->slab;
     if (slab == NULL || slab->num_keys == 0)
@@ -31,7 +31,9 @@ void slab_expireUpdate(tairhash_zskiplist *zsl, RedisModuleString *cur_key, long
 int slab_expireGet(tairhash_zskiplist *zsl, RedisModuleString *key, long long expire);
 void slab_free(tairhash_zskiplist *zsl);
 tairhash_zskiplist *slab_create();
-int slab_getSlabTimeoutExpireIndex(tairhash_zskiplistNode *node, int *ontime_indices, int *timeout_indices);
+int slab_getSlabTimeoutExpireIndex(tairhash_zskiplistNode *node, int *ontime_indices, int *timeout_indices, long long now);
 void slab_deleteSlabExpire(tairhash_zskiplist *zsl, tairhash_zskiplistNode *zsl_node, int *effective_indexs, int effective_num);
 unsigned int slab_deleteTairhashRangeByRank(tairhash_zskiplist *zsl, unsigned int start, unsigned int end);
+unsigned long long slab_getStatSplits(void);
+unsigned long long slab_getStatMerges(void);
 #endif
@@ -32,6 +32,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "histogram.h"
 #include "scan_algorithm.h"
 #include "slab_algorithm.h"
 #include "sort_algorithm.h"
@@ -42,30 +43,174 @@ static int redis_major_ver = 0;
 static int redis_minor_ver = 0;
 static int redis_patch_ver = 0;
 
+/* The `databases` of the server, read at load. */
+int g_db_num = TAIR_HASH_DEFAULT_DB_NUM;
+
 #if defined(SORT_MODE) || defined(SLAB_MODE)
-m_zskiplist *g_expire_index[DB_NUM];
+/* Created with the first expiring key of a db. */
+expireDb **g_expire_index;
+/* Partitions of the global index of a db: the hash slots in cluster mode,
+ * a single one otherwise. */
+unsigned int g_expire_slots = 1;
 #endif
 
 RedisModuleTimerID g_expire_timer_id;
 ExpireAlgorithm g_expire_algorithm;
 
+/* Values at least this long are stored LZF compressed, 0 disables it. */
+static long long g_compress_threshold = 0;
+
+typedef struct compressStat {
+    uint64_t attempts;   /* Values long enough to try. */
+    uint64_t compressed; /* Values that did shrink enough. */
+    uint64_t bytes_in;   /* Bytes of the compressed values... */
+    uint64_t bytes_out;  /* ...and what they take once compressed. */
+    uint64_t compress_usec;
+    uint64_t decompressed;
+    uint64_t decompress_usec;
+} compressStat;
+static compressStat g_compress_stat;
+
+/* Expired events carry the value and version of the field along with its
+ * name, see fieldEventPayload(). */
+static int g_expired_event_payload = 0;
+
+/* Values left unread this many seconds move to the cold store, 0 disables
+ * it. The store is created in cold_tier_dir by the first sweep. */
+static long long g_cold_idle_time = 0;
+static char *g_cold_dir = NULL;
+coldStore *g_cold_store = NULL;
+static int g_cold_timer_running = 0;
+static long long *g_cold_scan_cursor; /* g_db_num entries. */
+static int g_cold_db = 0;
+static int g_fork_child_event = 0; /* Subscribed to the fork child events. */
+
+typedef struct coldStat {
+    uint64_t fields; /* Values in the cold store, updated atomically. */
+    uint64_t frozen; /* Values moved to the store... */
+    uint64_t thawed; /* ...and back in memory by a read. */
+    uint64_t errors; /* Values kept in memory for want of room on disk. */
+} coldStat;
+static coldStat g_cold_stat;
+
+/* All the commands of the module: name, handler, flags, first key, last key
+ * and key step. Every command is registered through a wrapper recording its
+ * latency, see Module_CreateCommands(). */
+#define TAIRHASH_COMMAND_TABLE(X)                                                          \
+    /* write cmds */                                                                       \
+    X(exhset, TairHashTypeHset_RedisCommand, "write deny-oom", 1, 1, 1)                    \
+    X(exhdel, TairHashTypeHdel_RedisCommand, "write deny-oom", 1, 1, 1)                    \
+    X(exhdelrepl, TairHashTypeHdelRepl_RedisCommand, "write deny-oom", 1, 1, 1)            \
+    X(exhdelwithver, TairHashTypeHdelWithVer_RedisCommand, "write deny-oom", 1, 1, 1)      \
+    X(exhincrby, TairHashTypeHincrBy_RedisCommand, "write deny-oom", 1, 1, 1)              \
+    X(exhincrbyfloat, TairHashTypeHincrByFloat_RedisCommand, "write deny-oom", 1, 1, 1)    \
+    X(exhappend, TairHashTypeHappend_RedisCommand, "write deny-oom", 1, 1, 1)              \
+    X(exhsetrange, TairHashTypeHsetRange_RedisCommand, "write deny-oom", 1, 1, 1)          \
+    X(exhsetnx, TairHashTypeHsetNx_RedisCommand, "write deny-oom", 1, 1, 1)                \
+    X(exhmset, TairHashTypeHmset_RedisCommand, "write deny-oom", 1, 1, 1)                  \
+    X(exhmsetwithopts, TairHashTypeHmsetWithOpts_RedisCommand, "write deny-oom", 1, 1, 1)  \
+    X(exhsetver, TairHashTypeHsetVer_RedisCommand, "write deny-oom", 1, 1, 1)              \
+    X(exhexpire, TairHashTypeHexpire_RedisCommand, "write deny-oom", 1, 1, 1)              \
+    X(exhexpireat, TairHashTypeHexpireAt_RedisCommand, "write deny-oom", 1, 1, 1)          \
+    X(exhpexpire, TairHashTypeHpexpire_RedisCommand, "write deny-oom", 1, 1, 1)            \
+    X(exhpexpireat, TairHashTypeHpexpireAt_RedisCommand, "write deny-oom", 1, 1, 1)        \
+    X(exhpersist, TairHashTypeHpersist_RedisCommand, "write deny-oom", 1, 1, 1)            \
+    X(exhimport, TairHashTypeImport_RedisCommand, "write deny-oom", 1, 1, 1)               \
+    X(exhlexindex, TairHashTypeLexIndex_RedisCommand, "write deny-oom", 1, 1, 1)           \
+    /* readonly cmds */                                                                    \
+    X(exhget, TairHashTypeHget_RedisCommand, "readonly fast", 1, 1, 1)                     \
+    X(exhlen, TairHashTypeHlen_RedisCommand, "readonly fast", 1, 1, 1)                     \
+    X(exhexists, TairHashTypeHexists_RedisCommand, "readonly fast", 1, 1, 1)               \
+    X(exhstrlen, TairHashTypeHstrlen_RedisCommand, "readonly fast", 1, 1, 1)               \
+    X(exhkeys, TairHashTypeHkeys_RedisCommand, "readonly fast", 1, 1, 1)                   \
+    X(exhvals, TairHashTypeHvals_RedisCommand, "readonly fast", 1, 1, 1)                   \
+    X(exhgetall, TairHashTypeHgetAll_RedisCommand, "readonly fast", 1, 1, 1)               \
+    X(exhgetallwithver, TairHashTypeHgetAllWithVer_RedisCommand, "readonly fast", 1, 1, 1) \
+    X(exhmget, TairHashTypeHmget_RedisCommand, "readonly fast", 1, 1, 1)                   \
+    X(exhmgetwithver, TairHashTypeHmgetWithVer_RedisCommand, "readonly fast", 1, 1, 1)     \
+    X(exhscan, TairHashTypeHscan_RedisCommand, "readonly fast", 1, 1, 1)                   \
+    X(exhrangebylex, TairHashTypeHrangeByLex_RedisCommand, "readonly", 1, 1, 1)            \
+    X(exhexport, TairHashTypeExport_RedisCommand, "readonly", 1, 1, 1)                     \
+    X(exhver, TairHashTypeHver_RedisCommand, "readonly fast", 1, 1, 1)                     \
+    X(exhttl, TairHashTypeHttl_RedisCommand, "readonly fast", 1, 1, 1)                     \
+    X(exhpttl, TairHashTypeHpttl_RedisCommand, "readonly fast", 1, 1, 1)                   \
+    X(exhgetwithver, TairHashTypeHgetWithVer_RedisCommand, "readonly fast", 1, 1, 1)       \
+    X(exhexpireinfo, TairHashTypeActiveExpireInfo_RedisCommand, "readonly fast", 0, 0, 0)  \
+    X(exhlatencyreset, TairHashTypeLatencyReset_RedisCommand, "admin fast", 0, 0, 0)    \
+    X(exhdebug, TairHashTypeDebug_RedisCommand, "readonly", 0, 0, 0)                    \
+    X(exhexpiretrace, TairHashTypeExpireTrace_RedisCommand, "admin", 0, 0, 0)
+
+#define TAIRHASH_CMD_ENUM(name, func, flags, firstkey, lastkey, keystep) TAIRHASH_CMD_##name,
+#define TAIRHASH_CMD_NAME(name, func, flags, firstkey, lastkey, keystep) #name,
+enum { TAIRHASH_COMMAND_TABLE(TAIRHASH_CMD_ENUM) TAIRHASH_CMD_NUM };
+static const char *g_cmd_names[TAIRHASH_CMD_NUM] = {TAIRHASH_COMMAND_TABLE(TAIRHASH_CMD_NAME)};
+
+/* Latency histograms in microseconds. */
+static m_histogram g_cmd_latency[TAIRHASH_CMD_NUM];
+static m_histogram g_active_expire_latency;
+static m_histogram g_passive_expire_latency;
+/* Per db delay in milliseconds between the expire time of a field and its
+ * deletion. */
+static m_histogram *g_expire_lag;
+
+/* Ring buffer of the recent active expire passes, one entry per db visited
+ * by a cycle. */
+#define TAIRHASH_EXPIRE_TRACE_LEN 128
+typedef struct expireTraceEntry {
+    uint64_t id;
+    long long start_msec;
+    uint64_t duration_usec;
+    int dbid;
+    uint64_t keys_visited;
+    uint64_t fields_expired;
+    uint64_t notifications;
+    uint64_t repl_bytes;
+} expireTraceEntry;
+static expireTraceEntry g_expire_trace[TAIRHASH_EXPIRE_TRACE_LEN];
+static uint64_t g_expire_trace_next_id = 0;
+static uint64_t g_expire_trace_len = 0;
+
+static inline uint64_t latencyNowUsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 void _moduleAssert(const char *estr, const char *file, int line) {
     fprintf(stderr, "=== ASSERTION FAILED ===");
     fprintf(stderr, "==> %s:%d '%s' is not true", file, line, estr);
     *((char *)-1) = 'x';
 }
 
+/* Seconds clock of TairHashVal.atime. */
+uint32_t coldClock(void) {
+    return (uint32_t)(expireClockNow() / 1000);
+}
+
 inline struct TairHashVal *createTairHashVal(void) {
     struct TairHashVal *o;
     o = RedisModule_Calloc(1, sizeof(*o));
+    o->atime = coldClock();
     return o;
 }
 
+/* Free what holds the value, in memory or in the cold store. May run in the
+ * lazyfree thread. */
+void tairHashValDrop(TairHashVal *val) {
+    if (val->cold) {
+        m_coldStoreFree(g_cold_store, val->cold_offset);
+        __atomic_sub_fetch(&g_cold_stat.fields, 1, __ATOMIC_RELAXED);
+        val->cold = 0;
+    } else if (val->value) {
+        RedisModule_FreeString(NULL, val->value);
+    }
+    val->value = NULL;
+    val->owned = 0;
+}
+
 inline void tairHashValRelease(struct TairHashVal *o) {
     if (o) {
-        if (o->value) {
-            RedisModule_FreeString(NULL, o->value);
-        }
+        tairHashValDrop(o);
         RedisModule_Free(o);
     }
 }
@@ -75,16 +220,229 @@ RedisModuleString *takeAndRef(RedisModuleString *str) {
     return str;
 }
 
+/* The value as stored, maybe compressed. A cold value is read from the
+ * mapping of the cold store, the pointer is valid until the next append. */
+static const char *tairHashValStored(const TairHashVal *val, size_t *len) {
+    if (val->cold) return m_coldStoreGet(g_cold_store, val->cold_offset, len);
+    return RedisModule_StringPtrLen(val->value, len);
+}
+
+/* Store 'value' in the field, LZF compressed if it reaches the threshold and
+ * shrinks by at least 1/8, else as is with a new reference. */
+void setTairHashValValue(TairHashVal *val, RedisModuleString *value) {
+    RedisModuleString *old;
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(value, &len);
+
+    /* A value in memory may be the one passed in, it is freed last. */
+    if (val->cold) tairHashValDrop(val);
+    old = val->value;
+    val->value = NULL;
+    val->owned = 0;
+    val->encoding = TAIRHASH_VAL_RAW;
+    val->atime = coldClock();
+    if (g_compress_threshold && len >= (size_t)g_compress_threshold && len <= UINT32_MAX) {
+        uint64_t start = latencyNowUsec();
+        unsigned int outlen = (unsigned int)(len - len / 8);
+        unsigned char *buf = RedisModule_Alloc(4 + outlen);
+        unsigned int clen = m_lzfCompress(ptr, (unsigned int)len, buf + 4, outlen);
+        if (clen) {
+            for (int j = 0; j < 4; j++) buf[j] = (unsigned char)(len >> (8 * j));
+            val->value = RedisModule_CreateString(NULL, (char *)buf, 4 + clen);
+            val->encoding = TAIRHASH_VAL_LZF;
+            g_compress_stat.compressed++;
+            g_compress_stat.bytes_in += len;
+            g_compress_stat.bytes_out += 4 + clen;
+        }
+        RedisModule_Free(buf);
+        g_compress_stat.attempts++;
+        g_compress_stat.compress_usec += latencyNowUsec() - start;
+    }
+    if (val->value == NULL) {
+        val->value = takeAndRef(value);
+    }
+    if (old) {
+        RedisModule_FreeString(NULL, old);
+    }
+}
+
+/* Store 'value' as is, taking the reference of the caller. */
+void setTairHashValRaw(TairHashVal *val, RedisModuleString *value) {
+    tairHashValDrop(val);
+    val->value = value;
+    val->encoding = TAIRHASH_VAL_RAW;
+    val->atime = coldClock();
+}
+
+/* Length of the value as written by the client. */
+size_t tairHashValLen(const TairHashVal *val) {
+    size_t len;
+    const unsigned char *ptr = (const unsigned char *)tairHashValStored(val, &len);
+    if (val->encoding == TAIRHASH_VAL_RAW) return len;
+    return (size_t)ptr[0] | (size_t)ptr[1] << 8 | (size_t)ptr[2] << 16 | (size_t)ptr[3] << 24;
+}
+
+/* Decompress an LZF value into a new buffer of tairHashValLen() bytes. */
+static char *tairHashValInflate(const TairHashVal *val, size_t *len) {
+    uint64_t start = latencyNowUsec();
+    size_t clen;
+    const char *ptr = tairHashValStored(val, &clen);
+    *len = tairHashValLen(val);
+    char *buf = RedisModule_Alloc(*len ? *len : 1);
+    Module_Assert(m_lzfDecompress(ptr + 4, (unsigned int)(clen - 4), buf, (unsigned int)*len) == *len);
+    g_compress_stat.decompressed++;
+    g_compress_stat.decompress_usec += latencyNowUsec() - start;
+    return buf;
+}
+
+/* The value as written by the client, with a reference for the caller. A
+ * cold value is read but stays cold. */
+RedisModuleString *tairHashValDecode(const TairHashVal *val) {
+    size_t len;
+    if (val->encoding == TAIRHASH_VAL_RAW) {
+        if (!val->cold) return takeAndRef(val->value);
+        const char *ptr = tairHashValStored(val, &len);
+        return RedisModule_CreateString(NULL, ptr, len);
+    }
+    char *buf = tairHashValInflate(val, &len);
+    RedisModuleString *value = RedisModule_CreateString(NULL, buf, len);
+    RedisModule_Free(buf);
+    return value;
+}
+
+/* Write the 'len' bytes of 'buf' at 'offset' of the value, padding it with
+ * zeros up to 'offset', and return its new length. The first patch copies
+ * the value into a raw string of the field alone, the next ones change that
+ * string in place, and grow it with room to spare. */
+static size_t tairHashValPatch(TairHashVal *val, size_t offset, const char *buf, size_t len) {
+    size_t cur_len;
+
+    if (!val->owned) {
+        RedisModuleString *value;
+        if (val->value == NULL && !val->cold) {
+            value = RedisModule_CreateString(NULL, "", 0);
+        } else {
+            RedisModuleString *cur = tairHashValDecode(val);
+            const char *ptr = RedisModule_StringPtrLen(cur, &cur_len);
+            value = RedisModule_CreateString(NULL, ptr, cur_len);
+            RedisModule_FreeString(NULL, cur);
+        }
+        setTairHashValRaw(val, value);
+        val->owned = 1;
+    }
+    val->atime = coldClock();
+
+    RedisModule_StringPtrLen(val->value, &cur_len);
+    if (offset > cur_len) {
+        /* Grow once to the target length, the padding and the data together. */
+        size_t tail_len = offset - cur_len + len;
+        char *tail = RedisModule_Calloc(1, tail_len);
+        memcpy(tail + offset - cur_len, buf, len);
+        Module_Assert(RedisModule_StringAppendBuffer(NULL, val->value, tail, tail_len) == REDISMODULE_OK);
+        RedisModule_Free(tail);
+        return cur_len + tail_len;
+    }
+    if (offset < cur_len) {
+        /* Nothing else sees the string, it can be written like SETRANGE
+         * writes its sds. */
+        size_t n = cur_len - offset < len ? cur_len - offset : len;
+        memcpy((char *)RedisModule_StringPtrLen(val->value, NULL) + offset, buf, n);
+        buf += n;
+        len -= n;
+    }
+    if (len) {
+        Module_Assert(RedisModule_StringAppendBuffer(NULL, val->value, buf, len) == REDISMODULE_OK);
+    }
+    RedisModule_StringPtrLen(val->value, &cur_len);
+    return cur_len;
+}
+
+/* Move a value left unread long enough to the cold store. Returns 1 if it
+ * moved. */
+static int tairHashValFreeze(TairHashVal *val) {
+    size_t len;
+    uint64_t offset;
+
+    if (val->cold) return 0;
+    const char *ptr = RedisModule_StringPtrLen(val->value, &len);
+    if (len < TAIRHASH_COLD_MIN_LEN || coldClock() - val->atime < (uint32_t)g_cold_idle_time) return 0;
+    if (m_coldStorePut(g_cold_store, ptr, len, &offset) == -1) {
+        g_cold_stat.errors++;
+        return 0;
+    }
+    RedisModule_FreeString(NULL, val->value);
+    val->cold_offset = offset;
+    val->cold = 1;
+    val->owned = 0;
+    __atomic_add_fetch(&g_cold_stat.fields, 1, __ATOMIC_RELAXED);
+    g_cold_stat.frozen++;
+    return 1;
+}
+
+/* Bring a cold value back in memory. */
+static void tairHashValThaw(TairHashVal *val) {
+    size_t len;
+    const char *ptr = tairHashValStored(val, &len);
+    RedisModuleString *value = RedisModule_CreateString(NULL, ptr, len);
+
+    tairHashValDrop(val);
+    val->value = value;
+    g_cold_stat.thawed++;
+}
+
+/* Reply with the value as written by the client, a read brings a cold value
+ * back in memory. */
+int replyWithTairHashVal(RedisModuleCtx *ctx, TairHashVal *val) {
+    if (val->cold) tairHashValThaw(val);
+    val->atime = coldClock();
+    if (val->encoding == TAIRHASH_VAL_RAW) return RedisModule_ReplyWithString(ctx, val->value);
+    size_t len;
+    char *buf = tairHashValInflate(val, &len);
+    int ret = RedisModule_ReplyWithStringBuffer(ctx, buf, len);
+    RedisModule_Free(buf);
+    return ret;
+}
+
+/* Every expire decision is taken against one sample of the clock per top
+ * level command and per active expire cycle, the commands the module calls
+ * itself keep the sample of their caller. Servers that export
+ * RedisModule_CachedMicroseconds also keep it for a whole MULTI/EXEC or
+ * script. */
+static int g_expire_clock_depth = 0;
+static long long g_expire_clock_now = 0;
+
+void expireClockEnter(int cycle) {
+    if (g_expire_clock_depth++ == 0) {
+        if (!cycle && RedisModule_CachedMicroseconds) {
+            g_expire_clock_now = RedisModule_CachedMicroseconds() / 1000;
+        } else {
+            g_expire_clock_now = RedisModule_Milliseconds();
+        }
+    }
+}
+
+void expireClockLeave(void) {
+    Module_Assert(g_expire_clock_depth > 0);
+    g_expire_clock_depth--;
+}
+
+long long expireClockNow(void) {
+    return g_expire_clock_depth ? g_expire_clock_now : RedisModule_Milliseconds();
+}
+
 int isExpire(long long when) {
     if (when == 0) return 0;
-    return RedisModule_Milliseconds() > when;
+    return expireClockNow() > when;
 }
 
 int delEmptyTairHashIfNeeded(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *raw_key, tairHashObj *obj) {
-    if (!obj || (RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_SLAVE) || (dictSize(obj->hash) != 0)) {
+    if (!obj || (RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_SLAVE) || (segDictSize(obj->hash) != 0)) {
         return 0;
     }
 
+    /* The name may be the one owned by the object, which dies with the key. */
+    raw_key = takeAndRef(raw_key);
+
     if (redis_major_ver < 6 || (redis_major_ver == 6 && redis_minor_ver < 2)) {
         /* See bugfix: https://github.com/redis/redis/pull/8617
                        https://github.com/redis/redis/pull/8097
@@ -104,16 +462,24 @@ int delEmptyTairHashIfNeeded(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModu
         }
         RedisModule_CloseKey(key);
     }
+    RedisModule_FreeString(NULL, raw_key);
     return 1;
 }
 
-void notifyFieldSpaceEvent(char *event, RedisModuleString *key, RedisModuleString *field, int dbid) {
-    size_t key_len, field_len;
+/* Must run before the field is deleted, 'val' is read when the payload is
+ * enabled, it may be NULL to send the name alone. */
+void notifyFieldSpaceEvent(char *event, RedisModuleString *key, RedisModuleString *field, const TairHashVal *val, int dbid) {
+    size_t key_len;
     const char *key_ptr = RedisModule_StringPtrLen(key, &key_len);
-    const char *field_ptr = RedisModule_StringPtrLen(field, &field_len);
+    g_expire_algorithm.stat_expired_notifications++;
     /* tairhash@<db>@<key>__:<event> <field> notifications. */
     RedisModuleString *channel = RedisModule_CreateStringPrintf(NULL, "tairhash@%d@%s__:%s", dbid, key_ptr, event);
-    RedisModuleString *message = RedisModule_CreateStringFromString(NULL, field);
+    RedisModuleString *message;
+    if (g_expired_event_payload && val) {
+        message = fieldEventPayload(field, val);
+    } else {
+        message = RedisModule_CreateStringFromString(NULL, field);
+    }
 
     if (RedisModule_PublishMessage) {
         RedisModule_PublishMessage(NULL, channel, message);
@@ -129,20 +495,12 @@ void notifyFieldSpaceEvent(char *event, RedisModuleString *key, RedisModuleStrin
     RedisModule_FreeString(NULL, message);
 }
 
+/* Collects field and TairHashVal pairs, the value is decoded on reply. */
 void tairhashScanCallback(void *privdata, const m_dictEntry *de) {
     list *keys = (list *)privdata;
-    RedisModuleString *key, *val = NULL;
 
-    RedisModuleString *skey = dictGetKey(de);
-    TairHashVal *sval = dictGetVal(de);
-    key = skey;
-    if (sval) {
-        val = sval->value;
-    }
-    m_listAddNodeTail(keys, key);
-    if (val) {
-        m_listAddNodeTail(keys, val);
-    }
+    m_listAddNodeTail(keys, dictGetKey(de));
+    m_listAddNodeTail(keys, dictGetVal(de));
 }
 
 uint64_t dictModuleStrHash(const void *key) {
@@ -186,13 +544,42 @@ m_dictType tairhashDictType = {
     dictModuleValueDestructor /* val destructor */
 };
 
+/* Build the lex index of the key from its fields. Returns 0 if the key
+ * already has one. */
+static int createLexIndexIfNeeded(tairHashObj *o) {
+    if (o->lex_index) return 0;
+    o->lex_index = m_zslCreate();
+    m_segDictIterator *di = m_segDictGetIterator(o->hash);
+    m_dictEntry *de;
+    while ((de = m_segDictNext(di)) != NULL) {
+        m_zslInsert(o->lex_index, 0, takeAndRef(dictGetKey(de)));
+    }
+    m_segDictReleaseIterator(di);
+    return 1;
+}
+
+/* Returns 0 if the key has no lex index. */
+static int releaseLexIndex(tairHashObj *o) {
+    if (o->lex_index == NULL) return 0;
+    m_zslFree(o->lex_index);
+    o->lex_index = NULL;
+    return 1;
+}
+
 static void tairHashTypeReleaseObject(struct tairHashObj *o) {
-    m_dictRelease(o->hash);
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    /* Servers without unlink callbacks free keys still in the index. */
+    removeGlobalExpireIndex(o);
+#endif
+    m_segDictRelease(o->hash);
+    releaseLexIndex(o);
+    if (o->expire_index) {
 #ifdef SLAB_MODE
-    slab_free(o->expire_index);
+        slab_free(o->expire_index);
 #else
-    m_zslFree(o->expire_index);
+        m_zslFree(o->expire_index);
 #endif
+    }
     if (o->key) {
         RedisModule_FreeString(NULL, o->key);
     }
@@ -201,15 +588,169 @@ static void tairHashTypeReleaseObject(struct tairHashObj *o) {
 
 static struct tairHashObj *createTairHashTypeObject() {
     tairHashObj *o = RedisModule_Calloc(1, sizeof(*o));
-    o->hash = m_dictCreate(&tairhashDictType, NULL);
+    o->hash = m_segDictCreate(&tairhashDictType, NULL);
+    return o;
+}
+
+/* Add a field missing from the key, the key takes the reference. */
+int addTairHashField(tairHashObj *o, RedisModuleString *field, TairHashVal *val) {
+    if (m_segDictAdd(o->hash, field, val) != DICT_OK) return DICT_ERR;
+    if (o->lex_index) m_zslInsert(o->lex_index, 0, takeAndRef(field));
+    return DICT_OK;
+}
+
+int delTairHashField(tairHashObj *o, RedisModuleString *field) {
+    if (o->lex_index) m_zslDelete(o->lex_index, 0, field, NULL);
+    return m_segDictDelete(o->hash, field);
+}
+
+/* Most tairhash keys never set a field expire, so the expire index is only
+ * created with the first expiring field and released with the last one. */
+void createExpireIndexIfNeeded(tairHashObj *o) {
+    if (o->expire_index) return;
 #ifdef SLAB_MODE
     o->expire_index = slab_create();
 #else
     o->expire_index = m_zslCreate();
 #endif
-    return o;
 }
 
+void releaseExpireIndexIfEmpty(tairHashObj *o) {
+    if (o->expire_index == NULL || o->expire_index->length) return;
+#ifdef SLAB_MODE
+    slab_free(o->expire_index);
+#else
+    m_zslFree(o->expire_index);
+#endif
+    o->expire_index = NULL;
+}
+
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+static unsigned long globalExpireIndexLength(int dbid) {
+    return g_expire_index[dbid] ? g_expire_index[dbid]->length : 0;
+}
+
+static expireDb *expireDbCreate(void) {
+    expireDb *db = RedisModule_Alloc(sizeof(*db));
+    m_heapInit(&db->slots);
+    db->slot = NULL;
+    db->length = 0;
+    return db;
+}
+
+/* Free the global index of a db in O(slots), the keys still in it are
+ * unlinked. */
+static void expireDbFree(expireDb *db) {
+    m_heapClear(&db->slots);
+    for (unsigned int j = 0; db->slot && j < g_expire_slots; j++) {
+        if (db->slot[j]) {
+            m_heapClear(&db->slot[j]->keys);
+            RedisModule_Free(db->slot[j]);
+        }
+    }
+    RedisModule_Free(db->slot);
+    RedisModule_Free(db);
+}
+
+static size_t expireDbMemUsage(const expireDb *db) {
+    size_t bytes = sizeof(*db) + db->slots.size * sizeof(m_heapItem);
+    if (db->slot == NULL) {
+        return bytes;
+    }
+    bytes += g_expire_slots * sizeof(expireSlot *);
+    for (unsigned int j = 0; j < g_expire_slots; j++) {
+        if (db->slot[j]) {
+            bytes += sizeof(expireSlot) + db->slot[j]->keys.size * sizeof(m_heapItem);
+        }
+    }
+    return bytes;
+}
+
+/* The slot of the key in the global index of 'dbid', the index, its slot
+ * array and the slot are created on first use. */
+static expireSlot *expireSlotGet(int dbid, RedisModuleString *key) {
+    unsigned int j = 0;
+    if (g_expire_index[dbid] == NULL) {
+        g_expire_index[dbid] = expireDbCreate();
+    }
+    expireDb *db = g_expire_index[dbid];
+    if (g_expire_slots > 1 && key) {
+        size_t len;
+        const char *name = RedisModule_StringPtrLen(key, &len);
+        j = m_keyHashSlot(name, (int)len);
+    }
+    if (db->slot == NULL) {
+        db->slot = RedisModule_Calloc(g_expire_slots, sizeof(expireSlot *));
+    }
+    if (db->slot[j] == NULL) {
+        expireSlot *slot = RedisModule_Calloc(1, sizeof(*slot));
+        m_heapInit(&slot->keys);
+        slot->slot = j;
+        slot->db = db;
+        db->slot[j] = slot;
+    }
+    return db->slot[j];
+}
+
+/* Place the slot in the summary of its db at its earliest key. An emptied
+ * slot leaves the summary and is freed along with its statistics, and so is
+ * the slot array of the db with its last slot, memory follows the expiring
+ * keys. */
+static void expireSlotSync(expireSlot *slot) {
+    if (slot->keys.length == 0) {
+        expireDb *db = slot->db;
+        if (slot->entry.heap) {
+            m_heapDelete(&slot->entry);
+        }
+        m_heapClear(&slot->keys);
+        db->slot[slot->slot] = NULL;
+        RedisModule_Free(slot);
+        if (db->length == 0) {
+            m_heapClear(&db->slots);
+            RedisModule_Free(db->slot);
+            db->slot = NULL;
+        }
+    } else if (slot->entry.heap) {
+        m_heapUpdate(&slot->entry, m_heapScore(m_heapFirst(&slot->keys)));
+    } else {
+        m_heapInsert(&slot->db->slots, &slot->entry, m_heapScore(m_heapFirst(&slot->keys)));
+    }
+}
+
+/* Take the key out of the global index, if it is in. */
+void removeGlobalExpireIndex(tairHashObj *o) {
+    if (o->expire_entry.heap == NULL) {
+        return;
+    }
+    expireSlot *slot = expireSlotOf(o->expire_entry.heap);
+    m_heapDelete(&o->expire_entry);
+    slot->db->length--;
+    expireSlotSync(slot);
+}
+
+/* Place the key in the global index of 'dbid' at the earliest expire of its
+ * fields, or take it out when none is left. Called after every change of the
+ * key's own index, and when the key moves to another db. */
+void updateGlobalExpireIndex(int dbid, tairHashObj *o) {
+    m_heapEntry *entry = &o->expire_entry;
+    if (entry->heap && (expireIndexLength(o) == 0 || expireSlotOf(entry->heap)->db != g_expire_index[dbid])) {
+        removeGlobalExpireIndex(o);
+    }
+    if (expireIndexLength(o) == 0) {
+        return;
+    }
+    if (entry->heap) {
+        m_heapUpdate(entry, expireIndexMin(o));
+        expireSlotSync(expireSlotOf(entry->heap));
+    } else {
+        expireSlot *slot = expireSlotGet(dbid, o->key);
+        m_heapInsert(&slot->keys, entry, expireIndexMin(o));
+        slot->db->length++;
+        expireSlotSync(slot);
+    }
+}
+#endif
+
 int isReadOnlyStatus(RedisModuleCtx *ctx) {
     int flags = RedisModule_GetContextFlags(ctx);
     if (flags & REDISMODULE_CTX_FLAGS_SLAVE || flags & REDISMODULE_CTX_FLAGS_READONLY) {
@@ -220,6 +761,83 @@ int isReadOnlyStatus(RedisModuleCtx *ctx) {
 }
 
 /* ========================== Common  func =============================*/
+
+/* Key samples and per key walk bound used to estimate the expired fields not
+ * yet reclaimed. */
+#define TAIRHASH_STALE_SAMPLE_KEYS 5
+#define TAIRHASH_STALE_SAMPLE_FIELDS 1024
+
+static inline uint64_t fieldBytes(tairHashObj *o, RedisModuleString *field) {
+    size_t field_len, value_len = 0;
+    TairHashVal *tair_hash_val = m_segDictFetchValue(o->hash, field);
+
+    RedisModule_StringPtrLen(field, &field_len);
+    if (tair_hash_val && !tair_hash_val->cold) {
+        RedisModule_StringPtrLen(tair_hash_val->value, &value_len);
+    }
+    return field_len + value_len;
+}
+
+/* Count (at most 'limit') fields of the object expired at 'now', adding their
+ * field and value sizes to '*bytes'. */
+static uint64_t countExpiredFields(tairHashObj *o, long long now, uint64_t limit, uint64_t *bytes) {
+    uint64_t count = 0;
+    if (o->expire_index == NULL) return 0;
+#ifdef SLAB_MODE
+    tairhash_zskiplistNode *ln = o->expire_index->header->level[0].forward;
+    while (ln && ln->expire_min <= now && count < limit) {
+        for (int j = 0; j < ln->slab->num_keys && count < limit; j++) {
+            if (ln->slab->expires[j] <= now) {
+                count++;
+                *bytes += fieldBytes(o, ln->slab->keys[j]);
+            }
+        }
+        ln = ln->level[0].forward;
+    }
+#else
+    m_zskiplistNode *ln = o->expire_index->header->level[0].forward;
+    while (ln && ln->score <= now && count < limit) {
+        count++;
+        *bytes += fieldBytes(o, ln->member);
+        ln = ln->level[0].forward;
+    }
+#endif
+    return count;
+}
+
+/* Estimate the expired but still resident fields of the selected db from a
+ * few random keys, scaled by the db size. */
+static void estimateExpiredStaleFields(RedisModuleCtx *ctx, int dbid) {
+    uint64_t fields = 0, bytes = 0, samples = 0;
+    long long now = expireClockNow();
+    long long dbsize = RedisModule_DbSize ? RedisModule_DbSize(ctx) : 0;
+
+    for (int i = 0; i < TAIRHASH_STALE_SAMPLE_KEYS && dbsize > 0; ++i) {
+        RedisModuleCallReply *reply = RedisModule_Call(ctx, "RANDOMKEY", "");
+        if (reply == NULL) {
+            break;
+        }
+        if (RedisModule_CallReplyType(reply) != REDISMODULE_REPLY_STRING) {
+            RedisModule_FreeCallReply(reply);
+            break;
+        }
+
+        RedisModuleString *keyname = RedisModule_CreateStringFromCallReply(reply);
+        RedisModule_FreeCallReply(reply);
+        RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_OPEN_KEY_NOTOUCH);
+        if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) == TairHashType) {
+            tairHashObj *o = RedisModule_ModuleTypeGetValue(key);
+            fields += countExpiredFields(o, now, TAIRHASH_STALE_SAMPLE_FIELDS, &bytes);
+        }
+        RedisModule_CloseKey(key);
+        RedisModule_FreeString(ctx, keyname);
+        samples++;
+    }
+
+    g_expire_algorithm.stat_expired_stale_fields[dbid] = samples ? fields * dbsize / samples : 0;
+    g_expire_algorithm.stat_expired_stale_bytes[dbid] = samples ? bytes * dbsize / samples : 0;
+}
+
 void activeExpireTimerHandler(RedisModuleCtx *ctx, void *data) {
     REDISMODULE_NOT_USED(data);
     RedisModule_AutoMemory(ctx);
@@ -232,28 +850,74 @@ void activeExpireTimerHandler(RedisModuleCtx *ctx, void *data) {
     }
 
     long long start = RedisModule_Milliseconds();
+    uint64_t start_us = latencyNowUsec();
+    expireClockEnter(1);
+    uint64_t keys_visited = g_expire_algorithm.stat_active_keys_visited;
+    uint64_t fields_examined = g_expire_algorithm.stat_active_fields_examined;
 
     for (int i = 0; i < dbs_per_call; ++i) {
-        current_db = current_db % DB_NUM;
+        expireTraceEntry *trace;
+        current_db = current_db % g_db_num;
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+        /* Without an expiring key the db has nothing to expire, nor to
+         * estimate. */
+        if (globalExpireIndexLength(current_db) == 0) {
+            g_expire_algorithm.stat_expired_stale_fields[current_db] = 0;
+            g_expire_algorithm.stat_expired_stale_bytes[current_db] = 0;
+            current_db++;
+            continue;
+        }
+#endif
         if (RedisModule_SelectDb(ctx, current_db) != REDISMODULE_OK) {
             current_db++;
             continue;
         }
 
         if (RedisModule_DbSize && RedisModule_DbSize(ctx) == 0) {
+            g_expire_algorithm.stat_expired_stale_fields[current_db] = 0;
+            g_expire_algorithm.stat_expired_stale_bytes[current_db] = 0;
             current_db++;
             continue;
         }
 
+        trace = &g_expire_trace[g_expire_trace_next_id % TAIRHASH_EXPIRE_TRACE_LEN];
+        trace->start_msec = RedisModule_Milliseconds();
+        trace->duration_usec = latencyNowUsec();
+        trace->keys_visited = g_expire_algorithm.stat_active_keys_visited;
+        trace->fields_expired = g_expire_algorithm.stat_active_expired_field[current_db];
+        trace->notifications = g_expire_algorithm.stat_expired_notifications;
+        trace->repl_bytes = g_expire_algorithm.stat_expired_repl_bytes;
+
         /* Perform active expire algorithm. */
         g_expire_algorithm.activeExpire(ctx, current_db, g_expire_algorithm.keys_per_active_loop);
+
+        trace->id = g_expire_trace_next_id++;
+        trace->dbid = current_db;
+        trace->duration_usec = latencyNowUsec() - trace->duration_usec;
+        trace->keys_visited = g_expire_algorithm.stat_active_keys_visited - trace->keys_visited;
+        trace->fields_expired = g_expire_algorithm.stat_active_expired_field[current_db] - trace->fields_expired;
+        trace->notifications = g_expire_algorithm.stat_expired_notifications - trace->notifications;
+        trace->repl_bytes = g_expire_algorithm.stat_expired_repl_bytes - trace->repl_bytes;
+        if (g_expire_trace_len < TAIRHASH_EXPIRE_TRACE_LEN) {
+            g_expire_trace_len++;
+        }
+
+        estimateExpiredStaleFields(ctx, current_db);
         current_db++;
     }
 
+    g_expire_algorithm.stat_last_active_keys_visited = g_expire_algorithm.stat_active_keys_visited - keys_visited;
+    g_expire_algorithm.stat_last_active_fields_examined = g_expire_algorithm.stat_active_fields_examined - fields_examined;
+    m_histogramRecord(&g_active_expire_latency, latencyNowUsec() - start_us);
     g_expire_algorithm.stat_last_active_expire_time_msec = RedisModule_Milliseconds() - start;
     if (g_expire_algorithm.stat_max_active_expire_time_msec < g_expire_algorithm.stat_last_active_expire_time_msec) {
         g_expire_algorithm.stat_max_active_expire_time_msec = g_expire_algorithm.stat_last_active_expire_time_msec;
     }
+    /* Redis only keeps the samples above latency-monitor-threshold. */
+    if (RedisModule_LatencyAddSample) {
+        RedisModule_LatencyAddSample("tairhash-expire-cycle", g_expire_algorithm.stat_last_active_expire_time_msec);
+    }
+    expireClockLeave();
     total_expire_time += g_expire_algorithm.stat_last_active_expire_time_msec;
     if (++loop_cnt % 10 == 0) {
         g_expire_algorithm.stat_avg_active_expire_time_msec = total_expire_time / loop_cnt;
@@ -268,7 +932,7 @@ restart:
 }
 
 int fieldExpireIfNeeded(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *o, RedisModuleString *field, int is_timer) {
-    TairHashVal *tair_hash_val = m_dictFetchValue(o->hash, field);
+    TairHashVal *tair_hash_val = m_segDictFetchValue(o->hash, field);
     if (tair_hash_val == NULL) {
         return 0;
     }
@@ -278,7 +942,7 @@ int fieldExpireIfNeeded(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, t
         return 0;
     }
 
-    long long now = RedisModule_Milliseconds();
+    long long now = expireClockNow();
     if (isReadOnlyStatus(ctx)) {
         return now > when;
     }
@@ -303,9 +967,9 @@ void swapDbCallback(RedisModuleCtx *ctx, RedisModuleEvent e, uint64_t sub, void
     int to_dbid = ei->dbnum_second;
 
     /* 1. swap index */
-    m_zskiplist *tmp_zsl = g_expire_index[from_dbid];
+    expireDb *tmp_db = g_expire_index[from_dbid];
     g_expire_index[from_dbid] = g_expire_index[to_dbid];
-    g_expire_index[to_dbid] = tmp_zsl;
+    g_expire_index[to_dbid] = tmp_db;
 
     /* 2. swap statistics*/
     uint64_t tmp_stat = g_expire_algorithm.stat_active_expired_field[from_dbid];
@@ -315,6 +979,14 @@ void swapDbCallback(RedisModuleCtx *ctx, RedisModuleEvent e, uint64_t sub, void
     tmp_stat = g_expire_algorithm.stat_passive_expired_field[from_dbid];
     g_expire_algorithm.stat_passive_expired_field[from_dbid] = g_expire_algorithm.stat_passive_expired_field[to_dbid];
     g_expire_algorithm.stat_passive_expired_field[to_dbid] = tmp_stat;
+
+    tmp_stat = g_expire_algorithm.stat_expired_stale_fields[from_dbid];
+    g_expire_algorithm.stat_expired_stale_fields[from_dbid] = g_expire_algorithm.stat_expired_stale_fields[to_dbid];
+    g_expire_algorithm.stat_expired_stale_fields[to_dbid] = tmp_stat;
+
+    tmp_stat = g_expire_algorithm.stat_expired_stale_bytes[from_dbid];
+    g_expire_algorithm.stat_expired_stale_bytes[from_dbid] = g_expire_algorithm.stat_expired_stale_bytes[to_dbid];
+    g_expire_algorithm.stat_expired_stale_bytes[to_dbid] = tmp_stat;
 }
 
 void flushDbCallback(RedisModuleCtx *ctx, RedisModuleEvent e, uint64_t sub, void *data) {
@@ -325,13 +997,19 @@ void flushDbCallback(RedisModuleCtx *ctx, RedisModuleEvent e, uint64_t sub, void
     RedisModuleFlushInfo *fi = data;
     if (sub == REDISMODULE_SUBEVENT_FLUSHDB_START) {
         if (fi->dbnum != -1) {
-            /* Free and Re-Create index. */
-            m_zslFree(g_expire_index[fi->dbnum]);
-            g_expire_index[fi->dbnum] = m_zslCreate();
+            /* Free the index, it is created again with the next expiring
+             * key. The keys are released after it and maybe in a background
+             * thread. */
+            if (g_expire_index[fi->dbnum]) {
+                expireDbFree(g_expire_index[fi->dbnum]);
+                g_expire_index[fi->dbnum] = NULL;
+            }
         } else {
-            for (int i = 0; i < DB_NUM; i++) {
-                m_zslFree(g_expire_index[i]);
-                g_expire_index[i] = m_zslCreate();
+            for (int i = 0; i < g_db_num; i++) {
+                if (g_expire_index[i]) {
+                    expireDbFree(g_expire_index[i]);
+                    g_expire_index[i] = NULL;
+                }
             }
         }
     }
@@ -347,7 +1025,7 @@ static int keySpaceNotification(RedisModuleCtx *ctx, int type, const char *event
 #define CMD_MOVE 2
 
     static RedisModuleString *from_key = NULL, *to_key = NULL;
-    static int from_dbid, to_dbid;
+    static int to_dbid;
     static int cmd_flag = CMD_NONE;
 
     int dbid = RedisModule_GetSelectedDb(ctx);
@@ -357,58 +1035,46 @@ static int keySpaceNotification(RedisModuleCtx *ctx, int type, const char *event
     } else if (strcmp(event, "rename_to") == 0) {
         to_key = RedisModule_CreateStringFromString(NULL, key);
         cmd_flag = CMD_RENAME;
-    } else if (strcmp(event, "move_from") == 0) {
-        from_dbid = dbid;
     } else if (strcmp(event, "move_to") == 0) {
         to_dbid = dbid;
         cmd_flag = CMD_MOVE;
     }
 
     if (cmd_flag != CMD_NONE) {
-        RedisModuleString *local_from_key = NULL, *local_to_key = NULL;
-        int local_from_dbid, local_to_dbid;
+        RedisModuleString *local_to_key = NULL;
+        int local_to_dbid;
         /* We assign values in advance so that `move` and `rename` can be processed uniformly. */
         if (cmd_flag == CMD_RENAME) {
-            local_from_key = from_key;
             local_to_key = to_key;
             /* `rename` does not change the dbid of the key. */
-            local_from_dbid = dbid;
             local_to_dbid = dbid;
         } else {
             /* `move` does not change the name of the key. */
-            local_from_key = key;
             local_to_key = key;
-            local_from_dbid = from_dbid;
             local_to_dbid = to_dbid;
         }
 
         RedisModule_SelectDb(ctx, local_to_dbid);
         RedisModuleKey *real_key = RedisModule_OpenKey(ctx, local_to_key, REDISMODULE_READ | REDISMODULE_WRITE);
         int type = RedisModule_KeyType(real_key);
-        Module_Assert(type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(real_key) == TairHashType);
-        tairHashObj *tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
-
-        /* If there are no expire fields, we don’t have any indexes to adjust, just return ASAP. */
-        if (tair_hash_obj->expire_index->length == 0) {
-            return REDISMODULE_OK;
-        }
-#ifdef SLAB_MODE
-        long long previous_index = tair_hash_obj->expire_index->header->level[0].forward->expire_min;
-#else
-        long long previous_index = tair_hash_obj->expire_index->header->level[0].forward->score;
-#endif
+        /* Keys of other types are renamed and moved too. */
+        if (type != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(real_key) == TairHashType) {
+            tairHashObj *tair_hash_obj = RedisModule_ModuleTypeGetValue(real_key);
+
+            if (tair_hash_obj->key) {
+                /* Change key name. */
+                RedisModule_FreeString(NULL, tair_hash_obj->key);
+                tair_hash_obj->key = RedisModule_CreateStringFromString(NULL, local_to_key);
+            }
 
-        /* Delete the previous index */
-        m_zslDelete(g_expire_index[local_from_dbid], previous_index, local_from_key, NULL);
-        if (tair_hash_obj->key) {
-            /* Change key name. */
-            RedisModule_FreeString(NULL, tair_hash_obj->key);
-            tair_hash_obj->key = RedisModule_CreateStringFromString(NULL, local_to_key);
+            /* The index holds the object, not its name, it only has to follow
+             * the key to the dst db, and to the slot of its new name. */
+            if (g_expire_slots > 1) {
+                removeGlobalExpireIndex(tair_hash_obj);
+            }
+            updateGlobalExpireIndex(local_to_dbid, tair_hash_obj);
         }
 
-        /* Re-insert to dst index. */
-        m_zslInsert(g_expire_index[local_to_dbid], previous_index, takeAndRef(tair_hash_obj->key));
-
         /* Release sources. */
         if (cmd_flag == CMD_RENAME) {
             if (to_key) {
@@ -429,7 +1095,40 @@ static int keySpaceNotification(RedisModuleCtx *ctx, int type, const char *event
     return REDISMODULE_OK;
 }
 
+#endif
+
+/* While a fork child (BGSAVE, AOF rewrite, full sync) is alive, every page
+ * the parent touches is duplicated by copy-on-write. Rehashing a large field
+ * dict dirties both bucket arrays, so we stop growing tables until the child
+ * exits, unless a table goes beyond dict_force_resize_ratio. */
+void forkChildCallback(RedisModuleCtx *ctx, RedisModuleEvent e, uint64_t sub, void *data) {
+    REDISMODULE_NOT_USED(ctx);
+    REDISMODULE_NOT_USED(e);
+    REDISMODULE_NOT_USED(data);
+
+    if (sub == REDISMODULE_SUBEVENT_FORK_CHILD_BORN) {
+        m_dictDisableResize();
+    } else if (sub == REDISMODULE_SUBEVENT_FORK_CHILD_DIED) {
+        m_dictEnableResize();
+    }
+}
+
+static void infoAddLatencyField(RedisModuleInfoCtx *ctx, const char *name, const m_histogram *h) {
+    if (h->count == 0) {
+        return;
+    }
+    RedisModule_InfoBeginDictField(ctx, (char *)name);
+    RedisModule_InfoAddFieldULongLong(ctx, "calls", h->count);
+    RedisModule_InfoAddFieldULongLong(ctx, "p50_usec", m_histogramPercentile(h, 50));
+    RedisModule_InfoAddFieldULongLong(ctx, "p99_usec", m_histogramPercentile(h, 99));
+    RedisModule_InfoAddFieldULongLong(ctx, "p999_usec", m_histogramPercentile(h, 99.9));
+    RedisModule_InfoAddFieldULongLong(ctx, "max_usec", h->max);
+    RedisModule_InfoEndDictField(ctx);
+}
+
 void infoFunc(RedisModuleInfoCtx *ctx, int for_crash_report) {
+    REDISMODULE_NOT_USED(for_crash_report);
+
     RedisModule_InfoAddSection(ctx, "Statistics");
     RedisModule_InfoAddFieldLongLong(ctx, "active_expire_enable", g_expire_algorithm.enable_active_expire);
     RedisModule_InfoAddFieldLongLong(ctx, "active_expire_period", g_expire_algorithm.active_expire_period);
@@ -439,11 +1138,58 @@ void infoFunc(RedisModuleInfoCtx *ctx, int for_crash_report) {
     RedisModule_InfoAddFieldLongLong(ctx, "active_expire_max_time_msec", g_expire_algorithm.stat_max_active_expire_time_msec);
     RedisModule_InfoAddFieldLongLong(ctx, "active_expire_avg_time_msec", g_expire_algorithm.stat_avg_active_expire_time_msec);
     RedisModule_InfoAddFieldLongLong(ctx, "passive_expire_keys_per_loop", g_expire_algorithm.keys_per_passive_loop);
+    RedisModule_InfoAddFieldLongLong(ctx, "expired_event_payload", g_expired_event_payload);
+    RedisModule_InfoAddFieldLongLong(ctx, "dict_resize_enabled", m_dictIsResizeEnabled());
+    RedisModule_InfoAddFieldLongLong(ctx, "dict_force_resize_ratio", m_dictGetForceResizeRatio());
+    RedisModule_InfoAddFieldULongLong(ctx, "dict_deferred_resizes", m_dictGetStatDeferredResizes());
+    RedisModule_InfoAddFieldULongLong(ctx, "dict_segment_threshold", m_segDictGetSplitSize());
+    RedisModule_InfoAddFieldULongLong(ctx, "dict_segment_splits", m_segDictGetStatSplits());
+    RedisModule_InfoAddFieldLongLong(ctx, "value_compress_threshold", g_compress_threshold);
+    RedisModule_InfoAddFieldULongLong(ctx, "value_compress_attempts", g_compress_stat.attempts);
+    RedisModule_InfoAddFieldULongLong(ctx, "value_compressed", g_compress_stat.compressed);
+    RedisModule_InfoAddFieldDouble(ctx, "value_compress_ratio",
+                                   g_compress_stat.bytes_out ? (double)g_compress_stat.bytes_in / g_compress_stat.bytes_out : 0);
+    RedisModule_InfoAddFieldULongLong(ctx, "value_compress_usec", g_compress_stat.compress_usec);
+    RedisModule_InfoAddFieldULongLong(ctx, "value_decompressed", g_compress_stat.decompressed);
+    RedisModule_InfoAddFieldULongLong(ctx, "value_decompress_usec", g_compress_stat.decompress_usec);
+    RedisModule_InfoAddFieldLongLong(ctx, "cold_tier_idle_time", g_cold_idle_time);
+    RedisModule_InfoAddFieldULongLong(ctx, "cold_fields", __atomic_load_n(&g_cold_stat.fields, __ATOMIC_RELAXED));
+    RedisModule_InfoAddFieldULongLong(ctx, "cold_live_bytes", g_cold_store ? m_coldStoreLiveBytes(g_cold_store) : 0);
+    RedisModule_InfoAddFieldULongLong(ctx, "cold_file_bytes", g_cold_store ? m_coldStoreFileBytes(g_cold_store) : 0);
+    RedisModule_InfoAddFieldULongLong(ctx, "cold_reclaimed_bytes", g_cold_store ? g_cold_store->stat_reclaimed : 0);
+    RedisModule_InfoAddFieldULongLong(ctx, "cold_frozen", g_cold_stat.frozen);
+    RedisModule_InfoAddFieldULongLong(ctx, "cold_thawed", g_cold_stat.thawed);
+    RedisModule_InfoAddFieldULongLong(ctx, "cold_errors", g_cold_stat.errors);
+    RedisModule_InfoAddFieldULongLong(ctx, "active_expire_keys_visited", g_expire_algorithm.stat_active_keys_visited);
+    RedisModule_InfoAddFieldULongLong(ctx, "active_expire_fields_examined", g_expire_algorithm.stat_active_fields_examined);
+    RedisModule_InfoAddFieldULongLong(ctx, "active_expire_last_keys_visited", g_expire_algorithm.stat_last_active_keys_visited);
+    RedisModule_InfoAddFieldULongLong(ctx, "active_expire_last_fields_examined", g_expire_algorithm.stat_last_active_fields_examined);
+
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    RedisModule_InfoAddSection(ctx, "Index");
+#ifdef SLAB_MODE
+    RedisModule_InfoAddFieldLongLong(ctx, "slabs", slab_getStatSlabs());
+    RedisModule_InfoAddFieldULongLong(ctx, "slab_splits", slab_getStatSplits());
+    RedisModule_InfoAddFieldULongLong(ctx, "slab_merges", slab_getStatMerges());
+#endif
+    for (int i = 0; i < g_db_num; ++i) {
+        char name[48];
+        if (globalExpireIndexLength(i) == 0) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "db%d_global_index_length", i);
+        RedisModule_InfoAddFieldULongLong(ctx, name, globalExpireIndexLength(i));
+    }
 
+#endif
     RedisModule_InfoAddSection(ctx, "ActiveExpiredFields");
-    char buf[10];
-    for (int i = 0; i < DB_NUM; ++i) {
-        if (g_expire_index[i]->length == 0 && g_expire_algorithm.stat_active_expired_field[i] == 0) {
+    char buf[16];
+    for (int i = 0; i < g_db_num; ++i) {
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+        if (globalExpireIndexLength(i) == 0 && g_expire_algorithm.stat_active_expired_field[i] == 0) {
+#else
+        if (g_expire_algorithm.stat_active_expired_field[i] == 0) {
+#endif
             continue;
         }
         snprintf(buf, sizeof(buf), "db%d", i);
@@ -451,44 +1197,546 @@ void infoFunc(RedisModuleInfoCtx *ctx, int for_crash_report) {
     }
 
     RedisModule_InfoAddSection(ctx, "PassiveExpiredFields");
-    for (int i = 0; i < DB_NUM; ++i) {
-        if (g_expire_index[i]->length == 0 && g_expire_algorithm.stat_passive_expired_field[i] == 0) {
+    for (int i = 0; i < g_db_num; ++i) {
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+        if (globalExpireIndexLength(i) == 0 && g_expire_algorithm.stat_passive_expired_field[i] == 0) {
+#else
+        if (g_expire_algorithm.stat_passive_expired_field[i] == 0) {
+#endif
             continue;
         }
         snprintf(buf, sizeof(buf), "db%d", i);
         RedisModule_InfoAddFieldLongLong(ctx, buf, g_expire_algorithm.stat_passive_expired_field[i]);
     }
+
+    RedisModule_InfoAddSection(ctx, "ExpireLag");
+    for (int i = 0; i < g_db_num; ++i) {
+        if (g_expire_lag[i].count == 0 && g_expire_algorithm.stat_expired_stale_fields[i] == 0) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "db%d", i);
+        RedisModule_InfoBeginDictField(ctx, buf);
+        RedisModule_InfoAddFieldULongLong(ctx, "expired", g_expire_lag[i].count);
+        RedisModule_InfoAddFieldULongLong(ctx, "lag_p50_msec", m_histogramPercentile(&g_expire_lag[i], 50));
+        RedisModule_InfoAddFieldULongLong(ctx, "lag_p99_msec", m_histogramPercentile(&g_expire_lag[i], 99));
+        RedisModule_InfoAddFieldULongLong(ctx, "lag_p999_msec", m_histogramPercentile(&g_expire_lag[i], 99.9));
+        RedisModule_InfoAddFieldULongLong(ctx, "lag_max_msec", g_expire_lag[i].max);
+        RedisModule_InfoAddFieldULongLong(ctx, "stale_fields", g_expire_algorithm.stat_expired_stale_fields[i]);
+        RedisModule_InfoAddFieldULongLong(ctx, "stale_bytes", g_expire_algorithm.stat_expired_stale_bytes[i]);
+        RedisModule_InfoEndDictField(ctx);
+    }
+
+    RedisModule_InfoAddSection(ctx, "Latency");
+    for (int i = 0; i < TAIRHASH_CMD_NUM; ++i) {
+        infoAddLatencyField(ctx, g_cmd_names[i], &g_cmd_latency[i]);
+    }
+    infoAddLatencyField(ctx, "active_expire", &g_active_expire_latency);
+    infoAddLatencyField(ctx, "passive_expire", &g_passive_expire_latency);
+}
+
+/* Write commands are propagated with the client's own argument strings, the
+ * numbers are formatted on the stack, so replication allocates nothing in the
+ * module. */
+#define LONG_STR_SIZE 21
+
+/* Propagate EXHSET <key> <field> <value> [ABS version] [PXAT expire], a zero
+ * version or expire leaves the option out. */
+static void replicateHset(RedisModuleCtx *ctx, RedisModuleString *key, RedisModuleString *field, RedisModuleString *value,
+                          long long version, long long expire) {
+    char vbuf[LONG_STR_SIZE], ebuf[LONG_STR_SIZE];
+    size_t vlen = version ? m_ll2string(vbuf, sizeof(vbuf), version) : 0;
+    size_t elen = expire ? m_ll2string(ebuf, sizeof(ebuf), expire) : 0;
+
+    if (vlen && elen) {
+        RedisModule_Replicate(ctx, "EXHSET", "ssscbcb", key, field, value, "ABS", vbuf, vlen, "PXAT", ebuf, elen);
+    } else if (vlen) {
+        RedisModule_Replicate(ctx, "EXHSET", "ssscb", key, field, value, "ABS", vbuf, vlen);
+    } else if (elen) {
+        RedisModule_Replicate(ctx, "EXHSET", "ssscb", key, field, value, "PXAT", ebuf, elen);
+    } else {
+        RedisModule_Replicate(ctx, "EXHSET", "sss", key, field, value);
+    }
+}
+
+/* Propagate EXHPEXPIREAT <key> <field> <expire> [ABS version], a zero version
+ * leaves the option out. */
+static void replicateHpexpireAt(RedisModuleCtx *ctx, RedisModuleString *key, RedisModuleString *field, long long expire, long long version) {
+    char vbuf[LONG_STR_SIZE], ebuf[LONG_STR_SIZE];
+    size_t elen = m_ll2string(ebuf, sizeof(ebuf), expire);
+
+    if (version) {
+        size_t vlen = m_ll2string(vbuf, sizeof(vbuf), version);
+        RedisModule_Replicate(ctx, "EXHPEXPIREAT", "ssbcb", key, field, ebuf, elen, "ABS", vbuf, vlen);
+    } else {
+        RedisModule_Replicate(ctx, "EXHPEXPIREAT", "ssb", key, field, ebuf, elen);
+    }
+}
+
+/* Propagate EXHAPPEND <key> <field> <data>, or EXHSETRANGE <key> <field>
+ * <offset> <data> when 'offset' is given, with ABS version [PXAT expire]:
+ * only the patch is sent, not the whole value. A zero expire leaves the
+ * option out. */
+static void replicatePatch(RedisModuleCtx *ctx, RedisModuleString *key, RedisModuleString *field, RedisModuleString *offset,
+                           RedisModuleString *data, long long version, long long expire) {
+    char vbuf[LONG_STR_SIZE], ebuf[LONG_STR_SIZE];
+    size_t vlen = m_ll2string(vbuf, sizeof(vbuf), version);
+    size_t elen = expire ? m_ll2string(ebuf, sizeof(ebuf), expire) : 0;
+
+    if (offset && elen) {
+        RedisModule_Replicate(ctx, "EXHSETRANGE", "sssscbcb", key, field, offset, data, "ABS", vbuf, vlen, "PXAT", ebuf, elen);
+    } else if (offset) {
+        RedisModule_Replicate(ctx, "EXHSETRANGE", "sssscb", key, field, offset, data, "ABS", vbuf, vlen);
+    } else if (elen) {
+        RedisModule_Replicate(ctx, "EXHAPPEND", "ssscbcb", key, field, data, "ABS", vbuf, vlen, "PXAT", ebuf, elen);
+    } else {
+        RedisModule_Replicate(ctx, "EXHAPPEND", "ssscb", key, field, data, "ABS", vbuf, vlen);
+    }
+}
+
+void startExpireTimer(RedisModuleCtx *ctx, void *data) {
+    if (!g_expire_algorithm.enable_active_expire) {
+        return;
+    }
+
+    if (RedisModule_GetTimerInfo(ctx, g_expire_timer_id, NULL, NULL) == REDISMODULE_OK) {
+        return;
+    }
+
+    g_expire_timer_id = RedisModule_CreateTimer(ctx, g_expire_algorithm.active_expire_period, activeExpireTimerHandler, data);
+}
+
+/* ========================== Cold tier =============================*/
+
+#define TAIRHASH_COLD_SWEEP_PERIOD 100
+#define TAIRHASH_COLD_SWEEP_KEYS 16
+#define TAIRHASH_COLD_SWEEP_FIELDS 1024
+#define TAIRHASH_COLD_RECLAIM_PAGES 4096
+
+static void coldSweepCallback(void *privdata, const m_dictEntry *de) {
+    unsigned long *examined = privdata;
+    tairHashValFreeze(dictGetVal(de));
+    (*examined)++;
+}
+
+/* Look at the next fields of the key, from where the last sweep left it. */
+static void coldSweepKey(tairHashObj *o) {
+    unsigned long examined = 0;
+    do {
+        o->cold_cursor = m_segDictScan(o->hash, o->cold_cursor, coldSweepCallback, NULL, &examined);
+    } while (o->cold_cursor && examined < TAIRHASH_COLD_SWEEP_FIELDS);
+}
+
+/* Sweep the next keys of the first non empty db from where the last sweep
+ * left, moving to the next db once all of its keys were seen. */
+static void coldSweepDb(RedisModuleCtx *ctx) {
+    int dbid = g_cold_db;
+    RedisModuleCallReply *reply = NULL;
+
+    for (int j = 0; j < g_db_num; j++, dbid = (dbid + 1) % g_db_num) {
+        if (RedisModule_SelectDb(ctx, dbid) == REDISMODULE_OK && (!RedisModule_DbSize || RedisModule_DbSize(ctx))) break;
+        g_cold_scan_cursor[dbid] = 0;
+    }
+    g_cold_db = dbid;
+    if (RedisModule_SelectDb(ctx, dbid) == REDISMODULE_OK) {
+        reply = RedisModule_Call(ctx, "SCAN", "lcl", g_cold_scan_cursor[dbid], "COUNT", (long long)TAIRHASH_COLD_SWEEP_KEYS);
+    }
+    if (reply == NULL || RedisModule_CallReplyType(reply) != REDISMODULE_REPLY_ARRAY) {
+        g_cold_scan_cursor[dbid] = 0;
+    } else {
+        RedisModuleCallReply *cursor_reply = RedisModule_CallReplyArrayElement(reply, 0);
+        RedisModuleCallReply *keys_reply = RedisModule_CallReplyArrayElement(reply, 1);
+        Module_Assert(RedisModule_StringToLongLong(RedisModule_CreateStringFromCallReply(cursor_reply), &g_cold_scan_cursor[dbid]) == REDISMODULE_OK);
+        for (size_t j = 0; j < RedisModule_CallReplyLength(keys_reply); j++) {
+            RedisModuleString *key = RedisModule_CreateStringFromCallReply(RedisModule_CallReplyArrayElement(keys_reply, j));
+            RedisModuleKey *real_key = RedisModule_OpenKey(ctx, key, REDISMODULE_READ | REDISMODULE_OPEN_KEY_NOTOUCH);
+            if (RedisModule_KeyType(real_key) == REDISMODULE_KEYTYPE_MODULE && RedisModule_ModuleTypeGetType(real_key) == TairHashType) {
+                coldSweepKey(RedisModule_ModuleTypeGetValue(real_key));
+            }
+            RedisModule_CloseKey(real_key);
+        }
+    }
+    if (g_cold_scan_cursor[dbid] == 0) {
+        g_cold_db = (dbid + 1) % g_db_num;
+    }
+}
+
+/* A fork child may still read the records freed since it was born, their
+ * pages can't be punched out of the shared mapping until it exits. Redis
+ * reports the child in the context flags, servers too old to list the flag
+ * in GetContextFlagsAll() may still send the fork child events. */
+static int coldActiveChildFlag(void) {
+    return RedisModule_GetContextFlagsAll && (RedisModule_GetContextFlagsAll() & REDISMODULE_CTX_FLAGS_ACTIVE_CHILD);
+}
+
+static int coldReclaimGuarded(void) {
+    return coldActiveChildFlag() || g_fork_child_event;
+}
+
+static int coldForkChildActive(RedisModuleCtx *ctx) {
+    if (coldActiveChildFlag()) {
+        return (RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_ACTIVE_CHILD) != 0;
+    }
+    return !m_dictIsResizeEnabled();
+}
+
+/* Moves idle values to the cold store and gives the space of the freed ones
+ * back to the file system. Keeps running once the store exists. */
+static void coldTierTimerHandler(RedisModuleCtx *ctx, void *data) {
+    REDISMODULE_NOT_USED(data);
+    RedisModule_AutoMemory(ctx);
+
+    if (g_cold_idle_time && g_cold_store == NULL && (g_cold_store = m_coldStoreCreate(g_cold_dir)) == NULL) {
+        RedisModule_Log(ctx, "warning", "Can't create the cold store in %s, cold tier disabled", g_cold_dir);
+        g_cold_idle_time = 0;
+    }
+    if (g_cold_idle_time) {
+        coldSweepDb(ctx);
+    }
+    if (g_cold_store && !coldForkChildActive(ctx)) {
+        m_coldStoreReclaim(g_cold_store, TAIRHASH_COLD_RECLAIM_PAGES);
+    }
+    g_cold_timer_running = g_cold_idle_time || g_cold_store;
+    if (g_cold_timer_running) {
+        RedisModule_CreateTimer(ctx, TAIRHASH_COLD_SWEEP_PERIOD, coldTierTimerHandler, NULL);
+    }
+}
+
+static void startColdTierTimer(RedisModuleCtx *ctx) {
+    if (g_cold_idle_time && !g_cold_timer_running) {
+        RedisModule_CreateTimer(ctx, TAIRHASH_COLD_SWEEP_PERIOD, coldTierTimerHandler, NULL);
+        g_cold_timer_running = 1;
+    }
+}
+
+/* ========================== Module configs =============================*/
+
+/* Numeric configs share one getter/setter, privdata points to the field of
+ * g_expire_algorithm they control. */
+static long long getNumericConfig(const char *name, void *privdata) {
+    REDISMODULE_NOT_USED(name);
+    return (long long)*(uint64_t *)privdata;
+}
+
+static int setNumericConfig(const char *name, long long val, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(err);
+    *(uint64_t *)privdata = (uint64_t)val;
+    return REDISMODULE_OK;
+}
+
+static int getEnableActiveExpireConfig(const char *name, void *privdata) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    return g_expire_algorithm.enable_active_expire;
+}
+
+static int setEnableActiveExpireConfig(const char *name, int val, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(err);
+    g_expire_algorithm.enable_active_expire = val;
+    return REDISMODULE_OK;
+}
+
+static int getExpiredEventPayloadConfig(const char *name, void *privdata) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    return g_expired_event_payload;
+}
+
+static int setExpiredEventPayloadConfig(const char *name, int val, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(err);
+    g_expired_event_payload = val;
+    return REDISMODULE_OK;
+}
+
+static long long getDictForceResizeRatioConfig(const char *name, void *privdata) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    return m_dictGetForceResizeRatio();
+}
+
+static int setDictForceResizeRatioConfig(const char *name, long long val, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(err);
+    m_dictSetForceResizeRatio((unsigned int)val);
+    return REDISMODULE_OK;
+}
+
+static long long getDictSegmentThresholdConfig(const char *name, void *privdata) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    return m_segDictGetSplitSize();
+}
+
+static int setDictSegmentThresholdConfig(const char *name, long long val, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(err);
+    m_segDictSetSplitSize((unsigned long)val);
+    return REDISMODULE_OK;
+}
+
+static long long getValueCompressThresholdConfig(const char *name, void *privdata) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    return g_compress_threshold;
+}
+
+static int setValueCompressThresholdConfig(const char *name, long long val, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(err);
+    g_compress_threshold = val;
+    return REDISMODULE_OK;
+}
+
+static long long getColdTierIdleTimeConfig(const char *name, void *privdata) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    return g_cold_idle_time;
+}
+
+static int setColdTierIdleTimeConfig(const char *name, long long val, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(name);
+    REDISMODULE_NOT_USED(privdata);
+    if (val && !coldReclaimGuarded()) {
+        *err = RedisModule_CreateString(NULL, "ERR the server does not report its fork children", 48);
+        return REDISMODULE_ERR;
+    }
+    g_cold_idle_time = val;
+    return REDISMODULE_OK;
+}
+
+static int applyColdTierConfig(RedisModuleCtx *ctx, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(err);
+    startColdTierTimer(ctx);
+    return REDISMODULE_OK;
+}
+
+/* The timer re-arms itself with the period it was created with, so a new
+ * period or enable flag only takes effect once the pending timer is replaced. */
+static int applyActiveExpireConfig(RedisModuleCtx *ctx, void *privdata, RedisModuleString **err) {
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(err);
+    if (RedisModule_GetTimerInfo(ctx, g_expire_timer_id, NULL, NULL) == REDISMODULE_OK) {
+        RedisModule_StopTimer(ctx, g_expire_timer_id, NULL);
+    }
+    startExpireTimer(ctx, NULL);
+    return REDISMODULE_OK;
+}
+
+/* Expose the module arguments as `tairhash.<name>` configs (redis 7.0+), the
+ * values parsed from the module arguments are used as defaults. */
+static int Module_RegisterConfigs(RedisModuleCtx *ctx) {
+    if (RedisModule_RegisterBoolConfig(ctx, "enable_active_expire", g_expire_algorithm.enable_active_expire, REDISMODULE_CONFIG_DEFAULT,
+                                       getEnableActiveExpireConfig, setEnableActiveExpireConfig, applyActiveExpireConfig, NULL) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "active_expire_period", g_expire_algorithm.active_expire_period, REDISMODULE_CONFIG_DEFAULT, 1, INT_MAX,
+                                          getNumericConfig, setNumericConfig, applyActiveExpireConfig, &g_expire_algorithm.active_expire_period) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "active_expire_keys_per_loop", g_expire_algorithm.keys_per_active_loop, REDISMODULE_CONFIG_DEFAULT, 1, LLONG_MAX,
+                                          getNumericConfig, setNumericConfig, NULL, &g_expire_algorithm.keys_per_active_loop) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "active_expire_dbs_per_loop", g_expire_algorithm.dbs_per_active_loop, REDISMODULE_CONFIG_DEFAULT, 1, INT_MAX,
+                                          getNumericConfig, setNumericConfig, NULL, &g_expire_algorithm.dbs_per_active_loop) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "passive_expire_keys_per_loop", g_expire_algorithm.keys_per_passive_loop, REDISMODULE_CONFIG_DEFAULT, 1, LLONG_MAX,
+                                          getNumericConfig, setNumericConfig, NULL, &g_expire_algorithm.keys_per_passive_loop) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "dict_force_resize_ratio", m_dictGetForceResizeRatio(), REDISMODULE_CONFIG_DEFAULT, 1, UINT_MAX,
+                                          getDictForceResizeRatioConfig, setDictForceResizeRatioConfig, NULL, NULL) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "dict_segment_threshold", m_segDictGetSplitSize(), REDISMODULE_CONFIG_DEFAULT, 1, LLONG_MAX,
+                                          getDictSegmentThresholdConfig, setDictSegmentThresholdConfig, NULL, NULL) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "value_compress_threshold", g_compress_threshold, REDISMODULE_CONFIG_DEFAULT, 0, UINT32_MAX,
+                                          getValueCompressThresholdConfig, setValueCompressThresholdConfig, NULL, NULL) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterNumericConfig(ctx, "cold_tier_idle_time", g_cold_idle_time, REDISMODULE_CONFIG_DEFAULT, 0, UINT32_MAX,
+                                          getColdTierIdleTimeConfig, setColdTierIdleTimeConfig, applyColdTierConfig, NULL) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (RedisModule_RegisterBoolConfig(ctx, "expired_event_payload", g_expired_event_payload, REDISMODULE_CONFIG_DEFAULT,
+                                       getExpiredEventPayloadConfig, setExpiredEventPayloadConfig, NULL, NULL) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    return RedisModule_LoadConfigs(ctx);
+}
+
+static int mstrcasecmp(const RedisModuleString *rs1, const char *s2) {
+    size_t n1 = strlen(s2);
+    size_t n2;
+    const char *s1 = RedisModule_StringPtrLen(rs1, &n2);
+    if (n1 != n2) {
+        return -1;
+    }
+    return strncasecmp(s1, s2, n1);
+}
+
+static int mstrmatchlen(RedisModuleString *pattern, RedisModuleString *str, int nocase) {
+    size_t plen, slen;
+    const char *pattern_p = RedisModule_StringPtrLen(pattern, &plen);
+    const char *str_p = RedisModule_StringPtrLen(str, &slen);
+    return m_stringmatchlen(pattern_p, plen, str_p, slen, nocase);
+}
+
+/* Keyword options of the write commands. A keyword is found with a single
+ * probe of hashOptTable, indexed by its first and last byte lowercased, which
+ * tells all the keywords below apart. */
+#define HASH_OPT_SLOT(first, last) ((((first) | 0x20) + 2 * ((last) | 0x20)) & 31)
+
+typedef enum hashOptArg {
+    HASH_OPT_ARG_NONE = 0,
+    HASH_OPT_ARG_EXPIRE,
+    HASH_OPT_ARG_VERSION,
+    HASH_OPT_ARG_MIN,
+    HASH_OPT_ARG_MAX,
+} hashOptArg;
+
+typedef struct hashOptSpec {
+    const char *name;
+    size_t len;
+    int flags;     /* TAIR_HASH_SET_* flags set by the option. */
+    int conflicts; /* Flags the option can not be combined with. */
+    hashOptArg arg;
+} hashOptSpec;
+
+#define HASH_OPT_EXPIRE_CONFLICTS (TAIR_HASH_SET_WITH_EXPIRE | TAIR_HASH_SET_KEEPTTL)
+
+static const hashOptSpec hashOptTable[32] = {
+    [HASH_OPT_SLOT('n', 'x')] = {"nx", 2, TAIR_HASH_SET_NX, TAIR_HASH_SET_XX, HASH_OPT_ARG_NONE},
+    [HASH_OPT_SLOT('x', 'x')] = {"xx", 2, TAIR_HASH_SET_XX, TAIR_HASH_SET_NX, HASH_OPT_ARG_NONE},
+    [HASH_OPT_SLOT('e', 'x')] = {"ex", 2, TAIR_HASH_SET_EX, HASH_OPT_EXPIRE_CONFLICTS, HASH_OPT_ARG_EXPIRE},
+    [HASH_OPT_SLOT('e', 't')] = {"exat", 4, TAIR_HASH_SET_EX | TAIR_HASH_SET_ABS_EXPIRE, HASH_OPT_EXPIRE_CONFLICTS, HASH_OPT_ARG_EXPIRE},
+    [HASH_OPT_SLOT('p', 'x')] = {"px", 2, TAIR_HASH_SET_PX, HASH_OPT_EXPIRE_CONFLICTS, HASH_OPT_ARG_EXPIRE},
+    [HASH_OPT_SLOT('p', 't')] = {"pxat", 4, TAIR_HASH_SET_PX | TAIR_HASH_SET_ABS_EXPIRE, HASH_OPT_EXPIRE_CONFLICTS, HASH_OPT_ARG_EXPIRE},
+    [HASH_OPT_SLOT('v', 'r')] = {"ver", 3, TAIR_HASH_SET_WITH_VER, TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER, HASH_OPT_ARG_VERSION},
+    [HASH_OPT_SLOT('a', 's')] = {"abs", 3, TAIR_HASH_SET_WITH_ABS_VER, TAIR_HASH_SET_WITH_VER | TAIR_HASH_SET_WITH_GT_VER, HASH_OPT_ARG_VERSION},
+    [HASH_OPT_SLOT('g', 't')] = {"gt", 2, TAIR_HASH_SET_WITH_GT_VER, TAIR_HASH_SET_WITH_VER | TAIR_HASH_SET_WITH_ABS_VER, HASH_OPT_ARG_VERSION},
+    [HASH_OPT_SLOT('m', 'n')] = {"min", 3, TAIR_HASH_SET_WITH_BOUNDARY, 0, HASH_OPT_ARG_MIN},
+    [HASH_OPT_SLOT('m', 'x')] = {"max", 3, TAIR_HASH_SET_WITH_BOUNDARY, 0, HASH_OPT_ARG_MAX},
+    [HASH_OPT_SLOT('k', 'l')] = {"keepttl", 7, TAIR_HASH_SET_KEEPTTL, TAIR_HASH_SET_WITH_EXPIRE, HASH_OPT_ARG_NONE},
+};
+
+/* Options accepted by each command. */
+#define HASH_OPTS_EXPIRE TAIR_HASH_SET_WITH_ANY_VER
+#define HASH_OPTS_INCR (TAIR_HASH_SET_WITH_EXPIRE | TAIR_HASH_SET_ABS_EXPIRE | TAIR_HASH_SET_WITH_ANY_VER | TAIR_HASH_SET_WITH_BOUNDARY | TAIR_HASH_SET_KEEPTTL)
+#define HASH_OPTS_SET ((HASH_OPTS_INCR & ~TAIR_HASH_SET_WITH_BOUNDARY) | TAIR_HASH_SET_NX | TAIR_HASH_SET_XX)
+#define HASH_OPTS_PATCH (HASH_OPTS_INCR & ~TAIR_HASH_SET_WITH_BOUNDARY)
+
+typedef struct hashOpts {
+    int flags;                        /* TAIR_HASH_SET_* */
+    long long milliseconds;           /* Absolute expire, 0 without EX, EXAT, PX or PXAT. */
+    long long version;                /* 0 without VER, ABS or GT. */
+    RedisModuleString *min_p, *max_p; /* MIN and MAX, their type depends on the command. */
+} hashOpts;
+
+static const hashOptSpec *lookupHashOpt(RedisModuleString *arg) {
+    size_t len;
+    const char *p = RedisModule_StringPtrLen(arg, &len);
+    if (len < 2) {
+        return NULL;
+    }
+    const hashOptSpec *spec = &hashOptTable[HASH_OPT_SLOT((unsigned char)p[0], (unsigned char)p[len - 1])];
+    if (spec->len != len || strncasecmp(p, spec->name, len)) {
+        return NULL;
+    }
+    return spec;
 }
 
-#endif
+/* Parse argv[start..argc-1] as options of a command accepting the 'allowed'
+ * flags. Unknown, conflicting or malformed options reply with an error and
+ * return REDISMODULE_ERR. */
+static int parseHashOpts(RedisModuleCtx *ctx, RedisModuleString **argv, int start, int argc, int allowed, hashOpts *opts) {
+    RedisModuleString *expire_p = NULL, *version_p = NULL;
+    long long expire = 0;
 
-void startExpireTimer(RedisModuleCtx *ctx, void *data) {
-    if (!g_expire_algorithm.enable_active_expire) {
-        return;
+    memset(opts, 0, sizeof(*opts));
+    for (int j = start; j < argc; j++) {
+        const hashOptSpec *spec = lookupHashOpt(argv[j]);
+        if (spec == NULL || (spec->flags & ~allowed) || (opts->flags & spec->conflicts) || (spec->arg && j == argc - 1)) {
+            RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+            return REDISMODULE_ERR;
+        }
+        opts->flags |= spec->flags;
+        switch (spec->arg) {
+            case HASH_OPT_ARG_EXPIRE:
+                expire_p = argv[++j];
+                break;
+            case HASH_OPT_ARG_VERSION:
+                version_p = argv[++j];
+                break;
+            case HASH_OPT_ARG_MIN:
+                opts->min_p = argv[++j];
+                break;
+            case HASH_OPT_ARG_MAX:
+                opts->max_p = argv[++j];
+                break;
+            default:
+                break;
+        }
     }
 
-    if (RedisModule_GetTimerInfo(ctx, g_expire_timer_id, NULL, NULL) == REDISMODULE_OK) {
-        return;
+    if (expire_p && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK || expire < 0)) {
+        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
     }
 
-    g_expire_timer_id = RedisModule_CreateTimer(ctx, g_expire_algorithm.active_expire_period, activeExpireTimerHandler, data);
+    if (version_p && (RedisModule_StringToLongLong(version_p, &opts->version) != REDISMODULE_OK || opts->version < 0 ||
+                      ((opts->flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) && opts->version == 0))) {
+        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (expire > 0) {
+        if (opts->flags & TAIR_HASH_SET_EX) {
+            expire *= 1000;
+        }
+        opts->milliseconds = (opts->flags & TAIR_HASH_SET_ABS_EXPIRE) ? expire : expireClockNow() + expire;
+    } else if (expire_p) {
+        /* Already expired. */
+        opts->milliseconds = 1;
+    }
+    return REDISMODULE_OK;
 }
 
-static int mstrcasecmp(const RedisModuleString *rs1, const char *s2) {
-    size_t n1 = strlen(s2);
-    size_t n2;
-    const char *s1 = RedisModule_StringPtrLen(rs1, &n2);
-    if (n1 != n2) {
-        return -1;
+/* Check the VER or GT option against the current version of a field, replying
+ * with an error on mismatch. */
+static int checkHashOptsVersion(RedisModuleCtx *ctx, const hashOpts *opts, const TairHashVal *tair_hash_val) {
+    if (((opts->flags & TAIR_HASH_SET_WITH_VER) && opts->version != 0 && opts->version != tair_hash_val->version) ||
+        ((opts->flags & TAIR_HASH_SET_WITH_GT_VER) && opts->version <= tair_hash_val->version)) {
+        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
+        return REDISMODULE_ERR;
     }
-    return strncasecmp(s1, s2, n1);
+    return REDISMODULE_OK;
 }
 
-static int mstrmatchlen(RedisModuleString *pattern, RedisModuleString *str, int nocase) {
-    size_t plen, slen;
-    const char *pattern_p = RedisModule_StringPtrLen(pattern, &plen);
-    const char *str_p = RedisModule_StringPtrLen(str, &slen);
-    return m_stringmatchlen(pattern_p, plen, str_p, slen, nocase);
+/* Version of a field written with these options. */
+static inline long long hashOptsNextVersion(const hashOpts *opts, const TairHashVal *tair_hash_val) {
+    return (opts->flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) ? opts->version : tair_hash_val->version + 1;
 }
 
 int tairHashExpireGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, long long basetime, int unit) {
@@ -499,9 +1747,9 @@ int tairHashExpireGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
     }
 
     long long milliseconds;
-    long long version = 0;
     int field_expired = 0;
     int nokey;
+    hashOpts opts;
 
     if (RedisModule_StringToLongLong(argv[3], &milliseconds) != REDISMODULE_OK) {
         RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
@@ -513,38 +1761,7 @@ int tairHashExpireGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
         return REDISMODULE_ERR;
     }
 
-    RedisModuleString *version_p = NULL;
-    int ex_flags = TAIR_HASH_SET_NO_FLAGS;
-
-    if (argc > 4) {
-        for (int j = 4; j < argc; j++) {
-            RedisModuleString *next = (j == argc - 1) ? NULL : argv[j + 1];
-            if (!mstrcasecmp(argv[4], "ver") && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-                ex_flags |= TAIR_HASH_SET_WITH_VER;
-                version_p = next;
-                j++;
-            } else if (!mstrcasecmp(argv[4], "abs") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-                ex_flags |= TAIR_HASH_SET_WITH_ABS_VER;
-                version_p = next;
-                j++;
-            } else if (!mstrcasecmp(argv[4], "gt") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && next) {
-                ex_flags |= TAIR_HASH_SET_WITH_GT_VER;
-                version_p = next;
-                j++;
-            } else {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-                return REDISMODULE_ERR;
-            }
-        }
-    }
-
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if (version < 0 || ((ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) && version == 0)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+    if (parseHashOpts(ctx, argv, 4, argc, HASH_OPTS_EXPIRE, &opts) != REDISMODULE_OK) {
         return REDISMODULE_ERR;
     }
 
@@ -571,7 +1788,7 @@ int tairHashExpireGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
     }
 
     TairHashVal *tair_hash_val = NULL;
-    m_dictEntry *de = m_dictFind(tair_hash_obj->hash, skey);
+    m_dictEntry *de = m_segDictFind(tair_hash_obj->hash, skey);
     if (field_expired || de == NULL) {
         nokey = 1;
         RedisModule_ReplyWithLongLong(ctx, 0);
@@ -579,16 +1796,8 @@ int tairHashExpireGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
         nokey = 0;
         skey = dictGetKey(de);
         tair_hash_val = dictGetVal(de);
-        if (ex_flags & TAIR_HASH_SET_WITH_VER) {
-            if (version != 0 && version != tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
-        } else if (ex_flags & TAIR_HASH_SET_WITH_GT_VER) {
-            if (version <= tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
+        if (checkHashOptsVersion(ctx, &opts, tair_hash_val) != REDISMODULE_OK) {
+            return REDISMODULE_ERR;
         }
 
         if (milliseconds == 0) {
@@ -612,24 +1821,8 @@ int tairHashExpireGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
 
         RedisModule_ReplyWithLongLong(ctx, 1);
 
-        if (ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) {
-            tair_hash_val->version = version;
-        } else {
-            tair_hash_val->version += 1;
-        }
-
-        size_t vlen = 0, VSIZE_MAX = 5;
-        RedisModuleString **v = RedisModule_Alloc(sizeof(RedisModuleString *) * VSIZE_MAX);
-        v[vlen++] = RedisModule_CreateStringFromString(ctx, argv[1]);
-        v[vlen++] = RedisModule_CreateStringFromString(ctx, argv[2]);
-        v[vlen++] = RedisModule_CreateStringFromLongLong(ctx, tair_hash_val->expire);
-        if (version_p) {
-            v[vlen++] = RedisModule_CreateString(ctx, "ABS", 3);
-            v[vlen++] = RedisModule_CreateStringFromLongLong(ctx, tair_hash_val->version);
-        }
-
-        RedisModule_Replicate(ctx, "EXHPEXPIREAT", "v", v, vlen);
-        RedisModule_Free(v);
+        tair_hash_val->version = hashOptsNextVersion(&opts, tair_hash_val);
+        replicateHpexpireAt(ctx, argv[1], argv[2], tair_hash_val->expire, (opts.flags & TAIR_HASH_SET_WITH_ANY_VER) ? tair_hash_val->version : 0);
     }
 
     delEmptyTairHashIfNeeded(ctx, key, pkey, tair_hash_obj);
@@ -672,14 +1865,14 @@ int tairHashTTLGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int ar
         field_expired = 1;
     }
 
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, skey);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, skey);
     if (field_expired || tair_hash_val == NULL) {
         RedisModule_ReplyWithLongLong(ctx, -3);
     } else {
         if (tair_hash_val->expire == 0) {
             RedisModule_ReplyWithLongLong(ctx, -1);
         } else {
-            long long ttl = tair_hash_val->expire - RedisModule_Milliseconds();
+            long long ttl = tair_hash_val->expire - expireClockNow();
             if (ttl < 0) {
                 ttl = 0;
             }
@@ -718,89 +1911,28 @@ int TairHashTypeHset_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         return RedisModule_WrongArity(ctx);
     }
 
-    long long milliseconds = 0, expire = 0, version = 0;
-    RedisModuleString *expire_p = NULL, *version_p = NULL;
-    int ex_flags = TAIR_HASH_SET_NO_FLAGS;
+    long long milliseconds;
+    hashOpts opts;
     int nokey = 0;
 
-    g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), argv[1]);
-
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
         return REDISMODULE_ERR;
     }
 
-    for (int j = 4; j < argc; j++) {
-        RedisModuleString *next = (j == argc - 1) ? NULL : argv[j + 1];
-        if (!mstrcasecmp(argv[j], "nx") && !(ex_flags & TAIR_HASH_SET_XX)) {
-            ex_flags |= TAIR_HASH_SET_NX;
-        } else if (!mstrcasecmp(argv[j], "xx") && !(ex_flags & TAIR_HASH_SET_NX)) {
-            ex_flags |= TAIR_HASH_SET_XX;
-        } else if (!mstrcasecmp(argv[j], "ex") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_EX;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "exat") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_EX;
-            ex_flags |= TAIR_HASH_SET_ABS_EXPIRE;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "px") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_PX;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "pxat") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_PX;
-            ex_flags |= TAIR_HASH_SET_ABS_EXPIRE;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "ver") && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "abs") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_ABS_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "gt") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_GT_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "keepttl") && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_PX)) {
-            ex_flags |= TAIR_HASH_SET_KEEPTTL;
-        } else {
-            RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-            return REDISMODULE_ERR;
-        }
-    }
-
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if (expire_p && expire < 0) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if (version < 0 || ((ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) && version == 0)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+    if (parseHashOpts(ctx, argv, 4, argc, HASH_OPTS_SET, &opts) != REDISMODULE_OK) {
         return REDISMODULE_ERR;
     }
+    milliseconds = opts.milliseconds;
 
     RedisModuleString *pkey = argv[1], *skey = argv[2];
 
     tairHashObj *tair_hash_obj = NULL;
     if (type == REDISMODULE_KEYTYPE_EMPTY) {
-        if (ex_flags & TAIR_HASH_SET_XX) {
+        if (opts.flags & TAIR_HASH_SET_XX) {
             RedisModule_ReplyWithLongLong(ctx, -1);
             return REDISMODULE_ERR;
         }
@@ -813,9 +1945,11 @@ int TairHashTypeHset_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
 
     int dbid = RedisModule_GetSelectedDb(ctx);
     fieldExpireIfNeeded(ctx, dbid, pkey, tair_hash_obj, skey, 0);
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, skey);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, skey);
     if (tair_hash_val == NULL) {
-        if (ex_flags & TAIR_HASH_SET_XX) {
+        if (opts.flags & TAIR_HASH_SET_XX) {
+            /* The field may just have expired, and it may have been the last one. */
+            delEmptyTairHashIfNeeded(ctx, key, pkey, tair_hash_obj);
             RedisModule_ReplyWithLongLong(ctx, -1);
             return REDISMODULE_ERR;
         }
@@ -826,45 +1960,20 @@ int TairHashTypeHset_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         tair_hash_val->value = NULL;
     } else {
         nokey = 0;
-        if (ex_flags & TAIR_HASH_SET_NX) {
+        if (opts.flags & TAIR_HASH_SET_NX) {
             RedisModule_ReplyWithLongLong(ctx, -1);
             return REDISMODULE_ERR;
         }
 
         /* Version equals 0 means no version checking */
-        if (ex_flags & TAIR_HASH_SET_WITH_VER) {
-            if (version != 0 && version != tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
-        } else if (ex_flags & TAIR_HASH_SET_WITH_GT_VER) {
-            if (version <= tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
+        if (checkHashOptsVersion(ctx, &opts, tair_hash_val) != REDISMODULE_OK) {
+            return REDISMODULE_ERR;
         }
     }
 
-    if (ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) {
-        tair_hash_val->version = version;
-    } else {
-        tair_hash_val->version += 1;
-    }
-
-    if (0 < expire) {
-        if (ex_flags & TAIR_HASH_SET_EX) {
-            expire *= 1000;
-        }
-        if (ex_flags & TAIR_HASH_SET_ABS_EXPIRE) {
-            milliseconds = expire;
-        } else {
-            milliseconds = RedisModule_Milliseconds() + expire;
-        }
-    } else if (expire_p && expire == 0) {
-        milliseconds = 1;
-    }
+    tair_hash_val->version = hashOptsNextVersion(&opts, tair_hash_val);
 
-    if (milliseconds == 0 && !(ex_flags & TAIR_HASH_SET_KEEPTTL)) {
+    if (milliseconds == 0 && !(opts.flags & TAIR_HASH_SET_KEEPTTL)) {
         g_expire_algorithm.delete(ctx, dbid, argv[1], tair_hash_obj, skey, tair_hash_val->expire);
         tair_hash_val->expire = 0;
     }
@@ -878,33 +1987,16 @@ int TairHashTypeHset_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         tair_hash_val->expire = milliseconds;
     }
 
-    if (tair_hash_val->value) {
-        RedisModule_FreeString(NULL, tair_hash_val->value);
-    }
-
-    tair_hash_val->value = takeAndRef(argv[3]);
+    setTairHashValValue(tair_hash_val, argv[3]);
     if (nokey) {
-        m_dictAdd(tair_hash_obj->hash, takeAndRef(skey), tair_hash_val);
+        addTairHashField(tair_hash_obj, takeAndRef(skey), tair_hash_val);
         RedisModule_ReplyWithLongLong(ctx, 1);
     } else {
         RedisModule_ReplyWithLongLong(ctx, 0);
     }
 
-    size_t vlen = 0, VSIZE_MAX = 7;
-    RedisModuleString **v = RedisModule_Alloc(sizeof(RedisModuleString *) * VSIZE_MAX);
-    v[vlen++] = RedisModule_CreateStringFromString(ctx, argv[1]);
-    v[vlen++] = RedisModule_CreateStringFromString(ctx, argv[2]);
-    v[vlen++] = RedisModule_CreateStringFromString(ctx, tair_hash_val->value);
-    if (version_p) {
-        v[vlen++] = RedisModule_CreateString(ctx, "ABS", 3);
-        v[vlen++] = RedisModule_CreateStringFromLongLong(ctx, tair_hash_val->version);
-    }
-    if (expire_p) {
-        v[vlen++] = RedisModule_CreateString(ctx, "PXAT", 4);
-        v[vlen++] = RedisModule_CreateStringFromLongLong(ctx, tair_hash_val->expire);
-    }
-    RedisModule_Replicate(ctx, "EXHSET", "v", v, vlen);
-    RedisModule_Free(v);
+    /* The expire is sent whenever the field has one, KEEPTTL included. */
+    replicateHset(ctx, argv[1], argv[2], argv[3], (opts.flags & TAIR_HASH_SET_WITH_ANY_VER) ? tair_hash_val->version : 0, tair_hash_val->expire);
     return REDISMODULE_OK;
 }
 
@@ -916,9 +2008,8 @@ int TairHashTypeHsetNx_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **arg
         return RedisModule_WrongArity(ctx);
     }
 
-    g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), argv[1]);
-
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -936,7 +2027,7 @@ int TairHashTypeHsetNx_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **arg
         tair_hash_obj = RedisModule_ModuleTypeGetValue(key);
     }
 
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, skey);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, skey);
     if (tair_hash_val == NULL) {
         tair_hash_val = createTairHashVal();
         tair_hash_val->expire = 0;
@@ -945,8 +2036,8 @@ int TairHashTypeHsetNx_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **arg
         return REDISMODULE_OK;
     }
 
-    tair_hash_val->value = takeAndRef(svalue);
-    m_dictAdd(tair_hash_obj->hash, takeAndRef(skey), tair_hash_val);
+    setTairHashValValue(tair_hash_val, svalue);
+    addTairHashField(tair_hash_obj, takeAndRef(skey), tair_hash_val);
 
     RedisModule_ReplicateVerbatim(ctx);
     RedisModule_ReplyWithLongLong(ctx, 1);
@@ -961,10 +2052,8 @@ int TairHashTypeHmset_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
         return RedisModule_WrongArity(ctx);
     }
 
-    g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), argv[1]);
-
-    int nokey;
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -982,21 +2071,18 @@ int TairHashTypeHmset_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
 
     int dbid = RedisModule_GetSelectedDb(ctx);
     for (int i = 2; i < argc; i += 2) {
+        int nokey = 0;
         fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[i], 0);
-        TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[i]);
+        TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[i]);
         if (tair_hash_val == NULL) {
             nokey = 1;
             tair_hash_val = createTairHashVal();
             tair_hash_val->expire = 0;
-        } else {
-            if (tair_hash_val->value) {
-                RedisModule_FreeString(NULL, tair_hash_val->value);
-            }
         }
-        tair_hash_val->value = takeAndRef(argv[i + 1]);
+        setTairHashValValue(tair_hash_val, argv[i + 1]);
         tair_hash_val->version++;
         if (nokey) {
-            m_dictAdd(tair_hash_obj->hash, takeAndRef(argv[i]), tair_hash_val);
+            addTairHashField(tair_hash_obj, takeAndRef(argv[i]), tair_hash_val);
         }
     }
 
@@ -1013,9 +2099,8 @@ int TairHashTypeHmsetWithOpts_RedisCommand(RedisModuleCtx *ctx, RedisModuleStrin
         return RedisModule_WrongArity(ctx);
     }
 
-    g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), argv[1]);
-
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -1053,7 +2138,7 @@ int TairHashTypeHmsetWithOpts_RedisCommand(RedisModuleCtx *ctx, RedisModuleStrin
         }
 
         fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[i], 0);
-        TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[i]);
+        TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[i]);
         if (tair_hash_val == NULL || ver == 0 || tair_hash_val->version == ver) {
             continue;
         } else {
@@ -1062,16 +2147,13 @@ int TairHashTypeHmsetWithOpts_RedisCommand(RedisModuleCtx *ctx, RedisModuleStrin
         }
     }
 
-    size_t vlen = 0;
-    RedisModuleString **v = RedisModule_Alloc(sizeof(RedisModuleString *) * 7);
-
     for (int i = 2; i < argc; i += 4) {
         if (RedisModule_StringToLongLong(argv[i + 3], &when) != REDISMODULE_OK) {
             RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
             return REDISMODULE_ERR;
         }
 
-        TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[i]);
+        TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[i]);
         if (tair_hash_val == NULL) {
             tair_hash_val = createTairHashVal();
             tair_hash_val->expire = 0;
@@ -1082,15 +2164,11 @@ int TairHashTypeHmsetWithOpts_RedisCommand(RedisModuleCtx *ctx, RedisModuleStrin
             nokey = 0;
         }
 
-        if (tair_hash_val->value) {
-            RedisModule_FreeString(NULL, tair_hash_val->value);
-        }
-
-        tair_hash_val->value = takeAndRef(argv[i + 1]);
+        setTairHashValValue(tair_hash_val, argv[i + 1]);
         tair_hash_val->version++;
 
         int dbid = RedisModule_GetSelectedDb(ctx);
-        when = RedisModule_Milliseconds() + when * 1000;
+        when = expireClockNow() + when * 1000;
         if (nokey || tair_hash_val->expire == 0) {
             g_expire_algorithm.insert(ctx, dbid, argv[1], tair_hash_obj, argv[i], when);
         } else {
@@ -1099,21 +2177,12 @@ int TairHashTypeHmsetWithOpts_RedisCommand(RedisModuleCtx *ctx, RedisModuleStrin
         tair_hash_val->expire = when;
 
         if (nokey) {
-            m_dictAdd(tair_hash_obj->hash, takeAndRef(argv[i]), tair_hash_val);
+            addTairHashField(tair_hash_obj, takeAndRef(argv[i]), tair_hash_val);
         }
 
-        v[vlen++] = RedisModule_CreateStringFromString(ctx, argv[1]);
-        v[vlen++] = RedisModule_CreateStringFromString(ctx, argv[i]);
-        v[vlen++] = RedisModule_CreateStringFromString(ctx, argv[i + 1]);
-        v[vlen++] = RedisModule_CreateString(ctx, "ABS", 3);
-        v[vlen++] = RedisModule_CreateStringFromLongLong(ctx, tair_hash_val->version);
-        v[vlen++] = RedisModule_CreateString(ctx, "PXAT", 4);
-        v[vlen++] = RedisModule_CreateStringFromLongLong(ctx, tair_hash_val->expire);
-        RedisModule_Replicate(ctx, "EXHSET", "v", v, vlen);
-        vlen = 0;
+        replicateHset(ctx, argv[1], argv[i], argv[i + 1], tair_hash_val->version, tair_hash_val->expire);
     }
 
-    RedisModule_Free(v);
     RedisModule_ReplyWithSimpleString(ctx, "OK");
     return REDISMODULE_OK;
 }
@@ -1125,7 +2194,7 @@ int TairHashTypeHpexpireAt_RedisCommand(RedisModuleCtx *ctx, RedisModuleString *
 
 /*  EXHPEXPIRE <key> <field> <milliseconds> [ VER version | ABS version | GT version ]*/
 int TairHashTypeHpexpire_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    return tairHashExpireGenericFunc(ctx, argv, argc, RedisModule_Milliseconds(), UNIT_MILLISECONDS);
+    return tairHashExpireGenericFunc(ctx, argv, argc, expireClockNow(), UNIT_MILLISECONDS);
 }
 
 /*  EXHEXPIREAT <key> <field> <timestamp> [ VER version | ABS version | GT version ] */
@@ -1135,7 +2204,7 @@ int TairHashTypeHexpireAt_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **
 
 /*  EXHEXPIRE <key> <field> <seconds> [ VER version | ABS version | GT version ] */
 int TairHashTypeHexpire_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    return tairHashExpireGenericFunc(ctx, argv, argc, RedisModule_Milliseconds(), UNIT_SECONDS);
+    return tairHashExpireGenericFunc(ctx, argv, argc, expireClockNow(), UNIT_SECONDS);
 }
 
 /*  EXHPTTL <key> <field> */
@@ -1178,11 +2247,12 @@ int TairHashTypeHpersist_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **a
 
     int dbid = RedisModule_GetSelectedDb(ctx);
     if (fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[2], 0)) {
+        delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
         RedisModule_ReplyWithLongLong(ctx, 0);
         return REDISMODULE_OK;
     }
 
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[2]);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[2]);
     if (tair_hash_val == NULL) {
         RedisModule_ReplyWithLongLong(ctx, 0);
         return REDISMODULE_OK;
@@ -1235,7 +2305,7 @@ int TairHashTypeHver_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         field_expired = 1;
     }
 
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[2]);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[2]);
     if (field_expired || tair_hash_val == NULL) {
         RedisModule_ReplyWithLongLong(ctx, -2);
     } else {
@@ -1267,9 +2337,8 @@ int TairHashTypeHsetVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
         return REDISMODULE_ERR;
     }
 
-    g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), argv[1]);
-
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -1289,7 +2358,7 @@ int TairHashTypeHsetVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
         return REDISMODULE_ERR;
     }
 
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[2]);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[2]);
     if (tair_hash_val == NULL) {
         RedisModule_ReplyWithLongLong(ctx, 0);
         return REDISMODULE_OK;
@@ -1316,16 +2385,12 @@ int TairHashTypeHincrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
         return RedisModule_WrongArity(ctx);
     }
 
-    long long milliseconds = 0, expire = 0, incr = 0, version = 0, min = 0, max = 0;
-    RedisModuleString *expire_p = NULL;
-    RedisModuleString *version_p = NULL;
-    RedisModuleString *min_p = NULL, *max_p = NULL;
-    int ex_flags = TAIR_HASH_SET_NO_FLAGS;
+    long long milliseconds, incr = 0, min = 0, max = 0;
+    hashOpts opts;
     int nokey;
 
-    g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), argv[1]);
-
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -1337,85 +2402,22 @@ int TairHashTypeHincrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
         return REDISMODULE_ERR;
     }
 
-    for (int j = 4; j < argc; j++) {
-        RedisModuleString *next = (j == argc - 1) ? NULL : argv[j + 1];
-        if (!mstrcasecmp(argv[j], "ex") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_EX;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "exat") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_EX;
-            ex_flags |= TAIR_HASH_SET_ABS_EXPIRE;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "px") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_PX;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "pxat") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_PX;
-            ex_flags |= TAIR_HASH_SET_ABS_EXPIRE;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "ver") && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "abs") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_ABS_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "gt") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_GT_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "min") && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_BOUNDARY;
-            min_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "max") && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_BOUNDARY;
-            max_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "keepttl") && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_PX)) {
-            ex_flags |= TAIR_HASH_SET_KEEPTTL;
-        } else {
-            RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-            return REDISMODULE_ERR;
-        }
-    }
-
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if (expire_p && expire < 0) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if (version < 0 || ((ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) && version == 0)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+    if (parseHashOpts(ctx, argv, 4, argc, HASH_OPTS_INCR, &opts) != REDISMODULE_OK) {
         return REDISMODULE_ERR;
     }
+    milliseconds = opts.milliseconds;
 
-    if ((NULL != min_p) && (RedisModule_StringToLongLong(min_p, &min))) {
+    if ((NULL != opts.min_p) && (RedisModule_StringToLongLong(opts.min_p, &min))) {
         RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_INT_MIN_MAX);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != max_p) && (RedisModule_StringToLongLong(max_p, &max))) {
+    if ((NULL != opts.max_p) && (RedisModule_StringToLongLong(opts.max_p, &max))) {
         RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_INT_MIN_MAX);
         return REDISMODULE_ERR;
     }
 
-    if (NULL != min_p && NULL != max_p && max < min) {
+    if (NULL != opts.min_p && NULL != opts.max_p && max < min) {
         RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_MIN_MAX);
         return REDISMODULE_ERR;
     }
@@ -1434,7 +2436,7 @@ int TairHashTypeHincrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
     int dbid = RedisModule_GetSelectedDb(ctx);
     fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[2], 0);
     TairHashVal *tair_hash_val = NULL;
-    m_dictEntry *de = m_dictFind(tair_hash_obj->hash, skey);
+    m_dictEntry *de = m_segDictFind(tair_hash_obj->hash, skey);
     if (de == NULL) {
         nokey = 1;
         tair_hash_val = createTairHashVal();
@@ -1452,26 +2454,21 @@ int TairHashTypeHincrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
         cur_val = 0;
         tair_hash_val->version = 0;
     } else {
-        if (RedisModule_StringToLongLong(tair_hash_val->value, &cur_val) != REDISMODULE_OK) {
+        RedisModuleString *cur = tairHashValDecode(tair_hash_val);
+        int ret = RedisModule_StringToLongLong(cur, &cur_val);
+        RedisModule_FreeString(NULL, cur);
+        if (ret != REDISMODULE_OK) {
             RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_NOT_INTEGER);
             return REDISMODULE_ERR;
         }
 
         /* Version equals 0 means no version checking */
-        if (ex_flags & TAIR_HASH_SET_WITH_VER) {
-            if (version != 0 && version != tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
-        } else if (ex_flags & TAIR_HASH_SET_WITH_GT_VER) {
-            if (version <= tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
+        if (checkHashOptsVersion(ctx, &opts, tair_hash_val) != REDISMODULE_OK) {
+            return REDISMODULE_ERR;
         }
     }
 
-    if ((incr < 0 && cur_val < 0 && incr < (LLONG_MIN - cur_val)) || (incr > 0 && cur_val > 0 && incr > (LLONG_MAX - cur_val)) || (max_p != NULL && cur_val + incr > max) || (min_p != NULL && cur_val + incr < min)) {
+    if ((incr < 0 && cur_val < 0 && incr < (LLONG_MIN - cur_val)) || (incr > 0 && cur_val > 0 && incr > (LLONG_MAX - cur_val)) || (opts.max_p != NULL && cur_val + incr > max) || (opts.min_p != NULL && cur_val + incr < min)) {
         if (nokey) {
             tairHashValRelease(tair_hash_val);
         }
@@ -1479,33 +2476,14 @@ int TairHashTypeHincrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
         return REDISMODULE_ERR;
     }
 
-    if (ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) {
-        tair_hash_val->version = version;
-    } else {
-        tair_hash_val->version += 1;
-    }
+    tair_hash_val->version = hashOptsNextVersion(&opts, tair_hash_val);
 
     cur_val += incr;
 
-    if (tair_hash_val->value) {
-        RedisModule_FreeString(NULL, tair_hash_val->value);
-    }
-    tair_hash_val->value = RedisModule_CreateStringFromLongLong(NULL, cur_val);
-
-    if (0 < expire) {
-        if (ex_flags & TAIR_HASH_SET_EX) {
-            expire *= 1000;
-        }
-        if (ex_flags & TAIR_HASH_SET_ABS_EXPIRE) {
-            milliseconds = expire;
-        } else {
-            milliseconds = RedisModule_Milliseconds() + expire;
-        }
-    } else if (expire_p && expire == 0) {
-        milliseconds = 1;
-    }
+    /* Numbers are too short to be worth compressing. */
+    setTairHashValRaw(tair_hash_val, RedisModule_CreateStringFromLongLong(NULL, cur_val));
 
-    if (milliseconds == 0 && !(ex_flags & TAIR_HASH_SET_KEEPTTL)) {
+    if (milliseconds == 0 && !(opts.flags & TAIR_HASH_SET_KEEPTTL)) {
         g_expire_algorithm.delete(ctx, dbid, argv[1], tair_hash_obj, skey, tair_hash_val->expire);
         tair_hash_val->expire = 0;
     }
@@ -1520,15 +2498,11 @@ int TairHashTypeHincrBy_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
     }
 
     if (nokey) {
-        m_dictAdd(tair_hash_obj->hash, takeAndRef(skey), tair_hash_val);
+        addTairHashField(tair_hash_obj, takeAndRef(skey), tair_hash_val);
     }
 
-    if (milliseconds > 0) {
-        RedisModule_Replicate(ctx, "EXHSET", "sssclcl", argv[1], argv[2], tair_hash_val->value, "abs",
-                              tair_hash_val->version, "pxat", (milliseconds + RedisModule_Milliseconds()));
-    } else {
-        RedisModule_Replicate(ctx, "EXHSET", "ssscl", argv[1], argv[2], tair_hash_val->value, "abs", tair_hash_val->version);
-    }
+    /* The expire is already absolute, and kept by KEEPTTL. */
+    replicateHset(ctx, argv[1], argv[2], tair_hash_val->value, tair_hash_val->version, tair_hash_val->expire);
 
     RedisModule_ReplyWithLongLong(ctx, cur_val);
     return REDISMODULE_OK;
@@ -1543,17 +2517,13 @@ int TairHashTypeHincrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
         return RedisModule_WrongArity(ctx);
     }
 
-    long long milliseconds = 0, expire = 0, version = 0;
+    long long milliseconds;
     long double incr = 0, min = 0, max = 0;
-    RedisModuleString *expire_p = NULL;
-    RedisModuleString *version_p = NULL;
-    RedisModuleString *min_p = NULL, *max_p = NULL;
-    int ex_flags = TAIR_HASH_SET_NO_FLAGS;
+    hashOpts opts;
     int nokey = 0;
 
-    g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), argv[1]);
-
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -1565,86 +2535,22 @@ int TairHashTypeHincrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
         return REDISMODULE_ERR;
     }
 
-    for (int j = 4; j < argc; j++) {
-        RedisModuleString *next = (j == argc - 1) ? NULL : argv[j + 1];
-
-        if (!mstrcasecmp(argv[j], "ex") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_EX;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "exat") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_EX;
-            ex_flags |= TAIR_HASH_SET_ABS_EXPIRE;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "px") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_PX;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "pxat") && !(ex_flags & TAIR_HASH_SET_PX) && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_KEEPTTL) && next) {
-            ex_flags |= TAIR_HASH_SET_PX;
-            ex_flags |= TAIR_HASH_SET_ABS_EXPIRE;
-            expire_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "ver") && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "abs") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_GT_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_ABS_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "gt") && !(ex_flags & TAIR_HASH_SET_WITH_VER) && !(ex_flags & TAIR_HASH_SET_WITH_ABS_VER) && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_GT_VER;
-            version_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "min") && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_BOUNDARY;
-            min_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "max") && next) {
-            ex_flags |= TAIR_HASH_SET_WITH_BOUNDARY;
-            max_p = next;
-            j++;
-        } else if (!mstrcasecmp(argv[j], "keepttl") && !(ex_flags & TAIR_HASH_SET_EX) && !(ex_flags & TAIR_HASH_SET_PX)) {
-            ex_flags |= TAIR_HASH_SET_KEEPTTL;
-        } else {
-            RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-            return REDISMODULE_ERR;
-        }
-    }
-
-    if ((NULL != expire_p) && (RedisModule_StringToLongLong(expire_p, &expire) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if (expire_p && expire < 0) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if ((NULL != version_p) && (RedisModule_StringToLongLong(version_p, &version) != REDISMODULE_OK)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
-        return REDISMODULE_ERR;
-    }
-
-    if (version < 0 || ((ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) && version == 0)) {
-        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+    if (parseHashOpts(ctx, argv, 4, argc, HASH_OPTS_INCR, &opts) != REDISMODULE_OK) {
         return REDISMODULE_ERR;
     }
+    milliseconds = opts.milliseconds;
 
-    if ((NULL != min_p) && (mstring2ld(min_p, &min) != REDISMODULE_OK)) {
+    if ((NULL != opts.min_p) && (mstring2ld(opts.min_p, &min) != REDISMODULE_OK)) {
         RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_FLOAT_MIN_MAX);
         return REDISMODULE_ERR;
     }
 
-    if ((NULL != max_p) && (mstring2ld(max_p, &max) != REDISMODULE_OK)) {
+    if ((NULL != opts.max_p) && (mstring2ld(opts.max_p, &max) != REDISMODULE_OK)) {
         RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_FLOAT_MIN_MAX);
         return REDISMODULE_ERR;
     }
 
-    if (NULL != min_p && NULL != max_p && max < min) {
+    if (NULL != opts.min_p && NULL != opts.max_p && max < min) {
         RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_MIN_MAX);
         return REDISMODULE_ERR;
     }
@@ -1666,7 +2572,7 @@ int TairHashTypeHincrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
     RedisModuleString *skey = argv[2];
     int dbid = RedisModule_GetSelectedDb(ctx);
     fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[2], 0);
-    m_dictEntry *de = m_dictFind(tair_hash_obj->hash, skey);
+    m_dictEntry *de = m_segDictFind(tair_hash_obj->hash, skey);
     TairHashVal *tair_hash_val = NULL;
     if (de == NULL) {
         nokey = 1;
@@ -1685,22 +2591,17 @@ int TairHashTypeHincrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
         cur_val = 0;
         tair_hash_val->version = 0;
     } else {
-        if (mstring2ld(tair_hash_val->value, &cur_val) != REDISMODULE_OK) {
+        RedisModuleString *cur = tairHashValDecode(tair_hash_val);
+        int ret = mstring2ld(cur, &cur_val);
+        RedisModule_FreeString(NULL, cur);
+        if (ret != REDISMODULE_OK) {
             RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_NOT_FLOAT);
             return REDISMODULE_ERR;
         }
 
         /* Version equals 0 means no version checking */
-        if (ex_flags & TAIR_HASH_SET_WITH_VER) {
-            if (version != 0 && version != tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
-        } else if (ex_flags & TAIR_HASH_SET_WITH_GT_VER) {
-            if (version <= tair_hash_val->version) {
-                RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_VERSION);
-                return REDISMODULE_ERR;
-            }
+        if (checkHashOptsVersion(ctx, &opts, tair_hash_val) != REDISMODULE_OK) {
+            return REDISMODULE_ERR;
         }
     }
 
@@ -1712,7 +2613,7 @@ int TairHashTypeHincrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
         return REDISMODULE_ERR;
     }
 
-    if ((max_p != NULL && cur_val + incr > max) || (min_p != NULL && cur_val + incr < min)) {
+    if ((opts.max_p != NULL && cur_val + incr > max) || (opts.min_p != NULL && cur_val + incr < min)) {
         if (nokey) {
             tairHashValRelease(tair_hash_val);
         }
@@ -1720,36 +2621,136 @@ int TairHashTypeHincrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
         return REDISMODULE_ERR;
     }
 
-    if (ex_flags & (TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)) {
-        tair_hash_val->version = version;
+    tair_hash_val->version = hashOptsNextVersion(&opts, tair_hash_val);
+
+    cur_val += incr;
+
+    char dbuf[MAX_LONG_DOUBLE_CHARS] = {0};
+    int dlen = m_ld2string(dbuf, sizeof(dbuf), cur_val, 1);
+
+    setTairHashValRaw(tair_hash_val, RedisModule_CreateString(NULL, dbuf, dlen));
+
+    if (milliseconds == 0 && !(opts.flags & TAIR_HASH_SET_KEEPTTL)) {
+        g_expire_algorithm.delete(ctx, dbid, argv[1], tair_hash_obj, skey, tair_hash_val->expire);
+        tair_hash_val->expire = 0;
+    }
+
+    if (milliseconds > 0) {
+        if (nokey || tair_hash_val->expire == 0) {
+            g_expire_algorithm.insert(ctx, dbid, argv[1], tair_hash_obj, skey, milliseconds);
+        } else {
+            g_expire_algorithm.update(ctx, dbid, argv[1], tair_hash_obj, skey, tair_hash_val->expire, milliseconds);
+        }
+        tair_hash_val->expire = milliseconds;
+    }
+
+    if (nokey) {
+        addTairHashField(tair_hash_obj, takeAndRef(skey), tair_hash_val);
+    }
+
+    /* The expire is already absolute, and kept by KEEPTTL. */
+    replicateHset(ctx, argv[1], argv[2], tair_hash_val->value, tair_hash_val->version, tair_hash_val->expire);
+    replyWithTairHashVal(ctx, tair_hash_val);
+    return REDISMODULE_OK;
+}
+
+/* EXHAPPEND <key> <field> <value> [opts], or EXHSETRANGE <key> <field>
+ * <offset> <value> [opts] when 'setrange' is set. The options are those of
+ * EXHINCRBY but MIN and MAX. */
+int tairHashPatchGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int setrange) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4 + setrange) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    long long milliseconds, offset = 0;
+    hashOpts opts;
+    int nokey;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (setrange && (RedisModule_StringToLongLong(argv[3], &offset) != REDISMODULE_OK || offset < 0)) {
+        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_OFFSET);
+        return REDISMODULE_ERR;
+    }
+
+    if (parseHashOpts(ctx, argv, 4 + setrange, argc, HASH_OPTS_PATCH, &opts) != REDISMODULE_OK) {
+        return REDISMODULE_ERR;
+    }
+    milliseconds = opts.milliseconds;
+
+    RedisModuleString *pkey = argv[1], *skey = argv[2], *data = argv[3 + setrange];
+    size_t len;
+    const char *buf = RedisModule_StringPtrLen(data, &len);
+    /* Written so that a huge offset cannot overflow, as checkStringLength does. */
+    if ((long long)len > TAIRHASH_MAX_VALUE_LEN || offset > TAIRHASH_MAX_VALUE_LEN - (long long)len) {
+        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_TOO_LONG);
+        return REDISMODULE_ERR;
+    }
+
+    /* Like SETRANGE, an empty value creates nothing. */
+    if (setrange && len == 0 && type == REDISMODULE_KEYTYPE_EMPTY) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return REDISMODULE_OK;
+    }
+
+    tairHashObj *tair_hash_obj = NULL;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        tair_hash_obj = createTairHashTypeObject();
+        tair_hash_obj->key = RedisModule_CreateStringFromString(NULL, pkey);
+        RedisModule_ModuleTypeSetValue(key, TairHashType, tair_hash_obj);
     } else {
-        tair_hash_val->version += 1;
+        tair_hash_obj = RedisModule_ModuleTypeGetValue(key);
     }
 
-    cur_val += incr;
-
-    char dbuf[MAX_LONG_DOUBLE_CHARS] = {0};
-    int dlen = m_ld2string(dbuf, sizeof(dbuf), cur_val, 1);
-
-    if (tair_hash_val->value) {
-        RedisModule_FreeString(NULL, tair_hash_val->value);
-    }
-    tair_hash_val->value = RedisModule_CreateString(NULL, dbuf, dlen);
+    int dbid = RedisModule_GetSelectedDb(ctx);
+    fieldExpireIfNeeded(ctx, dbid, pkey, tair_hash_obj, skey, 0);
+    TairHashVal *tair_hash_val = NULL;
+    size_t cur_len = 0;
+    m_dictEntry *de = m_segDictFind(tair_hash_obj->hash, skey);
+    if (de == NULL) {
+        if (setrange && len == 0) {
+            /* The field may just have expired, and it may have been the last one. */
+            delEmptyTairHashIfNeeded(ctx, key, pkey, tair_hash_obj);
+            RedisModule_ReplyWithLongLong(ctx, 0);
+            return REDISMODULE_OK;
+        }
+        nokey = 1;
+        tair_hash_val = createTairHashVal();
+        tair_hash_val->expire = 0;
+        tair_hash_val->version = 0;
+    } else {
+        nokey = 0;
+        tair_hash_val = dictGetVal(de);
+        skey = dictGetKey(de);
 
-    if (0 < expire) {
-        if (ex_flags & TAIR_HASH_SET_EX) {
-            expire *= 1000;
+        /* Version equals 0 means no version checking */
+        if (checkHashOptsVersion(ctx, &opts, tair_hash_val) != REDISMODULE_OK) {
+            return REDISMODULE_ERR;
         }
-        if (ex_flags & TAIR_HASH_SET_ABS_EXPIRE) {
-            milliseconds = expire;
-        } else {
-            milliseconds = RedisModule_Milliseconds() + expire;
+        cur_len = tairHashValLen(tair_hash_val);
+        if (setrange && len == 0) {
+            RedisModule_ReplyWithLongLong(ctx, (long long)cur_len);
+            return REDISMODULE_OK;
+        }
+        if (!setrange && (long long)cur_len > TAIRHASH_MAX_VALUE_LEN - (long long)len) {
+            RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_TOO_LONG);
+            return REDISMODULE_ERR;
         }
-    } else if (expire_p && expire == 0) {
-        milliseconds = 1;
     }
 
-    if (milliseconds == 0 && !(ex_flags & TAIR_HASH_SET_KEEPTTL)) {
+    tair_hash_val->version = hashOptsNextVersion(&opts, tair_hash_val);
+
+    size_t new_len = tairHashValPatch(tair_hash_val, setrange ? (size_t)offset : cur_len, buf, len);
+
+    if (milliseconds == 0 && !(opts.flags & TAIR_HASH_SET_KEEPTTL)) {
         g_expire_algorithm.delete(ctx, dbid, argv[1], tair_hash_obj, skey, tair_hash_val->expire);
         tair_hash_val->expire = 0;
     }
@@ -1764,19 +2765,27 @@ int TairHashTypeHincrByFloat_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
     }
 
     if (nokey) {
-        m_dictAdd(tair_hash_obj->hash, takeAndRef(skey), tair_hash_val);
+        addTairHashField(tair_hash_obj, takeAndRef(skey), tair_hash_val);
     }
 
-    if (milliseconds > 0) {
-        RedisModule_Replicate(ctx, "EXHSET", "sssclcl", argv[1], argv[2], tair_hash_val->value, "abs", tair_hash_val->version, "pxat",
-                              (milliseconds + RedisModule_Milliseconds()));
-    } else {
-        RedisModule_Replicate(ctx, "EXHSET", "ssscl", argv[1], argv[2], tair_hash_val->value, "abs", tair_hash_val->version);
-    }
-    RedisModule_ReplyWithString(ctx, tair_hash_val->value);
+    /* The expire is already absolute, and kept by KEEPTTL. */
+    replicatePatch(ctx, argv[1], argv[2], setrange ? argv[3] : NULL, data, tair_hash_val->version, tair_hash_val->expire);
+
+    RedisModule_ReplyWithLongLong(ctx, (long long)new_len);
     return REDISMODULE_OK;
 }
 
+/* EXHAPPEND <key> <field> <value> [EX time] [EXAT time] [PX time] [PXAT time] [VER version | ABS version | GT version] [KEEPTTL] */
+int TairHashTypeHappend_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return tairHashPatchGenericFunc(ctx, argv, argc, 0);
+}
+
+/* EXHSETRANGE <key> <field> <offset> <value> [EX time] [EXAT time] [PX time] [PXAT time] [VER version | ABS version | GT
+ * version] [KEEPTTL] */
+int TairHashTypeHsetRange_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return tairHashPatchGenericFunc(ctx, argv, argc, 1);
+}
+
 /* EXHGET <key> <field> */
 int TairHashTypeHget_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
@@ -1815,11 +2824,11 @@ int TairHashTypeHget_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         field_expire = 1;
     }
 
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, skey);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, skey);
     if (field_expire || tair_hash_val == NULL) {
         RedisModule_ReplyWithNull(ctx);
     } else {
-        RedisModule_ReplyWithString(ctx, tair_hash_val->value);
+        replyWithTairHashVal(ctx, tair_hash_val);
     }
 
     delEmptyTairHashIfNeeded(ctx, key, pkey, tair_hash_obj);
@@ -1833,7 +2842,7 @@ int TairHashTypeHgetWithVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
     }
     RedisModule_AutoMemory(ctx);
 
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -1861,12 +2870,12 @@ int TairHashTypeHgetWithVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
         field_expired = 1;
     }
 
-    TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[2]);
+    TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[2]);
     if (field_expired || tair_hash_val == NULL) {
-        return RedisModule_ReplyWithNull(ctx);
+        RedisModule_ReplyWithNull(ctx);
     } else {
         RedisModule_ReplyWithArray(ctx, 2);
-        RedisModule_ReplyWithString(ctx, tair_hash_val->value);
+        replyWithTairHashVal(ctx, tair_hash_val);
         RedisModule_ReplyWithLongLong(ctx, tair_hash_val->version);
     }
     delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
@@ -1916,12 +2925,12 @@ int TairHashTypeHmget_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
             ++cn;
             continue;
         }
-        TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[ii]);
+        TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[ii]);
         if (tair_hash_val == NULL) {
             RedisModule_ReplyWithNull(ctx);
             ++cn;
         } else {
-            RedisModule_ReplyWithString(ctx, tair_hash_val->value);
+            replyWithTairHashVal(ctx, tair_hash_val);
             ++cn;
         }
     }
@@ -1972,13 +2981,13 @@ int TairHashTypeHmgetWithVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
             ++cn;
             continue;
         }
-        TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[ii]);
+        TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[ii]);
         if (tair_hash_val == NULL) {
             RedisModule_ReplyWithNull(ctx);
             ++cn;
         } else {
             RedisModule_ReplyWithArray(ctx, 2);
-            RedisModule_ReplyWithString(ctx, tair_hash_val->value);
+            replyWithTairHashVal(ctx, tair_hash_val);
             RedisModule_ReplyWithLongLong(ctx, tair_hash_val->version);
             ++cn;
         }
@@ -2018,13 +3027,13 @@ int TairHashTypeHdel_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
     for (j = 2; j < argc; j++) {
         /* Internal will perform RedisModule_Replicate EXHDEL for replication */
         fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[j], 0);
-        m_dictEntry *de = m_dictFind(tair_hash_obj->hash, argv[j]);
+        m_dictEntry *de = m_segDictFind(tair_hash_obj->hash, argv[j]);
         if (de) {
             tair_hash_val = dictGetVal(de);
             if (tair_hash_val->expire > 0) {
                 g_expire_algorithm.delete(ctx, dbid, argv[1], tair_hash_obj, argv[j], tair_hash_val->expire);
             }
-            m_dictDelete(tair_hash_obj->hash, argv[j]);
+            delTairHashField(tair_hash_obj, argv[j]);
 
             RedisModule_Replicate(ctx, "EXHDEL", "ss", argv[1], argv[j]);
             deleted++;
@@ -2066,9 +3075,9 @@ int TairHashTypeHdelRepl_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **a
 
     int dbid = RedisModule_GetSelectedDb(ctx);
     TairHashVal *tair_hash_val = NULL;
-    m_dictEntry *de = m_dictFind(tair_hash_obj->hash, argv[2]);
+    m_dictEntry *de = m_segDictFind(tair_hash_obj->hash, argv[2]);
     if (de) {
-        m_dictDelete(tair_hash_obj->hash, argv[2]);
+        delTairHashField(tair_hash_obj, argv[2]);
         RedisModule_Replicate(ctx, "EXHDEL", "ss", argv[1], argv[2]);
         deleted++;
     }
@@ -2122,13 +3131,13 @@ int TairHashTypeHdelWithVer_RedisCommand(RedisModuleCtx *ctx, RedisModuleString
         /* Internal will perform RedisModule_Replicate EXHDEL for replication */
         fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[j], 0);
 
-        TairHashVal *tair_hash_val = (TairHashVal *)m_dictFetchValue(tair_hash_obj->hash, argv[j]);
+        TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, argv[j]);
         if (tair_hash_val != NULL) {
             if (ver == 0 || ver == tair_hash_val->version) {
                 if (tair_hash_val->expire > 0) {
                     g_expire_algorithm.delete(ctx, dbid, argv[1], tair_hash_obj, argv[j], tair_hash_val->expire);
                 }
-                m_dictDelete(tair_hash_obj->hash, argv[j]);
+                delTairHashField(tair_hash_obj, argv[j]);
                 RedisModule_Replicate(ctx, "EXHDEL", "ss", argv[1], argv[j]);
                 deleted++;
             }
@@ -2181,22 +3190,22 @@ int TairHashTypeHlen_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
         return REDISMODULE_ERR;
     }
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     if (noexp) {
         TairHashVal *data;
-        di = m_dictGetIterator(tair_hash_obj->hash);
-        while ((de = m_dictNext(di)) != NULL) {
+        di = m_segDictGetIterator(tair_hash_obj->hash);
+        while ((de = m_segDictNext(di)) != NULL) {
             data = (TairHashVal *)dictGetVal(de);
             if (isExpire(data->expire)) {
                 continue;
             }
             len++;
         }
-        m_dictReleaseIterator(di);
+        m_segDictReleaseIterator(di);
     } else {
-        len = dictSize(tair_hash_obj->hash);
+        len = segDictSize(tair_hash_obj->hash);
     }
 
     RedisModule_ReplyWithLongLong(ctx, len);
@@ -2239,7 +3248,7 @@ int TairHashTypeHexists_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
         field_expired = 1;
     }
 
-    TairHashVal *tairHashval = m_dictFetchValue(tair_hash_obj->hash, argv[2]);
+    TairHashVal *tairHashval = m_segDictFetchValue(tair_hash_obj->hash, argv[2]);
     if (field_expired || tairHashval == NULL) {
         RedisModule_ReplyWithLongLong(ctx, 0);
     } else {
@@ -2281,17 +3290,15 @@ int TairHashTypeHstrlen_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **ar
     }
 
     int field_expired = 0;
-    size_t len = 0;
     int dbid = RedisModule_GetSelectedDb(ctx);
     if (fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, argv[2], 0)) {
         field_expired = 1;
     }
-    TairHashVal *val = m_dictFetchValue(tair_hash_obj->hash, argv[2]);
+    TairHashVal *val = m_segDictFetchValue(tair_hash_obj->hash, argv[2]);
     if (field_expired || !val) {
         RedisModule_ReplyWithLongLong(ctx, 0);
     } else {
-        RedisModule_StringPtrLen(val->value, &len);
-        RedisModule_ReplyWithLongLong(ctx, len);
+        RedisModule_ReplyWithLongLong(ctx, tairHashValLen(val));
     }
 
     delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
@@ -2306,11 +3313,7 @@ int TairHashTypeHkeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
         return RedisModule_WrongArity(ctx);
     }
 
-#if defined(SORT_MODE) || defined(SLAB_MODE)
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-#else
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
-#endif
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -2336,13 +3339,13 @@ int TairHashTypeHkeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
     RedisModuleString *skey;
     uint64_t cn = 0;
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     int dbid = RedisModule_GetSelectedDb(ctx);
     RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-    di = m_dictGetSafeIterator(tair_hash_obj->hash);
-    while ((de = m_dictNext(di)) != NULL) {
+    di = m_segDictGetSafeIterator(tair_hash_obj->hash);
+    while ((de = m_segDictNext(di)) != NULL) {
         skey = (RedisModuleString *)dictGetKey(de);
 #if defined(SORT_MODE) || defined(SLAB_MODE)
         data = (TairHashVal *)dictGetVal(de);
@@ -2357,7 +3360,7 @@ int TairHashTypeHkeys_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
         RedisModule_ReplyWithString(ctx, skey);
         cn++;
     }
-    m_dictReleaseIterator(di);
+    m_segDictReleaseIterator(di);
 
 #if !defined(SORT_MODE) && !defined(SLAB_MODE)
     delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
@@ -2373,11 +3376,7 @@ int TairHashTypeHvals_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
     if (argc != 2) {
         return RedisModule_WrongArity(ctx);
     }
-#if defined(SORT_MODE) || defined(SLAB_MODE)
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-#else
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
-#endif
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -2403,13 +3402,13 @@ int TairHashTypeHvals_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
     TairHashVal *data;
     uint64_t cn = 0;
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     int dbid = RedisModule_GetSelectedDb(ctx);
     RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-    di = m_dictGetSafeIterator(tair_hash_obj->hash);
-    while ((de = m_dictNext(di)) != NULL) {
+    di = m_segDictGetSafeIterator(tair_hash_obj->hash);
+    while ((de = m_segDictNext(di)) != NULL) {
         data = (TairHashVal *)dictGetVal(de);
 #if defined(SORT_MODE) || defined(SLAB_MODE)
         if (isExpire(data->expire)) {
@@ -2421,10 +3420,10 @@ int TairHashTypeHvals_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
             continue;
         }
 #endif
-        RedisModule_ReplyWithString(ctx, data->value);
+        replyWithTairHashVal(ctx, data);
         cn++;
     }
-    m_dictReleaseIterator(di);
+    m_segDictReleaseIterator(di);
 
 #if !defined(SORT_MODE) && !defined(SLAB_MODE)
     delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
@@ -2440,11 +3439,7 @@ int tairHashGetAllGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
         return RedisModule_WrongArity(ctx);
     }
 
-#if defined(SORT_MODE) || defined(SLAB_MODE)
     RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-#else
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
-#endif
     int type = RedisModule_KeyType(key);
     if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -2471,13 +3466,13 @@ int tairHashGetAllGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
     RedisModuleString *skey;
     uint64_t cn = 0;
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     int dbid = RedisModule_GetSelectedDb(ctx);
     RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-    di = m_dictGetSafeIterator(tair_hash_obj->hash);
-    while ((de = m_dictNext(di)) != NULL) {
+    di = m_segDictGetSafeIterator(tair_hash_obj->hash);
+    while ((de = m_segDictNext(di)) != NULL) {
         skey = (RedisModuleString *)dictGetKey(de);
         data = (TairHashVal *)dictGetVal(de);
 #if defined(SORT_MODE) || defined(SLAB_MODE)
@@ -2491,14 +3486,14 @@ int tairHashGetAllGenericFunc(RedisModuleCtx *ctx, RedisModuleString **argv, int
 #endif
         RedisModule_ReplyWithString(ctx, skey);
         cn++;
-        RedisModule_ReplyWithString(ctx, data->value);
+        replyWithTairHashVal(ctx, data);
         cn++;
         if (returnVer > 0) {
             RedisModule_ReplyWithLongLong(ctx, data->version);
             cn++;
         }
     }
-    m_dictReleaseIterator(di);
+    m_segDictReleaseIterator(di);
 
 #if !defined(SORT_MODE) && !defined(SLAB_MODE)
     delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
@@ -2532,6 +3527,92 @@ static int parseScanCursor(RedisModuleString *cs, unsigned long *cursor) {
     return REDISMODULE_OK;
 }
 
+/* A MATCH pattern made of a literal prefix and a trailing '*' selects a run
+ * of consecutive fields of the lex index, which EXHSCAN pages through with
+ * cursors of its own. The top bit flags them, dict scan cursors never reach
+ * it. A lex cursor holds up to TAIRHASH_LEX_CURSOR_BYTES bytes following the
+ * prefix in the next field to return, and their count in its low bits. The
+ * next page starts at the first field not below the prefix followed by those
+ * bytes: a field present for the whole scan is never missed, whatever the
+ * writes in between, and the fields sharing the bytes kept may be returned
+ * twice. A page holds at most COUNT*10 fields, a longer run of fields the
+ * cursor can't tell apart falls back to a dict scan of the whole key. */
+#define TAIRHASH_LEX_CURSOR_FLAG (1UL << 63)
+#define TAIRHASH_LEX_CURSOR_BYTES 7
+#define TAIRHASH_LEX_CURSOR_LEN_BITS 3
+
+/* The length of the literal prefix of 'pattern', or -1 if it is not a prefix
+ * followed by '*'. */
+static long lexPatternPrefixLen(RedisModuleString *pattern) {
+    size_t plen;
+    const char *p = RedisModule_StringPtrLen(pattern, &plen);
+    if (plen == 0 || p[plen - 1] != '*') return -1;
+    for (size_t i = 0; i < plen - 1; i++) {
+        if (p[i] == '*' || p[i] == '?' || p[i] == '[' || p[i] == '\\') return -1;
+    }
+    return (long)plen - 1;
+}
+
+static unsigned long lexCursorEncode(const char *field, size_t flen, size_t plen) {
+    size_t n = flen - plen < TAIRHASH_LEX_CURSOR_BYTES ? flen - plen : TAIRHASH_LEX_CURSOR_BYTES;
+    unsigned long bytes = 0;
+    for (size_t i = 0; i < TAIRHASH_LEX_CURSOR_BYTES; i++) {
+        bytes = (bytes << 8) | (i < n ? (unsigned char)field[plen + i] : 0);
+    }
+    return TAIRHASH_LEX_CURSOR_FLAG | (bytes << TAIRHASH_LEX_CURSOR_LEN_BITS) | n;
+}
+
+/* Write the bytes held by the cursor to 'buf' and return their count. */
+static size_t lexCursorDecode(unsigned long cursor, char *buf) {
+    size_t n = cursor & ((1UL << TAIRHASH_LEX_CURSOR_LEN_BITS) - 1);
+    unsigned long bytes = cursor >> TAIRHASH_LEX_CURSOR_LEN_BITS;
+    for (size_t i = 0; i < TAIRHASH_LEX_CURSOR_BYTES; i++) {
+        buf[i] = (char)(bytes >> (8 * (TAIRHASH_LEX_CURSOR_BYTES - 1 - i)));
+    }
+    return n;
+}
+
+/* Add to 'keys' about 'count' fields of the prefix run from the one '*cursor'
+ * points at, and set '*cursor' to the next page, 0 once the run is over. A
+ * page also takes in the fields sharing the bytes of its own cursor, so that
+ * every page moves forward. Returns 0 if more than 'count' * 10 of them do,
+ * the page can't move forward within that bound. */
+static int scanLexPrefix(tairHashObj *o, RedisModuleString *pattern, size_t plen, unsigned long *cursor, list *keys, long count) {
+    const char *p = RedisModule_StringPtrLen(pattern, NULL);
+    char buf[TAIRHASH_LEX_CURSOR_BYTES];
+    size_t n = *cursor ? lexCursorDecode(*cursor, buf) : 0;
+
+    RedisModuleString *min = RedisModule_CreateString(NULL, p, plen);
+    if (n) RedisModule_StringAppendBuffer(NULL, min, buf, n);
+    m_zlexrangespec range = {min, NULL, 0, 0};
+    m_zskiplistNode *x = m_zslFirstInLexRange(o->lex_index, &range);
+    RedisModule_FreeString(NULL, min);
+
+    unsigned long start = *cursor;
+    long taken = 0;
+    *cursor = 0;
+    for (; x; x = x->level[0].forward) {
+        size_t flen;
+        const char *f = RedisModule_StringPtrLen(x->member, &flen);
+        if (flen < plen || memcmp(f, p, plen) != 0) break;
+        if (taken >= count) {
+            unsigned long next = lexCursorEncode(f, flen, plen);
+            if (next != start) {
+                *cursor = next;
+                break;
+            }
+            if (taken >= count * 10) {
+                return 0;
+            }
+        }
+        TairHashVal *val = m_segDictFetchValue(o->hash, x->member);
+        m_listAddNodeTail(keys, x->member);
+        m_listAddNodeTail(keys, val);
+        taken++;
+    }
+    return 1;
+}
+
 /* EXHSCAN key cursor [MATCH pattern] [COUNT count]*/
 int TairHashTypeHscan_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     RedisModule_AutoMemory(ctx);
@@ -2595,9 +3676,22 @@ int TairHashTypeHscan_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
     long maxiterations = count * 10;
     list *keys = m_listCreate();
 
-    do {
-        cursor = m_dictScan(tair_hash_obj->hash, cursor, tairhashScanCallback, NULL, keys);
-    } while (cursor && maxiterations-- && listLength(keys) < (unsigned long)count);
+    long plen = pattern && tair_hash_obj->lex_index ? lexPatternPrefixLen(pattern) : -1;
+    int lex_scan = (cursor == 0 || (cursor & TAIRHASH_LEX_CURSOR_FLAG)) && plen >= 0;
+    if (lex_scan && !scanLexPrefix(tair_hash_obj, pattern, (size_t)plen, &cursor, keys, count)) {
+        /* Too many fields share the bytes of the cursor, go on with a dict
+         * scan from the start. */
+        m_listEmpty(keys);
+        lex_scan = 0;
+    }
+    if (!lex_scan) {
+        /* A lex cursor without the index or the pattern it was made for
+         * restarts the scan, which may repeat fields but never misses one. */
+        if (cursor & TAIRHASH_LEX_CURSOR_FLAG) cursor = 0;
+        do {
+            cursor = m_segDictScan(tair_hash_obj->hash, cursor, tairhashScanCallback, NULL, keys);
+        } while (cursor && maxiterations-- && listLength(keys) < (unsigned long)count);
+    }
 
     m_listNode *node, *nextnode;
     node = listFirst(keys);
@@ -2609,45 +3703,427 @@ int TairHashTypeHscan_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv
         nextnode = listNextNode(node);
         int filter = 0;
 
-        /* Filter element if it does not match the pattern. */
-        if (!filter && pattern) {
-            if (!mstrmatchlen(pattern, skey, 0))
-                filter = 1;
-        }
+        /* Filter element if it does not match the pattern. */
+        if (!filter && pattern) {
+            if (!mstrmatchlen(pattern, skey, 0))
+                filter = 1;
+        }
+
+        /* Filter element if it is an expired key. */
+        if (!filter && fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, skey, 0)) {
+            filter = 1;
+        }
+
+        /* Remove the element and its associted value if needed. */
+        if (filter) {
+            m_listDelNode(keys, node);
+        }
+
+        node = nextnode;
+        nextnode = listNextNode(node);
+        if (filter) {
+            m_listDelNode(keys, node);
+        }
+
+        node = nextnode;
+    }
+
+    /* Step 4: Reply to the client, lex cursors have the top bit set. */
+    char cursor_buf[32];
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithStringBuffer(ctx, cursor_buf, snprintf(cursor_buf, sizeof(cursor_buf), "%lu", cursor));
+
+    RedisModule_ReplyWithArray(ctx, listLength(keys));
+    while ((node = listFirst(keys)) != NULL) {
+        RedisModule_ReplyWithString(ctx, listNodeValue(node));
+        m_listDelNode(keys, node);
+        node = listFirst(keys);
+        replyWithTairHashVal(ctx, listNodeValue(node));
+        m_listDelNode(keys, node);
+    }
+
+    m_listRelease(keys);
+    delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
+    return REDISMODULE_OK;
+}
+
+/* Parse a bound of EXHRANGEBYLEX: "-" or "+", *inf is then -1 or 1 and the
+ * field NULL, or a field prefixed by '[' (inclusive) or '(' (exclusive). */
+static int parseLexRangeItem(RedisModuleCtx *ctx, RedisModuleString *item, RedisModuleString **field, int *ex, int *inf) {
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(item, &len);
+
+    *field = NULL;
+    *ex = 0;
+    *inf = 0;
+    if (len == 1 && (ptr[0] == '-' || ptr[0] == '+')) {
+        *inf = ptr[0] == '-' ? -1 : 1;
+        return REDISMODULE_OK;
+    }
+    if (len == 0 || (ptr[0] != '[' && ptr[0] != '(')) {
+        return REDISMODULE_ERR;
+    }
+    *ex = ptr[0] == '(';
+    *field = RedisModule_CreateString(ctx, ptr + 1, len - 1);
+    return REDISMODULE_OK;
+}
+
+/* EXHRANGEBYLEX key min max [WITHVALUES] [LIMIT offset count] */
+int TairHashTypeHrangeByLex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    m_zlexrangespec range;
+    int mininf, maxinf;
+    if (parseLexRangeItem(ctx, argv[2], &range.min, &range.minex, &mininf) == REDISMODULE_ERR
+        || parseLexRangeItem(ctx, argv[3], &range.max, &range.maxex, &maxinf) == REDISMODULE_ERR) {
+        return RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_LEX_RANGE);
+    }
+
+    int withvalues = 0;
+    long long offset = 0, limit = -1;
+    for (int j = 4; j < argc; j++) {
+        if (!mstrcasecmp(argv[j], "WITHVALUES")) {
+            withvalues = 1;
+        } else if (!mstrcasecmp(argv[j], "LIMIT") && j + 2 < argc) {
+            if (RedisModule_StringToLongLong(argv[j + 1], &offset) == REDISMODULE_ERR
+                || RedisModule_StringToLongLong(argv[j + 2], &limit) == REDISMODULE_ERR) {
+                return RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_NOT_INTEGER);
+            }
+            j += 2;
+        } else {
+            return RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+        }
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+
+    /* "+" as min or "-" as max select nothing, as does a negative offset. */
+    if (type == REDISMODULE_KEYTYPE_EMPTY || mininf == 1 || maxinf == -1 || offset < 0) {
+        return RedisModule_ReplyWithArray(ctx, 0);
+    }
+
+    tairHashObj *tair_hash_obj = RedisModule_ModuleTypeGetValue(key);
+    if (tair_hash_obj == NULL) {
+        return RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_INTERNAL_ERR);
+    }
+
+    if (tair_hash_obj->lex_index == NULL) {
+        return RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_NO_LEX_INDEX);
+    }
+
+    long cn = 0;
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    m_zskiplistNode *x = m_zslFirstInLexRange(tair_hash_obj->lex_index, &range);
+    for (; x && limit != 0 && m_zslLexValueLteMax(x->member, &range); x = x->level[0].forward) {
+        TairHashVal *val = m_segDictFetchValue(tair_hash_obj->hash, x->member);
+        if (isExpire(val->expire)) {
+            continue;
+        }
+        if (offset) {
+            offset--;
+            continue;
+        }
+        RedisModule_ReplyWithString(ctx, x->member);
+        cn++;
+        if (withvalues) {
+            replyWithTairHashVal(ctx, val);
+            cn++;
+        }
+        if (limit > 0) limit--;
+    }
+    RedisModule_ReplySetArrayLength(ctx, cn);
+    return REDISMODULE_OK;
+}
+
+/* EXHLEXINDEX key ON|OFF */
+int TairHashTypeLexIndex_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    int on;
+    if (!mstrcasecmp(argv[2], "ON")) {
+        on = 1;
+    } else if (!mstrcasecmp(argv[2], "OFF")) {
+        on = 0;
+    } else {
+        return RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithLongLong(ctx, 0);
+    }
+
+    tairHashObj *tair_hash_obj = RedisModule_ModuleTypeGetValue(key);
+    int changed = on ? createLexIndexIfNeeded(tair_hash_obj) : releaseLexIndex(tair_hash_obj);
+    if (changed) {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
+    return RedisModule_ReplyWithLongLong(ctx, changed);
+}
+
+/* The batches of EXHEXPORT and EXHIMPORT: a format version byte, then for
+ * each field its length and bytes, its value length and bytes, its version
+ * and its absolute expire in milliseconds (0 for none), all lengths and
+ * numbers as unsigned LEB128 varints. The CRC16 of everything before it ends
+ * the batch, in little endian. */
+#define TAIRHASH_EXPORT_VERSION 1
+#define TAIRHASH_EXPORT_MAX_VARINT 10
+
+typedef struct exportBatch {
+    char *buf;
+    size_t len;
+    size_t size;
+    unsigned long fields;
+} exportBatch;
+
+static void exportReserve(exportBatch *b, size_t n) {
+    if (b->len + n <= b->size) return;
+    while (b->len + n > b->size) b->size = b->size ? b->size * 2 : 256;
+    b->buf = RedisModule_Realloc(b->buf, b->size);
+}
+
+static void exportPutVarint(exportBatch *b, uint64_t v) {
+    exportReserve(b, TAIRHASH_EXPORT_MAX_VARINT);
+    while (v >= 0x80) {
+        b->buf[b->len++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    b->buf[b->len++] = (char)v;
+}
+
+static void exportPutString(exportBatch *b, RedisModuleString *str) {
+    size_t len;
+    const char *ptr = RedisModule_StringPtrLen(str, &len);
+    exportPutVarint(b, len);
+    exportReserve(b, len);
+    memcpy(b->buf + b->len, ptr, len);
+    b->len += len;
+}
+
+static void exportPutField(exportBatch *b, RedisModuleString *field, const TairHashVal *val) {
+    RedisModuleString *value = tairHashValDecode(val);
+    exportPutString(b, field);
+    exportPutString(b, value);
+    RedisModule_FreeString(NULL, value);
+    exportPutVarint(b, (uint64_t)val->version);
+    exportPutVarint(b, (uint64_t)val->expire);
+    b->fields++;
+}
+
+/* Fields already expired are left out, the export does not delete them. */
+static void exportScanCallback(void *privdata, const m_dictEntry *de) {
+    exportBatch *b = privdata;
+    TairHashVal *val = dictGetVal(de);
+    if (isExpire(val->expire)) return;
+    exportPutField(b, dictGetKey(de), val);
+}
+
+/* The message of a field event with expired_event_payload: the format
+ * version byte and the field as in a batch, without the CRC. A compressed or
+ * cold value is sent as written by the client. */
+RedisModuleString *fieldEventPayload(RedisModuleString *field, const TairHashVal *val) {
+    exportBatch b = {NULL, 0, 0, 0};
+    exportReserve(&b, 1);
+    b.buf[b.len++] = TAIRHASH_EXPORT_VERSION;
+    exportPutField(&b, field, val);
+    RedisModuleString *payload = RedisModule_CreateString(NULL, b.buf, b.len);
+    RedisModule_Free(b.buf);
+    return payload;
+}
+
+/* EXHEXPORT key cursor count */
+int TairHashTypeExport_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    unsigned long cursor;
+    long long count;
+    if (parseScanCursor(argv[2], &cursor) == REDISMODULE_ERR || RedisModule_StringToLongLong(argv[3], &count) == REDISMODULE_ERR || count < 1) {
+        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    exportBatch b = {NULL, 0, 0, 0};
+    exportReserve(&b, 1);
+    b.buf[b.len++] = TAIRHASH_EXPORT_VERSION;
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        cursor = 0;
+    } else {
+        /* Same bound on the buckets visited as EXHSCAN. */
+        tairHashObj *tair_hash_obj = RedisModule_ModuleTypeGetValue(key);
+        long maxiterations = count * 10;
+        do {
+            cursor = m_segDictScan(tair_hash_obj->hash, cursor, exportScanCallback, NULL, &b);
+        } while (cursor && maxiterations-- && b.fields < (unsigned long)count);
+    }
+
+    uint16_t crc = m_crc16(b.buf, (int)b.len);
+    exportReserve(&b, 2);
+    b.buf[b.len++] = (char)(crc & 0xff);
+    b.buf[b.len++] = (char)(crc >> 8);
+
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithString(ctx, RedisModule_CreateStringFromLongLong(ctx, cursor));
+    RedisModule_ReplyWithStringBuffer(ctx, b.buf, b.len);
+    RedisModule_Free(b.buf);
+    return REDISMODULE_OK;
+}
+
+static int importGetVarint(const char **p, const char *end, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 7 * TAIRHASH_EXPORT_MAX_VARINT && *p < end; shift += 7) {
+        unsigned char c = (unsigned char)*(*p)++;
+        if (shift == 63 && c > 1) return REDISMODULE_ERR;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return REDISMODULE_OK;
+    }
+    return REDISMODULE_ERR;
+}
+
+typedef struct importField {
+    const char *field;
+    size_t field_len;
+    const char *value;
+    size_t value_len;
+    long long version;
+    long long expire;
+} importField;
+
+/* Decode the next field of the batch at '*p', which ends at 'end'. */
+static int importGetField(const char **p, const char *end, importField *f) {
+    uint64_t v;
+    if (importGetVarint(p, end, &v) != REDISMODULE_OK || v > (uint64_t)(end - *p)) return REDISMODULE_ERR;
+    f->field = *p;
+    f->field_len = v;
+    *p += v;
+    if (importGetVarint(p, end, &v) != REDISMODULE_OK || v > (uint64_t)(end - *p)) return REDISMODULE_ERR;
+    f->value = *p;
+    f->value_len = v;
+    *p += v;
+    if (importGetVarint(p, end, &v) != REDISMODULE_OK || v > LLONG_MAX) return REDISMODULE_ERR;
+    f->version = (long long)v;
+    if (importGetVarint(p, end, &v) != REDISMODULE_OK || v > LLONG_MAX) return REDISMODULE_ERR;
+    f->expire = (long long)v;
+    return REDISMODULE_OK;
+}
+
+/* Check the whole batch before any field is applied, returns the start and
+ * the end of its fields. */
+static int importCheck(RedisModuleString *blob, const char **start, const char **end) {
+    size_t len;
+    const char *buf = RedisModule_StringPtrLen(blob, &len);
+    if (len < 3 || buf[0] != TAIRHASH_EXPORT_VERSION) return REDISMODULE_ERR;
+    uint16_t crc = (uint16_t)((unsigned char)buf[len - 2] | ((unsigned char)buf[len - 1] << 8));
+    if (m_crc16(buf, (int)(len - 2)) != crc) return REDISMODULE_ERR;
+
+    const char *p = buf + 1, *e = buf + len - 2;
+    importField f;
+    while (p < e) {
+        if (importGetField(&p, e, &f) != REDISMODULE_OK) return REDISMODULE_ERR;
+    }
+    *start = buf + 1;
+    *end = e;
+    return REDISMODULE_OK;
+}
+
+/* EXHIMPORT key blob
+ * Apply a batch of EXHEXPORT: the fields take the value, version and expire
+ * they had, fields expired since are skipped. Each field is propagated as an
+ * EXHSET. Replies with the number of fields imported. */
+int TairHashTypeImport_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    key = g_expire_algorithm.passiveExpire(ctx, RedisModule_GetSelectedDb(ctx), key, argv[1]);
+    int type = RedisModule_KeyType(key);
+    if (REDISMODULE_KEYTYPE_EMPTY != type && RedisModule_ModuleTypeGetType(key) != TairHashType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    const char *p, *end;
+    if (importCheck(argv[2], &p, &end) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid export batch");
+        return REDISMODULE_ERR;
+    }
 
-        /* Filter element if it is an expired key. */
-        if (!filter && fieldExpireIfNeeded(ctx, dbid, argv[1], tair_hash_obj, skey, 0)) {
-            filter = 1;
+    tairHashObj *tair_hash_obj = type == REDISMODULE_KEYTYPE_EMPTY ? NULL : RedisModule_ModuleTypeGetValue(key);
+    int dbid = RedisModule_GetSelectedDb(ctx);
+    long long imported = 0;
+    importField f;
+    while (p < end) {
+        Module_Assert(importGetField(&p, end, &f) == REDISMODULE_OK);
+        if (isExpire(f.expire)) {
+            continue;
         }
-
-        /* Remove the element and its associted value if needed. */
-        if (filter) {
-            m_listDelNode(keys, node);
+        if (tair_hash_obj == NULL) {
+            tair_hash_obj = createTairHashTypeObject();
+            tair_hash_obj->key = RedisModule_CreateStringFromString(NULL, argv[1]);
+            RedisModule_ModuleTypeSetValue(key, TairHashType, tair_hash_obj);
         }
 
-        node = nextnode;
-        nextnode = listNextNode(node);
-        if (filter) {
-            m_listDelNode(keys, node);
+        RedisModuleString *field = RedisModule_CreateString(NULL, f.field, f.field_len);
+        RedisModuleString *value = RedisModule_CreateString(NULL, f.value, f.value_len);
+        TairHashVal *tair_hash_val = (TairHashVal *)m_segDictFetchValue(tair_hash_obj->hash, field);
+        int nokey = tair_hash_val == NULL;
+        if (nokey) {
+            tair_hash_val = createTairHashVal();
+            tair_hash_val->expire = 0;
+            tair_hash_val->value = NULL;
         }
 
-        node = nextnode;
-    }
-
-    /* Step 4: Reply to the client. */
-    RedisModule_ReplyWithArray(ctx, 2);
-    RedisModule_ReplyWithString(ctx, RedisModule_CreateStringFromLongLong(ctx, cursor));
+        if (f.expire == 0) {
+            g_expire_algorithm.delete(ctx, dbid, argv[1], tair_hash_obj, field, tair_hash_val->expire);
+        } else if (tair_hash_val->expire == 0) {
+            g_expire_algorithm.insert(ctx, dbid, argv[1], tair_hash_obj, field, f.expire);
+        } else {
+            g_expire_algorithm.update(ctx, dbid, argv[1], tair_hash_obj, field, tair_hash_val->expire, f.expire);
+        }
+        tair_hash_val->expire = f.expire;
+        tair_hash_val->version = f.version;
+        setTairHashValValue(tair_hash_val, value);
 
-    RedisModule_ReplyWithArray(ctx, listLength(keys));
-    while ((node = listFirst(keys)) != NULL) {
-        RedisModuleString *skey = listNodeValue(node);
-        RedisModule_ReplyWithString(ctx, skey);
-        m_listDelNode(keys, node);
+        replicateHset(ctx, argv[1], field, value, tair_hash_val->version, tair_hash_val->expire);
+        RedisModule_FreeString(NULL, value);
+        if (nokey) {
+            addTairHashField(tair_hash_obj, field, tair_hash_val);
+        } else {
+            RedisModule_FreeString(NULL, field);
+        }
+        imported++;
     }
 
-    m_listRelease(keys);
-    delEmptyTairHashIfNeeded(ctx, key, argv[1], tair_hash_obj);
-    return REDISMODULE_OK;
+    return RedisModule_ReplyWithLongLong(ctx, imported);
 }
 
 /* exhexpireinfo */
@@ -2671,7 +4147,16 @@ int TairHashTypeActiveExpireInfo_RedisCommand(RedisModuleCtx *ctx, RedisModuleSt
         "tair_hash_active_expire_last_time_msec:%ld\r\n"
         "tair_hash_active_expire_max_time_msec:%ld\r\n"
         "tair_hash_active_expire_avg_time_msec:%ld\r\n"
-        "tair_hash_passive_expire_keys_per_loop:%ld\r\n",
+        "tair_hash_passive_expire_keys_per_loop:%ld\r\n"
+        "tair_hash_dict_resize_enabled:%d\r\n"
+        "tair_hash_dict_force_resize_ratio:%u\r\n"
+        "tair_hash_dict_deferred_resizes:%llu\r\n"
+        "tair_hash_dict_segment_threshold:%lu\r\n"
+        "tair_hash_dict_segment_splits:%llu\r\n"
+        "tair_hash_active_expire_keys_visited:%llu\r\n"
+        "tair_hash_active_expire_fields_examined:%llu\r\n"
+        "tair_hash_active_expire_last_keys_visited:%llu\r\n"
+        "tair_hash_active_expire_last_fields_examined:%llu\r\n",
         (long)g_expire_algorithm.enable_active_expire,
         (long)g_expire_algorithm.active_expire_period,
         (long)g_expire_algorithm.keys_per_active_loop,
@@ -2679,7 +4164,16 @@ int TairHashTypeActiveExpireInfo_RedisCommand(RedisModuleCtx *ctx, RedisModuleSt
         (long)g_expire_algorithm.stat_last_active_expire_time_msec,
         (long) g_expire_algorithm.stat_max_active_expire_time_msec,
         (long)g_expire_algorithm.stat_avg_active_expire_time_msec,
-        (long)g_expire_algorithm.keys_per_passive_loop);
+        (long)g_expire_algorithm.keys_per_passive_loop,
+        m_dictIsResizeEnabled(),
+        m_dictGetForceResizeRatio(),
+        m_dictGetStatDeferredResizes(),
+        m_segDictGetSplitSize(),
+        m_segDictGetStatSplits(),
+        (unsigned long long)g_expire_algorithm.stat_active_keys_visited,
+        (unsigned long long)g_expire_algorithm.stat_active_fields_examined,
+        (unsigned long long)g_expire_algorithm.stat_last_active_keys_visited,
+        (unsigned long long)g_expire_algorithm.stat_last_active_fields_examined);
 
     size_t a_len, d_len, t_size = 0;
     const char *a_buf = RedisModule_StringPtrLen(info_a, &a_len);
@@ -2694,12 +4188,21 @@ int TairHashTypeActiveExpireInfo_RedisCommand(RedisModuleCtx *ctx, RedisModuleSt
     strncat(buf, DB_DETAIL, d_len);
     t_size += d_len;
 
-    for (int i = 0; i < DB_NUM; ++i) {
-        if (g_expire_algorithm.stat_active_expired_field[i] == 0 && g_expire_algorithm.stat_passive_expired_field[i] == 0) {
+    for (int i = 0; i < g_db_num; ++i) {
+        if (g_expire_algorithm.stat_active_expired_field[i] == 0 && g_expire_algorithm.stat_passive_expired_field[i] == 0 &&
+            g_expire_algorithm.stat_expired_stale_fields[i] == 0) {
             continue;
         }
-        RedisModuleString *info_d = RedisModule_CreateStringPrintf(ctx, "db: %d, active_expired_fields: %ld, passive_expired_fields: %ld\r\n", i,
-                                                                   (long)g_expire_algorithm.stat_active_expired_field[i], (long)g_expire_algorithm.stat_passive_expired_field[i]);
+        RedisModuleString *info_d = RedisModule_CreateStringPrintf(ctx,
+                                                                   "db: %d, active_expired_fields: %ld, passive_expired_fields: %ld, "
+                                                                   "expire_lag_p50_msec: %llu, expire_lag_p99_msec: %llu, expire_lag_max_msec: %llu, "
+                                                                   "expired_stale_fields: %llu, expired_stale_bytes: %llu\r\n",
+                                                                   i, (long)g_expire_algorithm.stat_active_expired_field[i], (long)g_expire_algorithm.stat_passive_expired_field[i],
+                                                                   (unsigned long long)m_histogramPercentile(&g_expire_lag[i], 50),
+                                                                   (unsigned long long)m_histogramPercentile(&g_expire_lag[i], 99),
+                                                                   (unsigned long long)g_expire_lag[i].max,
+                                                                   (unsigned long long)g_expire_algorithm.stat_expired_stale_fields[i],
+                                                                   (unsigned long long)g_expire_algorithm.stat_expired_stale_bytes[i]);
         const char *d_buf = RedisModule_StringPtrLen(info_d, &d_len);
         strncat(buf, d_buf, d_len);
         RedisModule_FreeString(ctx, info_d);
@@ -2710,31 +4213,192 @@ int TairHashTypeActiveExpireInfo_RedisCommand(RedisModuleCtx *ctx, RedisModuleSt
     return REDISMODULE_OK;
 }
 
+static void replyWithStat(RedisModuleCtx *ctx, const char *name, long long value, long *len) {
+    RedisModule_ReplyWithSimpleString(ctx, name);
+    RedisModule_ReplyWithLongLong(ctx, value);
+    *len += 2;
+}
+
+static void replyWithDoubleStat(RedisModuleCtx *ctx, const char *name, double value, long *len) {
+    RedisModule_ReplyWithSimpleString(ctx, name);
+    RedisModule_ReplyWithDouble(ctx, value);
+    *len += 2;
+}
+
+/* Reply with the shape of the expire index of a single key. */
+static void replyWithKeyIndexStats(RedisModuleCtx *ctx, tairHashObj *o, long *len) {
+    unsigned long nodes = expireIndexLength(o);
+
+    replyWithStat(ctx, "fields", segDictSize(o->hash), len);
+    replyWithStat(ctx, "index_nodes", nodes, len);
+#ifdef SLAB_MODE
+    unsigned long levels = o->expire_index ? o->expire_index->level_sum : 0;
+    unsigned long fill[4] = {0}, fields = 0;
+
+    tairhash_zskiplistNode *ln = o->expire_index ? o->expire_index->header->level[0].forward : NULL;
+    while (ln) {
+        int quartile = (ln->slab->num_keys * 4 - 1) / SLABMAXN;
+        fill[quartile < 0 ? 0 : quartile]++;
+        fields += ln->slab->num_keys;
+        ln = ln->level[0].forward;
+    }
+    replyWithStat(ctx, "index_fields", fields, len);
+    replyWithStat(ctx, "index_bytes", o->expire_index ? tairhash_zslMemUsage(o->expire_index) : 0, len);
+    replyWithDoubleStat(ctx, "index_avg_level", nodes ? (double)levels / nodes : 0, len);
+    replyWithDoubleStat(ctx, "slab_avg_fill", nodes ? (double)fields / (nodes * SLABMAXN) : 0, len);
+    replyWithStat(ctx, "slab_fill_0_25", fill[0], len);
+    replyWithStat(ctx, "slab_fill_25_50", fill[1], len);
+    replyWithStat(ctx, "slab_fill_50_75", fill[2], len);
+    replyWithStat(ctx, "slab_fill_75_100", fill[3], len);
+#else
+    unsigned long levels = o->expire_index ? o->expire_index->level_sum : 0;
+    replyWithStat(ctx, "index_fields", nodes, len);
+    replyWithStat(ctx, "index_bytes", o->expire_index ? m_zslMemUsage(o->expire_index) : 0, len);
+    replyWithDoubleStat(ctx, "index_avg_level", nodes ? (double)levels / nodes : 0, len);
+#endif
+}
+
+/* Reply with the module wide index counters, and the shape of the global
+ * index of every db in SORT_MODE and SLAB_MODE. */
+static void replyWithGlobalIndexStats(RedisModuleCtx *ctx, long *len) {
+#if defined(SLAB_MODE)
+    RedisModule_ReplyWithSimpleString(ctx, "mode");
+    RedisModule_ReplyWithSimpleString(ctx, "slab");
+    *len += 2;
+    replyWithStat(ctx, "slabs", slab_getStatSlabs(), len);
+    replyWithStat(ctx, "slab_splits", slab_getStatSplits(), len);
+    replyWithStat(ctx, "slab_merges", slab_getStatMerges(), len);
+#elif defined(SORT_MODE)
+    RedisModule_ReplyWithSimpleString(ctx, "mode");
+    RedisModule_ReplyWithSimpleString(ctx, "sort");
+    *len += 2;
+#else
+    RedisModule_ReplyWithSimpleString(ctx, "mode");
+    RedisModule_ReplyWithSimpleString(ctx, "scan");
+    *len += 2;
+#endif
+
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    char name[64];
+    for (int i = 0; i < g_db_num; ++i) {
+        unsigned long nodes = globalExpireIndexLength(i);
+        if (nodes == 0) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "db%d_global_index_length", i);
+        replyWithStat(ctx, name, nodes, len);
+        snprintf(name, sizeof(name), "db%d_global_index_bytes", i);
+        replyWithStat(ctx, name, expireDbMemUsage(g_expire_index[i]), len);
+    }
+#endif
+}
+
+/* Reply with the slots of the global index of the selected db that hold
+ * keys: slot, keys, earliest expire and fields expired since the slot got
+ * its first key for each. Outside of cluster mode the db is a single slot 0. */
+static void replyWithSlotStats(RedisModuleCtx *ctx) {
+    long len = 0;
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    expireDb *db = g_expire_index[RedisModule_GetSelectedDb(ctx)];
+    for (unsigned int j = 0; db && db->slot && j < g_expire_slots; j++) {
+        expireSlot *slot = db->slot[j];
+        if (slot == NULL) {
+            continue;
+        }
+        RedisModule_ReplyWithArray(ctx, 4);
+        RedisModule_ReplyWithLongLong(ctx, slot->slot);
+        RedisModule_ReplyWithLongLong(ctx, slot->keys.length);
+        RedisModule_ReplyWithLongLong(ctx, m_heapScore(m_heapFirst(&slot->keys)));
+        RedisModule_ReplyWithLongLong(ctx, slot->expired);
+        len++;
+    }
+#endif
+    RedisModule_ReplySetArrayLength(ctx, len);
+}
+
+/* exhdebug indexstats [key] | slotstats */
+int TairHashTypeDebug_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RedisModule_AutoMemory(ctx);
+    long len = 0;
+
+    if (argc < 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    if (!mstrcasecmp(argv[1], "slotstats") && argc == 2) {
+        replyWithSlotStats(ctx);
+        return REDISMODULE_OK;
+    }
+
+    if (mstrcasecmp(argv[1], "indexstats") || argc > 3) {
+        RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+        return REDISMODULE_ERR;
+    }
+
+    if (argc == 2) {
+        RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+        replyWithGlobalIndexStats(ctx, &len);
+        RedisModule_ReplySetArrayLength(ctx, len);
+        return REDISMODULE_OK;
+    }
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_OPEN_KEY_NOTOUCH);
+    int type = RedisModule_KeyType(key);
+    if (type == REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithNull(ctx);
+    }
+    if (RedisModule_ModuleTypeGetType(key) != TairHashType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+    replyWithKeyIndexStats(ctx, RedisModule_ModuleTypeGetValue(key), &len);
+    RedisModule_ReplySetArrayLength(ctx, len);
+    return REDISMODULE_OK;
+}
+
 /* ========================== "tairhashtype" type methods ======================= */
 
 void *TairHashTypeRdbLoad(RedisModuleIO *rdb, int encver) {
-    REDISMODULE_NOT_USED(encver);
+    if (encver > TAIRHASH_ENCVER) {
+        return NULL;
+    }
 
     tairHashObj *o = createTairHashTypeObject();
     uint64_t len = RedisModule_LoadUnsigned(rdb);
     o->key = RedisModule_LoadString(rdb);
+    uint64_t flags = encver >= 2 ? RedisModule_LoadUnsigned(rdb) : 0;
+    if (flags & TAIRHASH_RDB_LEX_INDEX) {
+        o->lex_index = m_zslCreate();
+    }
 
     int dbid = RedisModule_GetDbIdFromIO ? RedisModule_GetDbIdFromIO(rdb) : 0;
 
     RedisModuleString *skey;
     long long version, expire;
+    int encoding;
     RedisModuleString *value;
 
     while (len--) {
         skey = RedisModule_LoadString(rdb);
         version = RedisModule_LoadUnsigned(rdb);
         expire = RedisModule_LoadUnsigned(rdb);
+        /* Compressed values are kept as they were saved, the others are
+         * compressed as if they were just written. */
+        encoding = encver >= 1 ? (int)RedisModule_LoadUnsigned(rdb) : TAIRHASH_VAL_RAW;
         value = RedisModule_LoadString(rdb);
         TairHashVal *hashv = createTairHashVal();
         hashv->version = version;
         hashv->expire = expire;
-        hashv->value = takeAndRef(value);
-        m_dictAdd(o->hash, takeAndRef(skey), hashv);
+        if (encoding == TAIRHASH_VAL_LZF) {
+            hashv->value = takeAndRef(value);
+            hashv->encoding = TAIRHASH_VAL_LZF;
+        } else {
+            setTairHashValValue(hashv, value);
+        }
+        addTairHashField(o, takeAndRef(skey), hashv);
         if (hashv->expire) {
             g_expire_algorithm.insert(NULL, dbid, NULL, o, skey, hashv->expire);
         }
@@ -2749,23 +4413,27 @@ void TairHashTypeRdbSave(RedisModuleIO *rdb, void *value) {
     tairHashObj *o = (tairHashObj *)value;
     RedisModuleString *skey;
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     if (o->hash) {
-        RedisModule_SaveUnsigned(rdb, dictSize(o->hash));
+        RedisModule_SaveUnsigned(rdb, segDictSize(o->hash));
         RedisModule_SaveString(rdb, o->key);
+        RedisModule_SaveUnsigned(rdb, o->lex_index ? TAIRHASH_RDB_LEX_INDEX : 0);
 
-        di = m_dictGetIterator(o->hash);
-        while ((de = m_dictNext(di)) != NULL) {
+        di = m_segDictGetIterator(o->hash);
+        while ((de = m_segDictNext(di)) != NULL) {
             skey = (RedisModuleString *)dictGetKey(de);
             TairHashVal *val = (TairHashVal *)dictGetVal(de);
             RedisModule_SaveString(rdb, skey);
             RedisModule_SaveUnsigned(rdb, val->version);
             RedisModule_SaveUnsigned(rdb, val->expire);
-            RedisModule_SaveString(rdb, val->value);
+            size_t len;
+            const char *ptr = tairHashValStored(val, &len);
+            RedisModule_SaveUnsigned(rdb, val->encoding);
+            RedisModule_SaveStringBuffer(rdb, ptr, len);
         }
-        m_dictReleaseIterator(di);
+        m_segDictReleaseIterator(di);
     }
 }
 
@@ -2773,13 +4441,14 @@ void TairHashTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *va
     tairHashObj *o = (tairHashObj *)value;
     RedisModuleString *skey;
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     // TODO: rewrite to exhmset for big tairhash
     if (o->hash) {
-        di = m_dictGetIterator(o->hash);
-        while ((de = m_dictNext(di)) != NULL) {
+        expireClockEnter(1);
+        di = m_segDictGetIterator(o->hash);
+        while ((de = m_segDictNext(di)) != NULL) {
             TairHashVal *val = (TairHashVal *)dictGetVal(de);
             skey = (RedisModuleString *)dictGetKey(de);
             if (val->expire) {
@@ -2787,12 +4456,20 @@ void TairHashTypeAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *va
                     /* For expired field, we do not REWRITE it. */
                     continue;
                 }
-                RedisModule_EmitAOF(aof, "EXHSET", "sssclcl", key, skey, val->value, "PXAT", val->expire, "ABS", val->version);
+            }
+            RedisModuleString *value = tairHashValDecode(val);
+            if (val->expire) {
+                RedisModule_EmitAOF(aof, "EXHSET", "sssclcl", key, skey, value, "PXAT", val->expire, "ABS", val->version);
             } else {
-                RedisModule_EmitAOF(aof, "EXHSET", "ssscl", key, skey, val->value, "ABS", val->version);
+                RedisModule_EmitAOF(aof, "EXHSET", "ssscl", key, skey, value, "ABS", val->version);
             }
+            RedisModule_FreeString(NULL, value);
+        }
+        m_segDictReleaseIterator(di);
+        expireClockLeave();
+        if (o->lex_index) {
+            RedisModule_EmitAOF(aof, "EXHLEXINDEX", "sc", key, "ON");
         }
-        m_dictReleaseIterator(di);
     }
 }
 
@@ -2802,6 +4479,14 @@ void TairHashTypeFree(void *value) {
     }
 }
 
+static size_t expireIndexMemUsage(tairHashObj *o) {
+#ifdef SLAB_MODE
+    return tairhash_zslMemUsage(o->expire_index);
+#else
+    return m_zslMemUsage(o->expire_index);
+#endif
+}
+
 #if defined(SORT_MODE) || defined(SLAB_MODE)
 
 size_t TairHashTypeMemUsage2(RedisModuleKeyOptCtx *ctx, const void *value) {
@@ -2815,28 +4500,34 @@ size_t TairHashTypeMemUsage2(RedisModuleKeyOptCtx *ctx, const void *value) {
         return size;
     }
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     if (o->hash) {
         size += sizeof(*o);
 
-        di = m_dictGetIterator(o->hash);
-        while ((de = m_dictNext(di)) != NULL) {
+        di = m_segDictGetIterator(o->hash);
+        while ((de = m_segDictNext(di)) != NULL) {
             TairHashVal *val = (TairHashVal *)dictGetVal(de);
             skey = dictGetKey(de);
             size += sizeof(*val);
             RedisModule_StringPtrLen(skey, &skeylen);
             size += skeylen;
-            size_t len;
-            RedisModule_StringPtrLen(val->value, &len);
-            size += len;
+            if (!val->cold) {
+                size_t len;
+                RedisModule_StringPtrLen(val->value, &len);
+                size += len;
+            }
         }
-        m_dictReleaseIterator(di);
+        m_segDictReleaseIterator(di);
     }
 
     if (o->expire_index) {
-        size += o->expire_index->length * sizeof(m_zskiplistNode);
+        size += expireIndexMemUsage(o);
+    }
+
+    if (o->lex_index) {
+        size += m_zslMemUsage(o->lex_index);
     }
 
     return size;
@@ -2845,16 +4536,10 @@ size_t TairHashTypeMemUsage2(RedisModuleKeyOptCtx *ctx, const void *value) {
 void TairHashTypeUnlink2(RedisModuleKeyOptCtx *ctx, const void *value) {
     struct tairHashObj *o = (struct tairHashObj *)value;
 
-    int dbid = RedisModule_GetDbIdFromOptCtx(ctx);
-
-    if (o->expire_index->length) {
-        /* UNLINK is a synchronous call, so ExpireNode can be safely deleted here. */
-#ifdef SLAB_MODE
-        m_zslDelete(g_expire_index[dbid], o->expire_index->header->level[0].forward->expire_min, o->key, NULL);
-#else
-        m_zslDelete(g_expire_index[dbid], o->expire_index->header->level[0].forward->score, o->key, NULL);
-#endif
-    }
+    REDISMODULE_NOT_USED(ctx);
+    /* UNLINK is a synchronous call, the value may then be freed by another
+     * thread. */
+    removeGlobalExpireIndex(o);
 }
 
 void *TairHashTypeCopy2(RedisModuleKeyOptCtx *ctx, const void *value) {
@@ -2865,32 +4550,38 @@ void *TairHashTypeCopy2(RedisModuleKeyOptCtx *ctx, const void *value) {
     const RedisModuleString *tokey = RedisModule_GetToKeyNameFromOptCtx(ctx);
 
     new->key = RedisModule_CreateStringFromString(NULL, tokey);
-    m_dictExpand(new->hash, dictSize(old->hash));
+    m_segDictExpand(new->hash, segDictSize(old->hash));
+    if (old->lex_index) {
+        new->lex_index = m_zslCreate();
+    }
 
     /* Copy hash. */
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
     RedisModuleString *field;
-    di = m_dictGetIterator(old->hash);
-    while ((de = m_dictNext(di)) != NULL) {
+    di = m_segDictGetIterator(old->hash);
+    while ((de = m_segDictNext(di)) != NULL) {
         field = RedisModule_CreateStringFromString(NULL, (RedisModuleString *)dictGetKey(de));
         TairHashVal *oldval = (TairHashVal *)dictGetVal(de);
         TairHashVal *newval = createTairHashVal();
         newval->expire = oldval->expire;
         newval->version = oldval->version;
-        newval->value = RedisModule_CreateStringFromString(NULL, oldval->value);
-        m_dictAdd(new->hash, field, newval);
+        size_t len;
+        const char *ptr = tairHashValStored(oldval, &len);
+        newval->value = RedisModule_CreateString(NULL, ptr, len);
+        newval->encoding = oldval->encoding;
+        addTairHashField(new, field, newval);
         if (newval->expire) {
             g_expire_algorithm.insert(NULL, to_dbid, NULL, new, field, newval->expire);
         }
     }
-    m_dictReleaseIterator(di);
+    m_segDictReleaseIterator(di);
     return new;
 }
 
 size_t TairHashTypeEffort2(RedisModuleKeyOptCtx *ctx, const void *value) {
     tairHashObj *o = (tairHashObj *)value;
-    return dictSize(o->hash) + o->expire_index->length;
+    return segDictSize(o->hash) + expireIndexLength(o);
 }
 #else
 
@@ -2905,28 +4596,34 @@ size_t TairHashTypeMemUsage(const void *value) {
         return size;
     }
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     if (o->hash) {
         size += sizeof(*o);
 
-        di = m_dictGetIterator(o->hash);
-        while ((de = m_dictNext(di)) != NULL) {
+        di = m_segDictGetIterator(o->hash);
+        while ((de = m_segDictNext(di)) != NULL) {
             TairHashVal *val = (TairHashVal *)dictGetVal(de);
             skey = dictGetKey(de);
             size += sizeof(*val);
             RedisModule_StringPtrLen(skey, &skeylen);
             size += skeylen;
-            size_t len;
-            RedisModule_StringPtrLen(val->value, &len);
-            size += len;
+            if (!val->cold) {
+                size_t len;
+                RedisModule_StringPtrLen(val->value, &len);
+                size += len;
+            }
         }
-        m_dictReleaseIterator(di);
+        m_segDictReleaseIterator(di);
     }
 
     if (o->expire_index) {
-        size += o->expire_index->length * sizeof(m_zskiplistNode);
+        size += expireIndexMemUsage(o);
+    }
+
+    if (o->lex_index) {
+        size += m_zslMemUsage(o->lex_index);
     }
 
     return size;
@@ -2935,7 +4632,7 @@ size_t TairHashTypeMemUsage(const void *value) {
 size_t TairHashTypeEffort(RedisModuleString *key, const void *value) {
     REDISMODULE_NOT_USED(key);
     tairHashObj *o = (tairHashObj *)value;
-    return dictSize(o->hash) + o->expire_index->length;
+    return segDictSize(o->hash) + expireIndexLength(o);
 }
 
 #endif
@@ -2949,23 +4646,304 @@ void TairHashTypeDigest(RedisModuleDigest *md, void *value) {
         return;
     }
 
-    m_dictIterator *di;
+    m_segDictIterator *di;
     m_dictEntry *de;
 
     if (o->hash) {
-        di = m_dictGetIterator(o->hash);
-        while ((de = m_dictNext(di)) != NULL) {
+        di = m_segDictGetIterator(o->hash);
+        while ((de = m_segDictNext(di)) != NULL) {
             TairHashVal *val = (TairHashVal *)dictGetVal(de);
             skey = (RedisModuleString *)dictGetKey(de);
+            /* The digest does not depend on the encoding of the value. */
+            RedisModuleString *value = tairHashValDecode(val);
             size_t val_len, skey_len;
-            const char *val_ptr = RedisModule_StringPtrLen(val->value, &val_len);
+            const char *val_ptr = RedisModule_StringPtrLen(value, &val_len);
             const char *skey_ptr = RedisModule_StringPtrLen(skey, &skey_len);
             RedisModule_DigestAddStringBuffer(md, (unsigned char *)skey_ptr, skey_len);
             RedisModule_DigestAddStringBuffer(md, (unsigned char *)val_ptr, val_len);
             RedisModule_DigestEndSequence(md);
+            RedisModule_FreeString(NULL, value);
+        }
+        m_segDictReleaseIterator(di);
+    }
+}
+
+/* The defrag cursor first walks the field dict with m_segDictScan(), then the
+ * per key expire index by rank, then the lex index by rank. The top bit tells
+ * the dict phase from the others, a dict scan cursor never reaches it, and
+ * the next one the lex index phase from the expire index one. */
+#define TAIRHASH_DEFRAG_INDEX_PHASE (1UL << (sizeof(unsigned long) * 8 - 1))
+#define TAIRHASH_DEFRAG_LEX_PHASE (1UL << (sizeof(unsigned long) * 8 - 2))
+
+static void defragScanCallback(void *privdata, const m_dictEntry *de) {
+    REDISMODULE_NOT_USED(privdata);
+    REDISMODULE_NOT_USED(de);
+}
+
+/* Relocate every entry of the bucket together with its field, TairHashVal and
+ * value. Fields that also live in the expire index are shared (refcount > 1)
+ * and are never moved by RedisModule_DefragRedisModuleString. */
+static void defragBucketCallback(void *privdata, m_dictEntry **bucketref) {
+    RedisModuleDefragCtx *ctx = privdata;
+    m_dictEntry *de, *newde;
+    TairHashVal *val, *newval;
+    RedisModuleString *newstr;
+
+    while ((de = *bucketref) != NULL) {
+        if ((newde = RedisModule_DefragAlloc(ctx, de)) != NULL) {
+            *bucketref = de = newde;
+        }
+        if ((newstr = RedisModule_DefragRedisModuleString(ctx, de->key)) != NULL) {
+            de->key = newstr;
+        }
+        val = de->v.val;
+        if ((newval = RedisModule_DefragAlloc(ctx, val)) != NULL) {
+            de->v.val = val = newval;
+        }
+        if (!val->cold && (newstr = RedisModule_DefragRedisModuleString(ctx, val->value)) != NULL) {
+            val->value = newstr;
+        }
+        bucketref = &de->next;
+    }
+}
+
+static void defragDictTables(RedisModuleDefragCtx *ctx, dict *d) {
+    void *newptr;
+
+    for (int j = 0; j < 2; j++) {
+        if (d->ht[j].table && (newptr = RedisModule_DefragAlloc(ctx, d->ht[j].table)) != NULL) {
+            d->ht[j].table = newptr;
+        }
+    }
+}
+
+int TairHashTypeDefrag(RedisModuleDefragCtx *ctx, RedisModuleString *key, void **value) {
+    REDISMODULE_NOT_USED(key);
+
+    tairHashObj *o = *value, *newo;
+    unsigned long cursor = 0;
+    void *newptr;
+
+    RedisModule_DefragCursorGet(ctx, &cursor);
+
+    if (cursor == 0) {
+        if ((newo = RedisModule_DefragAlloc(ctx, o)) != NULL) {
+            *value = o = newo;
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+            m_heapRelocate(&o->expire_entry);
+#endif
+        }
+        if (o->key && (newptr = RedisModule_DefragRedisModuleString(ctx, o->key)) != NULL) {
+            o->key = newptr;
+        }
+        if ((newptr = RedisModule_DefragAlloc(ctx, o->hash)) != NULL) {
+            o->hash = newptr;
+        }
+        defragDictTables(ctx, &o->hash->d);
+        if (o->hash->segs) {
+            if ((newptr = RedisModule_DefragAlloc(ctx, o->hash->segs)) != NULL) {
+                o->hash->segs = newptr;
+            }
+            for (int j = 0; j < M_SEGDICT_SEGS; j++) {
+                if ((newptr = RedisModule_DefragAlloc(ctx, o->hash->segs[j])) != NULL) {
+                    o->hash->segs[j] = newptr;
+                }
+                defragDictTables(ctx, o->hash->segs[j]);
+            }
+        }
+        if (o->expire_index && (newptr = RedisModule_DefragAlloc(ctx, o->expire_index)) != NULL) {
+            o->expire_index = newptr;
+        }
+        if (o->lex_index && (newptr = RedisModule_DefragAlloc(ctx, o->lex_index)) != NULL) {
+            o->lex_index = newptr;
+        }
+    }
+
+    if (!(cursor & TAIRHASH_DEFRAG_INDEX_PHASE)) {
+        do {
+            cursor = m_segDictScan(o->hash, cursor, defragScanCallback, defragBucketCallback, ctx);
+        } while (cursor && !RedisModule_DefragShouldStop(ctx));
+
+        if (cursor) {
+            RedisModule_DefragCursorSet(ctx, cursor);
+            return 1;
+        }
+        if (RedisModule_DefragShouldStop(ctx)) {
+            RedisModule_DefragCursorSet(ctx, TAIRHASH_DEFRAG_INDEX_PHASE);
+            return 1;
+        }
+    }
+
+    /* The indexes may also have been released since the last call. */
+    if (!(cursor & TAIRHASH_DEFRAG_LEX_PHASE) && o->expire_index) {
+#ifdef SLAB_MODE
+        cursor = tairhash_zslDefrag(ctx, o->expire_index, cursor & ~TAIRHASH_DEFRAG_INDEX_PHASE);
+#else
+        cursor = m_zslDefrag(ctx, o->expire_index, cursor & ~TAIRHASH_DEFRAG_INDEX_PHASE);
+#endif
+        if (cursor) {
+            RedisModule_DefragCursorSet(ctx, cursor | TAIRHASH_DEFRAG_INDEX_PHASE);
+            return 1;
+        }
+        if (o->lex_index && RedisModule_DefragShouldStop(ctx)) {
+            RedisModule_DefragCursorSet(ctx, TAIRHASH_DEFRAG_INDEX_PHASE | TAIRHASH_DEFRAG_LEX_PHASE);
+            return 1;
+        }
+    }
+    if (o->lex_index == NULL) {
+        return 0;
+    }
+    cursor = m_zslDefrag(ctx, o->lex_index, cursor & ~(TAIRHASH_DEFRAG_INDEX_PHASE | TAIRHASH_DEFRAG_LEX_PHASE));
+    if (cursor) {
+        RedisModule_DefragCursorSet(ctx, cursor | TAIRHASH_DEFRAG_INDEX_PHASE | TAIRHASH_DEFRAG_LEX_PHASE);
+        return 1;
+    }
+    return 0;
+}
+
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+/* The global expire indexes point at the objects, which are relocated with
+ * their keys, and the keys point at their slots, so only the item arrays are
+ * moved here. */
+int tairHashDefragGlobals(RedisModuleDefragCtx *ctx) {
+    for (int dbid = 0; dbid < g_db_num; dbid++) {
+        expireDb *db = g_expire_index[dbid];
+        if (db == NULL) {
+            continue;
+        }
+        m_heapDefrag(ctx, &db->slots);
+        for (unsigned int j = 0; db->slot && j < g_expire_slots; j++) {
+            if (db->slot[j]) {
+                m_heapDefrag(ctx, &db->slot[j]->keys);
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
+/* exhexpiretrace get [count] | len | reset */
+int TairHashTypeExpireTrace_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    if (!mstrcasecmp(argv[1], "len") && argc == 2) {
+        return RedisModule_ReplyWithLongLong(ctx, g_expire_trace_len);
+    } else if (!mstrcasecmp(argv[1], "reset") && argc == 2) {
+        g_expire_trace_len = 0;
+        return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    } else if (!mstrcasecmp(argv[1], "get") && argc <= 3) {
+        long long count = 10;
+        if (argc == 3 && (RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK || count < 0)) {
+            RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_NOT_INTEGER);
+            return REDISMODULE_ERR;
+        }
+        if ((uint64_t)count > g_expire_trace_len) {
+            count = g_expire_trace_len;
+        }
+
+        /* Newest entry first, like SLOWLOG GET. */
+        RedisModule_ReplyWithArray(ctx, count);
+        for (long long i = 0; i < count; ++i) {
+            expireTraceEntry *trace = &g_expire_trace[(g_expire_trace_next_id - 1 - i) % TAIRHASH_EXPIRE_TRACE_LEN];
+            RedisModule_ReplyWithArray(ctx, 8);
+            RedisModule_ReplyWithLongLong(ctx, trace->id);
+            RedisModule_ReplyWithLongLong(ctx, trace->start_msec);
+            RedisModule_ReplyWithLongLong(ctx, trace->duration_usec);
+            RedisModule_ReplyWithLongLong(ctx, trace->dbid);
+            RedisModule_ReplyWithLongLong(ctx, trace->keys_visited);
+            RedisModule_ReplyWithLongLong(ctx, trace->fields_expired);
+            RedisModule_ReplyWithLongLong(ctx, trace->notifications);
+            RedisModule_ReplyWithLongLong(ctx, trace->repl_bytes);
+        }
+        return REDISMODULE_OK;
+    }
+
+    RedisModule_ReplyWithError(ctx, TAIRHASH_ERRORMSG_SYNTAX);
+    return REDISMODULE_ERR;
+}
+
+/* exhlatencyreset */
+int TairHashTypeLatencyReset_RedisCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    REDISMODULE_NOT_USED(argv);
+
+    if (argc != 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+
+    for (int i = 0; i < TAIRHASH_CMD_NUM; ++i) {
+        m_histogramReset(&g_cmd_latency[i]);
+    }
+    m_histogramReset(&g_active_expire_latency);
+    m_histogramReset(&g_passive_expire_latency);
+    for (int i = 0; i < g_db_num; ++i) {
+        m_histogramReset(&g_expire_lag[i]);
+    }
+    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+}
+
+#define TAIRHASH_CMD_TIMED(name, func, flags, firstkey, lastkey, keystep)                 \
+    static int func##_Timed(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {    \
+        uint64_t start = latencyNowUsec();                                                \
+        expireClockEnter(0);                                                              \
+        int ret = func(ctx, argv, argc);                                                  \
+        expireClockLeave();                                                               \
+        m_histogramRecord(&g_cmd_latency[TAIRHASH_CMD_##name], latencyNowUsec() - start); \
+        return ret;                                                                       \
+    }
+TAIRHASH_COMMAND_TABLE(TAIRHASH_CMD_TIMED)
+
+/* Only the passes with something due are timed, the check is a comparison
+ * against the head of the index. */
+static RedisModuleKey *timedPassiveExpire(RedisModuleCtx *ctx, int dbid, RedisModuleKey *real_key, RedisModuleString *key) {
+    if (!passiveExpireDue(dbid, real_key)) {
+        return real_key;
+    }
+    uint64_t start = latencyNowUsec();
+    real_key = passiveExpire(ctx, dbid, real_key, key);
+    m_histogramRecord(&g_passive_expire_latency, latencyNowUsec() - start);
+    return real_key;
+}
+
+/* Length of the RESP encoding of a bulk string of 'len' bytes. */
+static size_t respBulkLen(size_t len) {
+    size_t digits = 1;
+    for (size_t v = len; v >= 10; v /= 10) {
+        digits++;
+    }
+    return 1 + digits + 2 + len + 2;
+}
+
+static void trackedDeleteAndPropagate(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *obj, RedisModuleString *field, long long expire, int is_timer) {
+    long long lag = RedisModule_Milliseconds() - expire;
+    size_t key_len, field_len;
+
+    m_histogramRecord(&g_expire_lag[dbid], lag > 0 ? (uint64_t)lag : 0);
+    /* Every expired field is propagated as EXHDEL <key> <field>. */
+    RedisModule_StringPtrLen(key, &key_len);
+    RedisModule_StringPtrLen(field, &field_len);
+    g_expire_algorithm.stat_expired_repl_bytes += 4 + respBulkLen(6) + respBulkLen(key_len) + respBulkLen(field_len);
+    deleteAndPropagate(ctx, dbid, key, obj, field, expire, is_timer);
+}
+
+/* Per db state is sized by the `databases` of the server. */
+static int getServerDatabases(RedisModuleCtx *ctx) {
+    long long databases = TAIR_HASH_DEFAULT_DB_NUM;
+    RedisModuleCallReply *reply = RedisModule_Call(ctx, "CONFIG", "cc", "GET", "databases");
+    if (reply == NULL) {
+        return databases;
+    }
+    if (RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY && RedisModule_CallReplyLength(reply) == 2) {
+        RedisModuleString *value = RedisModule_CreateStringFromCallReply(RedisModule_CallReplyArrayElement(reply, 1));
+        long long v;
+        if (value && RedisModule_StringToLongLong(value, &v) == REDISMODULE_OK && v > 0 && v <= INT_MAX) {
+            databases = v;
         }
-        m_dictReleaseIterator(di);
+        if (value) RedisModule_FreeString(ctx, value);
     }
+    RedisModule_FreeCallReply(reply);
+    return databases;
 }
 
 int Module_CreateCommands(RedisModuleCtx *ctx) {
@@ -2977,45 +4955,9 @@ int Module_CreateCommands(RedisModuleCtx *ctx) {
         }                                                                                                    \
     } while (0);
 
-#define CREATE_WRCMD(name, tgt) CREATE_CMD(name, tgt, "write deny-oom", 1, 1, 1);
-#define CREATE_ROCMD(name, tgt) CREATE_CMD(name, tgt, "readonly fast", 1, 1, 1);
-#define CREATE_WRMCMD(name, tgt, firstkey, lastkey, keystep) CREATE_CMD(name, tgt, "write deny-oom", firstkey, lastkey, keystep);
-#define CREATE_ROMCMD(name, tgt, firstkey, lastkey, keystep) CREATE_CMD(name, tgt, "readonly fast", firstkey, lastkey, keystep);
-
-    /* write cmds */
-    CREATE_WRCMD("exhset", TairHashTypeHset_RedisCommand)
-    CREATE_WRCMD("exhdel", TairHashTypeHdel_RedisCommand)
-    CREATE_WRCMD("exhdelrepl", TairHashTypeHdelRepl_RedisCommand)
-    CREATE_WRCMD("exhdelwithver", TairHashTypeHdelWithVer_RedisCommand)
-    CREATE_WRCMD("exhincrby", TairHashTypeHincrBy_RedisCommand)
-    CREATE_WRCMD("exhincrbyfloat", TairHashTypeHincrByFloat_RedisCommand)
-    CREATE_WRCMD("exhsetnx", TairHashTypeHsetNx_RedisCommand)
-    CREATE_WRCMD("exhmset", TairHashTypeHmset_RedisCommand)
-    CREATE_WRCMD("exhmsetwithopts", TairHashTypeHmsetWithOpts_RedisCommand)
-    CREATE_WRCMD("exhsetver", TairHashTypeHsetVer_RedisCommand)
-    CREATE_WRCMD("exhexpire", TairHashTypeHexpire_RedisCommand)
-    CREATE_WRCMD("exhexpireat", TairHashTypeHexpireAt_RedisCommand)
-    CREATE_WRCMD("exhpexpire", TairHashTypeHpexpire_RedisCommand)
-    CREATE_WRCMD("exhpexpireat", TairHashTypeHpexpireAt_RedisCommand)
-    CREATE_WRCMD("exhpersist", TairHashTypeHpersist_RedisCommand)
-
-    /* readonly cmds */
-    CREATE_ROCMD("exhget", TairHashTypeHget_RedisCommand)
-    CREATE_ROCMD("exhlen", TairHashTypeHlen_RedisCommand)
-    CREATE_ROCMD("exhexists", TairHashTypeHexists_RedisCommand)
-    CREATE_ROCMD("exhstrlen", TairHashTypeHstrlen_RedisCommand)
-    CREATE_ROCMD("exhkeys", TairHashTypeHkeys_RedisCommand)
-    CREATE_ROCMD("exhvals", TairHashTypeHvals_RedisCommand)
-    CREATE_ROCMD("exhgetall", TairHashTypeHgetAll_RedisCommand)
-    CREATE_ROCMD("exhgetallwithver", TairHashTypeHgetAllWithVer_RedisCommand)
-    CREATE_ROCMD("exhmget", TairHashTypeHmget_RedisCommand)
-    CREATE_ROCMD("exhmgetwithver", TairHashTypeHmgetWithVer_RedisCommand)
-    CREATE_ROCMD("exhscan", TairHashTypeHscan_RedisCommand)
-    CREATE_ROCMD("exhver", TairHashTypeHver_RedisCommand)
-    CREATE_ROCMD("exhttl", TairHashTypeHttl_RedisCommand)
-    CREATE_ROCMD("exhpttl", TairHashTypeHpttl_RedisCommand)
-    CREATE_ROCMD("exhgetwithver", TairHashTypeHgetWithVer_RedisCommand)
-    CREATE_ROMCMD("exhexpireinfo", TairHashTypeActiveExpireInfo_RedisCommand, 0, 0, 0)
+#define CREATE_TIMED_CMD(name, func, flags, firstkey, lastkey, keystep) CREATE_CMD(#name, func##_Timed, flags, firstkey, lastkey, keystep)
+
+    TAIRHASH_COMMAND_TABLE(CREATE_TIMED_CMD)
 
     return REDISMODULE_OK;
 }
@@ -3046,6 +4988,21 @@ int __attribute__((visibility("default"))) RedisModule_OnLoad(RedisModuleCtx *ct
     }
 #endif
 
+    g_db_num = getServerDatabases(ctx);
+    g_expire_algorithm.stat_active_expired_field = RedisModule_Calloc(g_db_num, sizeof(uint64_t));
+    g_expire_algorithm.stat_passive_expired_field = RedisModule_Calloc(g_db_num, sizeof(uint64_t));
+    g_expire_algorithm.stat_expired_stale_fields = RedisModule_Calloc(g_db_num, sizeof(uint64_t));
+    g_expire_algorithm.stat_expired_stale_bytes = RedisModule_Calloc(g_db_num, sizeof(uint64_t));
+    g_expire_lag = RedisModule_Calloc(g_db_num, sizeof(m_histogram));
+    g_cold_scan_cursor = RedisModule_Calloc(g_db_num, sizeof(long long));
+    g_cold_dir = RedisModule_Strdup(".");
+
+    /* Fork child events are available since redis 6.2, older versions keep resizing as before. */
+    if (RedisModule_SubscribeToServerEvent &&
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_ForkChild, forkChildCallback) == REDISMODULE_OK) {
+        g_fork_child_event = 1;
+    }
+
     g_expire_algorithm.enable_active_expire = 1;
     g_expire_algorithm.active_expire_period = TAIR_HASH_ACTIVE_EXPIRE_PERIOD;
     g_expire_algorithm.dbs_per_active_loop = TAIR_HASH_ACTIVE_DBS_PER_CALL;
@@ -3088,12 +5045,61 @@ int __attribute__((visibility("default"))) RedisModule_OnLoad(RedisModuleCtx *ct
                 return REDISMODULE_ERR;
             }
             g_expire_algorithm.keys_per_passive_loop = v;
+        } else if (!mstrcasecmp(argv[ii], "dict_force_resize_ratio")) {
+            long long v;
+            if (RedisModule_StringToLongLong(argv[ii + 1], &v) == REDISMODULE_ERR || v < 1 || v > UINT_MAX) {
+                RedisModule_Log(ctx, "warning", "Invalid argument for dict_force_resize_ratio");
+                return REDISMODULE_ERR;
+            }
+            m_dictSetForceResizeRatio((unsigned int)v);
+        } else if (!mstrcasecmp(argv[ii], "dict_segment_threshold")) {
+            long long v;
+            if (RedisModule_StringToLongLong(argv[ii + 1], &v) == REDISMODULE_ERR || v < 1) {
+                RedisModule_Log(ctx, "warning", "Invalid argument for dict_segment_threshold");
+                return REDISMODULE_ERR;
+            }
+            m_segDictSetSplitSize((unsigned long)v);
+        } else if (!mstrcasecmp(argv[ii], "value_compress_threshold")) {
+            long long v;
+            if (RedisModule_StringToLongLong(argv[ii + 1], &v) == REDISMODULE_ERR || v < 0 || v > UINT32_MAX) {
+                RedisModule_Log(ctx, "warning", "Invalid argument for value_compress_threshold");
+                return REDISMODULE_ERR;
+            }
+            g_compress_threshold = v;
+        } else if (!mstrcasecmp(argv[ii], "cold_tier_idle_time")) {
+            long long v;
+            if (RedisModule_StringToLongLong(argv[ii + 1], &v) == REDISMODULE_ERR || v < 0 || v > UINT32_MAX) {
+                RedisModule_Log(ctx, "warning", "Invalid argument for cold_tier_idle_time");
+                return REDISMODULE_ERR;
+            }
+            if (v && !coldReclaimGuarded()) {
+                RedisModule_Log(ctx, "warning", "cold_tier_idle_time needs a server reporting its fork children, 6.2 or above");
+                return REDISMODULE_ERR;
+            }
+            g_cold_idle_time = v;
+        } else if (!mstrcasecmp(argv[ii], "expired_event_payload")) {
+            long long v;
+            if (RedisModule_StringToLongLong(argv[ii + 1], &v) == REDISMODULE_ERR) {
+                RedisModule_Log(ctx, "warning", "Invalid argument for expired_event_payload");
+                return REDISMODULE_ERR;
+            }
+            g_expired_event_payload = v != 0;
+        } else if (!mstrcasecmp(argv[ii], "cold_tier_dir")) {
+            RedisModule_Free(g_cold_dir);
+            g_cold_dir = RedisModule_Strdup(RedisModule_StringPtrLen(argv[ii + 1], NULL));
         } else {
             RedisModule_Log(ctx, "warning", "Unrecognized option");
             return REDISMODULE_ERR;
         }
     }
 
+    if (RedisModule_RegisterNumericConfig && RedisModule_LoadConfigs) {
+        if (Module_RegisterConfigs(ctx) == REDISMODULE_ERR) {
+            RedisModule_Log(ctx, "warning", "Failed to register module configs");
+            return REDISMODULE_ERR;
+        }
+    }
+
     RedisModuleTypeMethods tm = {
         .version = REDISMODULE_TYPE_METHOD_VERSION,
         .rdb_load = TairHashTypeRdbLoad,
@@ -3101,6 +5107,7 @@ int __attribute__((visibility("default"))) RedisModule_OnLoad(RedisModuleCtx *ct
         .aof_rewrite = TairHashTypeAofRewrite,
         .free = TairHashTypeFree,
         .digest = TairHashTypeDigest,
+        .defrag = TairHashTypeDefrag,
 #if defined(SORT_MODE) || defined(SLAB_MODE)
         .unlink2 = TairHashTypeUnlink2,
         .copy2 = TairHashTypeCopy2,
@@ -3112,7 +5119,7 @@ int __attribute__((visibility("default"))) RedisModule_OnLoad(RedisModuleCtx *ct
 #endif
     };
 
-    TairHashType = RedisModule_CreateDataType(ctx, "tairhash-", 0, &tm);
+    TairHashType = RedisModule_CreateDataType(ctx, "tairhash-", TAIRHASH_ENCVER, &tm);
     if (TairHashType == NULL)
         return REDISMODULE_ERR;
 
@@ -3121,16 +5128,25 @@ int __attribute__((visibility("default"))) RedisModule_OnLoad(RedisModuleCtx *ct
     }
 
 #if defined(SORT_MODE) || defined(SLAB_MODE)
-    for (int i = 0; i < DB_NUM; i++) {
-        g_expire_index[i] = m_zslCreate();
+    if (RedisModule_GetContextFlags(ctx) & REDISMODULE_CTX_FLAGS_CLUSTER) {
+        g_expire_slots = M_CLUSTER_SLOTS;
     }
+    g_expire_index = RedisModule_Calloc(g_db_num, sizeof(expireDb *));
 
     RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_SwapDB, swapDbCallback);
     RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_FlushDB, flushDbCallback);
     RedisModule_SubscribeToKeyspaceEvents(ctx, REDISMODULE_NOTIFY_GENERIC, keySpaceNotification);
-    RedisModule_RegisterInfoFunc(ctx, infoFunc);
+    if (RedisModule_RegisterDefragFunc) {
+        RedisModule_RegisterDefragFunc(ctx, tairHashDefragGlobals);
+    }
+#else
+    g_scan_cursor = RedisModule_Calloc(g_db_num, sizeof(long long));
 #endif
 
+    if (RedisModule_RegisterInfoFunc) {
+        RedisModule_RegisterInfoFunc(ctx, infoFunc);
+    }
+
 #if defined(SLAB_MODE) && defined(__AVX2__)
     slab_initShuffleMask();
 #endif
@@ -3138,9 +5154,9 @@ int __attribute__((visibility("default"))) RedisModule_OnLoad(RedisModuleCtx *ct
     g_expire_algorithm.insert = insert;
     g_expire_algorithm.update = update;
     g_expire_algorithm.delete = delete;
-    g_expire_algorithm.deleteAndPropagate = deleteAndPropagate;
+    g_expire_algorithm.deleteAndPropagate = trackedDeleteAndPropagate;
     g_expire_algorithm.activeExpire = activeExpire;
-    g_expire_algorithm.passiveExpire = passiveExpire;
+    g_expire_algorithm.passiveExpire = timedPassiveExpire;
 
     if (g_expire_algorithm.enable_active_expire) {
         /* Here we can't directly use the 'ctx' passed by OnLoad, because
@@ -3151,5 +5167,10 @@ int __attribute__((visibility("default"))) RedisModule_OnLoad(RedisModuleCtx *ct
         startExpireTimer(ctx2, NULL);
         RedisModule_FreeThreadSafeContext(ctx2);
     }
+    if (g_cold_idle_time) {
+        RedisModuleCtx *ctx2 = RedisModule_GetThreadSafeContext(NULL);
+        startColdTierTimer(ctx2);
+        RedisModule_FreeThreadSafeContext(ctx2);
+    }
     return REDISMODULE_OK;
 }
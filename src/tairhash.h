@@ -15,11 +15,17 @@
  */
 #pragma once
 
+#include <stddef.h>
 #include <stdio.h>
 
+#include "coldstore.h"
+#include "crc16.h"
 #include "dict.h"
+#include "heap.h"
 #include "list.h"
+#include "lzf.h"
 #include "redismodule.h"
+#include "segdict.h"
 #include "skiplist.h"
 #include "slabapi.h"
 #include "util.h"
@@ -33,6 +39,10 @@
 #define TAIRHASH_ERRORMSG_INT_MIN_MAX "ERR min or max is specified, but value is not an integer"
 #define TAIRHASH_ERRORMSG_FLOAT_MIN_MAX "ERR min or max is specified, but value is not a float"
 #define TAIRHASH_ERRORMSG_MIN_MAX "ERR min value is bigger than max value"
+#define TAIRHASH_ERRORMSG_LEX_RANGE "ERR min or max not valid string range item"
+#define TAIRHASH_ERRORMSG_NO_LEX_INDEX "ERR the key has no lex index, see EXHLEXINDEX"
+#define TAIRHASH_ERRORMSG_OFFSET "ERR offset is out of range"
+#define TAIRHASH_ERRORMSG_TOO_LONG "ERR string exceeds maximum allowed size (proto-max-bulk-len)"
 
 #define TAIR_HASH_SET_NO_FLAGS 0
 #define TAIR_HASH_SET_NX (1 << 0)
@@ -45,10 +55,12 @@
 #define TAIR_HASH_SET_WITH_GT_VER (1 << 7)
 #define TAIR_HASH_SET_WITH_BOUNDARY (1 << 8)
 #define TAIR_HASH_SET_KEEPTTL (1 << 9)
+#define TAIR_HASH_SET_WITH_EXPIRE (TAIR_HASH_SET_EX | TAIR_HASH_SET_PX)
+#define TAIR_HASH_SET_WITH_ANY_VER (TAIR_HASH_SET_WITH_VER | TAIR_HASH_SET_WITH_ABS_VER | TAIR_HASH_SET_WITH_GT_VER)
 
 #define UNIT_SECONDS 0
 #define UNIT_MILLISECONDS 1
-#define DB_NUM 16 /* This value must be equal to the db_dum of redis. */
+#define TAIR_HASH_DEFAULT_DB_NUM 16 /* Used when the server does not report its `databases`. */
 
 #define TAIR_HASH_ACTIVE_EXPIRE_PERIOD 1000
 #define TAIR_HASH_ACTIVE_EXPIRE_KEYS_PER_LOOP 1000
@@ -65,45 +77,165 @@
  * will be Lost unless you specify ttl again. The `version` and `expire` of tairhash will
  * be completely recovered after the restore.
  */
+/* Encodings of TairHashVal.value. An LZF value starts with the length of the
+ * value as written by the client, 4 bytes little endian. */
+#define TAIRHASH_VAL_RAW 0
+#define TAIRHASH_VAL_LZF 1
+
+/* RDB encoding version, 1 saves the encoding of every value, 2 the flags
+ * of the key. */
+#define TAIRHASH_ENCVER 2
+#define TAIRHASH_RDB_LEX_INDEX (1 << 0) /* The key has a lex index. */
+
+/* Values left unread for cold_tier_idle_time seconds move to the cold store,
+ * see coldstore.h, unless shorter than this. */
+#define TAIRHASH_COLD_MIN_LEN 64
+
+/* Longest value EXHAPPEND and EXHSETRANGE can build, the default
+ * proto-max-bulk-len of redis. */
+#define TAIRHASH_MAX_VALUE_LEN (512LL * 1024 * 1024)
+
 typedef struct TairHashVal {
     long long version;
     long long expire;
-    RedisModuleString *value;
+    /* Read through tairHashValDecode() and friends. */
+    union {
+        RedisModuleString *value;
+        uint64_t cold_offset; /* In the cold store, while 'cold' is set. */
+    };
+    uint32_t atime;   /* Seconds clock of the last read or write. */
+    uint8_t encoding; /* Also of a cold value. */
+    uint8_t cold;
+    uint8_t owned; /* Nothing else references 'value', it may grow in place. */
 } TairHashVal;
 
 typedef struct tairHashObj {
-    dict *hash;
+    segDict *hash;
 #if defined SLAB_MODE
     tairhash_zskiplist *expire_index;
 #else
     m_zskiplist *expire_index;
 #endif
+    /* The fields in lexicographic order, built by EXHLEXINDEX key ON and
+     * kept in step with the dict until EXHLEXINDEX key OFF. */
+    m_zskiplist *lex_index;
     RedisModuleString *key;
+    unsigned long cold_cursor; /* Where the cold tier sweep resumes. */
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    /* Slot in the global index of the db, by the earliest expire of the
+     * fields. */
+    m_heapEntry expire_entry;
+#endif
 } tairHashObj;
 
+/* Number of expiring fields, the index is only allocated while there is one. */
+static inline unsigned long expireIndexLength(const tairHashObj *o) {
+    return o->expire_index ? o->expire_index->length : 0;
+}
+
+/* Earliest expire of the fields, the index must not be empty. */
+static inline long long expireIndexMin(const tairHashObj *o) {
+#ifdef SLAB_MODE
+    return o->expire_index->header->level[0].forward->expire_min;
+#else
+    return o->expire_index->header->level[0].forward->score;
+#endif
+}
+
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+static inline tairHashObj *expireEntryObj(m_heapEntry *entry) {
+    return (tairHashObj *)((char *)entry - offsetof(tairHashObj, expire_entry));
+}
+
+/* The global index of a db is partitioned by cluster hash slot, a single
+ * partition outside of cluster mode. Each slot keeps its keys in a heap by
+ * the earliest expire of their fields, and the db keeps its non empty slots
+ * in a summary heap by the earliest expire of their keys. */
+typedef struct expireSlot {
+    m_heap keys;       /* Must be the first member, see expireSlotOf(). */
+    m_heapEntry entry; /* In the summary of the db, freed once keys is empty. */
+    unsigned int slot;
+    struct expireDb *db;
+    uint64_t expired; /* Fields expired by active and passive expire. */
+} expireSlot;
+
+typedef struct expireDb {
+    m_heap slots;         /* Non empty slots, by their earliest key. */
+    expireSlot **slot;    /* g_expire_slots entries, NULL while the db has no key. */
+    unsigned long length; /* Keys in all the slots. */
+} expireDb;
+
+/* Slot of a key heap, or of an entry of the summary. */
+static inline expireSlot *expireSlotOf(const m_heap *keys) {
+    return (expireSlot *)keys;
+}
+
+static inline expireSlot *expireSummarySlot(const m_heapEntry *entry) {
+    return (expireSlot *)((char *)entry - offsetof(expireSlot, entry));
+}
+
+/* Earliest key of the db, NULL if the db has no expiring key. */
+static inline m_heapEntry *expireDbFirst(const expireDb *db) {
+    m_heapEntry *first = db ? m_heapFirst(&db->slots) : NULL;
+    return first ? m_heapFirst(&expireSummarySlot(first)->keys) : NULL;
+}
+#endif
+
 typedef struct ExpireAlgorithm {
     void (*insert)(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *obj, RedisModuleString *field, long long expire);
     void (*update)(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *obj, RedisModuleString *field, long long cur_expire, long long new_expire);
     void (*delete)(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *obj, RedisModuleString *field, long long expire);
     void (*deleteAndPropagate)(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *obj, RedisModuleString *field, long long expire, int is_timer);
     void (*activeExpire)(RedisModuleCtx *ctx, int dbid, uint64_t keys);
-    void (*passiveExpire)(RedisModuleCtx *ctx, int dbid, RedisModuleString *key_per_loop);
+    /* Runs on the write path with the key the command opened, returns the
+     * handle to keep using: a new one if the key was deleted. */
+    RedisModuleKey *(*passiveExpire)(RedisModuleCtx *ctx, int dbid, RedisModuleKey *real_key, RedisModuleString *key);
 
     int enable_active_expire;
     uint64_t active_expire_period;
     uint64_t dbs_per_active_loop;
     uint64_t keys_per_active_loop;
     uint64_t keys_per_passive_loop;
-    uint64_t stat_active_expired_field[DB_NUM];
-    uint64_t stat_passive_expired_field[DB_NUM];
+    /* Per db statistics, g_db_num entries. */
+    uint64_t *stat_active_expired_field;
+    uint64_t *stat_passive_expired_field;
     uint64_t stat_last_active_expire_time_msec;
     uint64_t stat_avg_active_expire_time_msec;
     uint64_t stat_max_active_expire_time_msec;
+    /* Keys and fields looked at by the active expire, in total and in the
+     * last cycle. */
+    uint64_t stat_active_keys_visited;
+    uint64_t stat_active_fields_examined;
+    uint64_t stat_last_active_keys_visited;
+    uint64_t stat_last_active_fields_examined;
+    /* Sampled estimate of the fields already expired but still resident. */
+    uint64_t *stat_expired_stale_fields;
+    uint64_t *stat_expired_stale_bytes;
+    /* Keyspace notifications sent and bytes propagated for expired fields. */
+    uint64_t stat_expired_notifications;
+    uint64_t stat_expired_repl_bytes;
 } ExpireAlgorithm;
 
 void _moduleAssert(const char *estr, const char *file, int line);
 RedisModuleString *takeAndRef(RedisModuleString *str);
 int delEmptyTairHashIfNeeded(RedisModuleCtx *ctx, RedisModuleKey *key, RedisModuleString *raw_key, tairHashObj *obj);
-void notifyFieldSpaceEvent(char *event, RedisModuleString *key, RedisModuleString *field, int dbid);
+void createExpireIndexIfNeeded(tairHashObj *o);
+void releaseExpireIndexIfEmpty(tairHashObj *o);
+void setTairHashValValue(TairHashVal *val, RedisModuleString *value);
+RedisModuleString *tairHashValDecode(const TairHashVal *val);
+size_t tairHashValLen(const TairHashVal *val);
+void setTairHashValRaw(TairHashVal *val, RedisModuleString *value);
+int replyWithTairHashVal(RedisModuleCtx *ctx, TairHashVal *val);
+int addTairHashField(tairHashObj *o, RedisModuleString *field, TairHashVal *val);
+int delTairHashField(tairHashObj *o, RedisModuleString *field);
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+void updateGlobalExpireIndex(int dbid, tairHashObj *o);
+void removeGlobalExpireIndex(tairHashObj *o);
+#endif
+void notifyFieldSpaceEvent(char *event, RedisModuleString *key, RedisModuleString *field, const TairHashVal *val, int dbid);
+RedisModuleString *fieldEventPayload(RedisModuleString *field, const TairHashVal *val);
+void expireClockEnter(int cycle);
+void expireClockLeave(void);
+long long expireClockNow(void);
 int isExpire(long long when);
 int fieldExpireIfNeeded(RedisModuleCtx *ctx, int dbid, RedisModuleString *key, tairHashObj *o, RedisModuleString *field, int is_timer);
@@ -0,0 +1,2112 @@
+/*
+ * Copyright 2021 Alibaba Tair Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "redismodule_mock.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "dict.h"
+
+#define mockAssert(_e) ((_e) ? (void)0 : mockPanic(__FILE__, __LINE__, "assertion failed: %s", #_e))
+
+static void mockPanic(const char *file, int line, const char *fmt, ...) {
+    va_list ap;
+    fprintf(stderr, "mock: %s:%d: ", file, line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    abort();
+}
+
+/* ========================== State =============================*/
+
+struct RedisModuleString {
+    int refcount;
+    size_t len;
+    size_t alloc; /* Room for len bytes and the terminator, grown by appends. */
+    char *ptr;
+};
+
+typedef struct mockAutoMemEntry {
+    int type;
+    void *ptr;
+} mockAutoMemEntry;
+
+#define MOCK_AM_STRING 1
+#define MOCK_AM_KEY 2
+#define MOCK_AM_REPLY 3
+
+#define MOCK_CTX_AUTO_MEMORY (1 << 0)
+#define MOCK_CTX_COMMAND (1 << 1)
+
+typedef struct mockCommand {
+    char *name;
+    RedisModuleCmdFunc func;
+    int write;
+} mockCommand;
+
+struct RedisModuleCtx {
+    void *getapifuncptr; /* Must be the first field, see RedisModule_Init(). */
+    int dbid;
+    int flags;
+    mockCommand *cmd;
+    RedisModuleString **argv; /* Arguments of the command being executed. */
+    int argc;
+    mockAutoMemEntry *am;
+    size_t am_len, am_cap;
+    /* The reply of a command, and the arrays still waiting for elements. */
+    RedisModuleCallReply *reply;
+    RedisModuleCallReply **stack;
+    size_t stack_len, stack_cap;
+};
+
+struct RedisModuleCallReply {
+    int type;
+    long long integer;
+    char *str;
+    size_t len;
+    RedisModuleCallReply **elements;
+    size_t elements_len, elements_cap;
+    long expected; /* Array length, REDISMODULE_POSTPONED_ARRAY_LEN until set. */
+    RedisModuleCallReply *parent;
+    RedisModuleCtx *ctx;
+};
+
+struct RedisModuleKey {
+    RedisModuleCtx *ctx;
+    int dbid;
+    int mode;
+    RedisModuleString *name;
+};
+
+struct RedisModuleType {
+    char name[10];
+    int encver;
+    RedisModuleTypeMethods tm;
+};
+
+typedef struct mockValue {
+    RedisModuleType *mt; /* NULL for string values. */
+    void *value;
+} mockValue;
+
+typedef struct mockArgv {
+    RedisModuleString **argv;
+    int argc;
+} mockArgv;
+
+typedef struct mockIOItem {
+    RedisModuleString *str; /* NULL for unsigned items. */
+    uint64_t u;
+} mockIOItem;
+
+struct RedisModuleIO {
+    int dbid;
+    mockIOItem *items;
+    size_t len, cap, pos;
+    mockArgv *cmds;
+    size_t cmds_len, cmds_cap;
+};
+
+struct RedisModuleDigest {
+    uint64_t o;
+    uint64_t x;
+};
+
+struct RedisModuleKeyOptCtx {
+    RedisModuleString *from_key;
+    RedisModuleString *to_key;
+    int from_dbid;
+    int to_dbid;
+};
+
+struct RedisModuleDefragCtx {
+    unsigned long cursor;
+    unsigned int stop_percent;
+};
+
+struct RedisModuleInfoCtx {
+    int sections;
+    int fields;
+    int in_dict;
+};
+
+typedef struct mockTimer {
+    RedisModuleTimerID id;
+    long long when;
+    RedisModuleTimerProc callback;
+    void *data;
+    struct mockTimer *next;
+} mockTimer;
+
+typedef struct mockKeyspaceSub {
+    int types;
+    RedisModuleNotificationFunc cb;
+    int active;
+} mockKeyspaceSub;
+
+#define MOCK_EVENT_NUM 32
+#define MOCK_KEYSPACE_SUBS 8
+
+static mockStats mock_stats;
+static long long mock_now_ms = 1700000000000LL;
+static int mock_ctx_flags = 0;
+static uint64_t mock_rand_state = 0x9e3779b97f4a7c15ULL;
+static dict *mock_db[MOCK_DB_NUM];
+static dict *mock_commands;
+static char mock_module_name[64];
+static RedisModuleType *mock_types[4];
+static int mock_types_num = 0;
+static mockTimer *mock_timers = NULL;
+static RedisModuleTimerID mock_next_timer_id = 0;
+static RedisModuleEventCallback mock_event_cb[MOCK_EVENT_NUM];
+static mockKeyspaceSub mock_keyspace_subs[MOCK_KEYSPACE_SUBS];
+static int mock_keyspace_subs_num = 0;
+static RedisModuleInfoFunc mock_info_func = NULL;
+static RedisModuleDefragFunc mock_defrag_func = NULL;
+
+static uint64_t mockRand(void) {
+    mock_rand_state ^= mock_rand_state >> 12;
+    mock_rand_state ^= mock_rand_state << 25;
+    mock_rand_state ^= mock_rand_state >> 27;
+    return mock_rand_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* ========================== Memory =============================*/
+
+/* Every block carries its size, so DefragAlloc() can move it and frees of
+ * pointers the mock did not allocate are caught. */
+typedef struct mockAllocHeader {
+    size_t size;
+    uint64_t magic;
+} mockAllocHeader;
+
+#define MOCK_ALLOC_MAGIC 0x6d6f636b616c6c63ULL
+#define MOCK_FREED_MAGIC 0x6672656564626c6bULL
+
+static void *mockAlloc(size_t bytes) {
+    mockAllocHeader *h = malloc(sizeof(*h) + bytes);
+    if (h == NULL) {
+        mockPanic(__FILE__, __LINE__, "out of memory allocating %zu bytes", bytes);
+    }
+    h->size = bytes;
+    h->magic = MOCK_ALLOC_MAGIC;
+    mock_stats.live_allocs++;
+    mock_stats.live_bytes += bytes;
+    return h + 1;
+}
+
+static mockAllocHeader *mockAllocGetHeader(void *ptr) {
+    mockAllocHeader *h = (mockAllocHeader *)ptr - 1;
+    if (h->magic != MOCK_ALLOC_MAGIC) {
+        mockPanic(__FILE__, __LINE__, "%s of a pointer not owned by RedisModule_Alloc: %p",
+                  h->magic == MOCK_FREED_MAGIC ? "double free" : "free", ptr);
+    }
+    return h;
+}
+
+static void *mockCalloc(size_t nmemb, size_t size) {
+    void *ptr = mockAlloc(nmemb * size);
+    memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+static void mockFree(void *ptr) {
+    if (ptr == NULL) return;
+    mockAllocHeader *h = mockAllocGetHeader(ptr);
+    mock_stats.live_allocs--;
+    mock_stats.live_bytes -= h->size;
+    h->magic = MOCK_FREED_MAGIC;
+    free(h);
+}
+
+static void *mockRealloc(void *ptr, size_t bytes) {
+    if (ptr == NULL) return mockAlloc(bytes);
+    mockAllocHeader *h = mockAllocGetHeader(ptr);
+    size_t old = h->size;
+    h = realloc(h, sizeof(*h) + bytes);
+    if (h == NULL) {
+        mockPanic(__FILE__, __LINE__, "out of memory allocating %zu bytes", bytes);
+    }
+    h->size = bytes;
+    mock_stats.live_bytes += (long long)bytes - (long long)old;
+    return h + 1;
+}
+
+static char *mockStrdup(const char *str) {
+    size_t len = strlen(str);
+    char *s = mockAlloc(len + 1);
+    memcpy(s, str, len + 1);
+    return s;
+}
+
+static void *mockCheckedRealloc(void *ptr, size_t bytes) {
+    ptr = realloc(ptr, bytes);
+    if (ptr == NULL) {
+        mockPanic(__FILE__, __LINE__, "out of memory allocating %zu bytes", bytes);
+    }
+    return ptr;
+}
+
+#define mockPush(arr, len, cap, elem)                                          \
+    do {                                                                       \
+        if ((len) == (cap)) {                                                  \
+            (cap) = (cap) ? (cap) * 2 : 8;                                     \
+            (arr) = mockCheckedRealloc((arr), sizeof(*(arr)) * (cap));         \
+        }                                                                      \
+        (arr)[(len)++] = (elem);                                               \
+    } while (0)
+
+/* ========================== Contexts and auto memory =============================*/
+
+static int mockGetApi(const char *name, void *funcptr);
+
+static RedisModuleCtx *mockCtxCreate(int dbid, int flags) {
+    RedisModuleCtx *ctx = calloc(1, sizeof(*ctx));
+    mockAssert(ctx != NULL);
+    ctx->getapifuncptr = (void *)(unsigned long)mockGetApi;
+    ctx->dbid = dbid;
+    ctx->flags = flags;
+    return ctx;
+}
+
+static void mockAutoMemoryAdd(RedisModuleCtx *ctx, int type, void *ptr) {
+    if (ctx == NULL || !(ctx->flags & MOCK_CTX_AUTO_MEMORY)) return;
+    mockAutoMemEntry entry = {type, ptr};
+    mockPush(ctx->am, ctx->am_len, ctx->am_cap, entry);
+}
+
+static int mockAutoMemoryFreed(RedisModuleCtx *ctx, int type, void *ptr) {
+    if (ctx == NULL || !(ctx->flags & MOCK_CTX_AUTO_MEMORY)) return 0;
+    for (size_t j = ctx->am_len; j > 0; j--) {
+        if (ctx->am[j - 1].type == type && ctx->am[j - 1].ptr == ptr) {
+            ctx->am[j - 1].type = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void mockStringDecr(RedisModuleString *str);
+static void mockCloseKey(RedisModuleKey *key);
+static void mockFreeCallReply(RedisModuleCallReply *reply);
+static void mockReplyRelease(RedisModuleCallReply *reply);
+
+static void mockAutoMemoryCollect(RedisModuleCtx *ctx) {
+    if (!(ctx->flags & MOCK_CTX_AUTO_MEMORY)) return;
+    ctx->flags &= ~MOCK_CTX_AUTO_MEMORY;
+    for (size_t j = 0; j < ctx->am_len; j++) {
+        void *ptr = ctx->am[j].ptr;
+        switch (ctx->am[j].type) {
+            case MOCK_AM_STRING:
+                mockStringDecr(ptr);
+                break;
+            case MOCK_AM_KEY:
+                mockCloseKey(ptr);
+                break;
+            case MOCK_AM_REPLY:
+                mockFreeCallReply(ptr);
+                break;
+        }
+    }
+    ctx->am_len = 0;
+}
+
+static void mockCtxFree(RedisModuleCtx *ctx) {
+    mockAutoMemoryCollect(ctx);
+    if (ctx->reply) mockReplyRelease(ctx->reply);
+    free(ctx->am);
+    free(ctx->stack);
+    free(ctx);
+}
+
+static void mockAutoMemory(RedisModuleCtx *ctx) {
+    ctx->flags |= MOCK_CTX_AUTO_MEMORY;
+}
+
+/* ========================== Strings =============================*/
+
+static RedisModuleString *mockStringNew(const char *ptr, size_t len) {
+    RedisModuleString *str = malloc(sizeof(*str));
+    mockAssert(str != NULL);
+    str->refcount = 1;
+    str->len = len;
+    str->alloc = len + 1;
+    str->ptr = malloc(str->alloc);
+    mockAssert(str->ptr != NULL);
+    memcpy(str->ptr, ptr, len);
+    str->ptr[len] = '\0';
+    mock_stats.live_strings++;
+    return str;
+}
+
+static void mockStringDecr(RedisModuleString *str) {
+    mockAssert(str->refcount > 0);
+    if (--str->refcount == 0) {
+        mock_stats.live_strings--;
+        str->refcount = -1;
+        free(str->ptr);
+        free(str);
+    }
+}
+
+static RedisModuleString *mockStringFromLongLong(long long ll) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%lld", ll);
+    return mockStringNew(buf, len);
+}
+
+static RedisModuleString *mockCreateString(RedisModuleCtx *ctx, const char *ptr, size_t len) {
+    RedisModuleString *str = mockStringNew(ptr, len);
+    mockAutoMemoryAdd(ctx, MOCK_AM_STRING, str);
+    return str;
+}
+
+static RedisModuleString *mockCreateStringFromLongLong(RedisModuleCtx *ctx, long long ll) {
+    RedisModuleString *str = mockStringFromLongLong(ll);
+    mockAutoMemoryAdd(ctx, MOCK_AM_STRING, str);
+    return str;
+}
+
+static RedisModuleString *mockCreateStringFromDouble(RedisModuleCtx *ctx, double d) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%.17g", d);
+    return mockCreateString(ctx, buf, len);
+}
+
+static RedisModuleString *mockCreateStringFromLongDouble(RedisModuleCtx *ctx, long double ld, int humanfriendly) {
+    char buf[5 * 1024];
+    int len;
+    if (humanfriendly) {
+        /* Like ld2string(): fixed point without trailing zeroes. */
+        len = snprintf(buf, sizeof(buf), "%.17Lf", ld);
+        if (strchr(buf, '.') != NULL) {
+            while (len > 0 && buf[len - 1] == '0') len--;
+            if (len > 0 && buf[len - 1] == '.') len--;
+        }
+    } else {
+        len = snprintf(buf, sizeof(buf), "%.17Lg", ld);
+    }
+    return mockCreateString(ctx, buf, len);
+}
+
+static RedisModuleString *mockCreateStringFromString(RedisModuleCtx *ctx, const RedisModuleString *str) {
+    return mockCreateString(ctx, str->ptr, str->len);
+}
+
+static RedisModuleString *mockCreateStringPrintf(RedisModuleCtx *ctx, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    char *buf = malloc(len + 1);
+    mockAssert(buf != NULL);
+    va_start(ap, fmt);
+    vsnprintf(buf, len + 1, fmt, ap);
+    va_end(ap);
+    RedisModuleString *str = mockCreateString(ctx, buf, len);
+    free(buf);
+    return str;
+}
+
+static void mockFreeString(RedisModuleCtx *ctx, RedisModuleString *str) {
+    mockStringDecr(str);
+    mockAutoMemoryFreed(ctx, MOCK_AM_STRING, str);
+}
+
+static void mockRetainString(RedisModuleCtx *ctx, RedisModuleString *str) {
+    /* Like redis, a string owned by the auto memory pool is just taken out
+     * of it, so it still has a single reference. */
+    if (!mockAutoMemoryFreed(ctx, MOCK_AM_STRING, str)) {
+        str->refcount++;
+    }
+}
+
+static int mockStringAppendBuffer(RedisModuleCtx *ctx, RedisModuleString *str, const char *buf, size_t len) {
+    /* Redis panics on a shared string, it would change for its other owners. */
+    mockAssert(str->refcount == 1);
+    if (str->len + len + 1 > str->alloc) {
+        str->alloc = (str->len + len + 1) * 2;
+        str->ptr = realloc(str->ptr, str->alloc);
+        mockAssert(str->ptr != NULL);
+    }
+    memcpy(str->ptr + str->len, buf, len);
+    str->len += len;
+    str->ptr[str->len] = '\0';
+    return REDISMODULE_OK;
+}
+
+static const char *mockStringPtrLen(const RedisModuleString *str, size_t *len) {
+    mockAssert(str != NULL && str->refcount > 0);
+    if (len) *len = str->len;
+    return str->ptr;
+}
+
+static int mockStringCompare(RedisModuleString *a, RedisModuleString *b) {
+    size_t minlen = a->len < b->len ? a->len : b->len;
+    int cmp = memcmp(a->ptr, b->ptr, minlen);
+    if (cmp == 0) return a->len < b->len ? -1 : (a->len > b->len);
+    return cmp;
+}
+
+/* Same rules as string2ll(): no spaces, no '+', no leading zeroes. */
+static int mockStringToLongLong(const RedisModuleString *str, long long *ll) {
+    const char *p = str->ptr;
+    size_t len = str->len;
+    int negative = 0;
+    unsigned long long v = 0;
+
+    if (len == 0 || len > 20) return REDISMODULE_ERR;
+    if (len == 1 && p[0] == '0') {
+        *ll = 0;
+        return REDISMODULE_OK;
+    }
+    if (p[0] == '-') {
+        negative = 1;
+        p++;
+        len--;
+        if (len == 0) return REDISMODULE_ERR;
+    }
+    if (p[0] < '1' || p[0] > '9') return REDISMODULE_ERR;
+    for (size_t j = 0; j < len; j++) {
+        if (!isdigit((unsigned char)p[j])) return REDISMODULE_ERR;
+        if (v > (ULLONG_MAX - (p[j] - '0')) / 10) return REDISMODULE_ERR;
+        v = v * 10 + (p[j] - '0');
+    }
+    if (negative) {
+        if (v > (unsigned long long)LLONG_MAX + 1) return REDISMODULE_ERR;
+        *ll = v == (unsigned long long)LLONG_MAX + 1 ? LLONG_MIN : -(long long)v;
+    } else {
+        if (v > LLONG_MAX) return REDISMODULE_ERR;
+        *ll = (long long)v;
+    }
+    return REDISMODULE_OK;
+}
+
+static int mockStringToDouble(const RedisModuleString *str, double *d) {
+    char *eptr;
+    if (str->len == 0 || isspace((unsigned char)str->ptr[0])) return REDISMODULE_ERR;
+    errno = 0;
+    double v = strtod(str->ptr, &eptr);
+    if (*eptr != '\0' || (errno == ERANGE && (v == HUGE_VAL || v == -HUGE_VAL || v == 0)) || isnan(v)) {
+        return REDISMODULE_ERR;
+    }
+    *d = v;
+    return REDISMODULE_OK;
+}
+
+static int mockStringToLongDouble(const RedisModuleString *str, long double *d) {
+    char *eptr;
+    if (str->len == 0 || isspace((unsigned char)str->ptr[0])) return REDISMODULE_ERR;
+    errno = 0;
+    long double v = strtold(str->ptr, &eptr);
+    if (*eptr != '\0' || errno == ERANGE || isnan(v)) return REDISMODULE_ERR;
+    *d = v;
+    return REDISMODULE_OK;
+}
+
+static int mockStringEqualsCase(const RedisModuleString *str, const char *s) {
+    return str->len == strlen(s) && strncasecmp(str->ptr, s, str->len) == 0;
+}
+
+/* ========================== Replies =============================*/
+
+static RedisModuleCallReply *mockReplyNew(int type) {
+    RedisModuleCallReply *reply = calloc(1, sizeof(*reply));
+    mockAssert(reply != NULL);
+    reply->type = type;
+    return reply;
+}
+
+static void mockReplyRelease(RedisModuleCallReply *reply) {
+    for (size_t j = 0; j < reply->elements_len; j++) {
+        mockReplyRelease(reply->elements[j]);
+    }
+    free(reply->elements);
+    free(reply->str);
+    free(reply);
+}
+
+static void mockReplySetString(RedisModuleCallReply *reply, const char *buf, size_t len) {
+    reply->str = malloc(len + 1);
+    mockAssert(reply->str != NULL);
+    memcpy(reply->str, buf, len);
+    reply->str[len] = '\0';
+    reply->len = len;
+}
+
+/* Pop the arrays that got all their elements. */
+static void mockReplyPopComplete(RedisModuleCtx *ctx) {
+    while (ctx->stack_len) {
+        RedisModuleCallReply *top = ctx->stack[ctx->stack_len - 1];
+        if (top->expected == REDISMODULE_POSTPONED_ARRAY_LEN || (long)top->elements_len < top->expected) break;
+        ctx->stack_len--;
+    }
+}
+
+static int mockReplyAdd(RedisModuleCtx *ctx, RedisModuleCallReply *reply) {
+    if (ctx->stack_len == 0) {
+        if (ctx->reply != NULL) {
+            mockPanic(__FILE__, __LINE__, "command '%s' replied more than once", ctx->cmd ? ctx->cmd->name : "?");
+        }
+        ctx->reply = reply;
+    } else {
+        RedisModuleCallReply *top = ctx->stack[ctx->stack_len - 1];
+        reply->parent = top;
+        mockPush(top->elements, top->elements_len, top->elements_cap, reply);
+    }
+    if (reply->type == REDISMODULE_REPLY_ARRAY && reply->expected != 0) {
+        mockPush(ctx->stack, ctx->stack_len, ctx->stack_cap, reply);
+    }
+    mockReplyPopComplete(ctx);
+    return REDISMODULE_OK;
+}
+
+static int mockReplyWithLongLong(RedisModuleCtx *ctx, long long ll) {
+    RedisModuleCallReply *reply = mockReplyNew(REDISMODULE_REPLY_INTEGER);
+    reply->integer = ll;
+    return mockReplyAdd(ctx, reply);
+}
+
+static int mockReplyWithError(RedisModuleCtx *ctx, const char *err) {
+    RedisModuleCallReply *reply = mockReplyNew(REDISMODULE_REPLY_ERROR);
+    mockReplySetString(reply, err, strlen(err));
+    return mockReplyAdd(ctx, reply);
+}
+
+static int mockReplyWithStringBuffer(RedisModuleCtx *ctx, const char *buf, size_t len) {
+    RedisModuleCallReply *reply = mockReplyNew(REDISMODULE_REPLY_STRING);
+    mockReplySetString(reply, buf, len);
+    return mockReplyAdd(ctx, reply);
+}
+
+static int mockReplyWithSimpleString(RedisModuleCtx *ctx, const char *msg) {
+    return mockReplyWithStringBuffer(ctx, msg, strlen(msg));
+}
+
+static int mockReplyWithCString(RedisModuleCtx *ctx, const char *buf) {
+    return mockReplyWithStringBuffer(ctx, buf, strlen(buf));
+}
+
+static int mockReplyWithString(RedisModuleCtx *ctx, RedisModuleString *str) {
+    mockAssert(str != NULL && str->refcount > 0);
+    return mockReplyWithStringBuffer(ctx, str->ptr, str->len);
+}
+
+static int mockReplyWithEmptyString(RedisModuleCtx *ctx) {
+    return mockReplyWithStringBuffer(ctx, "", 0);
+}
+
+static int mockReplyWithNull(RedisModuleCtx *ctx) {
+    return mockReplyAdd(ctx, mockReplyNew(REDISMODULE_REPLY_NULL));
+}
+
+static int mockReplyWithArray(RedisModuleCtx *ctx, long len) {
+    mockAssert(len >= 0 || len == REDISMODULE_POSTPONED_ARRAY_LEN);
+    RedisModuleCallReply *reply = mockReplyNew(REDISMODULE_REPLY_ARRAY);
+    reply->expected = len;
+    return mockReplyAdd(ctx, reply);
+}
+
+static int mockReplyWithNullArray(RedisModuleCtx *ctx) {
+    return mockReplyWithNull(ctx);
+}
+
+static int mockReplyWithEmptyArray(RedisModuleCtx *ctx) {
+    return mockReplyWithArray(ctx, 0);
+}
+
+static void mockReplySetArrayLength(RedisModuleCtx *ctx, long len) {
+    mockAssert(ctx->stack_len > 0);
+    RedisModuleCallReply *top = ctx->stack[ctx->stack_len - 1];
+    if (top->expected != REDISMODULE_POSTPONED_ARRAY_LEN) {
+        mockPanic(__FILE__, __LINE__, "ReplySetArrayLength() with an incomplete array of %ld elements on top", top->expected);
+    }
+    if ((long)top->elements_len != len) {
+        mockPanic(__FILE__, __LINE__, "ReplySetArrayLength(%ld) but %zu elements were emitted", len, top->elements_len);
+    }
+    top->expected = len;
+    mockReplyPopComplete(ctx);
+}
+
+static int mockReplyWithDouble(RedisModuleCtx *ctx, double d) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%.17g", d);
+    return mockReplyWithStringBuffer(ctx, buf, len);
+}
+
+static int mockReplyWithLongDouble(RedisModuleCtx *ctx, long double ld) {
+    char buf[5 * 1024];
+    int len = snprintf(buf, sizeof(buf), "%.17Lg", ld);
+    return mockReplyWithStringBuffer(ctx, buf, len);
+}
+
+static RedisModuleCallReply *mockReplyDup(RedisModuleCallReply *src) {
+    RedisModuleCallReply *reply = mockReplyNew(src->type);
+    reply->integer = src->integer;
+    reply->expected = src->expected;
+    if (src->str) mockReplySetString(reply, src->str, src->len);
+    for (size_t j = 0; j < src->elements_len; j++) {
+        RedisModuleCallReply *elem = mockReplyDup(src->elements[j]);
+        elem->parent = reply;
+        mockPush(reply->elements, reply->elements_len, reply->elements_cap, elem);
+    }
+    return reply;
+}
+
+static int mockReplyWithCallReply(RedisModuleCtx *ctx, RedisModuleCallReply *reply) {
+    return mockReplyAdd(ctx, mockReplyDup(reply));
+}
+
+static int mockWrongArity(RedisModuleCtx *ctx) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "ERR wrong number of arguments for '%s' command", ctx->cmd ? ctx->cmd->name : "?");
+    return mockReplyWithError(ctx, buf);
+}
+
+static int mockCallReplyType(RedisModuleCallReply *reply) {
+    return reply ? reply->type : REDISMODULE_REPLY_UNKNOWN;
+}
+
+static size_t mockCallReplyLength(RedisModuleCallReply *reply) {
+    switch (reply->type) {
+        case REDISMODULE_REPLY_STRING:
+        case REDISMODULE_REPLY_ERROR:
+            return reply->len;
+        case REDISMODULE_REPLY_ARRAY:
+            return reply->elements_len;
+        default:
+            return 0;
+    }
+}
+
+static RedisModuleCallReply *mockCallReplyArrayElement(RedisModuleCallReply *reply, size_t idx) {
+    if (reply->type != REDISMODULE_REPLY_ARRAY || idx >= reply->elements_len) return NULL;
+    return reply->elements[idx];
+}
+
+static long long mockCallReplyInteger(RedisModuleCallReply *reply) {
+    return reply->type == REDISMODULE_REPLY_INTEGER ? reply->integer : LLONG_MIN;
+}
+
+static const char *mockCallReplyStringPtr(RedisModuleCallReply *reply, size_t *len) {
+    if (reply->type != REDISMODULE_REPLY_STRING && reply->type != REDISMODULE_REPLY_ERROR) return NULL;
+    if (len) *len = reply->len;
+    return reply->str;
+}
+
+static RedisModuleString *mockCreateStringFromCallReply(RedisModuleCallReply *reply) {
+    RedisModuleCtx *ctx = NULL;
+    for (RedisModuleCallReply *r = reply; r; r = r->parent) ctx = r->ctx;
+    switch (reply->type) {
+        case REDISMODULE_REPLY_STRING:
+        case REDISMODULE_REPLY_ERROR:
+            return mockCreateString(ctx, reply->str, reply->len);
+        case REDISMODULE_REPLY_INTEGER:
+            return mockCreateStringFromLongLong(ctx, reply->integer);
+        default:
+            return NULL;
+    }
+}
+
+static void mockFreeCallReply(RedisModuleCallReply *reply) {
+    /* Nested replies are released together with the top level one. */
+    if (reply == NULL || reply->parent != NULL) return;
+    mockAutoMemoryFreed(reply->ctx, MOCK_AM_REPLY, reply);
+    mockReplyRelease(reply);
+}
+
+/* ========================== Keyspace =============================*/
+
+static uint64_t mockKeyHash(const void *key) {
+    const RedisModuleString *str = key;
+    return m_dictGenHashFunction(str->ptr, (int)str->len);
+}
+
+static int mockKeyCompare(void *privdata, const void *key1, const void *key2) {
+    const RedisModuleString *a = key1, *b = key2;
+    return a->len == b->len && memcmp(a->ptr, b->ptr, a->len) == 0;
+}
+
+static void mockKeyDestructor(void *privdata, void *key) {
+    mockStringDecr(key);
+}
+
+static void mockValueDestructor(void *privdata, void *val) {
+    mockValue *v = val;
+    if (v == NULL) return;
+    if (v->mt) {
+        v->mt->tm.free(v->value);
+    } else {
+        mockStringDecr(v->value);
+    }
+    free(v);
+}
+
+static m_dictType mockKeyspaceDictType = {
+    mockKeyHash,
+    NULL,
+    NULL,
+    mockKeyCompare,
+    mockKeyDestructor,
+    mockValueDestructor,
+};
+
+static mockValue *mockValueNew(RedisModuleType *mt, void *value) {
+    mockValue *v = malloc(sizeof(*v));
+    mockAssert(v != NULL);
+    v->mt = mt;
+    v->value = value;
+    return v;
+}
+
+static mockValue *mockDbFetch(int dbid, RedisModuleString *key) {
+    return m_dictFetchValue(mock_db[dbid], key);
+}
+
+static void mockDbAdd(int dbid, RedisModuleString *key, mockValue *v) {
+    mockAssert(m_dictAdd(mock_db[dbid], mockStringNew(key->ptr, key->len), v) == DICT_OK);
+}
+
+static void mockNotifyUnlink(int dbid, RedisModuleString *key, mockValue *v) {
+    if (v->mt == NULL) return;
+    if (v->mt->tm.unlink2) {
+        RedisModuleKeyOptCtx oc = {key, NULL, dbid, -1};
+        v->mt->tm.unlink2(&oc, v->value);
+    } else if (v->mt->tm.unlink) {
+        v->mt->tm.unlink(key, v->value);
+    }
+}
+
+/* Take the value out of the db without releasing it, like the first half of
+ * a RENAME or MOVE. The module sees it as unlinked, as redis 7.0 does. */
+static mockValue *mockDbUnlink(int dbid, RedisModuleString *key) {
+    m_dictEntry *de = m_dictUnlink(mock_db[dbid], key);
+    if (de == NULL) return NULL;
+    mockValue *v = dictGetVal(de);
+    mockNotifyUnlink(dbid, key, v);
+    de->v.val = NULL;
+    m_dictFreeUnlinkedEntry(mock_db[dbid], de);
+    return v;
+}
+
+static int mockDbDelete(int dbid, RedisModuleString *key) {
+    mockValue *v = mockDbUnlink(dbid, key);
+    if (v == NULL) return 0;
+    mockValueDestructor(NULL, v);
+    return 1;
+}
+
+/* ========================== Events =============================*/
+
+static void mockFireServerEvent(RedisModuleEvent event, uint64_t subevent, void *data) {
+    mockAssert(event.id < MOCK_EVENT_NUM);
+    RedisModuleEventCallback cb = mock_event_cb[event.id];
+    if (cb == NULL) return;
+    RedisModuleCtx *ctx = mockCtxCreate(0, 0);
+    cb(ctx, event, subevent, data);
+    mockCtxFree(ctx);
+}
+
+static void mockFireKeyspaceEvent(int type, const char *event, RedisModuleString *key, int dbid) {
+    mock_stats.keyspace_events++;
+    for (int j = 0; j < mock_keyspace_subs_num; j++) {
+        mockKeyspaceSub *sub = &mock_keyspace_subs[j];
+        /* Like redis, a subscriber is not called again for the events it
+         * fires itself. */
+        if (!(sub->types & type) || sub->active) continue;
+        RedisModuleCtx *ctx = mockCtxCreate(dbid, 0);
+        sub->active = 1;
+        sub->cb(ctx, type, event, key);
+        sub->active = 0;
+        mockCtxFree(ctx);
+    }
+}
+
+static int mockSubscribeToServerEvent(RedisModuleCtx *ctx, RedisModuleEvent event, RedisModuleEventCallback callback) {
+    if (event.id >= MOCK_EVENT_NUM) return REDISMODULE_ERR;
+    mock_event_cb[event.id] = callback;
+    return REDISMODULE_OK;
+}
+
+/* A disabled event keeps its subscriber aside until enabled again, as if
+ * the server had never sent it. */
+void mockSetServerEventEnabled(RedisModuleEvent event, int enabled) {
+    static RedisModuleEventCallback disabled_cb[MOCK_EVENT_NUM];
+    mockAssert(event.id < MOCK_EVENT_NUM);
+    if (enabled && mock_event_cb[event.id] == NULL) {
+        mock_event_cb[event.id] = disabled_cb[event.id];
+        disabled_cb[event.id] = NULL;
+    } else if (!enabled && mock_event_cb[event.id] != NULL) {
+        disabled_cb[event.id] = mock_event_cb[event.id];
+        mock_event_cb[event.id] = NULL;
+    }
+}
+
+static int mockSubscribeToKeyspaceEvents(RedisModuleCtx *ctx, int types, RedisModuleNotificationFunc cb) {
+    mockAssert(mock_keyspace_subs_num < MOCK_KEYSPACE_SUBS);
+    mock_keyspace_subs[mock_keyspace_subs_num].types = types;
+    mock_keyspace_subs[mock_keyspace_subs_num].cb = cb;
+    mock_keyspace_subs[mock_keyspace_subs_num].active = 0;
+    mock_keyspace_subs_num++;
+    return REDISMODULE_OK;
+}
+
+static int mockNotifyKeyspaceEvent(RedisModuleCtx *ctx, int type, const char *event, RedisModuleString *key) {
+    mockFireKeyspaceEvent(type, event, key, ctx ? ctx->dbid : 0);
+    return REDISMODULE_OK;
+}
+
+static char mock_last_channel[1024], mock_last_message[1024];
+static size_t mock_last_message_len;
+
+static void mockRecordPublished(RedisModuleString *channel, RedisModuleString *message) {
+    snprintf(mock_last_channel, sizeof(mock_last_channel), "%.*s", (int)channel->len, channel->ptr);
+    mock_last_message_len = message->len < sizeof(mock_last_message) ? message->len : sizeof(mock_last_message);
+    memcpy(mock_last_message, message->ptr, mock_last_message_len);
+    mock_stats.published++;
+}
+
+static int mockPublishMessage(RedisModuleCtx *ctx, RedisModuleString *channel, RedisModuleString *message) {
+    mockAssert(channel->refcount > 0 && message->refcount > 0);
+    mockRecordPublished(channel, message);
+    return 0;
+}
+
+/* ========================== Keys =============================*/
+
+static int mockGetSelectedDb(RedisModuleCtx *ctx) {
+    return ctx->dbid;
+}
+
+static int mockSelectDb(RedisModuleCtx *ctx, int newid) {
+    if (newid < 0 || newid >= MOCK_DB_NUM) return REDISMODULE_ERR;
+    ctx->dbid = newid;
+    return REDISMODULE_OK;
+}
+
+static void *mockOpenKey(RedisModuleCtx *ctx, RedisModuleString *keyname, int mode) {
+    if (!(mode & REDISMODULE_WRITE) && mockDbFetch(ctx->dbid, keyname) == NULL) {
+        return NULL;
+    }
+    RedisModuleKey *key = malloc(sizeof(*key));
+    mockAssert(key != NULL);
+    key->ctx = ctx;
+    key->dbid = ctx->dbid;
+    key->mode = mode;
+    key->name = mockStringNew(keyname->ptr, keyname->len);
+    mockAutoMemoryAdd(ctx, MOCK_AM_KEY, key);
+    mock_stats.open_keys++;
+    return key;
+}
+
+static void mockCloseKey(RedisModuleKey *key) {
+    if (key == NULL) return;
+    mockAutoMemoryFreed(key->ctx, MOCK_AM_KEY, key);
+    mockStringDecr(key->name);
+    mock_stats.open_keys--;
+    free(key);
+}
+
+static int mockKeyType(RedisModuleKey *key) {
+    if (key == NULL) return REDISMODULE_KEYTYPE_EMPTY;
+    mockValue *v = mockDbFetch(key->dbid, key->name);
+    if (v == NULL) return REDISMODULE_KEYTYPE_EMPTY;
+    return v->mt ? REDISMODULE_KEYTYPE_MODULE : REDISMODULE_KEYTYPE_STRING;
+}
+
+static int mockDeleteKey(RedisModuleKey *key) {
+    mockAssert(key->mode & REDISMODULE_WRITE);
+    mockDbDelete(key->dbid, key->name);
+    return REDISMODULE_OK;
+}
+
+static RedisModuleType *mockCreateDataType(RedisModuleCtx *ctx, const char *name, int encver, RedisModuleTypeMethods *typemethods) {
+    if (strlen(name) != 9 || mock_types_num == (int)(sizeof(mock_types) / sizeof(mock_types[0]))) return NULL;
+    RedisModuleType *mt = calloc(1, sizeof(*mt));
+    mockAssert(mt != NULL);
+    memcpy(mt->name, name, 10);
+    mt->encver = encver;
+    mt->tm = *typemethods;
+    mockAssert(mt->tm.free != NULL);
+    mock_types[mock_types_num++] = mt;
+    return mt;
+}
+
+static int mockModuleTypeSetValue(RedisModuleKey *key, RedisModuleType *mt, void *value) {
+    mockAssert(key->mode & REDISMODULE_WRITE);
+    mockDbDelete(key->dbid, key->name);
+    mockDbAdd(key->dbid, key->name, mockValueNew(mt, value));
+    return REDISMODULE_OK;
+}
+
+static RedisModuleType *mockModuleTypeGetType(RedisModuleKey *key) {
+    if (key == NULL) return NULL;
+    mockValue *v = mockDbFetch(key->dbid, key->name);
+    return v ? v->mt : NULL;
+}
+
+static void *mockModuleTypeGetValue(RedisModuleKey *key) {
+    if (key == NULL) return NULL;
+    mockValue *v = mockDbFetch(key->dbid, key->name);
+    return v && v->mt ? v->value : NULL;
+}
+
+static unsigned long long mockDbSizeApi(RedisModuleCtx *ctx) {
+    return dictSize(mock_db[ctx->dbid]);
+}
+
+static const RedisModuleString *mockGetKeyNameFromOptCtx(RedisModuleKeyOptCtx *ctx) {
+    return ctx->from_key;
+}
+
+static const RedisModuleString *mockGetToKeyNameFromOptCtx(RedisModuleKeyOptCtx *ctx) {
+    return ctx->to_key;
+}
+
+static int mockGetDbIdFromOptCtx(RedisModuleKeyOptCtx *ctx) {
+    return ctx->from_dbid;
+}
+
+static int mockGetToDbIdFromOptCtx(RedisModuleKeyOptCtx *ctx) {
+    return ctx->to_dbid;
+}
+
+/* ========================== Commands =============================*/
+
+#define MOCK_CALL_REPLICATE (1 << 0)
+
+static uint64_t mockCommandHash(const void *key) {
+    return m_dictGenCaseHashFunction(key, (int)strlen(key));
+}
+
+static int mockCommandCompare(void *privdata, const void *key1, const void *key2) {
+    return strcasecmp(key1, key2) == 0;
+}
+
+static void mockCommandDestructor(void *privdata, void *val) {
+    mockCommand *cmd = val;
+    free(cmd->name);
+    free(cmd);
+}
+
+static m_dictType mockCommandDictType = {
+    mockCommandHash,
+    NULL,
+    NULL,
+    mockCommandCompare,
+    NULL,
+    mockCommandDestructor,
+};
+
+static int mockAddCommand(const char *name, RedisModuleCmdFunc func, int write) {
+    mockCommand *cmd = malloc(sizeof(*cmd));
+    mockAssert(cmd != NULL);
+    cmd->name = strdup(name);
+    cmd->func = func;
+    cmd->write = write;
+    for (char *p = cmd->name; *p; p++) *p = tolower((unsigned char)*p);
+    if (m_dictAdd(mock_commands, cmd->name, cmd) != DICT_OK) {
+        mockCommandDestructor(NULL, cmd);
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+static mockCommand *mockLookupCommand(RedisModuleString *name) {
+    return m_dictFetchValue(mock_commands, name->ptr);
+}
+
+/* The flags redis accepts in RedisModule_CreateCommand(). */
+static int mockValidCommandFlags(const char *strflags, int *write) {
+    static const char *valid[] = {"write", "readonly", "admin", "deny-oom", "deny-script", "allow-loading",
+                                  "pubsub", "random", "allow-stale", "no-monitor", "no-slowlog", "fast",
+                                  "getkeys-api", "no-cluster", "no-auth", "may-replicate", "no-mandatory-keys",
+                                  "blocking", "allow-busy", "getchannels-api", NULL};
+    char *flags = strdup(strflags ? strflags : ""), *saveptr = NULL;
+    int ok = 1;
+    *write = 0;
+    for (char *tok = strtok_r(flags, " ", &saveptr); tok; tok = strtok_r(NULL, " ", &saveptr)) {
+        int found = 0;
+        for (int j = 0; valid[j]; j++) {
+            if (!strcasecmp(tok, valid[j])) found = 1;
+        }
+        if (!strcasecmp(tok, "write")) *write = 1;
+        if (!found) ok = 0;
+    }
+    free(flags);
+    return ok;
+}
+
+static int mockCreateCommand(RedisModuleCtx *ctx, const char *name, RedisModuleCmdFunc cmdfunc, const char *strflags, int firstkey, int lastkey, int keystep) {
+    int write;
+    if (!mockValidCommandFlags(strflags, &write)) return REDISMODULE_ERR;
+    return mockAddCommand(name, cmdfunc, write);
+}
+
+static void mockArgvPush(mockArgv *a, size_t *cap, RedisModuleString *str) {
+    size_t len = a->argc;
+    mockPush(a->argv, len, *cap, str);
+    a->argc = (int)len;
+}
+
+/* Turn a RedisModule_Call() style format into an argv owning a reference to
+ * every argument. */
+static mockArgv mockBuildArgv(const char *cmdname, const char *fmt, va_list ap, int *flags) {
+    mockArgv a = {NULL, 0};
+    size_t cap = 0;
+    *flags = 0;
+    mockArgvPush(&a, &cap, mockStringNew(cmdname, strlen(cmdname)));
+    for (const char *p = fmt; *p; p++) {
+        switch (*p) {
+            case 'c': {
+                const char *s = va_arg(ap, const char *);
+                mockArgvPush(&a, &cap, mockStringNew(s, strlen(s)));
+                break;
+            }
+            case 's': {
+                RedisModuleString *s = va_arg(ap, RedisModuleString *);
+                mockAssert(s != NULL && s->refcount > 0);
+                s->refcount++;
+                mockArgvPush(&a, &cap, s);
+                break;
+            }
+            case 'b': {
+                const char *buf = va_arg(ap, const char *);
+                size_t len = va_arg(ap, size_t);
+                mockArgvPush(&a, &cap, mockStringNew(buf, len));
+                break;
+            }
+            case 'l':
+                mockArgvPush(&a, &cap, mockStringFromLongLong(va_arg(ap, long long)));
+                break;
+            case 'v': {
+                RedisModuleString **v = va_arg(ap, RedisModuleString **);
+                size_t vlen = va_arg(ap, size_t);
+                for (size_t j = 0; j < vlen; j++) {
+                    mockAssert(v[j] != NULL && v[j]->refcount > 0);
+                    v[j]->refcount++;
+                    mockArgvPush(&a, &cap, v[j]);
+                }
+                break;
+            }
+            case '!':
+                *flags |= MOCK_CALL_REPLICATE;
+                break;
+            case 'A':
+            case 'R':
+            case '3':
+            case '0':
+            case 'C':
+            case 'S':
+            case 'W':
+            case 'E':
+            case 'M':
+            case 'K':
+            case 'X':
+                break;
+            default:
+                mockPanic(__FILE__, __LINE__, "unknown format specifier '%c' calling '%s'", *p, cmdname);
+        }
+    }
+    return a;
+}
+
+static void mockFreeArgv(mockArgv *a) {
+    for (int j = 0; j < a->argc; j++) mockStringDecr(a->argv[j]);
+    free(a->argv);
+    a->argv = NULL;
+    a->argc = 0;
+}
+
+static RedisModuleCallReply *mockExecute(int dbid, RedisModuleString **argv, int argc) {
+    mockCommand *cmd = mockLookupCommand(argv[0]);
+    if (cmd == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+    RedisModuleCtx *ctx = mockCtxCreate(dbid, MOCK_CTX_COMMAND);
+    ctx->cmd = cmd;
+    ctx->argv = argv;
+    ctx->argc = argc;
+    mock_stats.commands++;
+    cmd->func(ctx, argv, argc);
+    if (ctx->reply == NULL) {
+        mockPanic(__FILE__, __LINE__, "command '%s' returned without replying", cmd->name);
+    }
+    if (ctx->stack_len != 0) {
+        mockPanic(__FILE__, __LINE__, "command '%s' left an array reply incomplete", cmd->name);
+    }
+    RedisModuleCallReply *reply = ctx->reply;
+    ctx->reply = NULL;
+    mockCtxFree(ctx);
+    return reply;
+}
+
+static RedisModuleCallReply *mockCall(RedisModuleCtx *ctx, const char *cmdname, const char *fmt, ...) {
+    va_list ap;
+    int flags;
+    va_start(ap, fmt);
+    mockArgv a = mockBuildArgv(cmdname, fmt, ap, &flags);
+    va_end(ap);
+    RedisModuleCallReply *reply = mockExecute(ctx->dbid, a.argv, a.argc);
+    if (reply && (flags & MOCK_CALL_REPLICATE)) mock_stats.replicated++;
+    mockFreeArgv(&a);
+    if (reply) {
+        reply->ctx = ctx;
+        mockAutoMemoryAdd(ctx, MOCK_AM_REPLY, reply);
+    }
+    return reply;
+}
+
+static char mock_last_replicated[1024];
+
+static void mockRecordReplicated(RedisModuleString **argv, int argc) {
+    size_t len = 0;
+    for (int j = 0; j < argc && len + 1 < sizeof(mock_last_replicated); j++) {
+        len += snprintf(mock_last_replicated + len, sizeof(mock_last_replicated) - len, j ? " %.*s" : "%.*s", (int)argv[j]->len,
+                        argv[j]->ptr);
+    }
+}
+
+static int mockReplicate(RedisModuleCtx *ctx, const char *cmdname, const char *fmt, ...) {
+    va_list ap;
+    int flags;
+    va_start(ap, fmt);
+    mockArgv a = mockBuildArgv(cmdname, fmt, ap, &flags);
+    va_end(ap);
+    /* A replica would fail on anything it does not know about. */
+    if (mockLookupCommand(a.argv[0]) == NULL) {
+        mockPanic(__FILE__, __LINE__, "replicating unknown command '%s'", cmdname);
+    }
+    mock_stats.replicated++;
+    mockRecordReplicated(a.argv, a.argc);
+    mockFreeArgv(&a);
+    return REDISMODULE_OK;
+}
+
+static int mockReplicateVerbatim(RedisModuleCtx *ctx) {
+    mock_stats.replicated++;
+    if (ctx->argv) mockRecordReplicated(ctx->argv, ctx->argc);
+    return REDISMODULE_OK;
+}
+
+/* ========================== Builtin commands =============================*/
+
+static int mockParseDb(RedisModuleString *str, int *dbid) {
+    long long v;
+    if (mockStringToLongLong(str, &v) != REDISMODULE_OK || v < 0 || v >= MOCK_DB_NUM) return 0;
+    *dbid = (int)v;
+    return 1;
+}
+
+typedef struct mockScanData {
+    RedisModuleString **keys;
+    size_t len, cap;
+} mockScanData;
+
+static void mockScanCallback(void *privdata, const m_dictEntry *de) {
+    mockScanData *data = privdata;
+    mockPush(data->keys, data->len, data->cap, (RedisModuleString *)dictGetKey(de));
+}
+
+/* SCAN cursor [COUNT count] */
+static int mockCmdScan(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    long long cursor, count = 10;
+    if (argc != 2 && argc != 4) return mockWrongArity(ctx);
+    if (mockStringToLongLong(argv[1], &cursor) != REDISMODULE_OK || cursor < 0) {
+        return mockReplyWithError(ctx, "ERR invalid cursor");
+    }
+    if (argc == 4 && (!mockStringEqualsCase(argv[2], "count") || mockStringToLongLong(argv[3], &count) != REDISMODULE_OK || count < 1)) {
+        return mockReplyWithError(ctx, "ERR syntax error");
+    }
+
+    mockScanData data = {NULL, 0, 0};
+    unsigned long v = (unsigned long)cursor;
+    long maxiterations = count * 10;
+    do {
+        v = m_dictScan(mock_db[ctx->dbid], v, mockScanCallback, NULL, &data);
+    } while (v && maxiterations-- && (long long)data.len < count);
+
+    char buf[32];
+    mockReplyWithArray(ctx, 2);
+    mockReplyWithStringBuffer(ctx, buf, snprintf(buf, sizeof(buf), "%lu", v));
+    mockReplyWithArray(ctx, data.len);
+    for (size_t j = 0; j < data.len; j++) mockReplyWithString(ctx, data.keys[j]);
+    free(data.keys);
+    return REDISMODULE_OK;
+}
+
+static int mockCmdRandomKey(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 1) return mockWrongArity(ctx);
+    m_dictEntry *de = m_dictGetRandomKey(mock_db[ctx->dbid]);
+    return de ? mockReplyWithString(ctx, dictGetKey(de)) : mockReplyWithNull(ctx);
+}
+
+static int mockCmdDbSize(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 1) return mockWrongArity(ctx);
+    return mockReplyWithLongLong(ctx, dictSize(mock_db[ctx->dbid]));
+}
+
+static int mockCmdExists(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    long long count = 0;
+    if (argc < 2) return mockWrongArity(ctx);
+    for (int j = 1; j < argc; j++) count += mockDbFetch(ctx->dbid, argv[j]) != NULL;
+    return mockReplyWithLongLong(ctx, count);
+}
+
+static int mockCmdDel(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    long long count = 0;
+    if (argc < 2) return mockWrongArity(ctx);
+    for (int j = 1; j < argc; j++) {
+        if (mockDbDelete(ctx->dbid, argv[j])) {
+            mockFireKeyspaceEvent(REDISMODULE_NOTIFY_GENERIC, "del", argv[j], ctx->dbid);
+            count++;
+        }
+    }
+    return mockReplyWithLongLong(ctx, count);
+}
+
+static int mockCmdSet(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) return mockWrongArity(ctx);
+    /* An overwrite unlinks the old value first, like dbOverwrite(). */
+    mockDbDelete(ctx->dbid, argv[1]);
+    argv[2]->refcount++;
+    mockDbAdd(ctx->dbid, argv[1], mockValueNew(NULL, argv[2]));
+    mockFireKeyspaceEvent(REDISMODULE_NOTIFY_STRING, "set", argv[1], ctx->dbid);
+    return mockReplyWithSimpleString(ctx, "OK");
+}
+
+static int mockCmdRename(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) return mockWrongArity(ctx);
+    if (mockDbFetch(ctx->dbid, argv[1]) == NULL) return mockReplyWithError(ctx, "ERR no such key");
+    if (mockStringCompare(argv[1], argv[2]) == 0) return mockReplyWithSimpleString(ctx, "OK");
+
+    mockDbDelete(ctx->dbid, argv[2]);
+    mockValue *v = mockDbUnlink(ctx->dbid, argv[1]);
+    mockDbAdd(ctx->dbid, argv[2], v);
+    mockFireKeyspaceEvent(REDISMODULE_NOTIFY_GENERIC, "rename_from", argv[1], ctx->dbid);
+    mockFireKeyspaceEvent(REDISMODULE_NOTIFY_GENERIC, "rename_to", argv[2], ctx->dbid);
+    return mockReplyWithSimpleString(ctx, "OK");
+}
+
+static int mockCmdMove(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    int dst;
+    if (argc != 3) return mockWrongArity(ctx);
+    if (!mockParseDb(argv[2], &dst)) return mockReplyWithError(ctx, "ERR DB index is out of range");
+    if (dst == ctx->dbid) return mockReplyWithError(ctx, "ERR source and destination objects are the same");
+    if (mockDbFetch(ctx->dbid, argv[1]) == NULL || mockDbFetch(dst, argv[1]) != NULL) return mockReplyWithLongLong(ctx, 0);
+
+    mockValue *v = mockDbUnlink(ctx->dbid, argv[1]);
+    mockDbAdd(dst, argv[1], v);
+    mockFireKeyspaceEvent(REDISMODULE_NOTIFY_GENERIC, "move_from", argv[1], ctx->dbid);
+    mockFireKeyspaceEvent(REDISMODULE_NOTIFY_GENERIC, "move_to", argv[1], dst);
+    return mockReplyWithLongLong(ctx, 1);
+}
+
+/* COPY source destination [DB destination-db] [REPLACE] */
+static int mockCmdCopy(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    int dst = ctx->dbid, replace = 0;
+    if (argc < 3) return mockWrongArity(ctx);
+    for (int j = 3; j < argc; j++) {
+        if (mockStringEqualsCase(argv[j], "replace")) {
+            replace = 1;
+        } else if (mockStringEqualsCase(argv[j], "db") && j + 1 < argc) {
+            if (!mockParseDb(argv[++j], &dst)) return mockReplyWithError(ctx, "ERR DB index is out of range");
+        } else {
+            return mockReplyWithError(ctx, "ERR syntax error");
+        }
+    }
+    if (dst == ctx->dbid && mockStringCompare(argv[1], argv[2]) == 0) {
+        return mockReplyWithError(ctx, "ERR source and destination objects are the same");
+    }
+    mockValue *src = mockDbFetch(ctx->dbid, argv[1]);
+    if (src == NULL) return mockReplyWithLongLong(ctx, 0);
+    if (mockDbFetch(dst, argv[2]) != NULL) {
+        if (!replace) return mockReplyWithLongLong(ctx, 0);
+    }
+    if (src->mt && src->mt->tm.copy2 == NULL && src->mt->tm.copy == NULL) {
+        return mockReplyWithError(ctx, "ERR not supported for this module key");
+    }
+
+    void *value;
+    if (src->mt == NULL) {
+        value = mockStringNew(((RedisModuleString *)src->value)->ptr, ((RedisModuleString *)src->value)->len);
+    } else if (src->mt->tm.copy2) {
+        RedisModuleKeyOptCtx oc = {argv[1], argv[2], ctx->dbid, dst};
+        value = src->mt->tm.copy2(&oc, src->value);
+    } else {
+        value = src->mt->tm.copy(argv[1], argv[2], src->value);
+    }
+    if (value == NULL) return mockReplyWithError(ctx, "ERR module key failed to copy");
+    mockDbDelete(dst, argv[2]);
+    mockDbAdd(dst, argv[2], mockValueNew(src->mt, value));
+    mockFireKeyspaceEvent(REDISMODULE_NOTIFY_GENERIC, "copy_to", argv[2], dst);
+    return mockReplyWithLongLong(ctx, 1);
+}
+
+static int mockCmdSwapDb(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    int first, second;
+    if (argc != 3) return mockWrongArity(ctx);
+    if (!mockParseDb(argv[1], &first) || !mockParseDb(argv[2], &second)) {
+        return mockReplyWithError(ctx, "ERR DB index is out of range");
+    }
+    dict *tmp = mock_db[first];
+    mock_db[first] = mock_db[second];
+    mock_db[second] = tmp;
+    RedisModuleSwapDbInfo si = {REDISMODULE_SWAPDBINFO_VERSION, first, second};
+    mockFireServerEvent(RedisModuleEvent_SwapDB, 0, &si);
+    return mockReplyWithSimpleString(ctx, "OK");
+}
+
+static void mockFlush(int dbid) {
+    RedisModuleFlushInfo fi = {REDISMODULE_FLUSHINFO_VERSION, 1, dbid};
+    mockFireServerEvent(RedisModuleEvent_FlushDB, REDISMODULE_SUBEVENT_FLUSHDB_START, &fi);
+    for (int j = 0; j < MOCK_DB_NUM; j++) {
+        if (dbid == -1 || dbid == j) m_dictEmpty(mock_db[j], NULL);
+    }
+    mockFireServerEvent(RedisModuleEvent_FlushDB, REDISMODULE_SUBEVENT_FLUSHDB_END, &fi);
+}
+
+static int mockCmdFlushDb(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 1) return mockWrongArity(ctx);
+    mockFlush(ctx->dbid);
+    return mockReplyWithSimpleString(ctx, "OK");
+}
+
+static int mockCmdFlushAll(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 1) return mockWrongArity(ctx);
+    mockFlush(-1);
+    return mockReplyWithSimpleString(ctx, "OK");
+}
+
+static int mockCmdPublish(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) return mockWrongArity(ctx);
+    mockRecordPublished(argv[1], argv[2]);
+    return mockReplyWithLongLong(ctx, 0);
+}
+
+/* MEMORY USAGE key */
+static int mockCmdMemory(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3 || !mockStringEqualsCase(argv[1], "usage")) return mockReplyWithError(ctx, "ERR syntax error");
+    mockValue *v = mockDbFetch(ctx->dbid, argv[2]);
+    if (v == NULL) return mockReplyWithNull(ctx);
+    size_t usage = 0;
+    if (v->mt == NULL) {
+        usage = ((RedisModuleString *)v->value)->len;
+    } else if (v->mt->tm.mem_usage2) {
+        RedisModuleKeyOptCtx oc = {argv[2], NULL, ctx->dbid, -1};
+        usage = v->mt->tm.mem_usage2(&oc, v->value);
+    } else if (v->mt->tm.mem_usage) {
+        usage = v->mt->tm.mem_usage(v->value);
+    }
+    return mockReplyWithLongLong(ctx, (long long)usage);
+}
+
+/* CONFIG GET databases, the only parameter the module reads. */
+static int mockCmdConfig(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3 || !mockStringEqualsCase(argv[1], "get")) return mockReplyWithError(ctx, "ERR syntax error");
+    if (!mockStringEqualsCase(argv[2], "databases")) return mockReplyWithEmptyArray(ctx);
+    char buf[32];
+    mockReplyWithArray(ctx, 2);
+    mockReplyWithCString(ctx, "databases");
+    return mockReplyWithStringBuffer(ctx, buf, snprintf(buf, sizeof(buf), "%d", MOCK_DB_NUM));
+}
+
+/* ========================== Timers and clock =============================*/
+
+static long long mockMilliseconds(void) {
+    return mock_now_ms;
+}
+
+static ustime_t mockCachedMicroseconds(void) {
+    return mock_now_ms * 1000;
+}
+
+static RedisModuleTimerID mockCreateTimer(RedisModuleCtx *ctx, mstime_t period, RedisModuleTimerProc callback, void *data) {
+    mockTimer *timer = malloc(sizeof(*timer)), **pos = &mock_timers;
+    mockAssert(timer != NULL && period >= 0);
+    timer->id = ++mock_next_timer_id;
+    timer->when = mock_now_ms + period;
+    timer->callback = callback;
+    timer->data = data;
+    while (*pos && (*pos)->when <= timer->when) pos = &(*pos)->next;
+    timer->next = *pos;
+    *pos = timer;
+    return timer->id;
+}
+
+static mockTimer **mockFindTimer(RedisModuleTimerID id) {
+    mockTimer **pos = &mock_timers;
+    while (*pos && (*pos)->id != id) pos = &(*pos)->next;
+    return *pos ? pos : NULL;
+}
+
+static int mockStopTimer(RedisModuleCtx *ctx, RedisModuleTimerID id, void **data) {
+    mockTimer **pos = mockFindTimer(id), *timer;
+    if (pos == NULL) return REDISMODULE_ERR;
+    timer = *pos;
+    if (data) *data = timer->data;
+    *pos = timer->next;
+    free(timer);
+    return REDISMODULE_OK;
+}
+
+static int mockGetTimerInfo(RedisModuleCtx *ctx, RedisModuleTimerID id, uint64_t *remaining, void **data) {
+    mockTimer **pos = mockFindTimer(id);
+    if (pos == NULL) return REDISMODULE_ERR;
+    if (remaining) *remaining = (*pos)->when > mock_now_ms ? (*pos)->when - mock_now_ms : 0;
+    if (data) *data = (*pos)->data;
+    return REDISMODULE_OK;
+}
+
+long long mockGetTime(void) {
+    return mock_now_ms;
+}
+
+void mockSetTime(long long ms) {
+    mock_now_ms = ms;
+}
+
+void mockAdvanceTime(long long ms) {
+    long long target = mock_now_ms + ms;
+    while (mock_timers && mock_timers->when <= target) {
+        mockTimer *timer = mock_timers;
+        mock_timers = timer->next;
+        if (timer->when > mock_now_ms) mock_now_ms = timer->when;
+        RedisModuleCtx *ctx = mockCtxCreate(0, 0);
+        timer->callback(ctx, timer->data);
+        mockCtxFree(ctx);
+        mock_stats.timers_fired++;
+        free(timer);
+    }
+    mock_now_ms = target;
+}
+
+/* ========================== Serialization =============================*/
+
+static void mockIOPush(RedisModuleIO *io, RedisModuleString *str, uint64_t u) {
+    mockIOItem item = {str, u};
+    mockPush(io->items, io->len, io->cap, item);
+}
+
+static void mockSaveUnsigned(RedisModuleIO *io, uint64_t value) {
+    mockIOPush(io, NULL, value);
+}
+
+static uint64_t mockLoadUnsigned(RedisModuleIO *io) {
+    mockAssert(io->pos < io->len && io->items[io->pos].str == NULL);
+    return io->items[io->pos++].u;
+}
+
+static void mockSaveString(RedisModuleIO *io, RedisModuleString *s) {
+    mockIOPush(io, mockStringNew(s->ptr, s->len), 0);
+}
+
+static void mockSaveStringBuffer(RedisModuleIO *io, const char *str, size_t len) {
+    mockIOPush(io, mockStringNew(str, len), 0);
+}
+
+static RedisModuleString *mockLoadString(RedisModuleIO *io) {
+    mockAssert(io->pos < io->len && io->items[io->pos].str != NULL);
+    RedisModuleString *s = io->items[io->pos++].str;
+    return mockStringNew(s->ptr, s->len);
+}
+
+static int mockGetDbIdFromIO(RedisModuleIO *io) {
+    return io->dbid;
+}
+
+static void mockEmitAOF(RedisModuleIO *io, const char *cmdname, const char *fmt, ...) {
+    va_list ap;
+    int flags;
+    va_start(ap, fmt);
+    mockArgv a = mockBuildArgv(cmdname, fmt, ap, &flags);
+    va_end(ap);
+    mockPush(io->cmds, io->cmds_len, io->cmds_cap, a);
+}
+
+static void mockIORelease(RedisModuleIO *io) {
+    for (size_t j = 0; j < io->len; j++) {
+        if (io->items[j].str) mockStringDecr(io->items[j].str);
+    }
+    for (size_t j = 0; j < io->cmds_len; j++) mockFreeArgv(&io->cmds[j]);
+    free(io->items);
+    free(io->cmds);
+    memset(io, 0, sizeof(*io));
+}
+
+typedef struct mockSavedKey {
+    int dbid;
+    RedisModuleString *key;
+    mockValue *v; /* Still owned by the db while saving. */
+    RedisModuleIO io;
+} mockSavedKey;
+
+typedef struct mockSnapshot {
+    mockSavedKey *keys;
+    size_t len, cap;
+} mockSnapshot;
+
+static void mockSnapshotKeys(mockSnapshot *snap) {
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) {
+        m_dictIterator *di = m_dictGetIterator(mock_db[dbid]);
+        m_dictEntry *de;
+        while ((de = m_dictNext(di)) != NULL) {
+            mockSavedKey sk;
+            memset(&sk, 0, sizeof(sk));
+            sk.dbid = dbid;
+            sk.key = mockStringNew(((RedisModuleString *)dictGetKey(de))->ptr, ((RedisModuleString *)dictGetKey(de))->len);
+            sk.v = dictGetVal(de);
+            sk.io.dbid = dbid;
+            mockPush(snap->keys, snap->len, snap->cap, sk);
+        }
+        m_dictReleaseIterator(di);
+    }
+}
+
+static void mockSnapshotRelease(mockSnapshot *snap) {
+    for (size_t j = 0; j < snap->len; j++) {
+        mockStringDecr(snap->keys[j].key);
+        mockIORelease(&snap->keys[j].io);
+    }
+    free(snap->keys);
+}
+
+/* DEBUG RELOAD: save every key, flush everything, load them back. */
+void mockRdbReload(void) {
+    mockSnapshot snap = {NULL, 0, 0};
+    mockSnapshotKeys(&snap);
+    for (size_t j = 0; j < snap.len; j++) {
+        mockSavedKey *sk = &snap.keys[j];
+        if (sk->v->mt) {
+            sk->v->mt->tm.rdb_save(&sk->io, sk->v->value);
+        } else {
+            mockSaveString(&sk->io, sk->v->value);
+        }
+        sk->io.dbid = sk->dbid;
+        /* The type is all we need from the old value. */
+        sk->v = mockValueNew(sk->v->mt, NULL);
+    }
+    mockFlush(-1);
+    for (size_t j = 0; j < snap.len; j++) {
+        mockSavedKey *sk = &snap.keys[j];
+        if (sk->v->mt) {
+            sk->v->value = sk->v->mt->tm.rdb_load(&sk->io, sk->v->mt->encver);
+            mockAssert(sk->v->value != NULL);
+        } else {
+            sk->v->value = mockLoadString(&sk->io);
+        }
+        mockAssert(sk->io.pos == sk->io.len);
+        mockDbAdd(sk->dbid, sk->key, sk->v);
+    }
+    mockSnapshotRelease(&snap);
+}
+
+/* Rewrite the dataset as commands, flush everything and replay them.
+ * Returns the number of commands which failed. */
+int mockAofReload(void) {
+    mockSnapshot snap = {NULL, 0, 0};
+    int errors = 0;
+    mockSnapshotKeys(&snap);
+    for (size_t j = 0; j < snap.len; j++) {
+        mockSavedKey *sk = &snap.keys[j];
+        if (sk->v->mt) {
+            mockAssert(sk->v->mt->tm.aof_rewrite != NULL);
+            sk->v->mt->tm.aof_rewrite(&sk->io, sk->key, sk->v->value);
+        } else {
+            mockEmitAOF(&sk->io, "SET", "ss", sk->key, (RedisModuleString *)sk->v->value);
+        }
+    }
+    mockFlush(-1);
+    for (size_t j = 0; j < snap.len; j++) {
+        mockSavedKey *sk = &snap.keys[j];
+        for (size_t k = 0; k < sk->io.cmds_len; k++) {
+            RedisModuleCallReply *reply = mockExecute(sk->dbid, sk->io.cmds[k].argv, sk->io.cmds[k].argc);
+            if (reply == NULL || reply->type == REDISMODULE_REPLY_ERROR) {
+                fprintf(stderr, "mock: aof replay of '%s' failed: %s\n", sk->io.cmds[k].argv[0]->ptr, reply ? reply->str : "unknown command");
+                errors++;
+            }
+            if (reply) mockReplyRelease(reply);
+        }
+    }
+    mockSnapshotRelease(&snap);
+    return errors;
+}
+
+static uint64_t mockMix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Like redis, elements of a sequence are order dependent, sequences are
+ * not. */
+static void mockDigestAddStringBuffer(RedisModuleDigest *md, unsigned char *ele, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t j = 0; j < len; j++) {
+        h = (h ^ ele[j]) * 0x100000001b3ULL;
+    }
+    md->o = mockMix(md->o ^ h ^ len);
+}
+
+static void mockDigestAddLongLong(RedisModuleDigest *md, long long ll) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%lld", ll);
+    mockDigestAddStringBuffer(md, (unsigned char *)buf, len);
+}
+
+static void mockDigestEndSequence(RedisModuleDigest *md) {
+    md->x ^= mockMix(md->o);
+    md->o = 0;
+}
+
+uint64_t mockDigest(int dbid, RedisModuleString *key) {
+    RedisModuleDigest md = {0, 0};
+    mockValue *v = mockDbFetch(dbid, key);
+    if (v == NULL) return 0;
+    if (v->mt && v->mt->tm.digest) {
+        v->mt->tm.digest(&md, v->value);
+    } else if (v->mt == NULL) {
+        mockDigestAddStringBuffer(&md, (unsigned char *)((RedisModuleString *)v->value)->ptr, ((RedisModuleString *)v->value)->len);
+        mockDigestEndSequence(&md);
+    }
+    return md.x ^ md.o;
+}
+
+/* ========================== Defrag =============================*/
+
+static void *mockDefragAlloc(RedisModuleDefragCtx *ctx, void *ptr) {
+    /* Every allocation moves, the worst case for the module. */
+    mockAllocHeader *h = mockAllocGetHeader(ptr);
+    void *newptr = mockAlloc(h->size);
+    memcpy(newptr, ptr, h->size);
+    mockFree(ptr);
+    mock_stats.defrag_moves++;
+    return newptr;
+}
+
+static RedisModuleString *mockDefragRedisModuleString(RedisModuleDefragCtx *ctx, RedisModuleString *str) {
+    /* Shared strings are never moved, as in redis. */
+    if (str->refcount != 1) return NULL;
+    RedisModuleString *newstr = malloc(sizeof(*newstr));
+    mockAssert(newstr != NULL);
+    memcpy(newstr, str, sizeof(*str));
+    str->refcount = -1;
+    free(str);
+    mock_stats.defrag_moves++;
+    return newstr;
+}
+
+static int mockDefragShouldStop(RedisModuleDefragCtx *ctx) {
+    return mockRand() % 100 < ctx->stop_percent;
+}
+
+static int mockDefragCursorSet(RedisModuleDefragCtx *ctx, unsigned long cursor) {
+    ctx->cursor = cursor;
+    return REDISMODULE_OK;
+}
+
+static int mockDefragCursorGet(RedisModuleDefragCtx *ctx, unsigned long *cursor) {
+    *cursor = ctx->cursor;
+    return REDISMODULE_OK;
+}
+
+static int mockRegisterDefragFunc(RedisModuleCtx *ctx, RedisModuleDefragFunc func) {
+    mock_defrag_func = func;
+    return REDISMODULE_OK;
+}
+
+/* Defrag every module value, then the module globals. 'stop_percent' is the
+ * chance DefragShouldStop() asks the module to yield. */
+void mockDefrag(unsigned int stop_percent) {
+    RedisModuleDefragCtx dctx = {0, stop_percent};
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) {
+        m_dictIterator *di = m_dictGetSafeIterator(mock_db[dbid]);
+        m_dictEntry *de;
+        while ((de = m_dictNext(di)) != NULL) {
+            mockValue *v = dictGetVal(de);
+            if (v->mt == NULL || v->mt->tm.defrag == NULL) continue;
+            long rounds = 0;
+            dctx.cursor = 0;
+            while (v->mt->tm.defrag(&dctx, dictGetKey(de), &v->value)) {
+                mockAssert(++rounds < 100000000);
+            }
+        }
+        m_dictReleaseIterator(di);
+    }
+    if (mock_defrag_func) {
+        long rounds = 0;
+        while (mock_defrag_func(&dctx)) {
+            mockAssert(++rounds < 100000000);
+        }
+    }
+}
+
+/* ========================== Info =============================*/
+
+static int mockRegisterInfoFunc(RedisModuleCtx *ctx, RedisModuleInfoFunc cb) {
+    mock_info_func = cb;
+    return REDISMODULE_OK;
+}
+
+static int mockInfoAddSection(RedisModuleInfoCtx *ctx, char *name) {
+    mockAssert(!ctx->in_dict);
+    ctx->sections++;
+    return REDISMODULE_OK;
+}
+
+static int mockInfoBeginDictField(RedisModuleInfoCtx *ctx, char *name) {
+    mockAssert(ctx->sections > 0 && !ctx->in_dict);
+    ctx->in_dict = 1;
+    return REDISMODULE_OK;
+}
+
+static int mockInfoEndDictField(RedisModuleInfoCtx *ctx) {
+    mockAssert(ctx->in_dict);
+    ctx->in_dict = 0;
+    ctx->fields++;
+    return REDISMODULE_OK;
+}
+
+static int mockInfoAddField(RedisModuleInfoCtx *ctx, char *field) {
+    mockAssert(ctx->sections > 0 && field != NULL && strchr(field, ':') == NULL);
+    if (!ctx->in_dict) ctx->fields++;
+    return REDISMODULE_OK;
+}
+
+static int mockInfoAddFieldLongLong(RedisModuleInfoCtx *ctx, char *field, long long value) {
+    return mockInfoAddField(ctx, field);
+}
+
+static int mockInfoAddFieldULongLong(RedisModuleInfoCtx *ctx, char *field, unsigned long long value) {
+    return mockInfoAddField(ctx, field);
+}
+
+static int mockInfoAddFieldDouble(RedisModuleInfoCtx *ctx, char *field, double value) {
+    return mockInfoAddField(ctx, field);
+}
+
+static int mockInfoAddFieldCString(RedisModuleInfoCtx *ctx, char *field, char *value) {
+    return mockInfoAddField(ctx, field);
+}
+
+/* Run the INFO callback of the module, returns the number of fields. */
+int mockInfo(void) {
+    RedisModuleInfoCtx ictx = {0, 0, 0};
+    if (mock_info_func == NULL) return 0;
+    mock_info_func(&ictx, 0);
+    mockAssert(!ictx.in_dict);
+    return ictx.fields;
+}
+
+/* ========================== Misc =============================*/
+
+static void mockSetModuleAttribs(RedisModuleCtx *ctx, const char *name, int ver, int apiver) {
+    snprintf(mock_module_name, sizeof(mock_module_name), "%s", name);
+}
+
+static int mockIsModuleNameBusy(const char *name) {
+    return mock_module_name[0] && !strcmp(mock_module_name, name);
+}
+
+static void mockLog(RedisModuleCtx *ctx, const char *level, const char *fmt, ...) {
+    va_list ap;
+    if (strcmp(level, "warning") != 0) return;
+    fprintf(stderr, "mock: module %s: ", level);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+}
+
+static void mockLatencyAddSample(const char *event, mstime_t latency) {
+    mockAssert(event != NULL && latency >= 0);
+    mock_stats.latency_samples++;
+}
+
+static int mockGetServerVersion(void) {
+    return MOCK_SERVER_VERSION;
+}
+
+static int mockGetContextFlags(RedisModuleCtx *ctx) {
+    return mock_ctx_flags;
+}
+
+static int mockGetContextFlagsAll(void) {
+    return _REDISMODULE_CTX_FLAGS_NEXT - 1;
+}
+
+void mockSetContextFlags(int flags) {
+    mock_ctx_flags = flags;
+}
+
+static RedisModuleCtx *mockGetThreadSafeContext(RedisModuleBlockedClient *bc) {
+    return mockCtxCreate(0, 0);
+}
+
+static void mockFreeThreadSafeContext(RedisModuleCtx *ctx) {
+    mockCtxFree(ctx);
+}
+
+void mockForkChild(int born) {
+    if (born) {
+        mock_ctx_flags |= REDISMODULE_CTX_FLAGS_ACTIVE_CHILD;
+    } else {
+        mock_ctx_flags &= ~REDISMODULE_CTX_FLAGS_ACTIVE_CHILD;
+    }
+    mockFireServerEvent(RedisModuleEvent_ForkChild, born ? REDISMODULE_SUBEVENT_FORK_CHILD_BORN : REDISMODULE_SUBEVENT_FORK_CHILD_DIED, NULL);
+}
+
+void mockGetStats(mockStats *stats) {
+    *stats = mock_stats;
+}
+
+const char *mockLastReplicated(void) {
+    return mock_last_replicated;
+}
+
+const char *mockLastPublished(const char **message, size_t *len) {
+    *message = mock_last_message;
+    *len = mock_last_message_len;
+    return mock_last_channel;
+}
+
+/* ========================== API table =============================*/
+
+/* The conditional makes the compiler check the mock against the prototype
+ * of the API function it stands for. */
+#define MOCK_API(name, func) {"RedisModule_" #name, (void *)(1 ? func : RedisModule_##name), (void **)&RedisModule_##name}
+
+static const struct {
+    const char *name;
+    void *func;
+    void **slot;
+} mock_api[] = {
+    MOCK_API(Alloc, mockAlloc),
+    MOCK_API(Calloc, mockCalloc),
+    MOCK_API(Realloc, mockRealloc),
+    MOCK_API(Free, mockFree),
+    MOCK_API(Strdup, mockStrdup),
+    MOCK_API(CreateCommand, mockCreateCommand),
+    MOCK_API(SetModuleAttribs, mockSetModuleAttribs),
+    MOCK_API(IsModuleNameBusy, mockIsModuleNameBusy),
+    MOCK_API(WrongArity, mockWrongArity),
+    MOCK_API(ReplyWithLongLong, mockReplyWithLongLong),
+    MOCK_API(ReplyWithError, mockReplyWithError),
+    MOCK_API(ReplyWithSimpleString, mockReplyWithSimpleString),
+    MOCK_API(ReplyWithArray, mockReplyWithArray),
+    MOCK_API(ReplyWithNullArray, mockReplyWithNullArray),
+    MOCK_API(ReplyWithEmptyArray, mockReplyWithEmptyArray),
+    MOCK_API(ReplySetArrayLength, mockReplySetArrayLength),
+    MOCK_API(ReplyWithStringBuffer, mockReplyWithStringBuffer),
+    MOCK_API(ReplyWithCString, mockReplyWithCString),
+    MOCK_API(ReplyWithString, mockReplyWithString),
+    MOCK_API(ReplyWithEmptyString, mockReplyWithEmptyString),
+    MOCK_API(ReplyWithNull, mockReplyWithNull),
+    MOCK_API(ReplyWithCallReply, mockReplyWithCallReply),
+    MOCK_API(ReplyWithDouble, mockReplyWithDouble),
+    MOCK_API(ReplyWithLongDouble, mockReplyWithLongDouble),
+    MOCK_API(GetSelectedDb, mockGetSelectedDb),
+    MOCK_API(SelectDb, mockSelectDb),
+    MOCK_API(OpenKey, mockOpenKey),
+    MOCK_API(CloseKey, mockCloseKey),
+    MOCK_API(KeyType, mockKeyType),
+    MOCK_API(DeleteKey, mockDeleteKey),
+    MOCK_API(StringToLongLong, mockStringToLongLong),
+    MOCK_API(StringToDouble, mockStringToDouble),
+    MOCK_API(StringToLongDouble, mockStringToLongDouble),
+    MOCK_API(Call, mockCall),
+    MOCK_API(CallReplyType, mockCallReplyType),
+    MOCK_API(CallReplyLength, mockCallReplyLength),
+    MOCK_API(CallReplyArrayElement, mockCallReplyArrayElement),
+    MOCK_API(CallReplyInteger, mockCallReplyInteger),
+    MOCK_API(CallReplyStringPtr, mockCallReplyStringPtr),
+    MOCK_API(FreeCallReply, mockFreeCallReply),
+    MOCK_API(CreateStringFromCallReply, mockCreateStringFromCallReply),
+    MOCK_API(CreateString, mockCreateString),
+    MOCK_API(CreateStringFromLongLong, mockCreateStringFromLongLong),
+    MOCK_API(CreateStringFromDouble, mockCreateStringFromDouble),
+    MOCK_API(CreateStringFromLongDouble, mockCreateStringFromLongDouble),
+    MOCK_API(CreateStringFromString, mockCreateStringFromString),
+    MOCK_API(CreateStringPrintf, mockCreateStringPrintf),
+    MOCK_API(FreeString, mockFreeString),
+    MOCK_API(RetainString, mockRetainString),
+    MOCK_API(StringPtrLen, mockStringPtrLen),
+    MOCK_API(StringAppendBuffer, mockStringAppendBuffer),
+    MOCK_API(StringCompare, mockStringCompare),
+    MOCK_API(AutoMemory, mockAutoMemory),
+    MOCK_API(Replicate, mockReplicate),
+    MOCK_API(ReplicateVerbatim, mockReplicateVerbatim),
+    MOCK_API(Milliseconds, mockMilliseconds),
+    MOCK_API(CachedMicroseconds, mockCachedMicroseconds),
+    MOCK_API(Log, mockLog),
+    MOCK_API(CreateDataType, mockCreateDataType),
+    MOCK_API(ModuleTypeSetValue, mockModuleTypeSetValue),
+    MOCK_API(ModuleTypeGetType, mockModuleTypeGetType),
+    MOCK_API(ModuleTypeGetValue, mockModuleTypeGetValue),
+    MOCK_API(SaveUnsigned, mockSaveUnsigned),
+    MOCK_API(LoadUnsigned, mockLoadUnsigned),
+    MOCK_API(SaveString, mockSaveString),
+    MOCK_API(SaveStringBuffer, mockSaveStringBuffer),
+    MOCK_API(LoadString, mockLoadString),
+    MOCK_API(EmitAOF, mockEmitAOF),
+    MOCK_API(GetDbIdFromIO, mockGetDbIdFromIO),
+    MOCK_API(DigestAddStringBuffer, mockDigestAddStringBuffer),
+    MOCK_API(DigestAddLongLong, mockDigestAddLongLong),
+    MOCK_API(DigestEndSequence, mockDigestEndSequence),
+    MOCK_API(CreateTimer, mockCreateTimer),
+    MOCK_API(StopTimer, mockStopTimer),
+    MOCK_API(GetTimerInfo, mockGetTimerInfo),
+    MOCK_API(GetThreadSafeContext, mockGetThreadSafeContext),
+    MOCK_API(FreeThreadSafeContext, mockFreeThreadSafeContext),
+    MOCK_API(SubscribeToServerEvent, mockSubscribeToServerEvent),
+    MOCK_API(SubscribeToKeyspaceEvents, mockSubscribeToKeyspaceEvents),
+    MOCK_API(NotifyKeyspaceEvent, mockNotifyKeyspaceEvent),
+    MOCK_API(PublishMessage, mockPublishMessage),
+    MOCK_API(LatencyAddSample, mockLatencyAddSample),
+    MOCK_API(GetServerVersion, mockGetServerVersion),
+    MOCK_API(GetContextFlags, mockGetContextFlags),
+    MOCK_API(GetContextFlagsAll, mockGetContextFlagsAll),
+    MOCK_API(DbSize, mockDbSizeApi),
+    MOCK_API(InfoAddSection, mockInfoAddSection),
+    MOCK_API(InfoBeginDictField, mockInfoBeginDictField),
+    MOCK_API(InfoEndDictField, mockInfoEndDictField),
+    MOCK_API(InfoAddFieldLongLong, mockInfoAddFieldLongLong),
+    MOCK_API(InfoAddFieldULongLong, mockInfoAddFieldULongLong),
+    MOCK_API(InfoAddFieldDouble, mockInfoAddFieldDouble),
+    MOCK_API(InfoAddFieldCString, mockInfoAddFieldCString),
+    MOCK_API(RegisterInfoFunc, mockRegisterInfoFunc),
+    MOCK_API(RegisterDefragFunc, mockRegisterDefragFunc),
+    MOCK_API(DefragAlloc, mockDefragAlloc),
+    MOCK_API(DefragRedisModuleString, mockDefragRedisModuleString),
+    MOCK_API(DefragShouldStop, mockDefragShouldStop),
+    MOCK_API(DefragCursorSet, mockDefragCursorSet),
+    MOCK_API(DefragCursorGet, mockDefragCursorGet),
+    MOCK_API(GetKeyNameFromOptCtx, mockGetKeyNameFromOptCtx),
+    MOCK_API(GetToKeyNameFromOptCtx, mockGetToKeyNameFromOptCtx),
+    MOCK_API(GetDbIdFromOptCtx, mockGetDbIdFromOptCtx),
+    MOCK_API(GetToDbIdFromOptCtx, mockGetToDbIdFromOptCtx),
+};
+
+/* Everything else stays NULL, as on a server too old to export it. */
+static int mockGetApi(const char *name, void *funcptr) {
+    for (size_t j = 0; j < sizeof(mock_api) / sizeof(mock_api[0]); j++) {
+        if (!strcmp(mock_api[j].name, name)) {
+            *(void **)funcptr = mock_api[j].func;
+            return REDISMODULE_OK;
+        }
+    }
+    return REDISMODULE_ERR;
+}
+
+/* ========================== Setup =============================*/
+
+static const struct {
+    const char *name;
+    RedisModuleCmdFunc func;
+    int write;
+} mock_builtin_commands[] = {
+    {"scan", mockCmdScan, 0},
+    {"randomkey", mockCmdRandomKey, 0},
+    {"dbsize", mockCmdDbSize, 0},
+    {"exists", mockCmdExists, 0},
+    {"del", mockCmdDel, 1},
+    {"set", mockCmdSet, 1},
+    {"rename", mockCmdRename, 1},
+    {"move", mockCmdMove, 1},
+    {"copy", mockCmdCopy, 1},
+    {"swapdb", mockCmdSwapDb, 1},
+    {"flushdb", mockCmdFlushDb, 1},
+    {"flushall", mockCmdFlushAll, 1},
+    {"publish", mockCmdPublish, 0},
+    {"memory", mockCmdMemory, 0},
+    {"config", mockCmdConfig, 0},
+};
+
+/* Create the server and load the module with the given arguments. The API
+ * pointers are filled before OnLoad, so the caller can use them too. */
+void mockInit(void) {
+    for (size_t j = 0; j < sizeof(mock_api) / sizeof(mock_api[0]); j++) {
+        *mock_api[j].slot = mock_api[j].func;
+    }
+    if (mock_commands == NULL) {
+        mock_commands = m_dictCreate(&mockCommandDictType, NULL);
+        for (size_t j = 0; j < sizeof(mock_builtin_commands) / sizeof(mock_builtin_commands[0]); j++) {
+            mockAssert(mockAddCommand(mock_builtin_commands[j].name, mock_builtin_commands[j].func, mock_builtin_commands[j].write) == REDISMODULE_OK);
+        }
+        for (int j = 0; j < MOCK_DB_NUM; j++) {
+            mock_db[j] = m_dictCreate(&mockKeyspaceDictType, NULL);
+        }
+    }
+}
+
+int mockLoadModule(mockOnLoadFunc onload, int argc, const char **argv) {
+    mockInit();
+
+    RedisModuleString **args = malloc(sizeof(*args) * (argc + 1));
+    mockAssert(args != NULL);
+    for (int j = 0; j < argc; j++) args[j] = mockStringNew(argv[j], strlen(argv[j]));
+    RedisModuleCtx *ctx = mockCtxCreate(0, 0);
+    int ret = onload(ctx, args, argc);
+    mockCtxFree(ctx);
+    for (int j = 0; j < argc; j++) mockStringDecr(args[j]);
+    free(args);
+    /* The command table lives in the module allocator, leave it at rest so
+     * the caller can take an allocation baseline now. */
+    while (m_dictRehash(mock_commands, 100));
+    return ret;
+}
+
+RedisModuleCtx *mockCreateClient(int dbid) {
+    return mockCtxCreate(dbid, 0);
+}
+
+void mockFreeClient(RedisModuleCtx *ctx) {
+    mockCtxFree(ctx);
+}
+
+unsigned long mockDbSize(int dbid) {
+    return dictSize(mock_db[dbid]);
+}
+
+void *mockLookupKey(int dbid, RedisModuleString *key, RedisModuleType **mt) {
+    mockValue *v = mockDbFetch(dbid, key);
+    if (mt) *mt = v ? v->mt : NULL;
+    return v ? v->value : NULL;
+}
+
+void mockForEachKey(int dbid, mockKeyCallback cb, void *privdata) {
+    /* Safe, so the callback can look keys up, which may rehash. */
+    m_dictIterator *di = m_dictGetSafeIterator(mock_db[dbid]);
+    m_dictEntry *de;
+    while ((de = m_dictNext(di)) != NULL) {
+        mockValue *v = dictGetVal(de);
+        cb(privdata, dbid, dictGetKey(de), v->mt, v->value);
+    }
+    m_dictReleaseIterator(di);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2021 Alibaba Tair Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "redismodule.h"
+
+/* A single threaded, in process stand in for the parts of redis the module
+ * talks to: keyspace, command dispatch and replies, timers, server and
+ * keyspace events, rdb/aof serialization, defrag and a clock the caller
+ * controls. The module is loaded through its real RedisModule_OnLoad(), the
+ * API is handed out by RedisModule_GetApi() like redis does. Misuse of the
+ * API (unbalanced replies, keys left open, frees of foreign pointers) aborts
+ * the process. */
+
+#define MOCK_DB_NUM 32
+#define MOCK_SERVER_VERSION 0x00070200
+
+typedef int (*mockOnLoadFunc)(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+typedef void (*mockKeyCallback)(void *privdata, int dbid, RedisModuleString *key, RedisModuleType *mt, void *value);
+
+typedef struct mockStats {
+    long long live_strings;
+    long long live_allocs;
+    long long live_bytes;
+    long long open_keys;
+    long long commands;
+    long long replicated;
+    long long published;
+    long long keyspace_events;
+    long long latency_samples;
+    long long timers_fired;
+    long long defrag_moves;
+} mockStats;
+
+/* Hand out the API without loading a module, for code that uses the
+ * RedisModule_* functions directly, like the benchmarks. mockLoadModule()
+ * does it too. */
+void mockInit(void);
+int mockLoadModule(mockOnLoadFunc onload, int argc, const char **argv);
+RedisModuleCtx *mockCreateClient(int dbid);
+void mockFreeClient(RedisModuleCtx *ctx);
+
+/* Clock, RedisModule_Milliseconds() returns mockGetTime(). Advancing the
+ * clock fires the due timers in order, each one at its own due time. */
+long long mockGetTime(void);
+void mockSetTime(long long ms);
+void mockAdvanceTime(long long ms);
+
+/* Keyspace inspection, without any side effect on the module. */
+unsigned long mockDbSize(int dbid);
+void *mockLookupKey(int dbid, RedisModuleString *key, RedisModuleType **mt);
+void mockForEachKey(int dbid, mockKeyCallback cb, void *privdata);
+uint64_t mockDigest(int dbid, RedisModuleString *key);
+
+/* Server side operations the module only observes through callbacks. */
+void mockRdbReload(void);
+int mockAofReload(void);
+void mockDefrag(unsigned int stop_percent);
+/* Fires the fork child event and sets the active child context flag. */
+void mockForkChild(int born);
+void mockSetServerEventEnabled(RedisModuleEvent event, int enabled);
+int mockInfo(void);
+void mockSetContextFlags(int flags);
+
+void mockGetStats(mockStats *stats);
+/* The last command propagated to replicas and the AOF, arguments separated
+ * by spaces. */
+const char *mockLastReplicated(void);
+/* The channel of the last message published, the message is binary. */
+const char *mockLastPublished(const char **message, size_t *len);
@@ -1742,7 +1742,207 @@ start_server {tags {"tairhash"} overrides {bind 0.0.0.0}} {
         assert_equal {} [r exhget tairhashkey field]
         assert_equal -1 [r exhver tairhashkey field]
     }
-    
+
+    test {Latency histograms in info and exhlatencyreset} {
+        r del tairhashkey
+        r exhlatencyreset
+        for {set j 0} {$j < 100} {incr j} {
+            r exhset tairhashkey field$j value$j
+            r exhget tairhashkey field$j
+        }
+        set info [r info tairhash_latency]
+        assert_match {*exhset:calls=100,p50_usec=*,p99_usec=*,p999_usec=*,max_usec=*} $info
+        assert_match {*exhget:calls=100,*} $info
+        assert_match {*passive_expire:calls=100,*} $info
+
+        assert_equal OK [r exhlatencyreset]
+        set info [r info tairhash_latency]
+        assert {![string match {*exhset:*} $info]}
+        assert {![string match {*exhget:*} $info]}
+    }
+
+    test {Expire lag and active expire work counters} {
+        r del tairhashkey
+        r exhlatencyreset
+        for {set j 0} {$j < 20} {incr j} {
+            r exhset tairhashkey field$j value$j px 100
+        }
+        r exhset tairhashkey persist_field value
+
+        wait_for_condition 50 100 {
+            [r exhlen tairhashkey] == 1
+        } else {
+            fail "active expire not triggered"
+        }
+
+        set info [r exhexpireinfo]
+        assert {[getInfoProperty $info tair_hash_active_expire_keys_visited] > 0}
+        assert {[getInfoProperty $info tair_hash_active_expire_fields_examined] >= 20}
+        assert_match {*db: 9, active_expired_fields: *, expire_lag_p50_msec: *, expired_stale_fields: *} $info
+        assert_match {*db9:expired=20,lag_p50_msec=*,lag_max_msec=*,stale_fields=*,stale_bytes=*} [r info tairhash_expirelag]
+    }
+
+    test {Exhdebug indexstats} {
+        r del tairhashkey
+        for {set j 0} {$j < 100} {incr j} {
+            r exhset tairhashkey field$j value$j ex 1000
+        }
+        r exhset tairhashkey persist_field value
+
+        set stats [r exhdebug indexstats tairhashkey]
+        assert_equal 101 [dict get $stats fields]
+        assert_equal 100 [dict get $stats index_fields]
+        assert {[dict get $stats index_bytes] > 0}
+        assert {[dict get $stats index_avg_level] >= 1}
+
+        set stats [r exhdebug indexstats]
+        assert {[lsearch {scan sort slab} [dict get $stats mode]] >= 0}
+
+        assert_equal {} [r exhdebug indexstats no_exist_key]
+        catch {r exhdebug foo} err
+        assert_match {*ERR*syntax*} $err
+    }
+
+    test {Exhexpiretrace records active expire passes} {
+        r del tairhashkey
+        assert_equal OK [r exhexpiretrace reset]
+        assert_equal 0 [r exhexpiretrace len]
+        for {set j 0} {$j < 10} {incr j} {
+            r exhset tairhashkey field$j value$j px 100
+        }
+        r exhset tairhashkey persist_field value
+
+        wait_for_condition 50 100 {
+            [r exhlen tairhashkey] == 1
+        } else {
+            fail "active expire not triggered"
+        }
+
+        assert {[r exhexpiretrace len] > 0}
+        set expired 0
+        foreach entry [r exhexpiretrace get 128] {
+            lassign $entry id start duration db keys fields notifications repl_bytes
+            if {$db == 9} {
+                incr expired $fields
+                if {$fields > 0} {
+                    assert {$keys > 0}
+                    assert {$repl_bytes > 0}
+                }
+            }
+        }
+        assert_equal 10 $expired
+        assert_equal 1 [llength [r exhexpiretrace get 1]]
+
+        catch {r exhexpiretrace foo} err
+        assert_match {*ERR*syntax*} $err
+    }
+
+    # Fork child server events and the helpers used below need a recent redis.
+    if {[lindex [split [s redis_version] .] 0] >= 7} {
+        test {Dict resize is deferred while fork child exists} {
+            r config set save ""
+            r config set rdb-key-save-delay 100000
+            create_big_tairhash tairhashkey 1000
+            set deferred_before [getInfoProperty [r exhexpireinfo] tair_hash_dict_deferred_resizes]
+            assert_equal 1 [getInfoProperty [r exhexpireinfo] tair_hash_dict_resize_enabled]
+
+            r bgsave
+            wait_for_condition 50 100 {
+                [getInfoProperty [r exhexpireinfo] tair_hash_dict_resize_enabled] eq 0
+            } else {
+                fail "dict resize not disabled during bgsave"
+            }
+            for {set j 1000} {$j < 3000} {incr j} {
+                r exhset tairhashkey $j $j
+            }
+            assert_equal 3000 [r exhlen tairhashkey]
+            assert {[getInfoProperty [r exhexpireinfo] tair_hash_dict_deferred_resizes] > $deferred_before}
+
+            r config set rdb-key-save-delay 0
+            catch {exec kill [get_child_pid 0]}
+            wait_for_condition 50 100 {
+                [getInfoProperty [r exhexpireinfo] tair_hash_dict_resize_enabled] eq 1
+            } else {
+                fail "dict resize not enabled after child exit"
+            }
+            r exhset tairhashkey 3000 3000
+            assert_equal 3001 [r exhlen tairhashkey]
+        }
+    }
+
+    if {[lindex [split [s redis_version] .] 0] >= 7} {
+        test {Module configs can be changed at runtime} {
+            assert_equal {tairhash.active_expire_period 1000} [r config get tairhash.active_expire_period]
+            assert_equal {tairhash.enable_active_expire yes} [r config get tairhash.enable_active_expire]
+
+            r config set tairhash.active_expire_period 200
+            r config set tairhash.passive_expire_keys_per_loop 5
+            set info [r exhexpireinfo]
+            assert_match {*tair_hash_active_expire_period:200*} $info
+            assert_match {*tair_hash_passive_expire_keys_per_loop:5*} $info
+
+            catch {r config set tairhash.active_expire_period 0} err
+            assert_match {*ERR*} $err
+
+            r del tairhashkey
+            r config set tairhash.enable_active_expire no
+            r exhset tairhashkey field value px 100
+            after 600
+            assert_equal 1 [r exhlen tairhashkey]
+
+            r config set tairhash.enable_active_expire yes
+            wait_for_condition 50 100 {
+                [r exists tairhashkey] == 0
+            } else {
+                fail "active expire not restarted"
+            }
+
+            r config set tairhash.active_expire_period 1000
+            r config set tairhash.passive_expire_keys_per_loop 3
+        }
+    }
+
+    if {[string match {*jemalloc*} [s mem_allocator]] && [lindex [split [s redis_version] .] 0] >= 7} {
+        test {Active defrag keeps tairhash fields and expire index intact} {
+            r flushall
+            r config set hz 100
+            r config set activedefrag no
+            for {set k 0} {$k < 10} {incr k} {
+                for {set j 0} {$j < 2000} {incr j} {
+                    r exhset tairhashkey$k field$j [string repeat x 100]
+                    r exhset tairhashkey$k expfield$j $j px 10000
+                }
+                for {set j 0} {$j < 2000} {incr j 2} {
+                    r exhdel tairhashkey$k field$j
+                }
+            }
+            catch {r config set activedefrag yes} e
+            if {[r config get activedefrag] eq "activedefrag yes"} {
+                r config set active-defrag-ignore-bytes 1
+                r config set active-defrag-threshold-lower 0
+                r config set active-defrag-cycle-min 65
+                r config set active-defrag-cycle-max 75
+                after 1000
+            }
+            for {set k 0} {$k < 10} {incr k} {
+                assert_equal 3000 [r exhlen tairhashkey$k]
+                assert_equal [string repeat x 100] [r exhget tairhashkey$k field1]
+                assert_equal {} [r exhget tairhashkey$k field2]
+            }
+            for {set k 0} {$k < 10} {incr k} {
+                wait_for_condition 100 200 {
+                    [r exhlen tairhashkey$k] == 1000
+                } else {
+                    fail "expire index broken after defrag"
+                }
+                assert_equal {} [r exhget tairhashkey$k expfield1]
+            }
+            r config set activedefrag no
+            r config set hz 10
+            r flushall
+        }
+    }
+
     start_server {tags {"tairhash repl"} overrides {bind 0.0.0.0}} {
         r module load $testmodule
         set slave [srv 0 client]
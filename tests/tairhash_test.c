@@ -0,0 +1,1753 @@
+/*
+ * Copyright 2021 Alibaba Tair Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Unit and fuzz tests of the expire engine the module was compiled with,
+ * run against the mock server in tests/mock. Time only moves when the test
+ * says so, so every run is reproducible from its seed:
+ *
+ *   ./tairhash_test_slab --seed 42 --ops 1000000
+ *
+ * After every batch of random operations the per key expire index and the
+ * global index (SORT and SLAB modes) are checked against the field dicts. */
+
+#include <limits.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "redismodule_mock.h"
+#include "tairhash.h"
+
+extern RedisModuleType *TairHashType;
+extern ExpireAlgorithm g_expire_algorithm;
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+extern expireDb **g_expire_index;
+extern unsigned int g_expire_slots;
+#endif
+extern int g_db_num;
+extern coldStore *g_cold_store;
+
+int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc);
+
+#if defined(SLAB_MODE)
+#define ENGINE_NAME "slab"
+#elif defined(SORT_MODE)
+#define ENGINE_NAME "sort"
+#else
+#define ENGINE_NAME "scan"
+#endif
+
+#define test_assert(_e, ...)                                                  \
+    do {                                                                      \
+        if (!(_e)) {                                                          \
+            fprintf(stderr, "%s:%d: '%s' failed: ", __FILE__, __LINE__, #_e); \
+            fprintf(stderr, __VA_ARGS__);                                     \
+            fprintf(stderr, " (seed %llu, op %llu)\n", opt_seed, cur_op);     \
+            abort();                                                          \
+        }                                                                     \
+    } while (0)
+
+static unsigned long long opt_seed = 0;
+static unsigned long long opt_ops = 1000000;
+static int opt_keys = 64;
+static int opt_fields = 32;
+static int opt_dbs = 4;
+static int opt_check_every = 1000;
+static int opt_cluster = 0;
+static unsigned long long cur_op = 0;
+static uint64_t rng_state;
+
+static uint64_t rnd(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static long long rndRange(long long min, long long max) {
+    return min + (long long)(rnd() % (uint64_t)(max - min + 1));
+}
+
+/* ========================== Commands =============================*/
+
+static RedisModuleCtx *clients[MOCK_DB_NUM];
+
+/* Run a command given as a space separated string in 'dbid'. */
+static RedisModuleCallReply *call(int dbid, const char *fmt, ...) {
+    char buf[1024], *saveptr = NULL;
+    RedisModuleString *argv[64];
+    int argc = 0;
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    for (char *tok = strtok_r(buf, " ", &saveptr); tok; tok = strtok_r(NULL, " ", &saveptr)) {
+        test_assert(argc < 64, "too many arguments");
+        argv[argc++] = RedisModule_CreateString(NULL, tok, strlen(tok));
+    }
+    RedisModuleCallReply *reply = RedisModule_Call(clients[dbid], RedisModule_StringPtrLen(argv[0], NULL), "v", argv + 1, (size_t)(argc - 1));
+    test_assert(reply != NULL, "unknown command '%s'", RedisModule_StringPtrLen(argv[0], NULL));
+    for (int j = 0; j < argc; j++) RedisModule_FreeString(NULL, argv[j]);
+
+    mockStats stats;
+    mockGetStats(&stats);
+    test_assert(stats.open_keys == 0, "%lld keys left open", stats.open_keys);
+    return reply;
+}
+
+static void callDiscard(int dbid, const char *fmt, ...) {
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    RedisModule_FreeCallReply(call(dbid, "%s", buf));
+}
+
+static long long callInteger(int dbid, const char *fmt, ...) {
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    RedisModuleCallReply *reply = call(dbid, "%s", buf);
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_INTEGER, "'%s' replied type %d: %s", buf,
+                RedisModule_CallReplyType(reply), RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ERROR ? RedisModule_CallReplyStringPtr(reply, NULL) : "");
+    long long v = RedisModule_CallReplyInteger(reply);
+    RedisModule_FreeCallReply(reply);
+    return v;
+}
+
+/* Reply of a command returning a bulk string or nil, "(nil)" for nil. */
+static void callString(char *out, size_t outlen, int dbid, const char *fmt, ...) {
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    RedisModuleCallReply *reply = call(dbid, "%s", buf);
+    int type = RedisModule_CallReplyType(reply);
+    if (type == REDISMODULE_REPLY_NULL) {
+        snprintf(out, outlen, "(nil)");
+    } else {
+        size_t len;
+        const char *ptr = RedisModule_CallReplyStringPtr(reply, &len);
+        test_assert(type == REDISMODULE_REPLY_STRING, "'%s' replied type %d: %s", buf, type, ptr ? ptr : "");
+        snprintf(out, outlen, "%.*s", (int)len, ptr);
+    }
+    RedisModule_FreeCallReply(reply);
+}
+
+static tairHashObj *lookup(int dbid, const char *key) {
+    RedisModuleType *mt;
+    RedisModuleString *name = RedisModule_CreateString(NULL, key, strlen(key));
+    void *value = mockLookupKey(dbid, name, &mt);
+    RedisModule_FreeString(NULL, name);
+    return value && mt == TairHashType ? value : NULL;
+}
+
+static int hashOrMissing(int dbid, const char *key) {
+    RedisModuleType *mt;
+    RedisModuleString *name = RedisModule_CreateString(NULL, key, strlen(key));
+    void *value = mockLookupKey(dbid, name, &mt);
+    RedisModule_FreeString(NULL, name);
+    return value == NULL || mt == TairHashType;
+}
+
+static unsigned long totalKeys(void) {
+    unsigned long total = 0;
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) total += mockDbSize(dbid);
+    return total;
+}
+
+/* ========================== Invariants =============================*/
+
+typedef struct indexEntry {
+    long long expire;
+    RedisModuleString *field;
+} indexEntry;
+
+static int indexEntryCompare(const void *a, const void *b) {
+    const indexEntry *x = a, *y = b;
+    if (x->expire != y->expire) return x->expire < y->expire ? -1 : 1;
+    return RedisModule_StringCompare(x->field, y->field);
+}
+
+/* Walk every level of a skiplist, checking spans, backward links, tail,
+ * length and the count of node levels against the bottom level. */
+#define CHECK_SKIPLIST_LINKS(zsl, node_type, maxlevel)                                                                        \
+    do {                                                                                                                      \
+        unsigned long _n = 0;                                                                                                 \
+        node_type *_nodes[(zsl)->length ? (zsl)->length : 1];                                                                 \
+        node_type *_x = (zsl)->header->level[0].forward, *_prev = NULL;                                                      \
+        test_assert((zsl)->level >= 1 && (zsl)->level <= (zsl)->header_level && (zsl)->header_level <= (maxlevel),            \
+                    "bad skiplist level %d, header has %d", (zsl)->level, (zsl)->header_level);                              \
+        while (_x) {                                                                                                          \
+            test_assert(_n < (zsl)->length, "skiplist longer than its length %lu", (zsl)->length);                           \
+            test_assert(_x->backward == _prev, "bad backward link at rank %lu", _n + 1);                                     \
+            _nodes[_n++] = _x;                                                                                                \
+            _prev = _x;                                                                                                       \
+            _x = _x->level[0].forward;                                                                                        \
+        }                                                                                                                     \
+        test_assert(_n == (zsl)->length, "skiplist has %lu nodes, length %lu", _n, (zsl)->length);                          \
+        test_assert((zsl)->tail == _prev, "bad skiplist tail");                                                              \
+        unsigned long _levels = 0;                                                                                            \
+        for (int _i = 0; _i < (zsl)->level; _i++) {                                                                           \
+            unsigned long _rank = 0;                                                                                          \
+            _x = (zsl)->header;                                                                                               \
+            while (_x->level[_i].forward) {                                                                                   \
+                _rank += _x->level[_i].span;                                                                                  \
+                test_assert(_rank >= 1 && _rank <= _n && _nodes[_rank - 1] == _x->level[_i].forward, "bad span at level %d", \
+                            _i);                                                                                              \
+                _x = _x->level[_i].forward;                                                                                   \
+                _levels++;                                                                                                    \
+            }                                                                                                                 \
+        }                                                                                                                     \
+        test_assert(_levels == (zsl)->level_sum, "skiplist has %lu node levels, counted %lu", _levels, (zsl)->level_sum);    \
+        for (int _i = (zsl)->level; _i < (zsl)->header_level; _i++) {                                                        \
+            test_assert((zsl)->header->level[_i].forward == NULL, "header linked above level %d", (zsl)->level);             \
+        }                                                                                                                     \
+    } while (0)
+
+typedef struct checkState {
+    unsigned long keys;
+    unsigned long indexed_keys;
+    unsigned long fields;
+    unsigned long expiring_fields;
+    indexEntry *entries;
+    size_t entries_cap;
+} checkState;
+
+static void checkKey(void *privdata, int dbid, RedisModuleString *key, RedisModuleType *mt, void *value) {
+    checkState *cs = privdata;
+    tairHashObj *o = value;
+    const char *keyname = RedisModule_StringPtrLen(key, NULL);
+    size_t n = 0;
+
+    if (mt != TairHashType) return;
+    cs->keys++;
+    test_assert(segDictSize(o->hash) > 0, "empty tairhash %s left in db %d", keyname, dbid);
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    test_assert(o->key && RedisModule_StringCompare(o->key, key) == 0, "object of %s is named %s", keyname,
+                o->key ? RedisModule_StringPtrLen(o->key, NULL) : "(null)");
+#endif
+
+    unsigned long expiring = 0;
+    m_segDictIterator *di = m_segDictGetIterator(o->hash);
+    m_dictEntry *de;
+    while ((de = m_segDictNext(di)) != NULL) {
+        TairHashVal *val = dictGetVal(de);
+        test_assert(val->cold || val->value != NULL, "field without value in %s", keyname);
+        if (val->expire) expiring++;
+    }
+    m_segDictReleaseIterator(di);
+    if (o->lex_index) {
+        CHECK_SKIPLIST_LINKS(o->lex_index, m_zskiplistNode, ZSKIPLIST_MAXLEVEL);
+        test_assert(o->lex_index->length == segDictSize(o->hash), "lex index of %s has %lu fields out of %lu", keyname, o->lex_index->length,
+                    segDictSize(o->hash));
+        m_zskiplistNode *prev = NULL;
+        for (m_zskiplistNode *x = o->lex_index->header->level[0].forward; x; prev = x, x = x->level[0].forward) {
+            test_assert(m_segDictFind(o->hash, x->member) != NULL, "lex index of %s has a missing field", keyname);
+            test_assert(!prev || RedisModule_StringCompare(prev->member, x->member) < 0, "lex index of %s out of order", keyname);
+        }
+    }
+    cs->fields += segDictSize(o->hash);
+    cs->expiring_fields += expiring;
+
+    if (cs->entries_cap < expiring) {
+        cs->entries_cap = expiring * 2;
+        cs->entries = realloc(cs->entries, sizeof(indexEntry) * cs->entries_cap);
+    }
+
+    /* The index only exists while the key has expiring fields. */
+    if (o->expire_index == NULL) goto noindex;
+    test_assert(o->expire_index->length > 0, "%s keeps an empty expire index", keyname);
+#ifdef SLAB_MODE
+    CHECK_SKIPLIST_LINKS(o->expire_index, tairhash_zskiplistNode, TAIRHASH_ZSKIPLIST_MAXLEVEL);
+    long long prev_max_expire = LLONG_MIN;
+    RedisModuleString *prev_max_field = NULL;
+    for (tairhash_zskiplistNode *x = o->expire_index->header->level[0].forward; x; x = x->level[0].forward) {
+        Slab *slab = x->slab;
+        test_assert(slab && slab->num_keys > 0 && slab->num_keys <= SLABMAXN, "slab of %s holds %d fields", keyname, slab ? slab->num_keys : -1);
+        int min = 0, max = 0;
+        for (int j = 0; j < slab->num_keys; j++) {
+            indexEntry e = {slab->expires[j], slab->keys[j]};
+            test_assert(n < expiring, "%s has more indexed fields than expiring ones (%lu)", keyname, expiring);
+            cs->entries[n++] = e;
+            indexEntry m = {slab->expires[min], slab->keys[min]}, M = {slab->expires[max], slab->keys[max]};
+            if (indexEntryCompare(&e, &m) < 0) min = j;
+            if (indexEntryCompare(&e, &M) > 0) max = j;
+        }
+        test_assert(x->expire_min == slab->expires[min] && RedisModule_StringCompare(x->key_min, slab->keys[min]) == 0,
+                    "slab node of %s has min %lld but holds %lld", keyname, x->expire_min, slab->expires[min]);
+        /* Everything in a slab sorts before the next slab, the active expire
+         * relies on it. */
+        if (prev_max_field) {
+            indexEntry p = {prev_max_expire, prev_max_field}, m = {slab->expires[min], slab->keys[min]};
+            test_assert(indexEntryCompare(&p, &m) < 0, "slabs of %s overlap", keyname);
+        }
+        prev_max_expire = slab->expires[max];
+        prev_max_field = slab->keys[max];
+    }
+#else
+    CHECK_SKIPLIST_LINKS(o->expire_index, m_zskiplistNode, ZSKIPLIST_MAXLEVEL);
+    for (m_zskiplistNode *x = o->expire_index->header->level[0].forward; x; x = x->level[0].forward) {
+        indexEntry e = {x->score, x->member};
+        test_assert(n < expiring, "%s has more indexed fields than expiring ones (%lu)", keyname, expiring);
+        if (n) test_assert(indexEntryCompare(&cs->entries[n - 1], &e) < 0, "index of %s is out of order", keyname);
+        cs->entries[n++] = e;
+    }
+#endif
+noindex:
+    test_assert(n == expiring, "%s has %lu expiring fields but %zu indexed", keyname, expiring, n);
+
+    if (n) qsort(cs->entries, n, sizeof(indexEntry), indexEntryCompare);
+    for (size_t j = 0; j < n; j++) {
+        if (j) test_assert(indexEntryCompare(&cs->entries[j - 1], &cs->entries[j]) < 0, "field indexed twice in %s", keyname);
+        TairHashVal *val = m_segDictFetchValue(o->hash, cs->entries[j].field);
+        test_assert(val != NULL, "%s indexes missing field %s", keyname, RedisModule_StringPtrLen(cs->entries[j].field, NULL));
+        test_assert(val->expire == cs->entries[j].expire, "%s indexes %s at %lld, expire is %lld", keyname,
+                    RedisModule_StringPtrLen(cs->entries[j].field, NULL), cs->entries[j].expire, val->expire);
+    }
+    if (n) cs->indexed_keys++;
+}
+
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+static long long keyMinExpire(tairHashObj *o) {
+#ifdef SLAB_MODE
+    return o->expire_index->header->level[0].forward->expire_min;
+#else
+    return o->expire_index->header->level[0].forward->score;
+#endif
+}
+#endif
+
+static void checkInvariants(void) {
+    checkState cs;
+    memset(&cs, 0, sizeof(cs));
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) {
+        unsigned long indexed_keys = cs.indexed_keys;
+        mockForEachKey(dbid, checkKey, &cs);
+        indexed_keys = cs.indexed_keys - indexed_keys;
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+        /* Every key with expiring fields is in the global index exactly once,
+         * scored by its earliest field. */
+        expireDb *db = g_expire_index[dbid];
+        if (db == NULL) {
+            test_assert(indexed_keys == 0, "db %d: %lu keys have expiring fields, the db has no global index", dbid, indexed_keys);
+            continue;
+        }
+        test_assert(db->length == indexed_keys, "db %d: global index has %lu keys, %lu keys have expiring fields", dbid, db->length, indexed_keys);
+        /* Slots are freed once empty, the slot array with the last one. */
+        test_assert((db->slot == NULL) == (db->length == 0), "db %d: slot array %s with %lu keys", dbid, db->slot ? "kept" : "missing", db->length);
+        unsigned long slot_keys = 0, used_slots = 0;
+        for (unsigned int s = 0; db->slot && s < g_expire_slots; s++) {
+            expireSlot *slot = db->slot[s];
+            if (slot == NULL) continue;
+            m_heap *heap = &slot->keys;
+            test_assert(slot->slot == s && slot->db == db, "db %d: slot %u misplaced", dbid, s);
+            test_assert(heap->length <= heap->size, "db %d: slot %u overflows", dbid, s);
+            test_assert(heap->length > 0 && slot->entry.heap == &db->slots, "db %d: slot %u with %lu keys is %s the summary", dbid, s,
+                        heap->length, slot->entry.heap ? "in" : "not in");
+            test_assert(m_heapScore(&slot->entry) == heap->items[0].score, "db %d: slot %u is summarized at %lld, its earliest key at %lld", dbid, s,
+                        m_heapScore(&slot->entry), heap->items[0].score);
+            slot_keys += heap->length;
+            used_slots++;
+            for (unsigned long j = 0; j < heap->length; j++) {
+                m_heapEntry *entry = heap->items[j].entry;
+                tairHashObj *io = expireEntryObj(entry);
+                RedisModuleType *mt;
+                size_t len;
+                const char *keyname = RedisModule_StringPtrLen(io->key, &len);
+                tairHashObj *o = mockLookupKey(dbid, io->key, &mt);
+                test_assert(entry->heap == heap && entry->slot == j, "db %d: %s has a stale slot", dbid, keyname);
+                test_assert(o == io && mt == TairHashType, "db %d: global index has missing key %s", dbid, keyname);
+                test_assert(g_expire_slots == 1 || m_keyHashSlot(keyname, (int)len) == s, "db %d: %s is indexed in slot %u", dbid, keyname, s);
+                test_assert(o->expire_index && o->expire_index->length > 0, "db %d: global index has %s without expiring fields", dbid, keyname);
+                test_assert(heap->items[j].score == keyMinExpire(o), "db %d: %s is indexed at %lld, its earliest field at %lld", dbid, keyname, heap->items[j].score,
+                            keyMinExpire(o));
+                if (j > 0) {
+                    test_assert(heap->items[(j - 1) / M_HEAP_ARITY].score <= heap->items[j].score, "db %d: slot %u out of order", dbid, s);
+                }
+            }
+        }
+        test_assert(slot_keys == db->length, "db %d: slots hold %lu keys, the db counts %lu", dbid, slot_keys, db->length);
+        test_assert(db->slots.length == used_slots, "db %d: summary has %lu slots, %lu hold keys", dbid, db->slots.length, used_slots);
+        for (unsigned long j = 1; j < db->slots.length; j++) {
+            test_assert(db->slots.items[(j - 1) / M_HEAP_ARITY].score <= db->slots.items[j].score, "db %d: summary out of order", dbid);
+        }
+#else
+        REDISMODULE_NOT_USED(indexed_keys);
+#endif
+    }
+    free(cs.entries);
+}
+
+/* ========================== Fingerprints =============================*/
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hashString(RedisModuleString *s) {
+    size_t len;
+    const char *p = RedisModule_StringPtrLen(s, &len);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t j = 0; j < len; j++) h = (h ^ (unsigned char)p[j]) * 0x100000001b3ULL;
+    return h;
+}
+
+/* Unlike the DEBUG DIGEST of the type this covers versions and expires. */
+static void fingerprintKey(void *privdata, int dbid, RedisModuleString *key, RedisModuleType *mt, void *value) {
+    uint64_t *fp = privdata, h = mix(hashString(key) ^ (uint64_t)dbid);
+    if (mt != TairHashType) return;
+    h ^= mockDigest(dbid, key);
+    m_segDictIterator *di = m_segDictGetIterator(((tairHashObj *)value)->hash);
+    m_dictEntry *de;
+    while ((de = m_segDictNext(di)) != NULL) {
+        TairHashVal *val = dictGetVal(de);
+        RedisModuleString *value = tairHashValDecode(val);
+        h ^= mix(hashString(dictGetKey(de)) ^ mix(hashString(value) ^ mix((uint64_t)val->expire ^ mix((uint64_t)val->version))));
+        RedisModule_FreeString(NULL, value);
+    }
+    m_segDictReleaseIterator(di);
+    *fp ^= mix(h);
+}
+
+static uint64_t fingerprint(void) {
+    uint64_t fp = 0;
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) mockForEachKey(dbid, fingerprintKey, &fp);
+    return fp;
+}
+
+/* ========================== Unit tests =============================*/
+
+static void testBasicExpire(void) {
+    char buf[64];
+    test_assert(callInteger(0, "EXHSET k f v PX 100") == 1, "set");
+    test_assert(callInteger(0, "EXHSET k g w") == 1, "set");
+    long long pttl = callInteger(0, "EXHPTTL k f");
+    test_assert(pttl == 100, "pttl %lld", pttl);
+    mockAdvanceTime(99);
+    callString(buf, sizeof(buf), 0, "EXHGET k f");
+    test_assert(!strcmp(buf, "v"), "got %s", buf);
+    mockAdvanceTime(1);
+    callString(buf, sizeof(buf), 0, "EXHGET k f");
+    test_assert(!strcmp(buf, "(nil)"), "got %s after expire", buf);
+    test_assert(callInteger(0, "EXHLEN k") == 1, "len");
+    checkInvariants();
+
+    /* The last field expiring removes the key. */
+    test_assert(callInteger(0, "EXHPEXPIRE k g 10") == 1, "pexpire");
+    mockAdvanceTime(10);
+    callString(buf, sizeof(buf), 0, "EXHGET k g");
+    test_assert(!strcmp(buf, "(nil)"), "got %s after expire", buf);
+    test_assert(mockDbSize(0) == 0, "key left after its last field expired");
+
+    /* Persist and keepttl, the expire index goes away with the last
+     * expiring field. */
+    callDiscard(0, "EXHSET k f v");
+    test_assert(lookup(0, "k")->expire_index == NULL, "index allocated without expiring fields");
+    callDiscard(0, "EXHSET k f v EX 10");
+    test_assert(lookup(0, "k")->expire_index != NULL, "no index for an expiring field");
+    test_assert(callInteger(0, "EXHPERSIST k f") == 1, "persist");
+    test_assert(callInteger(0, "EXHTTL k f") == -1, "ttl after persist");
+    test_assert(lookup(0, "k")->expire_index == NULL, "index kept after persist");
+    callDiscard(0, "EXHSET k f v EX 10");
+    callDiscard(0, "EXHSET k f w KEEPTTL");
+    test_assert(callInteger(0, "EXHTTL k f") == 10, "ttl after keepttl");
+    checkInvariants();
+    callDiscard(0, "FLUSHALL");
+}
+
+static void testActiveExpire(void) {
+    for (int j = 0; j < 200; j++) {
+        callDiscard(j % opt_dbs, "EXHSET key:%d f%d v PX %d", j % 37, j, 10 + j);
+        callDiscard(j % opt_dbs, "EXHSET key:%d p%d v", j % 41 + 100, j);
+    }
+    checkInvariants();
+    checkState cs;
+    memset(&cs, 0, sizeof(cs));
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) mockForEachKey(dbid, checkKey, &cs);
+    free(cs.entries);
+    mockAdvanceTime(60 * 1000);
+    checkInvariants();
+    test_assert(totalKeys() == cs.keys - cs.indexed_keys, "%lu keys left, expected %lu", totalKeys(), cs.keys - cs.indexed_keys);
+    for (int dbid = 0; dbid < opt_dbs; dbid++) {
+        test_assert(g_expire_algorithm.stat_active_expired_field[dbid] > 0, "nothing expired in db %d", dbid);
+    }
+    callDiscard(0, "FLUSHALL");
+}
+
+/* The per db state is sized from the server's databases setting, the dbs
+ * past the old fixed 16 expire like the others. */
+static void testDatabases(void) {
+    int dbid = MOCK_DB_NUM - 1;
+    test_assert(g_db_num == MOCK_DB_NUM, "%d dbs, the server has %d", g_db_num, MOCK_DB_NUM);
+    uint64_t active = g_expire_algorithm.stat_active_expired_field[dbid];
+    callDiscard(dbid, "EXHSET k f v PX 10");
+    callDiscard(dbid, "EXHSET k g v");
+    checkInvariants();
+    mockAdvanceTime(1000);
+    test_assert(callInteger(dbid, "EXHLEN k") == 1, "field of db %d not expired", dbid);
+    test_assert(g_expire_algorithm.stat_active_expired_field[dbid] == active + 1, "db %d not actively expired", dbid);
+    checkInvariants();
+    callDiscard(dbid, "FLUSHALL");
+}
+
+/* The global index is partitioned by hash slot in cluster mode, and is a
+ * single slot 0 otherwise. EXHDEBUG SLOTSTATS reports the expire effort of
+ * each slot holding keys, a slot is freed with its last key. */
+static void testSlots(void) {
+    callDiscard(0, "FLUSHALL");
+    callDiscard(0, "EXHSET {a}1 f v PX 10");
+    callDiscard(0, "EXHSET {a}2 f v PX 20");
+    callDiscard(0, "EXHSET {a}2 g v PX 1000000");
+    callDiscard(0, "EXHSET b f v PX 30");
+    callDiscard(0, "EXHSET b g v");
+    checkInvariants();
+    mockAdvanceTime(1000);
+    checkInvariants();
+
+    RedisModuleCallReply *reply = call(0, "EXHDEBUG SLOTSTATS");
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY, "slotstats");
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    test_assert(m_crc16("123456789", 9) == 0x31c3, "crc16");
+    unsigned int a = opt_cluster ? m_keyHashSlot("a", 1) : 0;
+    test_assert(m_keyHashSlot("{a}1", 4) == m_keyHashSlot("a", 1) && m_keyHashSlot("{}a", 3) != m_keyHashSlot("a", 1), "hash tags");
+    /* The slot of b went with its last key. */
+    test_assert(RedisModule_CallReplyLength(reply) == 1, "%zu slots reported", RedisModule_CallReplyLength(reply));
+    RedisModuleCallReply *slot = RedisModule_CallReplyArrayElement(reply, 0);
+    long long id = RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(slot, 0));
+    long long keys = RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(slot, 1));
+    long long expired = RedisModule_CallReplyInteger(RedisModule_CallReplyArrayElement(slot, 3));
+    test_assert(id == a && keys == 1, "slot %lld reported with %lld keys", id, keys);
+    test_assert(expired == (opt_cluster ? 2 : 3), "slot %lld expired %lld fields", id, expired);
+    RedisModule_FreeCallReply(reply);
+
+    callDiscard(0, "EXHDEL {a}2 g");
+    test_assert(g_expire_index[0]->slot == NULL && g_expire_index[0]->slots.items == NULL, "slots of a db kept without expiring keys");
+    reply = call(0, "EXHDEBUG SLOTSTATS");
+    test_assert(RedisModule_CallReplyLength(reply) == 0, "%zu slots reported without keys", RedisModule_CallReplyLength(reply));
+    checkInvariants();
+#else
+    test_assert(RedisModule_CallReplyLength(reply) == 0, "slots reported without a global index");
+#endif
+    RedisModule_FreeCallReply(reply);
+    test_assert(callInteger(0, "EXHLEN b") == 1, "field without expire expired");
+    callDiscard(0, "FLUSHALL");
+}
+
+#ifdef SLAB_MODE
+/* The timed out and on time indices of a slab, whatever its size and mix of
+ * expires. With AVX2 they are gathered in 64 bit lanes and must be packed to
+ * int, exactly, without writing past the arrays. */
+static void testSlabTimeoutIndices(void) {
+    tairhash_zskiplistNode *node = RedisModule_Calloc(1, sizeof(*node));
+    node->slab = slab_createNode();
+    int ontime[SLABMAXN + 8], timeout[SLABMAXN + 8];
+    long long now = 1000000;
+
+    for (int size = 1; size <= SLABMAXN; size += size < 40 ? 1 : 37) {
+        int want_ontime[SLABMAXN], want_timeout[SLABMAXN], n_ontime = 0, n_timeout = 0;
+        node->slab->num_keys = size;
+        node->expire_min = now;
+        for (int i = 0; i < size; i++) {
+            long long expire = now + rndRange(-2, 2);
+            node->slab->expires[i] = expire;
+            if (expire < node->expire_min) node->expire_min = expire;
+            if (expire > now) {
+                want_ontime[n_ontime++] = i;
+            } else {
+                want_timeout[n_timeout++] = i;
+            }
+        }
+        for (int i = 0; i < SLABMAXN + 8; i++) ontime[i] = timeout[i] = -7;
+
+        int n = slab_getSlabTimeoutExpireIndex(node, ontime, timeout, now);
+        test_assert(n == (node->expire_min > now ? 0 : n_timeout), "%d timed out of %d, want %d", n, size, n_timeout);
+        if (n == 0) continue;
+        test_assert(!memcmp(timeout, want_timeout, n_timeout * sizeof(int)), "timed out indices of a slab of %d", size);
+        test_assert(!memcmp(ontime, want_ontime, n_ontime * sizeof(int)), "on time indices of a slab of %d", size);
+        for (int i = SLABMAXN; i < SLABMAXN + 8; i++) {
+            test_assert(ontime[i] == -7 && timeout[i] == -7, "slab of %d written past the index arrays", size);
+        }
+    }
+    slab_release(node->slab);
+    RedisModule_Free(node);
+}
+#endif
+
+/* Write commands expire the due fields of their key, and in SORT_MODE those
+ * of other keys of the db, before the timer gets to them. */
+static void testPassiveExpire(void) {
+#ifndef SLAB_MODE
+    long long now = mockGetTime();
+    uint64_t passive = g_expire_algorithm.stat_passive_expired_field[0];
+    callDiscard(0, "EXHSET p a v PX 10");
+    callDiscard(0, "EXHSET p b v PX 100");
+    callDiscard(0, "EXHSET q a v PX 10");
+    callDiscard(0, "EXHSET r a v PX 10");
+    callDiscard(0, "EXHSET p c v");
+    test_assert(g_expire_algorithm.stat_passive_expired_field[0] == passive, "expired before due");
+
+    /* Moves the clock without firing the timers. */
+    mockSetTime(now + 20);
+    test_assert(callInteger(0, "EXHSET p d v") == 1, "exhset");
+    test_assert(callInteger(0, "EXHLEN p") == 3, "due field of the written key kept");
+    /* Every field of the key is due, it is deleted and created again. */
+    test_assert(callInteger(0, "EXHINCRBY r n 1") == 1, "exhincrby on an expired key");
+    test_assert(callInteger(0, "EXHLEN r") == 1, "expired field kept");
+    checkInvariants();
+#ifdef SORT_MODE
+    test_assert(lookup(0, "q") == NULL, "due key of the db kept");
+    test_assert(g_expire_algorithm.stat_passive_expired_field[0] == passive + 3, "passive expired fields");
+#else
+    test_assert(lookup(0, "q") != NULL, "key not written expired");
+    test_assert(g_expire_algorithm.stat_passive_expired_field[0] == passive + 2, "passive expired fields");
+#endif
+    callDiscard(0, "FLUSHALL");
+#endif
+}
+
+/* Commands nested in an outer sample, like the ones the active expire cycle
+ * calls, take their expire decisions against the time it was taken. */
+static void testClock(void) {
+    long long now = mockGetTime();
+    callDiscard(0, "EXHSET k f v PX 10");
+    expireClockEnter(1);
+    mockSetTime(now + 20);
+    test_assert(callInteger(0, "EXHEXISTS k f") == 1, "expired against a newer clock");
+    test_assert(callInteger(0, "EXHPTTL k f") == 10, "ttl against a newer clock");
+    expireClockLeave();
+    test_assert(expireClockNow() == now + 20, "clock outside a command");
+    test_assert(callInteger(0, "EXHEXISTS k f") == 0, "not expired");
+    callDiscard(0, "FLUSHALL");
+}
+
+static void testKeyspaceCommands(void) {
+    char buf[64];
+    callDiscard(0, "EXHSET a f v PX 1000");
+    callDiscard(0, "EXHSET a g v PX 500");
+    callDiscard(0, "EXHSET b f v PX 200");
+    callDiscard(0, "RENAME a c");
+    checkInvariants();
+    test_assert(lookup(0, "c") != NULL && lookup(0, "a") == NULL, "rename");
+    callDiscard(0, "RENAME b c"); /* Overwrite. */
+    checkInvariants();
+    callDiscard(0, "EXHSET a f v PX 300");
+    test_assert(callInteger(0, "MOVE a 1") == 1, "move");
+    checkInvariants();
+    callDiscard(0, "SWAPDB 0 1");
+    checkInvariants();
+    test_assert(lookup(0, "a") != NULL && lookup(1, "c") != NULL, "swapdb");
+    RedisModuleCallReply *reply = call(0, "COPY a d DB 2");
+#if defined(SORT_MODE) || defined(SLAB_MODE)
+    test_assert(RedisModule_CallReplyInteger(reply) == 1, "copy");
+    test_assert(lookup(2, "d") != NULL, "copy");
+#else
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ERROR, "copy without copy callback");
+#endif
+    RedisModule_FreeCallReply(reply);
+    checkInvariants();
+
+    /* Renaming a key without expiring fields must not confuse the next
+     * keyspace event. */
+    callDiscard(3, "EXHSET x f v");
+    callDiscard(3, "RENAME x y");
+    callDiscard(3, "DEL y");
+    callDiscard(3, "EXHSET z f v PX 100");
+    callDiscard(3, "DEL z");
+    checkInvariants();
+
+    mockAdvanceTime(5000);
+    checkInvariants();
+    callString(buf, sizeof(buf), 1, "EXHGET c f");
+    test_assert(!strcmp(buf, "(nil)"), "got %s", buf);
+    test_assert(totalKeys() == 0, "%lu keys left", totalKeys());
+
+    callDiscard(0, "EXHSET a f v PX 100");
+    callDiscard(1, "EXHSET a f v PX 100");
+    callDiscard(0, "FLUSHDB");
+    checkInvariants();
+    test_assert(mockDbSize(1) == 1, "flushdb emptied another db");
+    callDiscard(0, "FLUSHALL");
+    checkInvariants();
+}
+
+static void testBigKey(void) {
+    int fields = 3 * SLABMAXN;
+    for (int j = 0; j < fields; j++) {
+        callDiscard(0, "EXHSET big f%d v PX %lld", j, rndRange(1, 100000));
+    }
+    checkInvariants();
+    for (int j = 0; j < fields * 4; j++) {
+        int f = (int)rndRange(0, fields - 1);
+        switch (rnd() % 4) {
+            case 0:
+                callDiscard(0, "EXHDEL big f%d", f);
+                break;
+            case 1:
+                callDiscard(0, "EXHPEXPIRE big f%d %lld", f, rndRange(1, 100000));
+                break;
+            case 2:
+                callDiscard(0, "EXHPERSIST big f%d", f);
+                break;
+            default:
+                callDiscard(0, "EXHSET big f%d v PX %lld", f, rndRange(1, 100000));
+                break;
+        }
+        if (j % 500 == 0) checkInvariants();
+    }
+    checkInvariants();
+    for (int j = 0; j < 100; j++) {
+        mockAdvanceTime(1000);
+        checkInvariants();
+    }
+    callDiscard(0, "FLUSHALL");
+}
+
+static void testSegments(void) {
+    int fields = 2000;
+    for (int j = 0; j < fields; j++) {
+        callDiscard(0, "EXHSET seg f%d v%d", j, j);
+    }
+    tairHashObj *o = lookup(0, "seg");
+    test_assert(o && segDictIsSegmented(o->hash) && segDictSize(o->hash) == (unsigned long)fields, "big key not segmented");
+    checkInvariants();
+
+    /* A scan walks every segment and reports every field. */
+    char *seen = calloc(fields, 1);
+    unsigned long cursor = 0;
+    do {
+        RedisModuleCallReply *reply = call(0, "EXHSCAN seg %lu COUNT 50", cursor);
+        cursor = strtoul(RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(reply, 0), NULL), NULL, 10);
+        RedisModuleCallReply *elements = RedisModule_CallReplyArrayElement(reply, 1);
+        for (size_t j = 0; j < RedisModule_CallReplyLength(elements); j += 2) {
+            size_t len;
+            const char *ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(elements, j), &len);
+            seen[atoi(ptr + 1)] = 1;
+        }
+        RedisModule_FreeCallReply(reply);
+    } while (cursor);
+    for (int j = 0; j < fields; j++) test_assert(seen[j], "f%d not scanned", j);
+    free(seen);
+
+    mockDefrag(0);
+    mockRdbReload();
+    o = lookup(0, "seg");
+    test_assert(o && segDictSize(o->hash) == (unsigned long)fields, "segmented key reloaded with %lu fields", o ? segDictSize(o->hash) : 0);
+    checkInvariants();
+
+    /* Draining the key shrinks its segments. */
+    for (int j = 10; j < fields; j++) {
+        callDiscard(0, "EXHDEL seg f%d", j);
+    }
+    o = lookup(0, "seg");
+    test_assert(callInteger(0, "EXHLEN seg") == 10, "fields left after the deletes");
+    test_assert(m_segDictSlots(o->hash) <= 2 * M_SEGDICT_SEGS * DICT_HT_INITIAL_SIZE, "segments kept %lu buckets", m_segDictSlots(o->hash));
+    checkInvariants();
+    callDiscard(0, "FLUSHALL");
+}
+
+static void testReload(void) {
+    for (int j = 0; j < 500; j++) {
+        callDiscard(j % opt_dbs, "EXHSET k%d f%d v%d PX %d VER %d", j % 50, j, j, 1000 + j, j + 1);
+        callDiscard(j % opt_dbs, "EXHSET k%d p%d v%d", j % 50, j, j);
+    }
+    uint64_t fp = fingerprint();
+    mockRdbReload();
+    checkInvariants();
+    test_assert(fingerprint() == fp, "rdb reload changed the dataset");
+    int errors = mockAofReload();
+    test_assert(errors == 0, "%d aof commands failed", errors);
+    checkInvariants();
+    test_assert(fingerprint() == fp, "aof reload changed the dataset");
+    mockDefrag(30);
+    checkInvariants();
+    test_assert(fingerprint() == fp, "defrag changed the dataset");
+    callDiscard(0, "FLUSHALL");
+}
+
+static int contextFlags(void) {
+    return opt_cluster ? REDISMODULE_CTX_FLAGS_CLUSTER : 0;
+}
+
+static void testReplica(void) {
+    char buf[64];
+    callDiscard(0, "EXHSET k f v PX 10");
+    mockSetContextFlags(contextFlags() | REDISMODULE_CTX_FLAGS_SLAVE);
+    mockAdvanceTime(1000);
+    /* A replica reports the field as expired but waits for its master to
+     * delete it. */
+    callString(buf, sizeof(buf), 0, "EXHGET k f");
+    test_assert(lookup(0, "k") != NULL, "replica deleted an expired field");
+    mockSetContextFlags(contextFlags());
+    mockAdvanceTime(5000);
+    test_assert(lookup(0, "k") == NULL, "field not expired after promotion");
+    checkInvariants();
+}
+
+static int callIsError(int dbid, const char *cmd) {
+    RedisModuleCallReply *reply = call(dbid, "%s", cmd);
+    int err = RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ERROR;
+    RedisModule_FreeCallReply(reply);
+    return err;
+}
+
+static void testOptions(void) {
+    static const char *bad[] = {
+        "EXHSET k f v EX 1 PX 1", "EXHSET k f v PXAT 1 EXAT 1", "EXHSET k f v KEEPTTL EX 1", "EXHSET k f v EX 1 KEEPTTL",
+        "EXHSET k f v NX XX",     "EXHSET k f v VER 1 ABS 2",   "EXHSET k f v ABS 0",        "EXHSET k f v GT -1",
+        "EXHSET k f v EX",        "EXHSET k f v EX -1",         "EXHSET k f v EX one",       "EXHSET k f v MIN 1",
+        "EXHSET k f v NXX",       "EXHSET k f v E",             "EXHINCRBY k n 1 NX",        "EXHINCRBY k n 1 MAX",
+        "EXHPEXPIRE k f 10 PX 1", "EXHPEXPIRE k f 10 GT 0",     "EXHPEXPIRE k f 10 keepttl",
+    };
+    for (size_t j = 0; j < sizeof(bad) / sizeof(bad[0]); j++) {
+        test_assert(callIsError(0, bad[j]), "'%s' accepted", bad[j]);
+    }
+    test_assert(mockDbSize(0) == 0, "a rejected command wrote");
+
+    long long now = mockGetTime();
+    test_assert(callInteger(0, "EXHSET k f v eXaT %lld nx aBs 7", now / 1000 + 10) == 1, "mixed case options");
+    test_assert(callInteger(0, "EXHVER k f") == 7, "abs");
+    test_assert(callInteger(0, "EXHTTL k f") == 10, "exat");
+    test_assert(callInteger(0, "EXHSET k f v VER 1 VER 7 KEEPTTL KEEPTTL") == 0, "repeated options");
+    test_assert(callInteger(0, "EXHINCRBY k n 1 MIN 0 MAX 5 PX 100 GT 3") == 1, "incrby options");
+    test_assert(callInteger(0, "EXHPTTL k n") == 100, "incrby px");
+    test_assert(callInteger(0, "EXHPEXPIRE k n 10 ver 3") == 1, "expire options");
+    callDiscard(0, "FLUSHALL");
+}
+
+/* What replicas and the AOF see must rebuild the same field, expire and
+ * version. */
+#define assertReplicated(...)                                                                                     \
+    do {                                                                                                          \
+        char _expect[256];                                                                                        \
+        snprintf(_expect, sizeof(_expect), __VA_ARGS__);                                                          \
+        test_assert(!strcmp(mockLastReplicated(), _expect), "replicated '%s', expected '%s'", mockLastReplicated(), \
+                    _expect);                                                                                     \
+    } while (0)
+
+static void testPropagation(void) {
+    long long now = mockGetTime();
+    callDiscard(0, "EXHSET k f v EX 10");
+    assertReplicated("EXHSET k f v PXAT %lld", now + 10000);
+    callDiscard(0, "EXHSET k f w KEEPTTL");
+    assertReplicated("EXHSET k f w PXAT %lld", now + 10000);
+    callDiscard(0, "EXHSET k f w VER 2");
+    assertReplicated("EXHSET k f w ABS 3");
+    callDiscard(0, "EXHPEXPIRE k f 100 VER 3");
+    assertReplicated("EXHPEXPIREAT k f %lld ABS 4", now + 100);
+    callDiscard(0, "EXHINCRBY k n 5 EX 10");
+    assertReplicated("EXHSET k n 5 ABS 1 PXAT %lld", now + 10000);
+    callDiscard(0, "EXHINCRBY k n 1 KEEPTTL");
+    assertReplicated("EXHSET k n 6 ABS 2 PXAT %lld", now + 10000);
+    callDiscard(0, "EXHINCRBYFLOAT k x 1.5 PX 20");
+    assertReplicated("EXHSET k x 1.5 ABS 1 PXAT %lld", now + 20);
+    callDiscard(0, "EXHMSETWITHOPTS k f u 0 30");
+    assertReplicated("EXHSET k f u ABS 5 PXAT %lld", now + 30000);
+    callDiscard(0, "FLUSHALL");
+}
+
+/* EXHIMPORT of a batch given as a buffer, the reply is left to the caller. */
+static RedisModuleCallReply *callImport(int dbid, const char *key, const char *blob, size_t len) {
+    RedisModuleCallReply *reply = RedisModule_Call(clients[dbid], "EXHIMPORT", "cb", key, blob, len);
+    mockStats stats;
+    mockGetStats(&stats);
+    test_assert(reply != NULL && stats.open_keys == 0, "exhimport");
+    return reply;
+}
+
+/* Move 'src' to 'dst' in batches of 'count' fields, returns the number of
+ * fields imported. */
+static long long exportImport(int src_db, const char *src, int dst_db, const char *dst, int count) {
+    long long imported = 0;
+    unsigned long cursor = 0;
+    do {
+        RedisModuleCallReply *reply = call(src_db, "EXHEXPORT %s %lu %d", src, cursor, count);
+        test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY && RedisModule_CallReplyLength(reply) == 2, "exhexport");
+        size_t len;
+        const char *ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(reply, 0), &len);
+        cursor = strtoul(ptr, NULL, 10);
+        ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(reply, 1), &len);
+        RedisModuleCallReply *ireply = callImport(dst_db, dst, ptr, len);
+        test_assert(RedisModule_CallReplyType(ireply) == REDISMODULE_REPLY_INTEGER, "exhimport replied type %d", RedisModule_CallReplyType(ireply));
+        imported += RedisModule_CallReplyInteger(ireply);
+        RedisModule_FreeCallReply(ireply);
+        RedisModule_FreeCallReply(reply);
+    } while (cursor);
+    return imported;
+}
+
+static void testExportImport(void) {
+    long long now = mockGetTime();
+    for (int j = 0; j < 300; j++) {
+        if (j % 3 == 0) {
+            callDiscard(0, "EXHSET src f%d v%d PX %d", j, j, 1000 + j);
+        } else if (j % 3 == 1) {
+            callDiscard(0, "EXHSET src f%d v%d ABS %d", j, j, j);
+        } else {
+            callDiscard(0, "EXHSET src f%d v%d", j, j);
+        }
+    }
+    callDiscard(0, "EXHSET src gone v PX 10");
+    /* Moves the clock without firing the timers, the due field is still
+     * there but is not exported. */
+    mockSetTime(now + 20);
+    test_assert(exportImport(0, "src", 1, "dst", 7) == 300, "fields imported");
+    checkInvariants();
+
+    tairHashObj *src = lookup(0, "src"), *dst = lookup(1, "dst");
+    test_assert(dst && segDictSize(dst->hash) == 300, "dst has %lu fields", dst ? segDictSize(dst->hash) : 0);
+    m_segDictIterator *di = m_segDictGetIterator(src->hash);
+    m_dictEntry *de;
+    while ((de = m_segDictNext(di)) != NULL) {
+        TairHashVal *a = dictGetVal(de), *b = m_segDictFetchValue(dst->hash, dictGetKey(de));
+        const char *field = RedisModule_StringPtrLen(dictGetKey(de), NULL);
+        if (!strcmp(field, "gone")) {
+            test_assert(b == NULL, "expired field imported");
+            continue;
+        }
+        test_assert(b != NULL, "%s not imported", field);
+        RedisModuleString *va = tairHashValDecode(a), *vb = tairHashValDecode(b);
+        test_assert(RedisModule_StringCompare(va, vb) == 0 && a->version == b->version && a->expire == b->expire, "%s imported as another field", field);
+        RedisModule_FreeString(NULL, va);
+        RedisModule_FreeString(NULL, vb);
+    }
+    m_segDictReleaseIterator(di);
+
+    /* Every field is propagated as it was imported. */
+    callDiscard(0, "EXHSET one f v PX 100");
+    callDiscard(0, "EXHSETVER one f 7");
+    test_assert(exportImport(0, "one", 0, "two", 10) == 1, "one field imported");
+    assertReplicated("EXHSET two f v ABS 7 PXAT %lld", now + 120);
+
+    /* A missing key exports an empty batch, importing it creates nothing. */
+    test_assert(exportImport(0, "missing", 0, "none", 10) == 0, "fields imported from a missing key");
+    test_assert(lookup(0, "none") == NULL, "key created by an empty batch");
+
+    /* Damaged batches are rejected as a whole. */
+    RedisModuleCallReply *reply = call(0, "EXHEXPORT one 0 10");
+    size_t len;
+    const char *ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(reply, 1), &len);
+    char *blob = malloc(len);
+    for (size_t j = 0; j < len; j++) {
+        memcpy(blob, ptr, len);
+        blob[j] ^= 0x40;
+        RedisModuleCallReply *ireply = callImport(0, "bad", blob, len);
+        test_assert(RedisModule_CallReplyType(ireply) == REDISMODULE_REPLY_ERROR, "batch damaged at %zu imported", j);
+        RedisModule_FreeCallReply(ireply);
+    }
+    for (size_t j = 0; j < len; j++) {
+        RedisModuleCallReply *ireply = callImport(0, "bad", ptr, j);
+        test_assert(RedisModule_CallReplyType(ireply) == REDISMODULE_REPLY_ERROR, "batch cut at %zu imported", j);
+        RedisModule_FreeCallReply(ireply);
+    }
+    test_assert(lookup(0, "bad") == NULL, "damaged batch created the key");
+    callDiscard(0, "SET str x");
+    RedisModuleCallReply *ireply = callImport(0, "str", ptr, len);
+    test_assert(RedisModule_CallReplyType(ireply) == REDISMODULE_REPLY_ERROR, "imported into a string");
+    RedisModule_FreeCallReply(ireply);
+    free(blob);
+    RedisModule_FreeCallReply(reply);
+    test_assert(callIsError(0, "EXHEXPORT str 0 10"), "exported a string");
+    test_assert(callIsError(0, "EXHEXPORT one 0 0"), "exported with a zero count");
+    test_assert(callIsError(0, "EXHEXPORT one x 10"), "exported with a bad cursor");
+    callDiscard(0, "FLUSHALL");
+}
+
+/* Fields of an array reply, joined by spaces. */
+static void replyFields(char *out, size_t outlen, RedisModuleCallReply *reply) {
+    out[0] = '\0';
+    for (size_t j = 0; j < RedisModule_CallReplyLength(reply); j++) {
+        size_t len, used = strlen(out);
+        const char *ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(reply, j), &len);
+        snprintf(out + used, outlen - used, "%s%.*s", j ? " " : "", (int)len, ptr);
+    }
+}
+
+static void assertRange(const char *expected, const char *fmt, ...) {
+    char cmd[256], got[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(cmd, sizeof(cmd), fmt, ap);
+    va_end(ap);
+    RedisModuleCallReply *reply = call(0, "%s", cmd);
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY, "'%s' did not reply an array", cmd);
+    replyFields(got, sizeof(got), reply);
+    RedisModule_FreeCallReply(reply);
+    test_assert(!strcmp(expected, got), "'%s': expected '%s', got '%s'", cmd, expected, got);
+}
+
+/* Scan 'key' with MATCH 'pattern' to the end, calling 'between' after every
+ * page, and return the fields seen as " f1 f2 ... " in 'out' and the page
+ * count. The most fields a page returned go to 'max_page' if not NULL. */
+static int scanPrefix(char *out, size_t outlen, const char *key, const char *pattern, int count, void (*between)(int page), size_t *max_page) {
+    char cursor[32] = "0";
+    int pages = 0;
+    snprintf(out, outlen, " ");
+    if (max_page) *max_page = 0;
+    do {
+        RedisModuleCallReply *reply = call(0, "EXHSCAN %s %s MATCH %s COUNT %d", key, cursor, pattern, count);
+        size_t len;
+        const char *ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(reply, 0), &len);
+        snprintf(cursor, sizeof(cursor), "%.*s", (int)len, ptr);
+        RedisModuleCallReply *fields = RedisModule_CallReplyArrayElement(reply, 1);
+        if (max_page && RedisModule_CallReplyLength(fields) / 2 > *max_page) *max_page = RedisModule_CallReplyLength(fields) / 2;
+        for (size_t j = 0; j < RedisModule_CallReplyLength(fields); j += 2) {
+            ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(fields, j), &len);
+            size_t used = strlen(out);
+            snprintf(out + used, outlen - used, "%.*s ", (int)len, ptr);
+        }
+        RedisModule_FreeCallReply(reply);
+        if (between) between(pages);
+        test_assert(++pages < 1000, "scan of %s %s does not end", key, pattern);
+    } while (strcmp(cursor, "0"));
+    return pages;
+}
+
+static void scanWrites(int page) {
+    if (page == 0) {
+        callDiscard(0, "EXHDEL lex p11");
+        callDiscard(0, "EXHSET lex p1 v");
+        callDiscard(0, "EXHSET lex p195 v");
+    }
+}
+
+static void testRangeByLex(void) {
+    callDiscard(0, "EXHMSET lex b 2 a 1 d 4 c 3 ab 12");
+    test_assert(callIsError(0, "EXHRANGEBYLEX lex - +"), "range without a lex index");
+    test_assert(callInteger(0, "EXHLEXINDEX lex ON") == 1 && lookup(0, "lex")->lex_index, "lex index not built");
+    assertReplicated("EXHLEXINDEX lex ON");
+    test_assert(callInteger(0, "EXHLEXINDEX lex on") == 0 && callInteger(0, "EXHLEXINDEX missing ON") == 0, "lex index built twice");
+    test_assert(callIsError(0, "EXHLEXINDEX lex YES") && callIsError(0, "EXHLEXINDEX lex"), "EXHLEXINDEX arguments");
+    assertRange("a ab b c d", "EXHRANGEBYLEX lex - +");
+    checkInvariants();
+    assertRange("ab b", "EXHRANGEBYLEX lex (a [b");
+    assertRange("b 2 c 3", "EXHRANGEBYLEX lex [b (d WITHVALUES");
+    assertRange("b c", "EXHRANGEBYLEX lex [aa + LIMIT 1 2");
+    assertRange("", "EXHRANGEBYLEX lex + -");
+    assertRange("", "EXHRANGEBYLEX lex [d [a");
+    assertRange("", "EXHRANGEBYLEX missing - +");
+    test_assert(callIsError(0, "EXHRANGEBYLEX lex a +"), "bound without [ or (");
+    test_assert(callIsError(0, "EXHRANGEBYLEX lex - + LIMIT 0"), "LIMIT without count");
+
+    /* The index follows the fields once built, expired fields are skipped. */
+    callDiscard(0, "EXHSET lex aa 0");
+    callDiscard(0, "EXHDEL lex c");
+    callDiscard(0, "EXHSET lex b 2 PX 10");
+    mockSetTime(mockGetTime() + 20);
+    assertRange("a aa ab d", "EXHRANGEBYLEX lex - +");
+    mockAdvanceTime(0);
+    checkInvariants();
+
+    /* The index is saved with the key. */
+    mockRdbReload();
+    test_assert(lookup(0, "lex")->lex_index != NULL, "lex index lost by an rdb reload");
+    test_assert(mockAofReload() == 0 && lookup(0, "lex")->lex_index != NULL, "lex index lost by an aof reload");
+    mockDefrag(0);
+    checkInvariants();
+
+    /* A prefix MATCH pages through the index with lex cursors. Fields there
+     * for the whole scan are all seen, whatever the writes between pages. */
+    for (int j = 0; j < 50; j++) {
+        callDiscard(0, "EXHSET lex p%02d v", j);
+    }
+    char seen[8192];
+    int pages = scanPrefix(seen, sizeof(seen), "lex", "p1*", 3, NULL, NULL);
+    test_assert(!strcmp(seen, " p10 p11 p12 p13 p14 p15 p16 p17 p18 p19 ") && pages == 4, "prefix scan saw%s in %d pages", seen, pages);
+    scanPrefix(seen, sizeof(seen), "lex", "p1*", 2, scanWrites, NULL);
+    for (int j = 10; j < 20; j++) {
+        char field[8];
+        snprintf(field, sizeof(field), " p%d ", j);
+        test_assert(j == 11 || strstr(seen, field), "prefix scan with writes missed%s", field);
+    }
+
+    /* Fields sharing more than the bytes a cursor holds still move on, in
+     * pages of at most COUNT*10 fields. */
+    for (int j = 0; j < 100; j++) {
+        callDiscard(0, "EXHSET lex qqqqqqqqqq%02d v", j);
+    }
+    size_t max_page;
+    scanPrefix(seen, sizeof(seen), "lex", "q*", 2, NULL, &max_page);
+    test_assert(max_page <= 20, "prefix scan of shared bytes returned a page of %zu fields", max_page);
+    for (int j = 0; j < 100; j++) {
+        char field[32];
+        snprintf(field, sizeof(field), " qqqqqqqqqq%02d ", j);
+        test_assert(strstr(seen, field), "prefix scan of shared bytes missed%s", field);
+    }
+
+    /* A lex cursor without the index restarts a plain scan. */
+    RedisModuleCallReply *reply = call(0, "EXHSCAN lex 0 MATCH p* COUNT 1");
+    char cursor[32];
+    size_t len;
+    const char *ptr = RedisModule_CallReplyStringPtr(RedisModule_CallReplyArrayElement(reply, 0), &len);
+    snprintf(cursor, sizeof(cursor), "%.*s", (int)len, ptr);
+    RedisModule_FreeCallReply(reply);
+    test_assert(strtoul(cursor, NULL, 10) >= (1UL << 63), "prefix scan returned cursor %s", cursor);
+    test_assert(callInteger(0, "EXHLEXINDEX lex OFF") == 1 && lookup(0, "lex")->lex_index == NULL, "lex index not dropped");
+    assertReplicated("EXHLEXINDEX lex OFF");
+    test_assert(callIsError(0, "EXHRANGEBYLEX lex - +"), "range after the lex index was dropped");
+    scanPrefix(seen, sizeof(seen), "lex", "p1*", 1000, NULL, NULL);
+    test_assert(strstr(seen, " p10 ") && strstr(seen, " p19 "), "plain prefix scan saw%s", seen);
+    callDiscard(0, "FLUSHALL");
+}
+
+static void testCompression(void) {
+    /* Round trips of the codec, on data from incompressible to runs. */
+    unsigned char in[3000], out[3000], back[3000];
+    for (int j = 0; j < 200; j++) {
+        unsigned int len = (unsigned int)rndRange(1, sizeof(in)), alphabet = (unsigned int)rndRange(1, 256);
+        for (unsigned int i = 0; i < len; i++) in[i] = (unsigned char)(rnd() % alphabet);
+        unsigned int clen = m_lzfCompress(in, len, out, len);
+        if (clen == 0) continue;
+        test_assert(m_lzfDecompress(out, clen, back, len) == len && !memcmp(in, back, len), "lzf round trip of %u bytes", len);
+        test_assert(m_lzfDecompress(out, clen, back, len - 1) == 0, "lzf decompressed past the output");
+    }
+
+    char json[1024], got[1024];
+    int len = 0;
+    while (len < 800) len += snprintf(json + len, sizeof(json) - len, "{\"id\":%d,\"name\":\"item\",\"tags\":[\"a\",\"b\"]},", len);
+    callDiscard(0, "EXHSET z json %s PX 100000", json);
+    callDiscard(0, "EXHSET z small v");
+    callDiscard(0, "EXHSET z num 1111111111111111111");
+    tairHashObj *o = lookup(0, "z");
+    RedisModuleString *name = RedisModule_CreateString(NULL, "json", 4);
+    TairHashVal *val = m_segDictFetchValue(o->hash, name);
+    test_assert(val->encoding == TAIRHASH_VAL_LZF, "json value not compressed");
+    size_t stored;
+    RedisModule_StringPtrLen(val->value, &stored);
+    test_assert(stored < (size_t)len / 2, "json value compressed to %zu bytes out of %d", stored, len);
+
+    callString(got, sizeof(got), 0, "EXHGET z json");
+    test_assert(!strcmp(got, json), "compressed value read back as %s", got);
+    test_assert(callInteger(0, "EXHSTRLEN z json") == len, "length of the compressed value");
+    test_assert(callInteger(0, "EXHINCRBY z num 1") == 1111111111111111112LL, "increment of a compressed number");
+
+    uint64_t fp = fingerprint();
+    mockRdbReload();
+    o = lookup(0, "z");
+    val = m_segDictFetchValue(o->hash, name);
+    RedisModule_FreeString(NULL, name);
+    test_assert(val->encoding == TAIRHASH_VAL_LZF, "rdb reload decompressed the value");
+    test_assert(fingerprint() == fp, "rdb reload changed a compressed value");
+    test_assert(mockAofReload() == 0 && fingerprint() == fp, "aof reload changed a compressed value");
+    test_assert(exportImport(0, "z", 1, "z2", 10) == 3, "fields imported");
+    callString(got, sizeof(got), 1, "EXHGET z2 json");
+    test_assert(!strcmp(got, json), "imported value read back as %s", got);
+    checkInvariants();
+    callDiscard(0, "FLUSHALL");
+}
+
+/* Letters in no order, LZF can't make them shorter. */
+static void rndLetters(char *buf, size_t len) {
+    for (size_t j = 0; j < len; j++) buf[j] = (char)('a' + rnd() % 26);
+    buf[len] = '\0';
+}
+
+/* The cold store lives as long as the module, it is created before the
+ * baseline of the leak check. */
+static void createColdStore(void) {
+    char value[TAIRHASH_COLD_MIN_LEN + 1];
+    rndLetters(value, TAIRHASH_COLD_MIN_LEN);
+    callDiscard(0, "EXHSET warm f %s", value);
+    mockAdvanceTime(6000);
+    test_assert(g_cold_store != NULL && m_coldStoreLiveBytes(g_cold_store) > 0, "cold store not created");
+    callDiscard(0, "FLUSHALL");
+}
+
+static TairHashVal *fieldVal(int dbid, const char *key, const char *field) {
+    RedisModuleString *name = RedisModule_CreateString(NULL, field, strlen(field));
+    TairHashVal *val = m_segDictFetchValue(lookup(dbid, key)->hash, name);
+    RedisModule_FreeString(NULL, name);
+    return val;
+}
+
+static int isCold(int dbid, const char *key, const char *field) {
+    return fieldVal(dbid, key, field)->cold;
+}
+
+static void testColdTier(void) {
+    /* Records of the store, in a store of their own. */
+    coldStore *cs = m_coldStoreCreate(".");
+    uint64_t offsets[64];
+    char buf[5000];
+    test_assert(cs != NULL, "cold store not created");
+    for (int j = 0; j < 64; j++) {
+        size_t len = (size_t)rndRange(0, sizeof(buf) - 1);
+        memset(buf, 'a' + j % 26, len);
+        test_assert(m_coldStorePut(cs, buf, len, &offsets[j]) == 0, "put of %zu bytes", len);
+    }
+    for (int j = 0; j < 64; j++) {
+        size_t len;
+        const char *ptr = m_coldStoreGet(cs, offsets[j], &len);
+        for (size_t i = 0; i < len; i++) test_assert(ptr[i] == 'a' + j % 26, "record %d damaged", j);
+        m_coldStoreFree(cs, offsets[j]);
+    }
+    test_assert(m_coldStoreLiveBytes(cs) == 0, "%llu bytes live once all freed", (unsigned long long)m_coldStoreLiveBytes(cs));
+    m_coldStoreReclaim(cs, ULONG_MAX);
+    test_assert(cs->stat_reclaimed > 0 || !cs->can_punch, "no page reclaimed");
+    m_coldStoreRelease(cs);
+
+    /* The file is reserved as it grows, so a put the disk has no room for
+     * fails instead of faulting on the mapping. A file size limit stands in
+     * for a full disk. */
+    struct rlimit old_limit, limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    limit = old_limit;
+    limit.rlim_cur = 64 * 1024;
+    signal(SIGXFSZ, SIG_IGN);
+    test_assert(setrlimit(RLIMIT_FSIZE, &limit) == 0, "file size limit not set");
+    cs = m_coldStoreCreate(".");
+    memset(buf, 'x', sizeof(buf));
+    int puts = 0;
+    while (m_coldStorePut(cs, buf, sizeof(buf), &offsets[0]) == 0) puts++;
+    test_assert(puts > 0 && puts < 64 * 1024 / (int)sizeof(buf) + 1, "%d puts under a 64k file size limit", puts);
+    m_coldStoreRelease(cs);
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, SIG_DFL);
+
+    char big[201], got[256];
+    rndLetters(big, 200);
+    callDiscard(0, "EXHSET c big %s", big);
+    callDiscard(0, "EXHSET c small v");
+    uint64_t fp = fingerprint(), live = m_coldStoreLiveBytes(g_cold_store);
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "c", "big") && !isCold(0, "c", "small"), "idle values not moved, or short ones moved");
+    test_assert(m_coldStoreLiveBytes(g_cold_store) > live, "cold store did not grow");
+    test_assert(fingerprint() == fp, "moving a value changed it");
+    test_assert(callInteger(0, "EXHSTRLEN c big") == 200 && isCold(0, "c", "big"), "length of a cold value");
+
+    mockRdbReload();
+    test_assert(fingerprint() == fp && !isCold(0, "c", "big"), "rdb reload of a cold value");
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "c", "big") && mockAofReload() == 0 && fingerprint() == fp, "aof reload of a cold value");
+
+    mockAdvanceTime(6000);
+    callString(got, sizeof(got), 0, "EXHGET c big");
+    test_assert(!strcmp(got, big) && !isCold(0, "c", "big"), "cold value read back as %s", got);
+    mockAdvanceTime(3000);
+    callString(got, sizeof(got), 0, "EXHGET c big");
+    mockAdvanceTime(3000);
+    test_assert(!isCold(0, "c", "big"), "a value read moved before it was idle");
+    callDiscard(0, "EXHSET c big v");
+    test_assert(callInteger(0, "EXHSTRLEN c big") == 1, "cold value overwritten");
+
+    /* The pages of freed records go back to the file system, but never
+     * while a fork child may still read them. */
+    char value[801];
+    for (int j = 0; j < 64; j++) {
+        rndLetters(value, 800);
+        callDiscard(0, "EXHSET r f%d %s", j, value);
+    }
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "r", "f0"), "idle values not moved");
+    live = m_coldStoreLiveBytes(g_cold_store);
+    uint64_t reclaimed = g_cold_store->stat_reclaimed;
+    mockForkChild(1);
+    callDiscard(0, "DEL r");
+    test_assert(m_coldStoreLiveBytes(g_cold_store) < live - 64 * 800, "records of a deleted key still live");
+    mockAdvanceTime(1000);
+    test_assert(g_cold_store->stat_reclaimed == reclaimed, "pages reclaimed under a fork child");
+    mockForkChild(0);
+    mockAdvanceTime(1000);
+    test_assert(g_cold_store->stat_reclaimed > reclaimed || !g_cold_store->can_punch, "pages of a deleted key not reclaimed");
+
+    /* Servers before 6.2 send no fork child event, the active child flag
+     * alone keeps the pages of the records the child may read. */
+    for (int j = 0; j < 64; j++) {
+        rndLetters(value, 800);
+        callDiscard(0, "EXHSET r f%d %s", j, value);
+    }
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "r", "f0"), "idle values not moved");
+    mockSetServerEventEnabled(RedisModuleEvent_ForkChild, 0);
+    reclaimed = g_cold_store->stat_reclaimed;
+    mockForkChild(1);
+    callDiscard(0, "DEL r");
+    callDiscard(0, "EXHSET s f %s", value);
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "s", "f"), "idle values not moved under a fork child");
+    test_assert(g_cold_store->stat_reclaimed == reclaimed, "pages reclaimed under a fork child without its event");
+    mockForkChild(0);
+    mockAdvanceTime(1000);
+    test_assert(g_cold_store->stat_reclaimed > reclaimed || !g_cold_store->can_punch, "pages of a deleted key not reclaimed");
+    mockSetServerEventEnabled(RedisModuleEvent_ForkChild, 1);
+    checkInvariants();
+    callDiscard(0, "FLUSHALL");
+}
+
+/* EXHSETRANGE of an empty value, which call() can't pass. */
+static long long callSetRangeEmpty(int dbid, const char *key, const char *field, const char *offset) {
+    RedisModuleCallReply *reply = RedisModule_Call(clients[dbid], "EXHSETRANGE", "cccb", key, field, offset, "", (size_t)0);
+    test_assert(reply != NULL && RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_INTEGER, "exhsetrange");
+    long long ret = RedisModule_CallReplyInteger(reply);
+    RedisModule_FreeCallReply(reply);
+    return ret;
+}
+
+static void testAppend(void) {
+    long long now = mockGetTime();
+    char got[1024];
+    size_t len;
+
+    test_assert(callInteger(0, "EXHAPPEND a f abc") == 3, "append to a missing field");
+    test_assert(callInteger(0, "EXHAPPEND a f def EX 10") == 6, "append");
+    assertReplicated("EXHAPPEND a f def ABS 2 PXAT %lld", now + 10000);
+    callString(got, sizeof(got), 0, "EXHGET a f");
+    test_assert(!strcmp(got, "abcdef") && callInteger(0, "EXHVER a f") == 2, "appended value read back as %s", got);
+
+    /* The value is the field's alone after the first append, the next
+     * ones grow it in place. */
+    TairHashVal *val = fieldVal(0, "a", "f");
+    RedisModuleString *value = val->value;
+    test_assert(val->owned, "appended value not owned by the field");
+    test_assert(callInteger(0, "EXHAPPEND a f ghi KEEPTTL") == 9 && val->value == value, "append copied the value");
+    test_assert(callInteger(0, "EXHTTL a f") == 10, "append with KEEPTTL dropped the expire");
+    test_assert(callInteger(0, "EXHAPPEND a f j") == 10 && callInteger(0, "EXHTTL a f") == -1, "append kept the expire");
+
+    test_assert(callInteger(0, "EXHSETRANGE a f 1 XY") == 10 && val->value == value, "setrange inside the value");
+    assertReplicated("EXHSETRANGE a f 1 XY ABS 5");
+    test_assert(callInteger(0, "EXHSETRANGE a f 12 Z") == 13, "setrange past the end");
+    const char *ptr = RedisModule_StringPtrLen(val->value, &len);
+    test_assert(len == 13 && !memcmp(ptr, "aXYdefghij\0\0Z", 13), "setrange past the end did not pad with zeros");
+    test_assert(callSetRangeEmpty(0, "a", "f", "3") == 13 && callInteger(0, "EXHVER a f") == 6, "empty setrange wrote");
+    test_assert(callSetRangeEmpty(0, "b", "f", "3") == 0 && lookup(0, "b") == NULL, "empty setrange created a key");
+    test_assert(callSetRangeEmpty(0, "a", "g", "0") == 0 && callInteger(0, "EXHLEN a") == 1, "empty setrange created a field");
+    test_assert(callIsError(0, "EXHSETRANGE a f -1 x"), "negative offset");
+    test_assert(callIsError(0, "EXHSETRANGE a f 536870912 x"), "offset past the largest value");
+    test_assert(callIsError(0, "EXHSETRANGE a f 9223372036854775807 x") && callInteger(0, "EXHSTRLEN a f") == 13,
+                "offset overflowing the length check");
+    test_assert(callIsError(0, "EXHAPPEND a f x VER 1") && callInteger(0, "EXHAPPEND a f x VER 6") == 14, "append version check");
+    test_assert(callIsError(0, "EXHAPPEND a f x MIN 1") && callIsError(0, "EXHAPPEND a f x NX"), "append options");
+
+    /* Compressed and cold values are read back first. */
+    char json[801];
+    memset(json, 'x', 800);
+    json[800] = '\0';
+    callDiscard(0, "EXHSET z json %s", json);
+    test_assert(fieldVal(0, "z", "json")->encoding == TAIRHASH_VAL_LZF, "long value not compressed");
+    test_assert(callInteger(0, "EXHAPPEND z json y") == 801, "append to a compressed value");
+    callString(got, sizeof(got), 0, "EXHGET z json");
+    test_assert(!strncmp(got, json, 800) && !strcmp(got + 800, "y"), "compressed value appended to");
+
+    char big[201];
+    rndLetters(big, 200);
+    callDiscard(0, "EXHSET c big %s", big);
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "c", "big"), "idle value not moved");
+    test_assert(callInteger(0, "EXHSETRANGE c big 0 ABC") == 200 && !isCold(0, "c", "big"), "setrange of a cold value");
+    callString(got, sizeof(got), 0, "EXHGET c big");
+    test_assert(!strncmp(got, "ABC", 3) && !strcmp(got + 3, big + 3), "cold value patched to %s", got);
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "c", "big") && !fieldVal(0, "c", "big")->owned, "patched value not moved");
+    test_assert(callInteger(0, "EXHAPPEND c big D") == 201, "append to a cold value");
+
+    uint64_t fp = fingerprint();
+    mockRdbReload();
+    test_assert(fingerprint() == fp && mockAofReload() == 0 && fingerprint() == fp, "reload of patched values");
+    checkInvariants();
+    callDiscard(0, "FLUSHALL");
+}
+
+static uint64_t payloadVarint(const char **p) {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char c = (unsigned char)*(*p)++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return v;
+    }
+}
+
+/* The last expired event carries 'field', 'value' and 'version'. */
+static void assertPayload(const char *key, const char *field, const char *value, long long version, long long expire) {
+    const char *msg, *p;
+    size_t len;
+    char channel[64];
+    snprintf(channel, sizeof(channel), "tairhash@0@%s__:expired", key);
+    test_assert(!strcmp(mockLastPublished(&msg, &len), channel), "event on %s", mockLastPublished(&msg, &len));
+    p = msg;
+    test_assert(*p++ == 1, "payload format version");
+    uint64_t n = payloadVarint(&p);
+    test_assert(n == strlen(field) && !memcmp(p, field, n), "payload field");
+    p += n;
+    n = payloadVarint(&p);
+    test_assert(n == strlen(value) && !memcmp(p, value, n), "payload value of %llu bytes", (unsigned long long)n);
+    p += n;
+    test_assert(payloadVarint(&p) == (uint64_t)version, "payload version");
+    test_assert(payloadVarint(&p) == (uint64_t)expire, "payload expire");
+    test_assert(p == msg + len, "payload of %zu bytes, %zu read", len, (size_t)(p - msg));
+}
+
+static void testEventPayload(void) {
+    char json[801], big[202];
+    memset(json, 'x', 800);
+    json[800] = '\0';
+    long long now = mockGetTime();
+    callDiscard(0, "EXHSET e f %s PX 50 ABS 9", json);
+    test_assert(fieldVal(0, "e", "f")->encoding == TAIRHASH_VAL_LZF, "long value not compressed");
+    mockAdvanceTime(1000);
+    test_assert(lookup(0, "e") == NULL, "field not expired");
+    assertPayload("e", "f", json, 9, now + 50);
+
+    rndLetters(big, 200);
+    now = mockGetTime();
+    callDiscard(0, "EXHSET c big %s PX 8000", big);
+    callDiscard(0, "EXHAPPEND c big ! KEEPTTL");
+    strcat(big, "!");
+    mockAdvanceTime(6000);
+    test_assert(isCold(0, "c", "big"), "idle value not moved");
+    mockAdvanceTime(3000);
+    test_assert(lookup(0, "c") == NULL, "cold field not expired");
+    assertPayload("c", "big", big, 2, now + 8000);
+    callDiscard(0, "FLUSHALL");
+}
+
+static void testReplies(void) {
+    callDiscard(0, "EXHSET k f v PX 100");
+    RedisModuleCallReply *reply = call(0, "EXHEXPIREINFO");
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_STRING, "exhexpireinfo");
+    RedisModule_FreeCallReply(reply);
+    reply = call(0, "EXHDEBUG INDEXSTATS k");
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY && RedisModule_CallReplyLength(reply) % 2 == 0, "exhdebug key");
+    RedisModule_FreeCallReply(reply);
+    reply = call(0, "EXHDEBUG INDEXSTATS");
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY && RedisModule_CallReplyLength(reply) % 2 == 0, "exhdebug");
+    RedisModule_FreeCallReply(reply);
+    reply = call(0, "EXHEXPIRETRACE GET 10");
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY, "exhexpiretrace");
+    RedisModule_FreeCallReply(reply);
+    reply = call(0, "EXHSCAN k 0");
+    test_assert(RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ARRAY && RedisModule_CallReplyLength(reply) == 2, "exhscan");
+    RedisModule_FreeCallReply(reply);
+    test_assert(mockInfo() > 0, "info");
+    callDiscard(0, "FLUSHALL");
+}
+
+/* ========================== Fuzz =============================*/
+
+static int rndDb(void) {
+    return (int)rndRange(0, opt_dbs - 1);
+}
+
+static long long rndTtl(void) {
+    /* Mostly short lived fields, some which outlive the run. */
+    switch (rnd() % 8) {
+        case 0:
+            return rndRange(1, 5);
+        case 1:
+            return rndRange(1000, 100000);
+        default:
+            return rndRange(1, 500);
+    }
+}
+
+/* EXHGET against what the field dict says right before the call. */
+static void fuzzGet(int dbid, int k, int f) {
+    char key[32], field[32], expected[128], got[128];
+    snprintf(key, sizeof(key), "key:%d", k);
+    snprintf(field, sizeof(field), "f%d", f);
+    tairHashObj *o = lookup(dbid, key);
+    snprintf(expected, sizeof(expected), "(nil)");
+    if (o) {
+        RedisModuleString *name = RedisModule_CreateString(NULL, field, strlen(field));
+        TairHashVal *val = m_segDictFetchValue(o->hash, name);
+        if (val && (val->expire == 0 || mockGetTime() < val->expire)) {
+            RedisModuleString *value = tairHashValDecode(val);
+            snprintf(expected, sizeof(expected), "%s", RedisModule_StringPtrLen(value, NULL));
+            RedisModule_FreeString(NULL, value);
+        }
+        RedisModule_FreeString(NULL, name);
+    }
+    RedisModuleCallReply *reply = call(dbid, "EXHGET %s %s", key, field);
+    if (RedisModule_CallReplyType(reply) == REDISMODULE_REPLY_ERROR) {
+        RedisModule_FreeCallReply(reply);
+        return; /* A string key. */
+    }
+    RedisModule_FreeCallReply(reply);
+    callString(got, sizeof(got), dbid, "EXHGET %s %s", key, field);
+    test_assert(!strcmp(expected, got), "EXHGET %s %s in db %d: expected %s, got %s", key, field, dbid, expected, got);
+}
+
+static void fuzzOp(void) {
+    int dbid = rndDb();
+    int k = (int)rndRange(0, opt_keys - 1), f = (int)rndRange(0, opt_fields - 1);
+    int r = (int)(rnd() % 1000);
+
+    if (r < 300) {
+        switch (rnd() % 9) {
+            case 0:
+                callDiscard(dbid, "EXHSET key:%d f%d v%d", k, f, (int)(rnd() % 100));
+                break;
+            case 6: {
+                /* Long values, compressible or not, that may go cold. */
+                char value[101];
+                int len = (int)rndRange(1, 100);
+                if (rnd() % 2) {
+                    rndLetters(value, len);
+                } else {
+                    memset(value, '0', len);
+                    value[len] = '\0';
+                }
+                callDiscard(dbid, "EXHSET key:%d f%d v%d-%s", k, f, (int)(rnd() % 100), value);
+                break;
+            }
+            case 1:
+                callDiscard(dbid, "EXHSET key:%d f%d v%d PX %lld", k, f, (int)(rnd() % 100), rndTtl());
+                break;
+            case 2:
+                callDiscard(dbid, "EXHSET key:%d f%d v%d PXAT %lld", k, f, (int)(rnd() % 100), mockGetTime() + rndTtl());
+                break;
+            case 3:
+                callDiscard(dbid, "EXHSET key:%d f%d v%d KEEPTTL", k, f, (int)(rnd() % 100));
+                break;
+            case 4:
+                callDiscard(dbid, "EXHSET key:%d f%d v%d %s PX %lld", k, f, (int)(rnd() % 100), rnd() % 2 ? "NX" : "XX", rndTtl());
+                break;
+            case 7:
+                callDiscard(dbid, "EXHAPPEND key:%d f%d -%d%s", k, f, (int)(rnd() % 100), rnd() % 2 ? " KEEPTTL" : "");
+                break;
+            case 8:
+                callDiscard(dbid, "EXHSETRANGE key:%d f%d %d x%d PX %lld", k, f, (int)rndRange(0, 80), (int)(rnd() % 10), rndTtl());
+                break;
+            default:
+                callDiscard(dbid, "EXHSET key:%d f%d v%d EX %lld VER %d", k, f, (int)(rnd() % 100), rndTtl() / 100 + 1, (int)(rnd() % 3));
+                break;
+        }
+    } else if (r < 380) {
+        callDiscard(dbid, "EXHPEXPIRE key:%d f%d %lld", k, f, rndTtl());
+    } else if (r < 420) {
+        callDiscard(dbid, "EXHPEXPIREAT key:%d f%d %lld", k, f, mockGetTime() + rndTtl() - 50);
+    } else if (r < 450) {
+        callDiscard(dbid, "EXHPERSIST key:%d f%d", k, f);
+    } else if (r < 520) {
+        callDiscard(dbid, "EXHDEL key:%d f%d", k, f);
+    } else if (r < 560) {
+        callDiscard(dbid, "EXHINCRBY key:%d n%d %d PX %lld", k, f, (int)rndRange(-5, 5), rndTtl());
+    } else if (r < 580) {
+        callDiscard(dbid, "EXHINCRBYFLOAT key:%d d%d 1.5 EX %lld", k, f, rndTtl() / 100 + 1);
+    } else if (r < 610) {
+        callDiscard(dbid, "EXHMSET key:%d f%d a f%d b", k, f, (f + 1) % opt_fields);
+    } else if (r < 630) {
+        callDiscard(dbid, "EXHSETVER key:%d f%d %d", k, f, (int)rndRange(1, 5));
+    } else if (r < 800) {
+        fuzzGet(dbid, k, f);
+    } else if (r < 830) {
+        callDiscard(dbid, "EXHLEN key:%d%s", k, rnd() % 2 ? " NOEXP" : "");
+    } else if (r < 850) {
+        callDiscard(dbid, "EXHGETALL key:%d", k);
+    } else if (r < 860) {
+        callDiscard(dbid, "EXHKEYS key:%d", k);
+    } else if (r < 865) {
+        callDiscard(dbid, "EXHSCAN key:%d 0 COUNT 5%s", k, rnd() % 2 ? " MATCH f1*" : "");
+    } else if (r < 868) {
+        callDiscard(dbid, "EXHRANGEBYLEX key:%d [f%d + WITHVALUES LIMIT 0 5", k, f);
+    } else if (r < 870) {
+        callDiscard(dbid, "EXHLEXINDEX key:%d %s", k, rnd() % 4 ? "ON" : "OFF");
+    } else if (r < 885) {
+        callDiscard(dbid, "EXHMGET key:%d f%d f%d", k, f, (f + 1) % opt_fields);
+    } else if (r < 900) {
+        callDiscard(dbid, "DEL key:%d", k);
+    } else if (r < 920) {
+        callDiscard(dbid, "RENAME key:%d key:%d", k, (int)rndRange(0, opt_keys - 1));
+    } else if (r < 935) {
+        callDiscard(dbid, "MOVE key:%d %d", k, rndDb());
+    } else if (r < 945) {
+        callDiscard(dbid, "COPY key:%d key:%d DB %d%s", k, (int)rndRange(0, opt_keys - 1), rndDb(), rnd() % 2 ? " REPLACE" : "");
+    } else if (r < 950) {
+        callDiscard(dbid, "SWAPDB %d %d", dbid, rndDb());
+    } else if (r < 953) {
+        callDiscard(dbid, "SET key:%d str", k);
+    } else if (r < 955) {
+        callDiscard(dbid, rnd() % 4 ? "FLUSHDB" : "FLUSHALL");
+    } else if (r < 960) {
+        char src[32], dst[32];
+        int dst_db = rndDb();
+        snprintf(src, sizeof(src), "key:%d", k);
+        snprintf(dst, sizeof(dst), "key:%d", (int)rndRange(0, opt_keys - 1));
+        if (hashOrMissing(dbid, src) && hashOrMissing(dst_db, dst)) {
+            exportImport(dbid, src, dst_db, dst, (int)rndRange(1, 8));
+        }
+    } else {
+        /* Let time pass, firing the active expire timer now and then. */
+        mockAdvanceTime(rnd() % 16 ? rndRange(0, 20) : rndRange(100, 2000));
+    }
+}
+
+/* Rare server side events, once in a while. */
+static void fuzzServerEvent(void) {
+    switch (rnd() % 6) {
+        case 0:
+            mockRdbReload();
+            break;
+        case 1: {
+            int errors = mockAofReload();
+            test_assert(errors == 0, "%d aof commands failed", errors);
+            break;
+        }
+        case 2:
+            mockDefrag((unsigned int)rndRange(0, 50));
+            break;
+        case 3:
+            mockForkChild(1);
+            break;
+        case 4:
+            mockForkChild(0);
+            break;
+        default:
+            test_assert(mockInfo() > 0, "info");
+            break;
+    }
+}
+
+static double fuzz(void) {
+    struct timespec start, end;
+    double checking = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (cur_op = 1; cur_op <= opt_ops; cur_op++) {
+        fuzzOp();
+        if (cur_op % 50000 == 0) fuzzServerEvent();
+        if (cur_op % opt_check_every == 0) {
+            struct timespec s, e;
+            clock_gettime(CLOCK_MONOTONIC, &s);
+            checkInvariants();
+            clock_gettime(CLOCK_MONOTONIC, &e);
+            checking += (e.tv_sec - s.tv_sec) + (e.tv_nsec - s.tv_nsec) / 1e9;
+        }
+    }
+    mockForkChild(0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    checkInvariants();
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9 - checking;
+}
+
+/* Past the longest TTL every field must have been reclaimed, without any
+ * client touching the keys. */
+static void checkDrained(void) {
+    mockAdvanceTime(200 * 1000);
+    for (int j = 0; j < 1000; j++) mockAdvanceTime(1000);
+    checkInvariants();
+    checkState cs;
+    memset(&cs, 0, sizeof(cs));
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) mockForEachKey(dbid, checkKey, &cs);
+    free(cs.entries);
+    test_assert(cs.expiring_fields == 0, "%lu expired fields were never reclaimed", cs.expiring_fields);
+}
+
+/* ========================== Main =============================*/
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--seed n] [--ops n] [--keys n] [--fields n] [--dbs n] [--check-every n] [--cluster 0|1]\n"
+            "Unit and fuzz tests of the " ENGINE_NAME " expire engine.\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    opt_seed = (unsigned long long)time(NULL);
+    for (int j = 1; j < argc; j++) {
+        if (j + 1 >= argc) usage(argv[0]);
+        const char *opt = argv[j], *val = argv[++j];
+        if (!strcmp(opt, "--seed")) {
+            opt_seed = strtoull(val, NULL, 10);
+        } else if (!strcmp(opt, "--ops")) {
+            opt_ops = strtoull(val, NULL, 10);
+        } else if (!strcmp(opt, "--keys")) {
+            opt_keys = atoi(val);
+        } else if (!strcmp(opt, "--fields")) {
+            opt_fields = atoi(val);
+        } else if (!strcmp(opt, "--dbs")) {
+            opt_dbs = atoi(val);
+        } else if (!strcmp(opt, "--check-every")) {
+            opt_check_every = atoi(val);
+        } else if (!strcmp(opt, "--cluster")) {
+            opt_cluster = atoi(val);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (opt_keys < 1 || opt_fields < 2 || opt_dbs < 1 || opt_dbs > MOCK_DB_NUM || opt_check_every < 1) usage(argv[0]);
+    rng_state = opt_seed * 0x9e3779b97f4a7c15ULL + 1;
+    srandom((unsigned int)opt_seed);
+    printf("engine=%s seed=%llu%s\n", ENGINE_NAME, opt_seed, opt_cluster ? " cluster" : "");
+
+    /* Keys split, values compress and go cold early, so the fuzz runs on
+     * segmented field dicts, compressed and cold values too, and expired
+     * events carry them. */
+    const char *args[] = {"active_expire_period", "100", "active_expire_keys_per_loop", "20", "dict_segment_threshold", "24", "value_compress_threshold", "16",
+                          "cold_tier_idle_time", "5", "expired_event_payload", "1"};
+    mockSetContextFlags(contextFlags());
+    test_assert(mockLoadModule(RedisModule_OnLoad, 12, args) == REDISMODULE_OK, "module failed to load");
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) clients[dbid] = mockCreateClient(dbid);
+
+    createColdStore();
+    mockStats baseline;
+    mockGetStats(&baseline);
+
+    testBasicExpire();
+    testActiveExpire();
+    testDatabases();
+    testSlots();
+#ifdef SLAB_MODE
+    testSlabTimeoutIndices();
+#endif
+    testPassiveExpire();
+    testClock();
+    testKeyspaceCommands();
+    testBigKey();
+    testSegments();
+    testCompression();
+    testColdTier();
+    testAppend();
+    testEventPayload();
+    testRangeByLex();
+    testExportImport();
+    testReload();
+    testReplica();
+    testOptions();
+    testPropagation();
+    testReplies();
+    printf("unit tests passed\n");
+
+    double elapsed = fuzz();
+    checkDrained();
+    mockStats stats;
+    mockGetStats(&stats);
+    printf("fuzz: %llu ops in %.2fs (%.0f ops/sec), %lld commands, %lld timers fired, %lld fields expired\n", opt_ops, elapsed,
+           elapsed > 0 ? opt_ops / elapsed : 0, stats.commands, stats.timers_fired, stats.published);
+
+    callDiscard(0, "FLUSHALL");
+    mockGetStats(&stats);
+    test_assert(stats.live_strings == baseline.live_strings, "%lld strings leaked", stats.live_strings - baseline.live_strings);
+    test_assert(stats.live_allocs == baseline.live_allocs, "%lld allocations leaked (%lld bytes)", stats.live_allocs - baseline.live_allocs,
+                stats.live_bytes - baseline.live_bytes);
+
+    for (int dbid = 0; dbid < MOCK_DB_NUM; dbid++) mockFreeClient(clients[dbid]);
+    printf("all tests passed\n");
+    return 0;
+}